@@ -18,11 +18,28 @@
 #include <HTTPClient.h>
 #include <ArduinoJson.h>
 #include <time.h>
-#include <Preferences.h>
+#include <esp_wifi.h>
+#include <esp_sleep.h>
 #include "config.h"
 #include "auth.h"
 #include "supabase_api.h"
 #include "sensors.h"
+#include "logger.h"
+#include "scheduler.h"
+#include "boot_timing.h"
+#include "control_state.h"
+#include "state_store.h"
+#include "wifi_manager.h"
+#include "mqtt_transport.h"
+#include "local_api.h"
+#include "memory_pool.h"
+#include "trace.h"
+#include "sampler.h"
+#include "metering.h"
+#include "outbound.h"
+#include "irrigation_schedule.h"
+#include "gateway.h"
+#include "sensor_node.h"
 #include "debug_test.h"
 #include "device_status_test.h"
 #include "diagnostics.h"
@@ -48,302 +65,459 @@ bool pumpStatus = false;
 bool automaticMode = true;
 int moistureLevel = 0;
 int moistureThreshold = MOISTURE_THRESHOLD; // Threshold for automatic irrigation (0-100, where 0 is dry)
-unsigned long lastReadingTime = 0;
-unsigned long lastCommandCheckTime = 0;
-unsigned long lastHeartbeatTime = 0;
-unsigned long lastSensorReadTime = 0;
-const unsigned long readingInterval = READING_INTERVAL;        // Read sensor every 1 minute
-const unsigned long commandCheckInterval = COMMAND_CHECK_INTERVAL; // Check for commands every 5 seconds
-const unsigned long heartbeatInterval = 10000;    // Send heartbeat every 10 seconds (for better responsiveness)
 
-// Authentication and security
+// Network bring-up state
+bool networkReady = false;
+bool timeSynced = false;
+bool bootTimingsReported = false;
+
+// Scheduled task ids
+int sensorTaskId = -1;
+int commandTaskId = -1;
+int heartbeatTaskId = -1;
+int networkTaskId = -1;
+int selfTestTaskId = -1;
+int consoleTaskId = -1;
+int localTaskId = -1;
+int traceTaskId = -1;
+int settingsTaskId = -1;
+int usageTaskId = -1;
+int outboundTaskId = -1;
+int scheduleTaskId = -1;
+int gatewayTaskId = -1;
+int authTaskId = -1;
+int stateTaskId = -1;
 
 void setup() {
   // Initialize serial communication
   Serial.begin(115200);
+#if !FAST_BOOT
   delay(1000);
   
   // Add a small delay for stability
   delay(100);
+#endif
+  
+  // Start the background log drain before anything else logs
+  initLogger();
+  
+  // Request-scoped JSON documents come from the arena on this (the loop) task
+  initMemoryPools();
+  
+#if TRACE_ENABLED
+  // Record from the first reading on
+  initTrace();
+#endif
   
-  Serial.println();
-  Serial.println();
-  Serial.println("IriQ Smart Irrigation System - Starting up...");
-  Serial.println("Version: 1.0.0");
-  Serial.println("Build Date: " + String(__DATE__) + " " + String(__TIME__));
-  Serial.println();
-  
-  Serial.println("Configuration:");
-  Serial.println("Device ID: " + deviceId);
-  Serial.println("Moisture Sensor Pin: " + String(moistureSensorPin));
-  Serial.println("Pump Relay Pin: " + String(pumpRelayPin));
-  Serial.println("LED Pin: " + String(ledPin));
-  Serial.println("Moisture Threshold: " + String(MOISTURE_THRESHOLD));
-  Serial.println();
+#if SENSOR_NODE_MODE
+  // A sensor node reports one reading and sleeps; it never reaches the loop
+  runSensorNode();
+#endif
+  
+  LOG_I("IriQ Smart Irrigation System - Starting up...");
+  LOG_I("Version: 1.0.0, Build Date: %s %s", __DATE__, __TIME__);
+  LOG_I("Device ID: %s, Moisture Sensor Pin: %d, Pump Relay Pin: %d, LED Pin: %d, Moisture Threshold: %d",
+        deviceId.c_str(), moistureSensorPin, pumpRelayPin, ledPin, MOISTURE_THRESHOLD);
   
   // Initialize pins
   pinMode(ledPin, OUTPUT);
   pinMode(pumpRelayPin, OUTPUT);
-  digitalWrite(pumpRelayPin, LOW); // Ensure pump is off at startup
+  digitalWrite(pumpRelayPin, HIGH); // Ensure pump is off at startup (active LOW relay)
   
-  // Connect to WiFi
-  connectToWifi();
+  // Initialize sensors
+  initSensors();
   
-  // Sync time with NTP server
-  syncTime();
+  // All NVS state goes through the store; pending writes are flushed on restart
+  initStateStore();
   
-  // Initialize authentication
-  Preferences preferences;
-  if (initAuth()) {
-    Serial.println("Authentication initialized with stored credentials");
-  } else {
-    Serial.println("No stored authentication, will authenticate when needed");
-    // Try to authenticate now
-    if (authenticateWithSupabase()) {
-      Serial.println("Successfully authenticated with Supabase");
-    } else {
-      Serial.println("Initial authentication failed, will retry later");
-    }
+  // Resume from the last persisted state before touching the network
+  bool restoredPump = false;
+  bool restoredAutomatic = automaticMode;
+  if (loadControlState(&restoredPump, &restoredAutomatic)) {
+    automaticMode = restoredAutomatic;
+    LOG_I("Restored state: pump %s, mode %s", restoredPump ? "ON" : "OFF", automaticMode ? "AUTOMATIC" : "MANUAL");
   }
+  markBootPhase(BOOT_PHASE_STATE_RESTORED);
   
-  // Initialize sensors
-  initSensors();
+  // Meter from the first relay change on
+  initMetering();
   
-  // Read initial moisture level
-  moistureLevel = readMoistureSensor();
-  Serial.print("Initial moisture level: ");
-  Serial.print(moistureLevel);
-  Serial.println("%");
+  // Sampling bounds last received from Supabase
+  initSampler();
   
-  // Set initial pump status based on moisture level (if in automatic mode)
-  if (automaticMode && moistureLevel < MOISTURE_THRESHOLD) {
+  // Watering windows last received from Supabase; they run without the network
+  initIrrigationSchedule(applyControlNow);
+  
+  // First control action: manual mode resumes the last pump state,
+  // automatic mode decides from the current reading
+  moistureLevel = readMoistureSensor();
+  LOG_I("Initial moisture level: %d%%", moistureLevel);
+  if (automaticMode) {
+    handleAutomaticMode();
+  } else if (restoredPump) {
     setPumpStatus(true);
   }
+  markBootPhase(BOOT_PHASE_FIRST_CONTROL);
   
-  // Update device status in Supabase
-  if (updateDeviceStatus(pumpStatus, automaticMode)) {
-    Serial.println("Initial device status updated in Supabase");
+  // Initialize authentication from stored credentials (no network needed)
+  if (initAuth()) {
+    LOG_I("Authentication initialized with stored credentials");
   } else {
-    Serial.println("Failed to update initial device status");
+    LOG_I("No stored authentication, will authenticate when connected");
   }
   
-  // Run connection tests to verify Supabase communication
-  Serial.println("\n\n==== STARTING CONNECTION TESTS ====\n");
-  delay(3000);  // Give system time to stabilize
-  Serial.println("Testing direct communication with Supabase...");
+  // Connect in the background; onLinkChange() finishes bring-up
+  onLinkEvent(onLinkChange);
+  initWifiManager(ssid, password);
   
-  // Run the connection tests
-  runConnectionTests();
+#if ESPNOW_GATEWAY_ENABLED
+  // Sensor nodes report over ESP-NOW on the router's channel
+  initGateway();
+  initRadioLink();
+#endif
   
-  // Run the original debug tests
-  // Test sensor readings
-  if (testSensorReadingsTable()) {
-    Serial.println("\nSensor readings table test successful!\n");
-  } else {
-    Serial.println("\nSensor readings table test failed!\n");
+#if !FAST_BOOT
+  // Legacy boot: wait for WiFi and time before entering the loop
+  connectToWifi();
+  syncTime();
+  blinkLED(5, 200);
+#endif
+  
+  // Periodic work, run cooperatively from loop()
+  sensorTaskId = scheduleTask("sensor", sensorTask, READING_INTERVAL, READING_INTERVAL);
+  commandTaskId = scheduleTask("command", commandTask, COMMAND_CHECK_INTERVAL);
+  heartbeatTaskId = scheduleTask("heartbeat", heartbeatTask, HEARTBEAT_INTERVAL);
+  networkTaskId = scheduleTask("network", networkTask, 250);
+  
+  // Tokens are fetched and refreshed here, never inside a request
+  authTaskId = scheduleTask("auth", authTask, AUTH_CHECK_INTERVAL);
+  consoleTaskId = scheduleTask("console", consoleTask, 100);
+  
+  // Everything sent to Supabase goes through the outbound queue, most urgent first
+  outboundTaskId = scheduleTask("outbound", outboundLoop, OUTBOUND_INTERVAL);
+  
+#if LOCAL_API_ENABLED
+  // LAN control keeps working when WiFi has no route to Supabase
+  initLocalApi(applyControlNow);
+  localTaskId = scheduleTask("local", localApiLoop, 50);
+#endif
+  
+#if TRACE_ENABLED
+  traceTaskId = scheduleTask("trace", flushTrace, TRACE_FLUSH_INTERVAL);
+#endif
+  
+  settingsTaskId = scheduleTask("settings", settingsTask, SETTINGS_CHECK_INTERVAL);
+  usageTaskId = scheduleTask("usage", usageTask, USAGE_UPLOAD_INTERVAL);
+  scheduleTaskId = scheduleTask("schedule", irrigationScheduleLoop, SCHEDULE_CHECK_INTERVAL);
+  
+  // Changed state is written to NVS in batches, never inside the task that changed it
+  stateTaskId = scheduleTask("state", stateStoreLoop, STATE_CHECK_INTERVAL);
+  
+#if ESPNOW_GATEWAY_ENABLED
+  gatewayTaskId = scheduleTask("gateway", gatewayTask, GATEWAY_POLL_INTERVAL);
+#endif
+  
+  // Self-tests write test rows to Supabase, so they only run on demand
+  selfTestTaskId = scheduleTask("selftest", runSelfTests, 0);
+  setTaskEnabled(selfTestTaskId, false);
+  
+  markBootPhase(BOOT_PHASE_SETUP_DONE);
+  LOG_I("Setup complete in %lu ms! Starting main loop...", millis());
+}
+
+void loop() {
+  runScheduler();
+  
+  // Sleep until the next task is due, in short slices to keep the console responsive
+  delay(min(getSchedulerIdleTime(), 50UL));
+}
+
+// Read the sensor, apply automatic control, then upload the reading
+void sensorTask() {
+  moistureLevel = readMoistureSensor();
+  LOG_D("Current moisture level: %d%%", moistureLevel);
+  
+  // Control first so the pump reacts without waiting on the network
+  if (automaticMode) {
+    handleAutomaticMode();
   }
   
-  // Test device status
-  if (testDeviceStatusTable()) {
-    Serial.println("\nDevice status table test successful!\n");
-  } else {
-    Serial.println("\nDevice status table test failed!\n");
+  // Sample faster while the pump runs or the soil nears the threshold
+  setTaskInterval(sensorTaskId, nextSampleInterval(moistureLevel, pumpStatus, automaticMode));
+  
+  // Meter a running pump; readings are fast while it runs
+  meteringLoop();
+  
+#if LOCAL_API_ENABLED
+  publishLocalSample(moistureLevel, pumpStatus, automaticMode);
+#endif
+  
+  if (!networkReady || !shouldUploadReading(moistureLevel)) {
+    return;
   }
   
-  Serial.println("==== DEBUG TESTS COMPLETE ====\n");
+  // Sent after any queued status changes and heartbeats
+  queueSensorReading(moistureLevel);
+}
+
+// Apply a command, then take a reading so the sampling rate follows the new pump state
+void applyControlNow(bool pumpControl, bool requestedAutomatic) {
+  applyControl(pumpControl, requestedAutomatic);
+  runTaskNow(sensorTaskId);
+}
+
+// Poll Supabase for control commands and apply them
+void commandTask() {
+  if (!networkReady) {
+    return;
+  }
   
-  // Blink LED to indicate successful setup
-  blinkLED(5, 200);
+  LOG_V("Checking for control commands (pump %s, mode %s)",
+        pumpStatus ? "ON" : "OFF", automaticMode ? "AUTOMATIC" : "MANUAL");
+  
+  ControlCommand command = checkForCommands();
   
-  Serial.println("Setup complete! Starting main loop...");
+  if (command.valid) {
+    applyControlNow(command.pumpControl, command.automaticMode);
+    
+    // Mark the applied command and every older one it superseded as executed
+    queueCommandAck(command.ids);
+  }
 }
 
-// Global variables to track if we've run the tests
-bool directTestRun = false;
-bool diagnosticsRun = false;
+// Send heartbeat to mark the device online
+void heartbeatTask() {
+  if (!networkReady) {
+    return;
+  }
+  
+  // Falls back to a device status update if it fails
+  queueHeartbeat();
+  
+  // Report boot timings once every phase has been reached
+  if (!bootTimingsReported && bootPhasesComplete()) {
+    reportBootTimings();
+    bootTimingsReported = true;
+  }
+}
 
-void loop() {
-  // Add a small delay to stabilize the loop
-  delay(50);
-  
-  // Run diagnostics once after authentication
-  if (!diagnosticsRun && WiFi.status() == WL_CONNECTED && isAuthenticated()) {
-    Serial.println("\n\n==== RUNNING DIAGNOSTICS FROM LOOP ====\n");
-    runDiagnostics();
-    diagnosticsRun = true;
-    Serial.println("\n==== LOOP DIAGNOSTICS COMPLETE ====\n");
-    delay(2000);
+// Pick up sampling bounds and schedule changes
+void settingsTask() {
+  if (!networkReady) {
+    return;
+  }
+  fetchSamplingSettings();
+  fetchIrrigationSchedule();
+}
+
+// Upload pump runtime and water usage not yet in Supabase
+void usageTask() {
+  if (!networkReady) {
+    return;
   }
   
-  // Run a direct test for sensor readings once
-  if (!directTestRun && WiFi.status() == WL_CONNECTED && isAuthenticated()) {
-    Serial.println("\n\n==== RUNNING DIRECT SENSOR READING TEST ====\n");
-    // Try sending a test sensor reading
-    if (sendSensorReading(50)) { // Test with value 50
-      Serial.println("Direct test: Sensor reading sent successfully!");
-    } else {
-      Serial.println("Direct test: Failed to send sensor reading");
-    }
-    directTestRun = true;
-    Serial.println("\n==== DIRECT TEST COMPLETE ====\n");
-    delay(2000);
+  queueUsageReport();
+}
+
+// Drive WiFi reconnects and poll for time sync
+void networkTask() {
+  wifiManagerLoop();
+  
+#if USE_MQTT_TRANSPORT
+  // Commands are pushed over MQTT; apply a new one without waiting for the command task
+  if (networkReady && mqttTransportLoop()) {
+    runTaskNow(commandTaskId);
   }
+#endif
   
-  // Check WiFi connection and reconnect if needed
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi connection lost, reconnecting...");
-    connectToWifi();
-    
-    // If reconnected, sync time again
-    if (WiFi.status() == WL_CONNECTED) {
-      syncTime();
-    }
+  if (!timeSynced && time(nullptr) > 1600000000) {
+    timeSynced = true;
+    markBootPhase(BOOT_PHASE_TIME_SYNCED);
+    LOG_I("Time synchronized: %s", getISOTime().c_str());
+  }
+}
+
+// Get the device token, and a new one ahead of its expiry
+void authTask() {
+  if (!networkReady) {
+    return;
   }
   
-  // Read moisture sensor at regular intervals
-  if (millis() - lastSensorReadTime >= READING_INTERVAL) {
-    // Read moisture level
-    moistureLevel = readMoistureSensor();
-    Serial.print("Current moisture level: ");
-    Serial.print(moistureLevel);
-    Serial.println("%");
-    
-    // Send sensor reading to Supabase
-    if (sendSensorReading(moistureLevel)) {
-      Serial.println("Sensor reading sent to Supabase");
-    } else {
-      Serial.println("Failed to send sensor reading");
-    }
-    
-    // Handle automatic mode
-    if (automaticMode) {
-      handleAutomaticMode();
-    }
-    
-    lastSensorReadTime = millis();
+  authLoop();
+  if (isAuthenticated()) {
+    markBootPhase(BOOT_PHASE_AUTHENTICATED);
+  }
+}
+
+// Finish network bring-up when the link comes up
+void onLinkChange(LinkEvent event) {
+  networkReady = event == LINK_UP;
+  if (!networkReady) {
+    return;
   }
   
-  // Check for commands at regular intervals
-  if (millis() - lastCommandCheckTime >= COMMAND_CHECK_INTERVAL) {
-    Serial.println("\n==== Checking for control commands... ====");
-    Serial.print("Current pump status: ");
-    Serial.println(pumpStatus ? "ON" : "OFF");
-    Serial.print("Current mode: ");
-    Serial.println(automaticMode ? "AUTOMATIC" : "MANUAL");
-    
-    ControlCommand command = checkForCommands();
-    
-    if (command.valid) {
-      Serial.println("Received valid command, executing...");
-      Serial.print("Command pump status: ");
-      Serial.println(command.pumpControl ? "ON" : "OFF");
-      Serial.print("Command mode: ");
-      Serial.println(command.automaticMode ? "AUTOMATIC" : "MANUAL");
-      
-      // Execute command
-      // First handle mode changes, as they affect pump behavior
-      if (command.automaticMode != automaticMode) {
-        Serial.print("Changing mode from ");
-        Serial.print(automaticMode ? "AUTOMATIC" : "MANUAL");
-        Serial.print(" to ");
-        Serial.println(command.automaticMode ? "AUTOMATIC" : "MANUAL");
-        
-        // Set the mode first
-        setAutomaticMode(command.automaticMode);
-        
-        // If switching to automatic mode, immediately apply automatic logic
-        if (command.automaticMode) {
-          Serial.println("Applying automatic mode logic immediately");
-          handleAutomaticMode();
-          // Skip pump control command since automatic mode will handle it
-          Serial.println("Skipping manual pump control as automatic mode is now active");
-        } else {
-          // If switching to manual mode, apply the requested pump status
-          Serial.print("Switching to manual mode with pump ");
-          Serial.println(command.pumpControl ? "ON" : "OFF");
-          setPumpStatus(command.pumpControl);
-        }
-      } 
-      // Only handle pump control commands in manual mode
-      else if (!automaticMode) {
-        // Always apply pump control in manual mode, even if it appears to match current status
-        // This ensures the physical relay state matches the command
-        Serial.print("Manual mode: Setting pump to ");
-        Serial.println(command.pumpControl ? "ON" : "OFF");
-        
-        // Force the pump status to change with extra verification
-        setPumpStatus(command.pumpControl);
-        
-        // Double-check that the pump status was actually applied
-        delay(200); // Wait for relay to stabilize
-        if (pumpStatus != command.pumpControl) {
-          Serial.println("WARNING: Pump status doesn't match command! Trying again...");
-          setPumpStatus(command.pumpControl); // Try again
-        }
-      } else if (automaticMode) {
-        Serial.println("Ignoring pump control command in automatic mode");
-      }
-      
-      // Mark command as executed
-      if (markCommandAsExecuted(command.id)) {
-        Serial.println("Command marked as executed");
-      } else {
-        Serial.println("Failed to mark command as executed");
-      }
-    } else {
-      Serial.println("No new commands found");
-    }
-    
-    lastCommandCheckTime = millis();
-    Serial.println("==== Command check complete ====");
+  markBootPhase(BOOT_PHASE_WIFI_CONNECTED);
+  
+  // Start SNTP in the background; completion is polled in networkTask()
+  if (!timeSynced) {
+    configTime(0, 0, "pool.ntp.org", "time.nist.gov", "time.google.com");
   }
   
-  // Send heartbeat at regular intervals
-  if (millis() - lastHeartbeatTime >= HEARTBEAT_INTERVAL) {
-    Serial.println("Sending heartbeat...");
-    
-    if (sendHeartbeat()) {
-      Serial.println("Heartbeat sent successfully");
-    } else {
-      Serial.println("Failed to send heartbeat, updating device status instead");
-      updateDeviceStatus(pumpStatus, automaticMode);
+  if (isAuthenticated()) {
+    markBootPhase(BOOT_PHASE_AUTHENTICATED);
+  } else {
+    runTaskNow(authTaskId);
+  }
+  
+  // Publish the state control has been running with while offline
+  queueDeviceStatus(pumpStatus, automaticMode);
+  runTaskNow(outboundTaskId);
+  runTaskNow(settingsTaskId);
+  runTaskNow(usageTaskId);
+  
+#if RUN_SELF_TESTS_ON_BOOT
+  static bool bootSelfTestsRun = false;
+  if (!bootSelfTestsRun) {
+    bootSelfTestsRun = true;
+    runTaskNow(selfTestTaskId);
+  }
+#endif
+}
+
+// Single-character serial console for on-demand diagnostics
+void consoleTask() {
+  if (!Serial.available()) {
+    return;
+  }
+  
+  switch (Serial.read()) {
+    case 'T':
+      // Run the connection and table self-tests
+      runTaskNow(selfTestTaskId);
+      break;
+    case 'B':
+      reportBootTimings();
+      break;
+    case 'M':
+      printMemoryReport();
+      break;
+    case 'U':
+      printUsageReport();
+      break;
+    case 'S':
+      printIrrigationSchedule();
+      break;
+    case 'P':
+      printStateReport();
+      break;
+#if ESPNOW_GATEWAY_ENABLED
+    case 'N':
+      printGatewayNodes();
+      break;
+#endif
+#if TRACE_ENABLED
+    case 'R':
+      // Print the event trace for esp32-firmware/replay
+      logFlush();
+      dumpTrace(Serial);
+      break;
+    case 'X':
+      clearTrace();
+      break;
+#endif
+#if LOG_BINARY_DUMP
+    case 'L':
+      // Dump the binary log history
+      logFlush();
+      logDumpBinary(Serial);
+      break;
+#endif
+  }
+}
+
+#if ESPNOW_GATEWAY_ENABLED
+// Acknowledge sensor node readings and hand full batches to the outbound queue
+void gatewayTask() {
+  gatewayLoop();
+  if (networkReady && gatewayBatchDue()) {
+    queueNodeBatch();
+  }
+}
+#endif
+
+#if SENSOR_NODE_MODE
+// Survives deep sleep, so the sequence and the gateway address carry over
+RTC_DATA_ATTR SensorNode sensorNode;
+RTC_DATA_ATTR bool sensorNodeStarted = false;
+
+// Read the sensor, send the reading to the gateway and deep sleep
+void runSensorNode() {
+  if (!sensorNodeStarted) {
+    // A random start keeps a restarted node clear of its old sequence numbers
+    initSensorNode(&sensorNode, esp_random());
+    sensorNodeStarted = true;
+  }
+  
+  initSensors();
+  int moisture = readMoistureSensor();
+  uint16_t batteryMv = 0;
+#if NODE_BATTERY_PIN >= 0
+  // Battery through a 1:2 divider
+  batteryMv = analogReadMilliVolts(NODE_BATTERY_PIN) * 2;
+#endif
+  
+  WiFi.mode(WIFI_STA);
+  esp_wifi_set_channel(NODE_WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE);
+  if (initRadioLink()) {
+    beginNodeReading(&sensorNode, moisture, batteryMv);
+    while (!nodeLoop(&sensorNode)) {
+      delay(2);
     }
-    
-    lastHeartbeatTime = millis();
+    LOG_I("Node reading %lu: moisture %d%%, %s after %u sends", (unsigned long)sensorNode.sequence, moisture,
+          sensorNode.state == NODE_ACKED ? "acknowledged" : "not acknowledged", sensorNode.attempts);
   }
   
-  // Small delay to prevent excessive CPU usage
-  delay(100);
+  logFlush();
+  esp_sleep_enable_timer_wakeup((uint64_t)NODE_SLEEP_INTERVAL * 1000ULL);
+  esp_deep_sleep_start();
+}
+#endif
+
+// Connection tests, table tests and diagnostics.
+// These insert test rows into the production tables, so they never run
+// unless requested from the console or enabled with RUN_SELF_TESTS_ON_BOOT.
+void runSelfTests() {
+  if (!networkReady || !isAuthenticated()) {
+    LOG_W("Self-tests need WiFi and authentication");
+    return;
+  }
+  
+  logFlush();
+  runConnectionTests();
+  testSensorReadingsTable();
+  testDeviceStatusTable();
+  runDiagnostics();
 }
 
-// Connect to WiFi network
+// Wait for the WiFi manager to connect (legacy blocking boot only)
 void connectToWifi() {
-  Serial.print("Connecting to WiFi");
-  WiFi.begin(ssid, password);
-  
-  // Wait for connection with timeout
-  int timeout = 0;
-  while (WiFi.status() != WL_CONNECTED && timeout < 20) {
-    delay(500);
-    Serial.print(".");
-    timeout++;
+  unsigned long startTime = millis();
+  while (!isWifiConnected() && millis() - startTime < WIFI_CONNECT_TIMEOUT) {
+    wifiManagerLoop();
+    delay(100);
   }
   
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi connected!");
-    Serial.print("IP address: ");
-    Serial.println(WiFi.localIP());
-    
+  if (isWifiConnected()) {
     // Blink LED to indicate successful connection
     blinkLED(3, 100);
   } else {
-    Serial.println("\nFailed to connect to WiFi. Will retry later.");
+    LOG_W("Failed to connect to WiFi. Will retry later.");
   }
 }
 
 // Sync time with NTP server
 void syncTime() {
-  Serial.println("Syncing time with NTP server...");
+  LOG_I("Syncing time with NTP server...");
   
   // Configure NTP server with multiple servers for reliability
   configTime(0, 0, "pool.ntp.org", "time.nist.gov", "time.google.com");
@@ -355,20 +529,15 @@ void syncTime() {
   const int retry_count = 15;  // Increase retry count
   
   while (timeinfo.tm_year < (2020 - 1900) && ++retry < retry_count) {
-    Serial.print(".");
     delay(1000);
     time(&now);
     localtime_r(&now, &timeinfo);
   }
   
-  Serial.println();
-  
   if (timeinfo.tm_year >= (2020 - 1900)) {
-    Serial.println("Time synchronized!");
-    Serial.print("Current time: ");
-    Serial.println(getISOTime());
+    LOG_I("Time synchronized: %s", getISOTime().c_str());
   } else {
-    Serial.println("Failed to sync time. Will use millis() as fallback.");
+    LOG_W("Failed to sync time. Will use millis() as fallback.");
   }
 }
 
@@ -382,32 +551,5 @@ void blinkLED(int times, int delayMs) {
   }
 }
 
-// Handle automatic mode logic
-void handleAutomaticMode() {
-  Serial.print("Automatic mode: Current moisture level: ");
-  Serial.print(moistureLevel);
-  Serial.print("%, Threshold: ");
-  Serial.print(MOISTURE_THRESHOLD);
-  Serial.print("%, Pump status: ");
-  Serial.println(pumpStatus ? "ON" : "OFF");
-  
-  if (moistureLevel < MOISTURE_THRESHOLD && !pumpStatus) {
-    // Soil is too dry and pump is off, turn it on
-    setPumpStatus(true);
-    Serial.println("Automatic mode: Soil too dry, turning pump ON");
-  } else if (moistureLevel >= MOISTURE_THRESHOLD && pumpStatus) {
-    // Soil is wet enough and pump is on, turn it off
-    setPumpStatus(false);
-    Serial.println("Automatic mode: Soil wet enough, turning pump OFF");
-  } else if (moistureLevel >= MOISTURE_THRESHOLD) {
-    // Force pump off if moisture is above threshold, regardless of current state
-    // This ensures the pump is always off when moisture is sufficient
-    if (pumpStatus) {
-      setPumpStatus(false);
-      Serial.println("Automatic mode: Forcing pump OFF as moisture is sufficient");
-    }
-  }
-}
-
 
 
@@ -0,0 +1,382 @@
+/*
+ * IriQ Smart Irrigation System - API Client Module
+ *
+ * This module executes every Supabase REST request.
+ * Each endpoint has a circuit breaker so an outage or rate limit makes the
+ * device back off instead of retrying on every loop tick:
+ * - CLOSED: requests flow; consecutive transient failures are counted
+ * - OPEN: requests are skipped until the backoff (or Retry-After) expires
+ * - HALF_OPEN: a single probe decides between CLOSED and OPEN
+ * Immediate retries draw from a shared budget that refills with successes,
+ * so retries can never multiply traffic during an outage.
+ * Requests share one keep-alive connection (tls_session.cpp).
+ */
+
+#include "api_client.h"
+#include "config.h"
+#include "auth.h"
+#include "logger.h"
+#include "tls_session.h"
+#include "memory_pool.h"
+#include "trace.h"
+#include <HTTPClient.h>
+
+// External variables from main file
+extern const char* supabaseUrl;
+extern const char* supabaseKey;
+
+enum BreakerState {
+  BREAKER_CLOSED,
+  BREAKER_OPEN,
+  BREAKER_HALF_OPEN
+};
+
+struct EndpointBreaker {
+  BreakerState state;
+  uint8_t consecutiveFailures;
+  uint8_t openCount;           // Consecutive openings, drives the backoff exponent
+  unsigned long openedAt;
+  unsigned long openDuration;
+  int lastStatus;
+  uint32_t requests;
+  uint32_t failures;
+  uint32_t retries;
+  uint32_t skipped;
+};
+
+static EndpointBreaker breakers[ENDPOINT_COUNT];
+
+static const char* endpointNames[ENDPOINT_COUNT] = {
+  "sensor_readings",
+  "device_status",
+  "control_commands",
+  "device_presence",
+  "auth",
+  "pump_usage",
+  "device_settings",
+  "device_schedules",
+  "local_control"
+};
+
+static const char* breakerStateNames[] = { "closed", "open", "half_open" };
+
+// Retry budget in tenths of a retry, so successes can refill fractionally
+static uint16_t retryBudget = API_RETRY_BUDGET_MAX * 10;
+
+// The last request ended in a 4xx that sending it again cannot fix
+static bool lastRequestRejected = false;
+
+// Network errors, timeouts, 5xx and 429 are worth backing off from
+static bool isTransientFailure(int statusCode) {
+  return statusCode <= 0 || statusCode == 408 || statusCode == 429 || statusCode >= 500;
+}
+
+// Parse a Retry-After header given in seconds; returns 0 if absent or invalid
+static unsigned long parseRetryAfter(const String& value) {
+  long seconds = value.toInt();
+  if (seconds <= 0) {
+    return 0;
+  }
+  return (unsigned long)min(seconds, (long)(API_BACKOFF_MAX / 1000)) * 1000UL;
+}
+
+static void openBreaker(ApiEndpoint endpoint, unsigned long retryAfter) {
+  EndpointBreaker& breaker = breakers[endpoint];
+
+  if (retryAfter > 0) {
+    // The server told us when to come back
+    breaker.openDuration = retryAfter;
+  } else {
+    // Exponential backoff with jitter: random in [ceiling/2, ceiling]
+    unsigned long ceiling = API_BACKOFF_MIN << (breaker.openCount < 8 ? breaker.openCount : 8);
+    if (ceiling > API_BACKOFF_MAX) {
+      ceiling = API_BACKOFF_MAX;
+    }
+    breaker.openDuration = ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+  }
+
+  if (breaker.openCount < 255) {
+    breaker.openCount++;
+  }
+  breaker.state = BREAKER_OPEN;
+  breaker.openedAt = millis();
+
+  LOG_W("Circuit open for %s for %lu ms (HTTP %d)", endpointNames[endpoint], breaker.openDuration, breaker.lastStatus);
+}
+
+static void recordSuccess(ApiEndpoint endpoint) {
+  EndpointBreaker& breaker = breakers[endpoint];
+
+  if (breaker.state != BREAKER_CLOSED) {
+    LOG_I("Circuit closed for %s", endpointNames[endpoint]);
+  }
+  breaker.state = BREAKER_CLOSED;
+  breaker.consecutiveFailures = 0;
+  breaker.openCount = 0;
+
+  retryBudget += API_RETRY_BUDGET_REFILL;
+  if (retryBudget > API_RETRY_BUDGET_MAX * 10) {
+    retryBudget = API_RETRY_BUDGET_MAX * 10;
+  }
+}
+
+static void recordFailure(ApiEndpoint endpoint, unsigned long retryAfter) {
+  EndpointBreaker& breaker = breakers[endpoint];
+  breaker.failures++;
+
+  if (breaker.consecutiveFailures < 255) {
+    breaker.consecutiveFailures++;
+  }
+
+  // A failed probe, a rate limit or too many failures in a row opens the breaker
+  if (breaker.state == BREAKER_HALF_OPEN || retryAfter > 0 ||
+      breaker.consecutiveFailures >= API_BREAKER_THRESHOLD) {
+    openBreaker(endpoint, retryAfter);
+  }
+}
+
+// True if the endpoint's breaker would let a request through now
+bool isEndpointAvailable(ApiEndpoint endpoint) {
+  EndpointBreaker& breaker = breakers[endpoint];
+
+  if (breaker.state == BREAKER_OPEN) {
+    if (millis() - breaker.openedAt < breaker.openDuration) {
+      return false;
+    }
+    breaker.state = BREAKER_HALF_OPEN;
+  }
+  return true;
+}
+
+// True while the endpoint's breaker is open
+bool isEndpointOpen(ApiEndpoint endpoint) {
+  const EndpointBreaker& breaker = breakers[endpoint];
+  return breaker.state == BREAKER_OPEN && millis() - breaker.openedAt < breaker.openDuration;
+}
+
+// Kept across requests: destroying an HTTPClient stops its connection
+static HTTPClient http;
+
+// Lets HTTPClient decode the body (including chunked encoding) straight into a pool block
+class ResponseStream : public Stream {
+public:
+  explicit ResponseStream(ResponseBuffer& target) : target(target) {}
+  size_t write(uint8_t byte) override { return target.write(&byte, 1); }
+  size_t write(const uint8_t* bytes, size_t count) override { return target.write(bytes, count); }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+private:
+  ResponseBuffer& target;
+};
+
+// HTTPClient takes header names and values as Strings. Those sent with
+// every request are built once instead of as temporaries each time.
+static const String apikeyHeader("apikey");
+static const String authorizationHeader("Authorization");
+static const String contentTypeHeader("Content-Type");
+static const String jsonContentType("application/json");
+static const String preferHeader("Prefer");
+static const String preferMinimal("return=minimal");
+static const String preferMerge("resolution=merge-duplicates");
+static const String preferMergeMinimal("resolution=merge-duplicates,return=minimal");
+static const String cacheControlHeader("Cache-Control");
+static const String noCache("no-cache");
+
+static const String& apiKey() {
+  static String key;
+  if (key.length() == 0) {
+    key = supabaseKey;
+  }
+  return key;
+}
+
+// The edge functions are called before there is a device token
+static const String& anonAuthHeader() {
+  static String header;
+  if (header.length() == 0) {
+    header = "Bearer ";
+    header += supabaseKey;
+  }
+  return header;
+}
+
+// True when a failed request provably never reached the server: the
+// connection failed or the request could not be written. A timeout or a
+// lost connection after the write may follow a request the server already
+// handled, so a POST is not sent again then.
+static bool isUnsentFailure(int statusCode) {
+  return statusCode == HTTPC_ERROR_CONNECTION_REFUSED || statusCode == HTTPC_ERROR_SEND_HEADER_FAILED ||
+         statusCode == HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+}
+
+// True when a failed request may be sent again without risking a second
+// copy on the server: a GET, an HTTP error the server answered with, or a
+// failure before the request was written
+static bool isRepeatable(const char* method, int statusCode) {
+  return strcmp(method, "GET") == 0 || statusCode > 0 || isUnsentFailure(statusCode);
+}
+
+// Send one request; *resendable is set when it failed on a reused
+// keep-alive connection in a way that is safe to send again
+static int sendOnce(const char* method, const String& url, const char* payload,
+                    uint8_t options, ResponseBuffer* body, unsigned long* retryAfter, bool* resendable) {
+  static const char* collectedHeaders[] = { "Retry-After" };
+
+  bool reused = false;
+  *resendable = false;
+  WiFiClient* client = openApiConnection(&reused);
+  if (client == nullptr) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+
+  http.begin(*client, url);
+  http.setReuse(true);
+  http.setTimeout(API_TIMEOUT);
+  http.addHeader(apikeyHeader, apiKey());
+  http.addHeader(authorizationHeader, (options & API_FUNCTION) ? anonAuthHeader() : getAuthHeader());
+  size_t payloadLength = strlen(payload);
+  if (payloadLength > 0) {
+    http.addHeader(contentTypeHeader, jsonContentType);
+  }
+  if (options & API_UPSERT) {
+    http.addHeader(preferHeader, (options & API_RETURN_MINIMAL) ? preferMergeMinimal : preferMerge);
+  } else if (options & API_RETURN_MINIMAL) {
+    http.addHeader(preferHeader, preferMinimal);
+  }
+  if (strcmp(method, "GET") == 0) {
+    http.addHeader(cacheControlHeader, noCache);
+  }
+  http.collectHeaders(collectedHeaders, 1);
+
+  // Sent from the caller's buffer; HTTPClient does not modify it
+  int statusCode = http.sendRequest(method, (uint8_t*)payload, payloadLength);
+
+  if (statusCode > 0) {
+    *retryAfter = parseRetryAfter(http.header("Retry-After"));
+    if ((options & API_READ_BODY) && statusCode >= 200 && statusCode < 300) {
+      if (!body->acquire()) {
+        LOG_W("No response buffer free for %s", url.c_str());
+        statusCode = HTTPC_ERROR_TOO_LESS_RAM;
+      } else {
+        ResponseStream stream(*body);
+        if (http.writeToStream(&stream) < 0 || body->overflowed()) {
+          LOG_W("Response to %s larger than %d bytes", url.c_str(), API_RESPONSE_BUFFER_SIZE);
+          statusCode = HTTPC_ERROR_TOO_LESS_RAM;
+        }
+      }
+    } else if (statusCode >= 300) {
+      LOG_V("%s %s -> %d: %s", method, url.c_str(), statusCode, http.getString().c_str());
+    }
+  }
+
+  // Keeps the connection open unless the server asked to close it
+  http.end();
+
+  if (statusCode < 0) {
+    closeApiConnection();
+    // The server closes idle keep-alive connections; that is not an outage.
+    // Only a request that never got out, or a GET, may be sent again.
+    *resendable = reused && isRepeatable(method, statusCode) && statusCode != HTTPC_ERROR_TOO_LESS_RAM;
+  }
+  return statusCode;
+}
+
+// Send a request through the endpoint's circuit breaker
+ApiResponse apiRequest(ApiEndpoint endpoint, const char* method, const char* path,
+                       const char* payload, uint8_t options) {
+  ApiResponse response;
+  response.statusCode = 0;
+  response.sent = false;
+
+  EndpointBreaker& breaker = breakers[endpoint];
+  lastRequestRejected = false;
+
+  if (!isEndpointAvailable(endpoint)) {
+    breaker.skipped++;
+    return response;
+  }
+
+  // Reuses its capacity instead of allocating a URL per request
+  static String url;
+  url = supabaseUrl;
+  url += (options & API_FUNCTION) ? "/functions/v1/" : "/rest/v1/";
+  url += path;
+  unsigned long retryAfter = 0;
+#if TRACE_ENABLED
+  unsigned long requestStart = millis();
+#endif
+
+  for (int attempt = 0; ; attempt++) {
+    bool resendable = false;
+    breaker.requests++;
+    response.statusCode = sendOnce(method, url, payload, options, &response.body, &retryAfter, &resendable);
+    response.sent = true;
+    breaker.lastStatus = response.statusCode;
+
+    // A stale keep-alive connection: resend at once on a fresh connection.
+    // This is the one retry for the request and comes from the same budget.
+    if (attempt == 0 && resendable && retryBudget >= 10) {
+      retryBudget -= 10;
+      breaker.retries++;
+      continue;
+    }
+
+    // Retry a transient failure once, only while the shared budget allows it
+    // and never against an explicit Retry-After or a half-open probe. A POST
+    // or PATCH that timed out or lost its connection after the write may
+    // already have been applied, so it is left to the caller's queue.
+    if (attempt == 0 && isTransientFailure(response.statusCode) && isRepeatable(method, response.statusCode) &&
+        retryAfter == 0 && breaker.state == BREAKER_CLOSED && retryBudget >= 10) {
+      retryBudget -= 10;
+      breaker.retries++;
+      delay(API_RETRY_DELAY / 2 + esp_random() % (API_RETRY_DELAY / 2 + 1));
+      continue;
+    }
+    break;
+  }
+  TRACE(TRACE_REQUEST, endpoint, response.statusCode, millis() - requestStart);
+
+  if (response.ok()) {
+    recordSuccess(endpoint);
+  } else if ((response.statusCode == 401 || response.statusCode == 403) && !(options & API_FUNCTION)) {
+    // Rejected token: refresh it on the next request, but let the breaker
+    // pace re-authentication instead of retrying on every loop tick
+    LOG_W("Authentication error on %s (HTTP %d)", endpointNames[endpoint], response.statusCode);
+    invalidateAuthToken();
+    recordFailure(endpoint, 0);
+  } else if (isTransientFailure(response.statusCode)) {
+    recordFailure(endpoint, retryAfter);
+  } else {
+    // Other 4xx: the request itself is wrong, retrying will not help
+    breaker.failures++;
+    lastRequestRejected = true;
+  }
+
+  return response;
+}
+
+// True when the last request was rejected as wrong; reading it clears it
+bool takeRequestRejected() {
+  bool rejected = lastRequestRejected;
+  lastRequestRejected = false;
+  return rejected;
+}
+
+// Add breaker state and retry counters to a telemetry object
+void appendApiMetrics(JsonObject metrics) {
+  JsonObject api = metrics.createNestedObject("api");
+  api["retry_budget"] = retryBudget / 10;
+
+  for (int i = 0; i < ENDPOINT_COUNT; i++) {
+    EndpointBreaker& breaker = breakers[i];
+    JsonObject endpoint = api.createNestedObject(endpointNames[i]);
+    endpoint["state"] = breakerStateNames[breaker.state];
+    endpoint["requests"] = breaker.requests;
+    endpoint["failures"] = breaker.failures;
+    endpoint["retries"] = breaker.retries;
+    endpoint["skipped"] = breaker.skipped;
+    endpoint["last_status"] = breaker.lastStatus;
+  }
+}
@@ -0,0 +1,66 @@
+/*
+ * IriQ Smart Irrigation System - API Client Header
+ *
+ * Header file for the shared Supabase request executor.
+ */
+
+#ifndef API_CLIENT_H
+#define API_CLIENT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "memory_pool.h"
+
+// Endpoints with independent circuit breakers
+enum ApiEndpoint {
+  ENDPOINT_SENSOR_READINGS,
+  ENDPOINT_DEVICE_STATUS,
+  ENDPOINT_CONTROL_COMMANDS,
+  ENDPOINT_HEARTBEATS,
+  ENDPOINT_AUTH,
+  ENDPOINT_PUMP_USAGE,
+  ENDPOINT_DEVICE_SETTINGS,
+  ENDPOINT_DEVICE_SCHEDULES,
+  ENDPOINT_LOCAL_CONTROL,
+  ENDPOINT_COUNT
+};
+
+// Request options
+#define API_READ_BODY 0x01       // Keep the response body
+#define API_RETURN_MINIMAL 0x02  // Send "Prefer: return=minimal"
+#define API_UPSERT 0x04          // Merge with an existing row on conflict (POST with ?on_conflict=)
+#define API_FUNCTION 0x08        // Call the edge function /functions/v1/<path> with the anon key
+
+// Result of an API request
+struct ApiResponse {
+  int statusCode;  // HTTP status, negative HTTPClient error, or 0 when not sent
+  bool sent;       // False when the circuit breaker skipped the request
+  ResponseBuffer body;  // Only filled with API_READ_BODY; a pool block, returned when the response goes away
+
+  bool ok() const { return statusCode >= 200 && statusCode < 300; }
+};
+
+// Send a request to /rest/v1/<path> (or /functions/v1/<path> with API_FUNCTION)
+// through the endpoint's circuit breaker. Build path and payload in an
+// ArenaString (memory_pool.h) rather than a String.
+// Transient failures are retried once if the retry budget allows; otherwise
+// the breaker opens with exponential backoff (or the server's Retry-After).
+ApiResponse apiRequest(ApiEndpoint endpoint, const char* method, const char* path,
+                       const char* payload, uint8_t options = API_RETURN_MINIMAL);
+
+// True if the endpoint's breaker would let a request through now
+bool isEndpointAvailable(ApiEndpoint endpoint);
+
+// True while the endpoint's breaker is open; unlike isEndpointAvailable()
+// it never moves the breaker to half-open
+bool isEndpointOpen(ApiEndpoint endpoint);
+
+// True when the last request ended in a 4xx other than 401, 403, 408 and
+// 429: the request itself is wrong, so sending it again cannot succeed.
+// Reading it clears it.
+bool takeRequestRejected();
+
+// Add breaker state and retry counters to a telemetry object
+void appendApiMetrics(JsonObject metrics);
+
+#endif // API_CLIENT_H
@@ -1,157 +1,260 @@
 /*
  * IriQ Smart Irrigation System - Authentication Module
- * 
+ *
  * This module handles secure authentication with the Supabase backend.
- * It implements JWT-based authentication and secure token storage.
+ * The device token is a JWT issued by the authenticate-device edge function
+ * (AUTH_TOKEN_FUNCTION) against the device's DEVICE_SECRET. Its expiry is
+ * kept as epoch time, in NVS with the token; the state store writes both
+ * after a new token arrives, not the request that fetched it.
+ *
+ * Requests never authenticate inline. The auth task fetches a new token
+ * AUTH_REFRESH_MARGIN seconds before the old one expires, so requests keep
+ * using the old token meanwhile, and retries a failed fetch with backoff.
+ * The Authorization header is built once per token.
  */
 
 #include "auth.h"
-#include <HTTPClient.h>
 #include <ArduinoJson.h>
+#include <limits.h>
 #include <time.h>
+#include "config.h"
+#include "logger.h"
+#include "api_client.h"
+#include "memory_pool.h"
+#include "state_store.h"
 
-#include <Preferences.h>
+// A token this close to expiry is no longer sent
+#define AUTH_EXPIRY_SKEW 60
 
-Preferences preferences;
-String authToken = "";
-bool isAuthenticatedFlag = false;
-long tokenExpiryTime = 0; // Unix timestamp when token expires
+// Anything earlier means SNTP has not set the clock yet
+#define AUTH_CLOCK_VALID 1600000000
+
+// Longest token kept in NVS; a longer one is used but fetched again after a reset
+#define AUTH_TOKEN_MAX 768
+
+// Persisted copy of the token
+static char storedToken[AUTH_TOKEN_MAX];
+static int64_t storedExpiresAt = 0;
+static int tokenSlot = -1;
+static int expirySlot = -1;
+
+static String authToken = "";
+static String authHeader = "";
+static int64_t tokenExpiresAt = 0;         // Epoch seconds
+static unsigned long tokenReceivedAt = 0;  // millis()
+static unsigned long tokenLifetime = 0;    // Seconds from tokenReceivedAt; 0 for a stored token
+
+static unsigned long nextAttemptAt = 0;
+static unsigned long retryDelay = AUTH_RETRY_MIN;
+
+// Statistics
+static uint32_t tokensIssued = 0;
+static uint32_t tokenFailures = 0;
+static uint32_t tokensRejected = 0;
 
 // External variables from main file
-extern const char* supabaseUrl;
 extern const char* supabaseKey;
 extern String deviceId;
 
+static void setToken(const String& token, int64_t expiresAt, unsigned long lifetime) {
+  authToken = token;
+  authHeader = "Bearer ";
+  authHeader += token;
+  tokenExpiresAt = expiresAt;
+  tokenReceivedAt = millis();
+  tokenLifetime = lifetime;
+}
+
+// Seconds the token stays valid; before the clock is set, counted from
+// when it was received, and unknown (assumed valid) for a stored token
+static long tokenSecondsLeft() {
+  time_t now = time(nullptr);
+  if (now >= AUTH_CLOCK_VALID && tokenExpiresAt > 0) {
+    return (long)(tokenExpiresAt - now);
+  }
+  if (tokenLifetime > 0) {
+    return (long)tokenLifetime - (long)((millis() - tokenReceivedAt) / 1000);
+  }
+  return LONG_MAX;
+}
+
+// The edge function refuses a request without a secret (HTTP 400)
+static bool deviceSecretMissing() {
+  return strlen(AUTH_TOKEN_FUNCTION) > 0 && strlen(DEVICE_SECRET) == 0;
+}
+
+static bool tokenNeedsRefresh() {
+  return authToken.length() == 0 || tokenSecondsLeft() < AUTH_REFRESH_MARGIN;
+}
+
 // Initialize authentication module
 bool initAuth() {
-  Serial.println("Initializing authentication module...");
-  
-  // Open preferences with namespace "auth"
-  if (!preferences.begin("auth", false)) {
-    Serial.println("Failed to initialize preferences");
-    return false;
+  tokenSlot = registerState("auth", "token", STATE_STRING, storedToken, sizeof(storedToken), STATE_COMMIT_DELAY);
+  expirySlot = registerState("auth", "expires_at", STATE_I64, &storedExpiresAt, sizeof(storedExpiresAt),
+                             STATE_COMMIT_DELAY);
+
+  if (deviceSecretMissing()) {
+    LOG_E("DEVICE_SECRET is not set in config.h: %s will not issue device tokens. Give the device a secret "
+          "with set_device_secret() (supabase-setup/device-credentials.sql) and put it in DEVICE_SECRET",
+          AUTH_TOKEN_FUNCTION);
   }
-  
+
   // Check if we have a stored token and if it's still valid
-  authToken = preferences.getString("token", "");
-  tokenExpiryTime = preferences.getLong("expiry", 0);
-  
-  if (authToken.length() > 0) {
-    // Get current time to check token validity
-    time_t now;
-    time(&now);
-    
-    if (now < tokenExpiryTime) {
-      Serial.println("Found valid stored authentication token");
-      Serial.print("Token expires in: ");
-      Serial.print((tokenExpiryTime - now) / 60);
-      Serial.println(" minutes");
-      isAuthenticatedFlag = true;
-      return true;
-    } else {
-      Serial.println("Stored token has expired, need to re-authenticate");
-      clearAuth();
-    }
+  if (storedToken[0] == '\0' || storedExpiresAt == 0) {
+    return false;
+  }
+
+  setToken(String(storedToken), storedExpiresAt, 0);
+  long secondsLeft = tokenSecondsLeft();
+  if (secondsLeft == LONG_MAX) {
+    LOG_I("Found stored token, expiry checked once the clock is set");
+    return true;
   }
-  
+  if (secondsLeft > AUTH_EXPIRY_SKEW) {
+    LOG_I("Found valid stored token, expires in %ld minutes", secondsLeft / 60);
+    return true;
+  }
+
+  LOG_I("Stored token has expired, need to re-authenticate");
+  clearAuth();
   return false;
 }
 
-// Authenticate with Supabase directly (without Edge Function)
+// Get a new device token from the edge function
 bool authenticateWithSupabase() {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot authenticate: WiFi not connected");
+    LOG_D("Cannot authenticate: WiFi not connected");
     return false;
   }
-  
-  Serial.println("Authenticating with Supabase (direct method)...");
-  
-  // For direct authentication, we'll use the anon key as the token
-  // This is less secure but will work for testing
-  authToken = String(supabaseKey);
-  
-  // Set expiry to 24 hours from now
-  tokenExpiryTime = millis() + (24 * 60 * 60 * 1000);
-  
-  // Save token and expiry
-  preferences.putString("token", authToken);
-  preferences.putULong("expiry", tokenExpiryTime);
-  
-  isAuthenticatedFlag = true;
-  Serial.println("Direct authentication successful");
-  
-  // Log device authentication
-  HTTPClient http;
-  String url = String(supabaseUrl) + "/rest/v1/device_auth_logs";
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + authToken);
-  
-  // Create log payload
-  DynamicJsonDocument logDoc(1024);
-  logDoc["device_id"] = deviceId;
-  logDoc["success"] = true;
-  logDoc["ip_address"] = WiFi.localIP().toString();
-  logDoc["user_agent"] = "ESP32";
-  
-  String jsonPayload;
-  serializeJson(logDoc, jsonPayload);
-  
-  // Send the log (but don't worry if it fails)
-  int httpResponseCode = http.POST(jsonPayload);
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    Serial.println("Authentication log created successfully");
+
+  if (strlen(AUTH_TOKEN_FUNCTION) == 0) {
+    // No edge function (e.g. behind the ingestion gateway): the anon key is the token
+    setToken(String(supabaseKey), 0, 0);
+    LOG_I("Using the anon key for authentication");
+    return true;
+  }
+
+  if (deviceSecretMissing()) {
+    // Would only be refused; initAuth() explained why
+    tokenFailures++;
+    LOG_E("Cannot authenticate: DEVICE_SECRET is not set");
+    return false;
+  }
+
+  ArenaJsonDocument requestDoc(256);
+  requestDoc["device_id"] = deviceId;
+  requestDoc["device_type"] = "ESP32";
+  requestDoc["device_secret"] = DEVICE_SECRET;
+
+  ArenaString jsonPayload(measureJson(requestDoc) + 1);
+  jsonPayload.assignJson(requestDoc);
+
+  // The edge function also writes the device_auth_logs entry
+  ApiResponse response = apiRequest(ENDPOINT_AUTH, "POST", AUTH_TOKEN_FUNCTION, jsonPayload.c_str(),
+                                    API_FUNCTION | API_READ_BODY);
+  if (!response.ok()) {
+    tokenFailures++;
+    if (response.statusCode == 401 || response.statusCode == 403) {
+      tokensRejected++;
+      LOG_E("Device credentials rejected (HTTP %d), check DEVICE_SECRET and devices.device_secret_hash",
+            response.statusCode);
+    } else if (response.sent) {
+      LOG_W("Error getting device token (HTTP %d)", response.statusCode);
+    }
+    return false;
+  }
+
+  ArenaJsonDocument doc(256);
+  DeserializationError error = deserializeJson(doc, response.body.data(), response.body.length());
+  const char* token = doc["token"];
+  unsigned long expiresIn = doc["expires_in"] | 0UL;
+  if (error || token == nullptr || expiresIn == 0) {
+    tokenFailures++;
+    LOG_W("Invalid device token response%s%s", error ? ": " : "", error ? error.c_str() : "");
+    return false;
+  }
+
+  // expires_in counts from the server's clock, so the device clock need not be set
+  int64_t expiresAt = doc["expires_at"] | (int64_t)0;
+  setToken(String(token), expiresAt, expiresIn);
+  tokensIssued++;
+
+  if (authToken.length() < sizeof(storedToken)) {
+    strcpy(storedToken, authToken.c_str());
+    storedExpiresAt = tokenExpiresAt;
   } else {
-    Serial.println("Failed to create auth log, but continuing anyway");
+    LOG_W("Device token too long to keep in NVS");
+    storedToken[0] = '\0';
+    storedExpiresAt = 0;
   }
-  
-  http.end();
+  LOG_I("Device token issued, expires in %lu minutes", expiresIn / 60);
   return true;
 }
 
-// Check if currently authenticated
-bool isAuthenticated() {
-  // Check if we have a token and it's not expired
-  if (authToken.length() > 0 && tokenExpiryTime > millis()) {
-    return true;
+// Refresh the token ahead of expiry, with backoff after failures (auth task)
+void authLoop() {
+  if (!tokenNeedsRefresh() || WiFi.status() != WL_CONNECTED || (long)(millis() - nextAttemptAt) < 0) {
+    return;
   }
-  
-  // Token expired or not present
-  if (authToken.length() > 0) {
-    return refreshToken();
+
+  if (authenticateWithSupabase()) {
+    retryDelay = AUTH_RETRY_MIN;
+    return;
   }
-  
-  return false;
+
+  nextAttemptAt = millis() + retryDelay;
+  LOG_W("Token refresh failed, retrying in %lu s", retryDelay / 1000);
+  retryDelay = retryDelay * 2 < AUTH_RETRY_MAX ? retryDelay * 2 : AUTH_RETRY_MAX;
 }
 
-// Refresh the authentication token
-bool refreshToken() {
-  Serial.println("Refreshing authentication token...");
-  
-  // For simplicity, we'll just re-authenticate
-  return authenticateWithSupabase();
+// Check if currently authenticated
+bool isAuthenticated() {
+  return authToken.length() > 0 && tokenSecondsLeft() > AUTH_EXPIRY_SKEW;
 }
 
 // Get the current authentication token
 String getAuthToken() {
-  // Make sure we have a valid token
-  if (!isAuthenticated()) {
-    authenticateWithSupabase();
-  }
-  
   return authToken;
 }
 
+// The "Bearer <token>" header value for the current token
+const String& getAuthHeader() {
+  return authHeader;
+}
+
 // Clear authentication data
 void clearAuth() {
-  Serial.println("Clearing authentication data...");
-  
+  invalidateAuthToken();
+
+  // Erase only the stored token
+  storedToken[0] = '\0';
+  storedExpiresAt = 0;
+  clearState(tokenSlot);
+  clearState(expirySlot);
+  LOG_I("Authentication data cleared");
+}
+
+// Drop the in-memory token after the server rejected it.
+// Unlike clearAuth() this leaves NVS alone, so a transient 401/403 does not
+// cost a flash erase; the auth task fetches a new token, which replaces the
+// stored one.
+void invalidateAuthToken() {
   authToken = "";
-  tokenExpiryTime = 0;
-  isAuthenticatedFlag = false;
-  
-  // Clear preferences
-  preferences.clear();
-  Serial.println("Authentication data cleared");
+  authHeader = "";
+  tokenExpiresAt = 0;
+  tokenLifetime = 0;
+  // Requests rejecting each new token must not turn into a token request loop
+  nextAttemptAt = millis() + AUTH_RETRY_MIN;
+  LOG_I("Authentication token invalidated");
+}
+
+// Add token state and counters to a telemetry object
+void appendAuthMetrics(JsonObject metrics) {
+  JsonObject auth = metrics.createNestedObject("auth");
+  long secondsLeft = tokenSecondsLeft();
+  auth["valid"] = isAuthenticated();
+  auth["expires_in_s"] = authToken.length() == 0 ? 0 : (secondsLeft == LONG_MAX ? -1 : secondsLeft);
+  auth["issued"] = tokensIssued;
+  auth["failures"] = tokenFailures;
+  auth["rejected"] = tokensRejected;
 }
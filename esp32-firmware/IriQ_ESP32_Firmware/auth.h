@@ -1,6 +1,6 @@
 /*
  * IriQ Smart Irrigation System - Authentication Header
- * 
+ *
  * Header file for the authentication module.
  */
 
@@ -8,6 +8,7 @@
 #define AUTH_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <WiFi.h>
 
 // External variables that need to be defined in the main file
@@ -15,10 +16,13 @@ extern String deviceId;
 
 // Function declarations
 bool initAuth();                // Initialize authentication module
-bool authenticateWithSupabase(); // Authenticate with Supabase
-bool isAuthenticated();         // Check if device is authenticated
+bool authenticateWithSupabase(); // Get a new device token now
+void authLoop();                // Refresh the token ahead of expiry (auth task)
+bool isAuthenticated();         // Check if device holds a token that has not expired
 String getAuthToken();          // Get authentication token
+const String& getAuthHeader();  // "Bearer <token>", built once per token
 void clearAuth();               // Clear authentication data
-bool refreshToken();            // Refresh the authentication token
+void invalidateAuthToken();     // Drop the in-memory token after the server rejected it
+void appendAuthMetrics(JsonObject metrics); // Add token state to a telemetry object
 
 #endif // AUTH_H
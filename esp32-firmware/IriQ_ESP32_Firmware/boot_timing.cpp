@@ -0,0 +1,68 @@
+/*
+ * IriQ Smart Irrigation System - Boot Timing Module
+ * 
+ * This module records when each boot phase is reached so time-to-control
+ * and time-to-cloud can be measured and reported after startup.
+ */
+
+#include "boot_timing.h"
+#include "logger.h"
+#include <esp_system.h>
+
+static unsigned long bootPhaseTimes[BOOT_PHASE_COUNT] = { 0 };
+
+static const char* bootPhaseNames[BOOT_PHASE_COUNT] = {
+  "state_restored",
+  "first_control",
+  "setup_done",
+  "wifi_connected",
+  "time_synced",
+  "authenticated",
+  "first_upload"
+};
+
+// Record the time a phase was reached
+void markBootPhase(BootPhase phase) {
+  if (phase >= BOOT_PHASE_COUNT || bootPhaseTimes[phase] != 0) {
+    return;
+  }
+  
+  // millis() is never 0 this late in boot, so 0 can mean "not reached"
+  bootPhaseTimes[phase] = millis();
+  LOG_D("Boot phase %s at %lu ms", bootPhaseNames[phase], bootPhaseTimes[phase]);
+}
+
+// Milliseconds since power-on when the phase was reached
+unsigned long getBootPhaseTime(BootPhase phase) {
+  return phase < BOOT_PHASE_COUNT ? bootPhaseTimes[phase] : 0;
+}
+
+// True once every phase has been reached
+bool bootPhasesComplete() {
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    if (bootPhaseTimes[i] == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Log the recorded boot timings
+void reportBootTimings() {
+  LOG_I("Boot timings (ms): restore=%lu control=%lu setup=%lu wifi=%lu time=%lu auth=%lu upload=%lu",
+        bootPhaseTimes[BOOT_PHASE_STATE_RESTORED], bootPhaseTimes[BOOT_PHASE_FIRST_CONTROL],
+        bootPhaseTimes[BOOT_PHASE_SETUP_DONE], bootPhaseTimes[BOOT_PHASE_WIFI_CONNECTED],
+        bootPhaseTimes[BOOT_PHASE_TIME_SYNCED], bootPhaseTimes[BOOT_PHASE_AUTHENTICATED],
+        bootPhaseTimes[BOOT_PHASE_FIRST_UPLOAD]);
+}
+
+// Add boot timings to a telemetry object
+void appendBootMetrics(JsonObject metrics) {
+  JsonObject boot = metrics.createNestedObject("boot_ms");
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    if (bootPhaseTimes[i] != 0) {
+      boot[bootPhaseNames[i]] = bootPhaseTimes[i];
+    }
+  }
+  boot["reset_reason"] = (int)esp_reset_reason();
+}
@@ -0,0 +1,40 @@
+/*
+ * IriQ Smart Irrigation System - Boot Timing Header
+ * 
+ * Header file for boot-phase timing.
+ */
+
+#ifndef BOOT_TIMING_H
+#define BOOT_TIMING_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Boot phases in the order they are normally reached
+enum BootPhase {
+  BOOT_PHASE_STATE_RESTORED,  // Persisted pump/mode state applied
+  BOOT_PHASE_FIRST_CONTROL,   // First sensor reading and control decision
+  BOOT_PHASE_SETUP_DONE,      // setup() returned
+  BOOT_PHASE_WIFI_CONNECTED,  // Station got an IP address
+  BOOT_PHASE_TIME_SYNCED,     // NTP time available
+  BOOT_PHASE_AUTHENTICATED,   // Supabase token available
+  BOOT_PHASE_FIRST_UPLOAD,    // First successful upload to Supabase
+  BOOT_PHASE_COUNT
+};
+
+// Record the time a phase was reached (only the first call counts)
+void markBootPhase(BootPhase phase);
+
+// Milliseconds since power-on when the phase was reached, 0 if not yet
+unsigned long getBootPhaseTime(BootPhase phase);
+
+// True once every phase has been reached
+bool bootPhasesComplete();
+
+// Log the recorded boot timings
+void reportBootTimings();
+
+// Add boot timings to a telemetry object
+void appendBootMetrics(JsonObject metrics);
+
+#endif // BOOT_TIMING_H
@@ -26,8 +26,140 @@
 
 // Operational parameters
 #define MOISTURE_THRESHOLD 30   // Threshold for automatic irrigation (0-100, where 0 is dry)
-#define READING_INTERVAL 3000   // Read sensor every 3 seconds for faster response
+#define READING_INTERVAL 3000   // Read sensor every 3 seconds while moisture is changing (see adaptive sampling)
 #define COMMAND_CHECK_INTERVAL 1000  // Check for commands every 1 second for faster control
 #define HEARTBEAT_INTERVAL 3000     // Send heartbeat every 3 seconds for better dashboard responsiveness
 
+// Logging
+#define LOG_LEVEL 3             // 0=none, 1=error, 2=warn, 3=info, 4=debug, 5=verbose (calls above this level are compiled out)
+#define LOG_BUFFER_SLOTS 32     // Ring buffer slots drained to Serial by a background task (power of two)
+#define LOG_MESSAGE_SIZE 120    // Maximum formatted length of a single log line
+#define LOG_BINARY_DUMP 0       // 1 = keep a binary log history in RTC memory that survives soft resets
+#define LOG_DUMP_SIZE 2048      // Size of the binary log history in bytes
+
+// Boot behaviour
+#define FAST_BOOT 1                 // 1 = start control from the persisted state and bring up the network in the background
+#define RUN_SELF_TESTS_ON_BOOT 0    // 1 = run the Supabase self-tests once after the first connection (inserts test rows)
+#define WIFI_CONNECT_TIMEOUT 10000  // Milliseconds before a WiFi connection attempt is restarted
+
+// Connectivity
+#define WIFI_FAST_CONNECT_TIMEOUT 3000  // Milliseconds to wait on the cached access point before scanning
+#define WIFI_BACKOFF_MIN 1000           // First reconnect backoff in milliseconds
+#define WIFI_BACKOFF_MAX 60000          // Reconnect backoff ceiling in milliseconds
+#define WIFI_STATIC_IP ""               // Static IP (e.g. "192.168.1.50") to skip DHCP; empty = DHCP
+#define WIFI_GATEWAY ""
+#define WIFI_SUBNET "255.255.255.0"
+#define WIFI_DNS "8.8.8.8"
+
+// Telemetry
+#define TELEMETRY_INTERVAL 60000  // Attach device metrics to a heartbeat every minute
+
+// API requests
+#define API_TIMEOUT 5000              // HTTP timeout per request in milliseconds
+#define API_BREAKER_THRESHOLD 3       // Consecutive transient failures before an endpoint's circuit opens
+#define API_BACKOFF_MIN 2000          // First circuit-open duration in milliseconds
+#define API_BACKOFF_MAX 300000        // Circuit-open ceiling in milliseconds (also caps Retry-After)
+#define API_RETRY_DELAY 200           // Delay before an immediate retry in milliseconds
+#define API_RETRY_BUDGET_MAX 10       // Immediate retries that can be banked
+#define API_RETRY_BUDGET_REFILL 1     // Tenths of a retry earned per successful request
+
+// Commands
+#define MAX_PENDING_COMMANDS 20  // Pending commands fetched and acknowledged per poll
+
+// MQTT transport
+#define USE_MQTT_TRANSPORT 0      // 1 = send data and receive commands over MQTT (bridged to the tables by ingest-gateway) instead of HTTP
+#define MQTT_HOST ""
+#define MQTT_PORT 1883
+#define MQTT_PASSWORD ""          // Broker password; the username is the device id
+#define MQTT_KEEPALIVE 15         // Seconds; the broker publishes the offline last will after 1.5x this without traffic
+#define MQTT_TIMEOUT 2000         // Milliseconds to wait for the broker's acknowledgement of a QoS 1 publish
+#define MQTT_BUFFER_SIZE 1024     // Largest message in either direction
+
+// Local LAN API
+#define LOCAL_API_ENABLED 0        // 1 = serve live readings and pump/mode control on the LAN (needs ESPAsyncWebServer and AsyncTCP)
+#define LOCAL_API_PORT 80
+#define LOCAL_API_TOKEN "YOUR_LOCAL_API_TOKEN"  // Bearer token for /api/*, or ?token= for the WebSocket
+#define LOCAL_API_MAX_CLIENTS 4    // WebSocket clients kept; the oldest is dropped beyond this
+#define LOCAL_SYNC_RETRY 5000      // Milliseconds between attempts to report local actions to Supabase
+
+// TLS
+// PEM of the root CA that signs SUPABASE_URL's certificate, parsed once and
+// used as the only trust anchor. "" = the roots of Supabase's CAs (tls_roots.h).
+#define TLS_ROOT_CA ""
+#define TLS_INSECURE 0               // 1 = skip certificate verification (testing only; sessions are then not resumed)
+#define TLS_HANDSHAKE_TIMEOUT 10000  // Milliseconds for the TCP connect plus TLS handshake
+#define TLS_SESSION_CACHE_SIZE 3072  // Bytes of RTC memory for the resumable session; 0 disables resumption
+#define TLS_SESSION_LIFETIME 7200    // Seconds a cached session is offered (the server may expire it sooner)
+
+// Memory
+#define API_ARENA_SIZE 12288           // Bytes for request-scoped documents and payloads on the loop task (a full node batch takes ~10K)
+#define API_RESPONSE_POOL_BLOCKS 2     // Response bodies that can be held at once
+#define API_RESPONSE_BUFFER_SIZE 4096  // Largest response body kept (the command poll is the largest)
+
+// Event trace
+#define TRACE_ENABLED 0              // 1 = record sensor, control and network events to flash for host replay (esp32-firmware/replay)
+#define TRACE_BUFFER_SIZE 1024       // Bytes of events buffered in RAM between flushes
+#define TRACE_FLUSH_INTERVAL 30000   // Milliseconds between appends to /trace.txt
+#define TRACE_FILE_MAX 262144        // Bytes at which /trace.txt rotates to /trace.old
+
+// Adaptive sampling
+#define SAMPLE_INTERVAL_MIN 1000         // Milliseconds between readings while the pump runs or moisture is near the threshold
+#define SAMPLE_INTERVAL_MAX 300000       // Milliseconds between readings once moisture is stable
+#define SAMPLE_NEAR_THRESHOLD 5          // Percentage points around MOISTURE_THRESHOLD sampled at the minimum interval
+#define SAMPLE_STABLE_DELTA 2            // Change in percentage points that counts as moving
+#define SAMPLE_UPLOAD_INTERVAL 3000      // Readings closer together than this are uploaded only when they moved
+#define SAMPLE_INTERVAL_FLOOR 250        // Lowest minimum interval accepted from device_settings
+#define SAMPLE_INTERVAL_CEILING 3600000  // Highest maximum interval accepted from device_settings
+#define SETTINGS_CHECK_INTERVAL 600000   // Check device_settings every 10 minutes
+
+// Metering
+#define FLOW_SENSOR_PIN -1                // GPIO of a pulse flow sensor, -1 when none is fitted
+#define FLOW_PULSES_PER_LITER 450         // Sensor pulses per litre (450 for a YF-S201)
+#define METER_CHECKPOINT_INTERVAL 300000  // Milliseconds between NVS checkpoints while the pump runs
+#define METER_MAX_PENDING_EVENTS 16       // Irrigation events kept until uploaded
+#define METER_MAX_PENDING_DAYS 7          // Closed days kept until uploaded
+#define USAGE_UPLOAD_INTERVAL 900000      // Upload usage every 15 minutes
+
+// Outbound queue
+#define OUTBOUND_INTERVAL 50              // Milliseconds between outbound passes; one request per pass
+#define OUTBOUND_CONTROL_DEPTH 4          // Queued status updates and command acknowledgements
+#define OUTBOUND_TELEMETRY_DEPTH 8        // Queued readings and usage reports; the oldest is dropped when full
+#define OUTBOUND_READING_MAX_AGE 30000    // Drop readings queued longer than this (Supabase timestamps them on arrival)
+#define OUTBOUND_TELEMETRY_ATTEMPTS 2     // Sends before a telemetry message is dropped
+#define OUTBOUND_RETRY_DELAY 2000         // Milliseconds a class waits after a failed send
+
+// Irrigation schedule
+#define SCHEDULE_MAX_ENTRIES 8            // Watering windows kept on the device
+#define SCHEDULE_CHECK_INTERVAL 5000      // Milliseconds between checks of the schedule against the clock
+
+// ESP-NOW sensor nodes
+#define ESPNOW_GATEWAY_ENABLED 0          // 1 = also take readings from battery sensor nodes over ESP-NOW and upload them in batches
+#define SENSOR_NODE_MODE 0                // 1 = build as a battery sensor node: read, send to the gateway, deep sleep
+#define NODE_NETWORK_ID 0x49524951        // Shared by a gateway and its nodes; change it when two installations are in range
+#define NODE_DEVICE_PREFIX "IRIQ-NODE-"   // A node's device_id is this plus its MAC; register it in devices under the gateway's user
+#define NODE_WIFI_CHANNEL 1               // WiFi channel of the gateway's access point (nodes only)
+#define NODE_SLEEP_INTERVAL 300000        // Milliseconds a node sleeps between readings
+#define NODE_ACK_TIMEOUT 50               // Milliseconds a node waits for an acknowledgement before resending
+#define NODE_SEND_ATTEMPTS 5              // Sends per reading before a node gives up until its next wake-up
+#define NODE_BATTERY_PIN -1               // ADC pin of the battery behind a 1:2 divider, -1 when not wired
+#define GATEWAY_MAX_NODES 16              // Nodes the gateway keeps track of
+#define GATEWAY_BATCH_SIZE 32             // Node readings per multi-row insert
+#define GATEWAY_UPLOAD_INTERVAL 30000     // Upload a partial batch once its oldest reading is this old
+#define GATEWAY_POLL_INTERVAL 20          // Milliseconds between passes over received frames
+#define RADIO_INBOX_SIZE 16               // Frames buffered between the WiFi task and the gateway task
+
+// Device tokens
+#define AUTH_TOKEN_FUNCTION "authenticate-device"  // Edge function that issues device JWTs; "" = send the anon key (e.g. behind ingest-gateway)
+#define DEVICE_SECRET ""                  // Required with AUTH_TOKEN_FUNCTION; its SHA-256 goes in devices.device_secret_hash
+#define AUTH_REFRESH_MARGIN 3600          // Seconds before expiry at which the auth task gets a new token
+#define AUTH_CHECK_INTERVAL 1000          // Token check interval in milliseconds
+#define AUTH_RETRY_MIN 5000               // First delay after a failed token request in milliseconds
+#define AUTH_RETRY_MAX 300000             // Delay ceiling for failed token requests in milliseconds
+
+// Persistent state (NVS)
+#define STATE_CHECK_INTERVAL 1000         // Milliseconds between passes that write changed state to NVS
+#define STATE_COMMIT_DELAY 2000           // Milliseconds a change waits before it is written; changes within it cost one write
+#define STATE_MAX_WRITES_PER_PASS 4       // NVS writes per pass; the rest wait for the next pass
+#define STATE_SHADOW_SIZE 2048            // Bytes for the copies of persisted state last written to NVS
+
 #endif // CONFIG_H
@@ -0,0 +1,38 @@
+/*
+ * IriQ Smart Irrigation System - Control State Module
+ * 
+ * This module persists the pump and mode state in NVS so control can resume
+ * from the last known state immediately after a reboot, before the network
+ * and Supabase are reachable. The state store writes a change
+ * STATE_COMMIT_DELAY after it happens, so quick toggles cost one write.
+ */
+
+#include "control_state.h"
+#include "state_store.h"
+
+static bool savedPump = false;
+static bool savedAutomatic = true;
+static int pumpSlot = -1;
+static int automaticSlot = -1;
+
+// Load the last persisted pump and mode state
+bool loadControlState(bool* pump, bool* automatic) {
+  savedPump = *pump;
+  savedAutomatic = *automatic;
+  pumpSlot = registerState("control", "pump", STATE_BOOL, &savedPump, sizeof(savedPump), STATE_COMMIT_DELAY);
+  automaticSlot = registerState("control", "automatic", STATE_BOOL, &savedAutomatic, sizeof(savedAutomatic),
+                                STATE_COMMIT_DELAY);
+  
+  bool found = isStateStored(automaticSlot);
+  if (found) {
+    *pump = savedPump;
+    *automatic = savedAutomatic;
+  }
+  return found;
+}
+
+// Persist the pump and mode state
+void saveControlState(bool pump, bool automatic) {
+  savedPump = pump;
+  savedAutomatic = automatic;
+}
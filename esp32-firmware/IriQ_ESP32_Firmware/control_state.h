@@ -0,0 +1,18 @@
+/*
+ * IriQ Smart Irrigation System - Control State Header
+ * 
+ * Header file for persisting the pump and mode state across reboots.
+ */
+
+#ifndef CONTROL_STATE_H
+#define CONTROL_STATE_H
+
+#include <Arduino.h>
+
+// Load the last persisted pump and mode state; returns false if none is stored
+bool loadControlState(bool* pump, bool* automatic);
+
+// Persist the pump and mode state (flash is only written when it changed)
+void saveControlState(bool pump, bool automatic);
+
+#endif // CONTROL_STATE_H
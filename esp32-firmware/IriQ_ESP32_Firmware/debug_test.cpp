@@ -43,7 +43,7 @@ bool testSensorReadingsTable() {
   Serial.println("[DEBUG TEST] GET URL: " + url);
   http.begin(url);
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   
   Serial.println("[DEBUG TEST] Sending GET request to check table structure...");
   int httpResponseCode = http.GET();
@@ -92,7 +92,7 @@ bool testSensorInsert() {
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   Serial.println("[DEBUG TEST] Sending POST request with test data...");
@@ -38,7 +38,7 @@ bool testDeviceStatusTable() {
   Serial.println("[DEVICE STATUS TEST] GET URL: " + url);
   http.begin(url);
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   
   int httpResponseCode = http.GET();
   
@@ -78,7 +78,7 @@ bool testDeviceStatusInsert() {
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   int httpResponseCode = http.POST(jsonPayload);
@@ -100,7 +100,7 @@ bool testDeviceStatusInsert() {
     http.begin(patchUrl);
     http.addHeader("Content-Type", "application/json");
     http.addHeader("apikey", supabaseKey);
-    http.addHeader("Authorization", "Bearer " + getAuthToken());
+    http.addHeader("Authorization", getAuthHeader());
     http.addHeader("Prefer", "return=minimal");
     int httpResponseCode2 = http.PATCH(jsonPayload);
     
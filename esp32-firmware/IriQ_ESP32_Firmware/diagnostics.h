@@ -34,7 +34,7 @@ bool checkTableStructure(const char* tableName) {
   String url = String(supabaseUrl) + "/rest/v1/" + tableName + "?limit=1";
   http.begin(url);
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   
   int httpResponseCode = http.GET();
   bool success = false;
@@ -111,7 +111,7 @@ void runDiagnostics() {
   http.begin(String(supabaseUrl) + "/rest/v1/device_heartbeats");
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   int httpResponseCode = http.POST(jsonPayload);
@@ -0,0 +1,121 @@
+/*
+ * IriQ Smart Irrigation System - ESP-NOW Link Module
+ *
+ * This module implements the radio link over ESP-NOW. Frames arrive in a
+ * WiFi task callback, which only copies them into a small inbox. radioPoll()
+ * hands them to the gateway or node code on the loop task, like the log
+ * ring in logger.cpp. ESP-NOW uses the channel of the station interface,
+ * so nodes must be set to the channel of the gateway's access point
+ * (NODE_WIFI_CHANNEL).
+ */
+
+#include "radio_link.h"
+#include "config.h"
+#include "logger.h"
+#include <WiFi.h>
+#include <esp_now.h>
+
+#define RADIO_MAX_FRAME 64
+
+struct RadioFrame {
+  uint8_t mac[RADIO_MAC_LENGTH];
+  uint8_t length;
+  uint8_t data[RADIO_MAX_FRAME];
+};
+
+const uint8_t radioBroadcastMac[RADIO_MAC_LENGTH] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static portMUX_TYPE inboxMux = portMUX_INITIALIZER_UNLOCKED;
+static RadioFrame inbox[RADIO_INBOX_SIZE];
+static volatile uint8_t inboxHead = 0;
+static volatile uint8_t inboxCount = 0;
+static volatile uint32_t inboxDropped = 0;
+static uint32_t reportedDropped = 0;
+
+// WiFi task: copy the frame and return
+static void onReceive(const uint8_t* mac, const uint8_t* data, int length) {
+  if (length <= 0 || length > RADIO_MAX_FRAME) {
+    return;
+  }
+  portENTER_CRITICAL(&inboxMux);
+  if (inboxCount == RADIO_INBOX_SIZE) {
+    inboxDropped++;
+  } else {
+    RadioFrame& frame = inbox[(inboxHead + inboxCount) % RADIO_INBOX_SIZE];
+    memcpy(frame.mac, mac, RADIO_MAC_LENGTH);
+    memcpy(frame.data, data, length);
+    frame.length = length;
+    inboxCount++;
+  }
+  portEXIT_CRITICAL(&inboxMux);
+}
+
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+static void onReceiveInfo(const esp_now_recv_info_t* info, const uint8_t* data, int length) {
+  onReceive(info->src_addr, data, length);
+}
+#endif
+
+static bool ensurePeer(const uint8_t* mac) {
+  if (esp_now_is_peer_exist(mac)) {
+    return true;
+  }
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, RADIO_MAC_LENGTH);
+  peer.channel = 0;  // Current channel
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+// Start the link on the current WiFi channel
+bool initRadioLink() {
+  if (esp_now_init() != ESP_OK) {
+    LOG_E("ESP-NOW init failed");
+    return false;
+  }
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  esp_now_register_recv_cb(onReceiveInfo);
+#else
+  esp_now_register_recv_cb(onReceive);
+#endif
+  LOG_I("ESP-NOW link up on channel %d", WiFi.channel());
+  return true;
+}
+
+// Send a frame to a peer
+bool radioSend(const uint8_t* mac, const uint8_t* data, size_t length) {
+  if (!ensurePeer(mac)) {
+    LOG_W("ESP-NOW peer table full");
+    return false;
+  }
+  return esp_now_send(mac, data, length) == ESP_OK;
+}
+
+// Deliver the frames received since the last call
+void radioPoll(RadioReceiveCallback callback) {
+  RadioFrame frame;
+  while (true) {
+    portENTER_CRITICAL(&inboxMux);
+    if (inboxCount == 0) {
+      portEXIT_CRITICAL(&inboxMux);
+      break;
+    }
+    frame = inbox[inboxHead];
+    inboxHead = (inboxHead + 1) % RADIO_INBOX_SIZE;
+    inboxCount--;
+    portEXIT_CRITICAL(&inboxMux);
+
+    callback(frame.mac, frame.data, frame.length);
+  }
+
+  if (inboxDropped != reportedDropped) {
+    LOG_W("ESP-NOW inbox full, %lu frames dropped", (unsigned long)(inboxDropped - reportedDropped));
+    reportedDropped = inboxDropped;
+  }
+}
+
+// This radio's address
+void getRadioMac(uint8_t* mac) {
+  WiFi.macAddress(mac);
+}
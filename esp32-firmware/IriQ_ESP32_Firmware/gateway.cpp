@@ -0,0 +1,202 @@
+/*
+ * IriQ Smart Irrigation System - Gateway Module
+ *
+ * This module takes sensor node readings off the radio link. Each node is
+ * known by its MAC and the last sequence number taken from it:
+ * - a newer sequence is acknowledged and queued for upload; a gap counts as
+ *   lost readings
+ * - the same sequence is a repeat after a lost acknowledgement; it is
+ *   acknowledged again but not queued
+ * - an older sequence is a late copy and is dropped
+ * - a node that lost power flags its first frame and starts a new sequence
+ *
+ * Queued readings go up as one multi-row insert when GATEWAY_BATCH_SIZE / 2
+ * have collected or the oldest is GATEWAY_UPLOAD_INTERVAL old. When the
+ * batch is full the oldest reading is dropped. Uploading is left to the
+ * outbound queue, so the host simulation runs this file unchanged.
+ */
+
+#include "gateway.h"
+#include "node_protocol.h"
+#include "logger.h"
+
+// A flagged first frame this close behind the last sequence is a late copy, not a restart
+#define NODE_RESTART_WINDOW 64
+
+struct GatewayNode {
+  uint8_t mac[RADIO_MAC_LENGTH];
+  int16_t lastMoisture;
+  uint16_t batteryMv;
+  uint32_t lastSequence;
+  unsigned long lastSeenAt;
+  uint32_t readings;
+};
+
+static GatewayNode nodes[GATEWAY_MAX_NODES];
+static uint8_t nodeCount = 0;
+static NodeBatch pending;
+static GatewayStats stats;
+
+static GatewayNode* findNode(const uint8_t* mac) {
+  for (int i = 0; i < nodeCount; i++) {
+    if (memcmp(nodes[i].mac, mac, RADIO_MAC_LENGTH) == 0) {
+      return &nodes[i];
+    }
+  }
+  return nullptr;
+}
+
+static void sendAck(const uint8_t* mac, uint32_t sequence) {
+  NodeFrame ack;
+  memset(&ack, 0, sizeof(ack));
+  ack.sequence = sequence;
+  sealNodeFrame(&ack, NODE_FRAME_ACK);
+  radioSend(mac, (const uint8_t*)&ack, sizeof(ack));
+}
+
+static void queueReading(const uint8_t* mac, const NodeFrame& frame) {
+  if (pending.count == GATEWAY_BATCH_SIZE) {
+    memmove(&pending.readings[0], &pending.readings[1], sizeof(NodeReading) * (GATEWAY_BATCH_SIZE - 1));
+    pending.count--;
+    stats.dropped++;
+  }
+  NodeReading& reading = pending.readings[pending.count++];
+  memcpy(reading.mac, mac, RADIO_MAC_LENGTH);
+  reading.moisture = frame.moisture;
+  reading.batteryMv = frame.batteryMv;
+  reading.sequence = frame.sequence;
+  reading.receivedAt = millis();
+  stats.readings++;
+}
+
+static void onGatewayFrame(const uint8_t* mac, const uint8_t* data, size_t length) {
+  stats.framesReceived++;
+  NodeFrame frame;
+  if (!openNodeFrame(data, length, &frame) || frame.type != NODE_FRAME_READING) {
+    stats.framesRejected++;
+    return;
+  }
+
+  GatewayNode* node = findNode(mac);
+  bool restart = false;
+  if (node == nullptr) {
+    if (nodeCount == GATEWAY_MAX_NODES) {
+      // Unacknowledged, so the node keeps trying and shows up in its own counters
+      stats.refused++;
+      return;
+    }
+    node = &nodes[nodeCount++];
+    memset(node, 0, sizeof(*node));
+    memcpy(node->mac, mac, RADIO_MAC_LENGTH);
+    stats.nodes++;
+    restart = true;
+
+    char deviceId[32];
+    formatNodeDeviceId(mac, deviceId, sizeof(deviceId));
+    LOG_I("Sensor node %s joined", deviceId);
+  } else if (frame.flags & NODE_FLAG_FIRST) {
+    uint32_t behind = node->lastSequence - frame.sequence;
+    restart = frame.sequence != node->lastSequence && behind >= NODE_RESTART_WINDOW;
+  }
+
+  if (!restart) {
+    if (frame.sequence == node->lastSequence) {
+      stats.duplicates++;
+      sendAck(mac, frame.sequence);
+      return;
+    }
+    if (!sequenceAfter(frame.sequence, node->lastSequence)) {
+      stats.late++;
+      return;
+    }
+    uint32_t gap = frame.sequence - node->lastSequence;
+    if (gap < NODE_RESTART_WINDOW) {
+      stats.lost += gap - 1;
+    }
+  }
+
+  node->lastSequence = frame.sequence;
+  node->lastSeenAt = millis();
+  node->lastMoisture = frame.moisture;
+  node->batteryMv = frame.batteryMv;
+  node->readings++;
+  sendAck(mac, frame.sequence);
+
+  if (frame.flags & NODE_FLAG_SENSOR_FAULT) {
+    LOG_W("Sensor node reading %lu has no moisture value", (unsigned long)frame.sequence);
+    return;
+  }
+  queueReading(mac, frame);
+}
+
+// Clear the node table and the pending batch
+void initGateway() {
+  memset(nodes, 0, sizeof(nodes));
+  nodeCount = 0;
+  memset(&pending, 0, sizeof(pending));
+  memset(&stats, 0, sizeof(stats));
+}
+
+// Take frames from the radio, acknowledge and queue new readings
+void gatewayLoop() {
+  radioPoll(onGatewayFrame);
+}
+
+// True when the pending batch is full enough or old enough to upload
+bool gatewayBatchDue() {
+  return pending.count >= GATEWAY_BATCH_SIZE / 2 ||
+         (pending.count > 0 && millis() - pending.readings[0].receivedAt >= GATEWAY_UPLOAD_INTERVAL);
+}
+
+// Copy the pending readings
+bool getGatewayBatch(NodeBatch* batch) {
+  batch->count = pending.count;
+  memcpy(batch->readings, pending.readings, sizeof(NodeReading) * pending.count);
+  return batch->count > 0;
+}
+
+// Drop the readings an uploaded batch covered
+void markGatewayBatchUploaded(const NodeBatch& batch) {
+  stats.batches++;
+  stats.rows += batch.count;
+  if (batch.count == 0) {
+    return;
+  }
+
+  // Readings dropped from a full batch during the upload shifted the rest,
+  // so cut after the batch's last reading rather than after batch.count
+  const NodeReading& last = batch.readings[batch.count - 1];
+  int uploaded = 0;
+  for (int i = 0; i < pending.count; i++) {
+    if (pending.readings[i].sequence == last.sequence && memcmp(pending.readings[i].mac, last.mac, RADIO_MAC_LENGTH) == 0) {
+      uploaded = i + 1;
+      break;
+    }
+  }
+  memmove(&pending.readings[0], &pending.readings[uploaded], sizeof(NodeReading) * (pending.count - uploaded));
+  pending.count -= uploaded;
+}
+
+// The Supabase device_id of a node
+void formatNodeDeviceId(const uint8_t* mac, char* deviceId, size_t size) {
+  snprintf(deviceId, size, "%s%02X%02X%02X%02X%02X%02X", NODE_DEVICE_PREFIX, mac[0], mac[1], mac[2], mac[3], mac[4],
+           mac[5]);
+}
+
+// Counters since boot
+GatewayStats getGatewayStats() {
+  return stats;
+}
+
+// Print the node table
+void printGatewayNodes() {
+  LOG_I("Gateway: %u nodes, %u readings pending upload", nodeCount, pending.count);
+  for (int i = 0; i < nodeCount; i++) {
+    const GatewayNode& node = nodes[i];
+    char deviceId[32];
+    formatNodeDeviceId(node.mac, deviceId, sizeof(deviceId));
+    LOG_I("  %s: moisture %d%%, battery %u mV, sequence %lu, %lu readings, seen %lu s ago", deviceId,
+          node.lastMoisture, node.batteryMv, (unsigned long)node.lastSequence, (unsigned long)node.readings,
+          (millis() - node.lastSeenAt) / 1000);
+  }
+}
@@ -0,0 +1,70 @@
+/*
+ * IriQ Smart Irrigation System - Gateway Header
+ *
+ * Header file for the ESP-NOW gateway (ESPNOW_GATEWAY_ENABLED): the
+ * controller takes readings from battery sensor nodes, acknowledges them and
+ * uploads them to Supabase in batches over its own connection.
+ */
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "radio_link.h"
+
+// A node reading waiting for upload
+struct NodeReading {
+  uint8_t mac[RADIO_MAC_LENGTH];
+  int16_t moisture;
+  uint16_t batteryMv;
+  uint32_t sequence;
+  unsigned long receivedAt;  // millis()
+};
+
+// Readings for one multi-row insert
+struct NodeBatch {
+  NodeReading readings[GATEWAY_BATCH_SIZE];
+  uint8_t count;
+};
+
+// Counters since boot
+struct GatewayStats {
+  uint32_t nodes;           // Nodes heard
+  uint32_t framesReceived;
+  uint32_t framesRejected;  // Foreign, corrupt or unexpected frames
+  uint32_t readings;        // New readings queued for upload
+  uint32_t duplicates;      // Repeats of a reading already queued
+  uint32_t late;            // Older than the node's newest reading
+  uint32_t lost;            // Gaps in the nodes' sequence numbers
+  uint32_t dropped;         // Oldest readings dropped from a full batch
+  uint32_t refused;         // Readings from nodes beyond GATEWAY_MAX_NODES
+  uint32_t batches;         // Batches uploaded
+  uint32_t rows;            // Readings uploaded
+};
+
+// Clear the node table and the pending batch
+void initGateway();
+
+// Take frames from the radio, acknowledge and queue new readings (gateway task)
+void gatewayLoop();
+
+// True when the pending batch is full enough or old enough to upload
+bool gatewayBatchDue();
+
+// Copy the pending readings; false when there are none
+bool getGatewayBatch(NodeBatch* batch);
+
+// Drop the readings an uploaded batch covered
+void markGatewayBatchUploaded(const NodeBatch& batch);
+
+// The Supabase device_id of a node: NODE_DEVICE_PREFIX and its MAC in hex
+void formatNodeDeviceId(const uint8_t* mac, char* deviceId, size_t size);
+
+// Counters since boot
+GatewayStats getGatewayStats();
+
+// Print the node table on the serial console
+void printGatewayNodes();
+
+#endif // GATEWAY_H
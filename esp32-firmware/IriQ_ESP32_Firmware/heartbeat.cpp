@@ -5,61 +5,64 @@
  */
 
 #include "supabase_api.h"
+#include "config.h"
+
+// With USE_MQTT_TRANSPORT presence comes from the broker session (mqtt_transport.cpp)
+#if !USE_MQTT_TRANSPORT
+
 #include "auth.h"
-#include <HTTPClient.h>
+#include "logger.h"
+#include "telemetry.h"
+#include "api_client.h"
+#include "memory_pool.h"
 #include <ArduinoJson.h>
 
 // External variables
-extern const char* supabaseUrl;
-extern const char* supabaseKey;
 extern String deviceId;
 
-// Send heartbeat to Supabase to indicate device is online
+// Send heartbeat to Supabase to indicate device is online.
+// Upserts the device's single device_presence row; the server stamps
+// last_seen and samples heartbeats into the device_heartbeats history.
 bool sendHeartbeat() {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot send heartbeat: WiFi not connected");
+    LOG_D("Cannot send heartbeat: WiFi not connected");
     return false;
   }
   
   // Ensure we have a valid authentication token
   if (!isAuthenticated()) {
-    Serial.println("Cannot send heartbeat: Authentication failed");
+    LOG_W("Cannot send heartbeat: Authentication failed");
     return false;
   }
   
-  Serial.println("Sending heartbeat to Supabase...");
-  
   // Create JSON payload
-  DynamicJsonDocument doc(1024);
+  ArenaJsonDocument doc(3072);
   doc["device_id"] = deviceId;
-  doc["last_seen"] = getISOTime();
   doc["status"] = "active";
   
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
+  // Attach device metrics every TELEMETRY_INTERVAL
+  bool includesMetrics = isTelemetryDue();
+  if (includesMetrics) {
+    appendTelemetry(doc.createNestedObject("metrics"));
+  }
   
-  // Send HTTP POST request to Supabase
-  HTTPClient http;
-  http.begin(String(supabaseUrl) + "/rest/v1/device_heartbeats");
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  http.addHeader("Prefer", "return=minimal");
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
   
-  int httpResponseCode = http.POST(jsonPayload);
-  bool success = false;
+  // Send HTTP POST request to Supabase
+  ApiResponse response = apiRequest(ENDPOINT_HEARTBEATS, "POST", "device_presence?on_conflict=device_id",
+                                    jsonPayload.c_str(), API_UPSERT | API_RETURN_MINIMAL);
   
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    Serial.println("Heartbeat sent successfully. HTTP Response code: " + String(httpResponseCode));
-    success = true;
-  } else if (httpResponseCode == 401 || httpResponseCode == 403) {
-    // Authentication error - try to refresh token
-    Serial.println("Authentication error. Clearing token and will retry next time.");
-    clearAuth();
-  } else {
-    Serial.println("Error sending heartbeat. HTTP Response code: " + String(httpResponseCode));
+  if (response.ok()) {
+    LOG_V("Heartbeat sent (HTTP %d)", response.statusCode);
+    if (includesMetrics) {
+      markTelemetrySent();
+    }
+  } else if (response.sent) {
+    LOG_W("Error sending heartbeat (HTTP %d)", response.statusCode);
   }
   
-  http.end();
-  return success;
+  return response.ok();
 }
+
+#endif // !USE_MQTT_TRANSPORT
@@ -0,0 +1,288 @@
+/*
+ * IriQ Smart Irrigation System - Irrigation Schedule Module
+ *
+ * This module runs watering windows on the device. The dashboard edits
+ * irrigation_schedules. A trigger compiles the enabled rows into a
+ * versioned row of device_schedules. The settings task fetches that row
+ * only when its version differs from the one stored in NVS, so an
+ * unchanged schedule costs one small request per SETTINGS_CHECK_INTERVAL.
+ *
+ * Every SCHEDULE_CHECK_INTERVAL the schedule task checks the device clock
+ * against the windows:
+ * - in manual mode, the pump is turned on when a window opens and off when
+ *   it closes; automatic mode waters by moisture alone
+ * - a window with a moisture condition is skipped when the soil is already
+ *   at or above it, and its run ends early once the soil gets there
+ * - turning the pump off by command cancels the run for that window
+ *
+ * The current run is kept in NVS, so a reset neither repeats a cancelled
+ * run nor leaves the pump on past the end of its window. Without a set
+ * clock no run starts, and a run in progress is paused until the time is
+ * known again.
+ */
+
+#include "irrigation_schedule.h"
+#include "logger.h"
+#include "supabase_api.h"
+#include "api_client.h"
+#include "memory_pool.h"
+#include "state_store.h"
+#include <time.h>
+
+#define SCHEDULE_MAGIC 0x49515331  // "IQS1"
+#define SECONDS_PER_DAY 86400UL
+
+// External variables
+extern String deviceId;
+extern bool pumpStatus;
+extern bool automaticMode;
+extern int moistureLevel;
+
+// Persisted as one blob
+struct ScheduleStore {
+  uint32_t magic;
+  uint32_t version;
+  int16_t utcOffsetMinutes;
+  uint8_t count;
+  ScheduleEntry entries[SCHEDULE_MAX_ENTRIES];
+};
+
+enum ScheduleRunState : uint8_t {
+  RUN_NONE,
+  RUN_ACTIVE,
+  RUN_DONE  // Completed, cancelled or skipped
+};
+
+// The latest window acted on
+struct ScheduleRun {
+  uint8_t state;
+  int8_t moistureBelow;
+  uint32_t windowStart;  // UTC epoch seconds
+  uint32_t endsAt;
+};
+
+static ScheduleStore store;
+static ScheduleRun run;
+static int storeSlot = -1;
+static int runSlot = -1;
+static bool runPaused = false;
+static ScheduleControlCallback controlCallback = nullptr;
+
+// Statistics
+static uint32_t runsStarted = 0;
+static uint32_t runsCompleted = 0;
+static uint32_t runsCancelled = 0;
+static uint32_t windowsSkippedWet = 0;
+
+static void saveRun() {
+  requestStateCommit(runSlot);
+}
+
+static void finishRun() {
+  run.state = RUN_DONE;
+  runPaused = false;
+  saveRun();
+}
+
+// Start of the window of entry that contains now (UTC epoch), or 0
+static uint32_t openWindow(const ScheduleEntry& entry, uint32_t now) {
+  int32_t offset = (int32_t)store.utcOffsetMinutes * 60;
+  uint32_t local = now + offset;
+  uint32_t midnight = local - local % SECONDS_PER_DAY;
+
+  // Today's window, or yesterday's if it runs past midnight
+  for (int back = 0; back < 2; back++) {
+    uint32_t day = midnight - back * SECONDS_PER_DAY;
+    uint32_t start = day + entry.startMinute * 60UL;
+    int weekday = (day / SECONDS_PER_DAY + 4) % 7;  // 1970-01-01 was a Thursday
+    if ((entry.days & (1 << weekday)) && local >= start && local < start + entry.durationMin * 60UL) {
+      return start - offset;
+    }
+  }
+  return 0;
+}
+
+// Load the schedule last received from Supabase
+void initIrrigationSchedule(ScheduleControlCallback callback) {
+  controlCallback = callback;
+  memset(&store, 0, sizeof(store));
+  memset(&run, 0, sizeof(run));
+
+  storeSlot = registerState("schedule", "store", STATE_BYTES, &store, sizeof(store), STATE_COMMIT_DELAY);
+  runSlot = registerState("schedule", "run", STATE_BYTES, &run, sizeof(run), STATE_COMMIT_DELAY);
+  if (store.magic != SCHEDULE_MAGIC || store.count > SCHEDULE_MAX_ENTRIES) {
+    memset(&store, 0, sizeof(store));
+    clearState(storeSlot);
+  }
+
+  if (store.count > 0) {
+    LOG_I("Irrigation schedule version %lu: %u windows%s", (unsigned long)store.version, store.count,
+          run.state == RUN_ACTIVE ? ", run in progress" : "");
+  }
+}
+
+// Start and stop scheduled runs
+void irrigationScheduleLoop() {
+  time_t clock = time(nullptr);
+  if (clock < 1600000000) {
+    // A run cannot be ended on time without the clock
+    if (run.state == RUN_ACTIVE && !runPaused) {
+      runPaused = true;
+      if (pumpStatus && !automaticMode) {
+        LOG_W("Clock not set, pausing the scheduled run");
+        controlCallback(false, false);
+      }
+    }
+    return;
+  }
+  uint32_t now = (uint32_t)clock;
+
+  if (run.state == RUN_ACTIVE) {
+    bool wet = run.moistureBelow >= 0 && moistureLevel >= run.moistureBelow;
+    if (automaticMode) {
+      LOG_I("Scheduled run handed over to automatic mode");
+      runsCancelled++;
+      finishRun();
+    } else if (now >= run.endsAt || wet) {
+      if (pumpStatus) {
+        controlCallback(false, false);
+      }
+      LOG_I("Scheduled run finished%s", wet ? " early, soil wet enough" : "");
+      runsCompleted++;
+      finishRun();
+    } else if (runPaused) {
+      LOG_I("Clock set, resuming the scheduled run for %lu s", (unsigned long)(run.endsAt - now));
+      runPaused = false;
+      controlCallback(true, false);
+    } else if (!pumpStatus) {
+      LOG_I("Scheduled run cancelled");
+      runsCancelled++;
+      finishRun();
+    }
+    return;
+  }
+
+  // Automatic mode waters by moisture alone; a manual run keeps the window waiting
+  if (automaticMode || pumpStatus) {
+    return;
+  }
+
+  for (int i = 0; i < store.count; i++) {
+    const ScheduleEntry& entry = store.entries[i];
+    uint32_t windowStart = openWindow(entry, now);
+    // Windows that opened before the last run are taken care of, overlapping ones included
+    if (windowStart == 0 || (run.state == RUN_DONE && windowStart <= run.windowStart)) {
+      continue;
+    }
+
+    run.windowStart = windowStart;
+    run.endsAt = windowStart + entry.durationMin * 60UL;
+    run.moistureBelow = entry.moistureBelow;
+
+    if (entry.moistureBelow >= 0 && moistureLevel >= entry.moistureBelow) {
+      LOG_I("Skipping scheduled run, moisture %d%% is not below %d%%", moistureLevel, entry.moistureBelow);
+      windowsSkippedWet++;
+      finishRun();
+      continue;
+    }
+
+    LOG_I("Starting scheduled run for %lu s", (unsigned long)(run.endsAt - now));
+    run.state = RUN_ACTIVE;
+    saveRun();
+    runsStarted++;
+    controlCallback(true, false);
+    return;
+  }
+}
+
+// Fetch the device's schedule if its version changed
+void fetchIrrigationSchedule() {
+  if (WiFi.status() != WL_CONNECTED || !ensureValidAuth()) {
+    return;
+  }
+
+  // Only a changed version returns a row
+  ArenaString path(112 + deviceId.length());
+  path += "device_schedules?select=version,utc_offset_minutes,entries&device_id=eq.";
+  path += deviceId;
+  path += "&version=neq.";
+  path += (unsigned long)store.version;
+  ApiResponse response = apiRequest(ENDPOINT_DEVICE_SCHEDULES, "GET", path.c_str(), "", API_READ_BODY);
+  if (!response.ok()) {
+    if (response.sent) {
+      LOG_W("Error fetching irrigation schedule (HTTP %d)", response.statusCode);
+    }
+    return;
+  }
+
+  ArenaJsonDocument doc(1024);
+  DeserializationError error = deserializeJson(doc, response.body.data(), response.body.length());
+  if (error) {
+    LOG_W("Error parsing irrigation schedule: %s", error.c_str());
+    return;
+  }
+
+  JsonObject row = doc[0];
+  if (row.isNull()) {
+    return;
+  }
+
+  ScheduleStore received;
+  memset(&received, 0, sizeof(received));
+  received.magic = SCHEDULE_MAGIC;
+  received.version = row["version"] | 0UL;
+  received.utcOffsetMinutes = row["utc_offset_minutes"] | 0;
+
+  // Each entry is [start_minute, duration_minutes, days, moisture_below or null]
+  for (JsonArray window : row["entries"].as<JsonArray>()) {
+    int startMinute = window[0] | -1;
+    int durationMin = window[1] | 0;
+    int days = window[2] | 0;
+    int moistureBelow = window[3].isNull() ? -1 : window[3].as<int>();
+    if (startMinute < 0 || startMinute >= 1440 || durationMin < 1 || durationMin > 1440 || days < 1 ||
+        days > 127 || moistureBelow < -1 || moistureBelow > 100) {
+      LOG_W("Ignoring schedule window %d+%d min, days %d", startMinute, durationMin, days);
+      continue;
+    }
+    if (received.count == SCHEDULE_MAX_ENTRIES) {
+      LOG_W("Schedule has more than %d windows, ignoring the rest", SCHEDULE_MAX_ENTRIES);
+      break;
+    }
+    ScheduleEntry& entry = received.entries[received.count++];
+    entry.startMinute = startMinute;
+    entry.durationMin = durationMin;
+    entry.days = days;
+    entry.moistureBelow = moistureBelow;
+  }
+
+  store = received;
+  requestStateCommit(storeSlot);
+  LOG_I("Irrigation schedule version %lu: %u windows, UTC%+d min", (unsigned long)store.version, store.count,
+        store.utcOffsetMinutes);
+}
+
+// Print the schedule and the current run
+void printIrrigationSchedule() {
+  LOG_I("Irrigation schedule version %lu, UTC%+d min, %u windows%s", (unsigned long)store.version,
+        store.utcOffsetMinutes, store.count, automaticMode ? " (inactive in automatic mode)" : "");
+  for (int i = 0; i < store.count; i++) {
+    const ScheduleEntry& entry = store.entries[i];
+    LOG_I("  %02u:%02u for %u min, days 0x%02x, moisture below %d", entry.startMinute / 60, entry.startMinute % 60,
+          entry.durationMin, entry.days, entry.moistureBelow);
+  }
+  if (run.state == RUN_ACTIVE) {
+    LOG_I("Run in progress until %lu%s", (unsigned long)run.endsAt, runPaused ? " (paused, clock not set)" : "");
+  }
+}
+
+// Add schedule state and counters to a telemetry object
+void appendScheduleMetrics(JsonObject metrics) {
+  JsonObject schedule = metrics.createNestedObject("schedule");
+  schedule["version"] = store.version;
+  schedule["windows"] = store.count;
+  schedule["running"] = run.state == RUN_ACTIVE && !runPaused;
+  schedule["runs"] = runsStarted;
+  schedule["completed"] = runsCompleted;
+  schedule["cancelled"] = runsCancelled;
+  schedule["skipped_wet"] = windowsSkippedWet;
+}
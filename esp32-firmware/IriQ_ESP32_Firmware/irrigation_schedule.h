@@ -0,0 +1,42 @@
+/*
+ * IriQ Smart Irrigation System - Irrigation Schedule Header
+ *
+ * Header file for the on-device irrigation schedule: watering windows
+ * synced from Supabase, kept in NVS and run from the device clock, so
+ * scheduled watering needs neither the dashboard nor the network.
+ */
+
+#ifndef IRRIGATION_SCHEDULE_H
+#define IRRIGATION_SCHEDULE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// One watering window
+struct ScheduleEntry {
+  uint16_t startMinute;   // Minute of the local day the run starts
+  uint16_t durationMin;   // Run length in minutes
+  uint8_t days;           // Bit 0 = Sunday ... bit 6 = Saturday
+  int8_t moistureBelow;   // Run only while moisture is below this, -1 = always
+};
+
+// Applies a requested pump/mode state; the same path dashboard commands use
+typedef void (*ScheduleControlCallback)(bool pumpControl, bool automaticMode);
+
+// Load the schedule last received from Supabase
+void initIrrigationSchedule(ScheduleControlCallback callback);
+
+// Start and stop scheduled runs (schedule task)
+void irrigationScheduleLoop();
+
+// Fetch the device's schedule if its version changed (settings task)
+void fetchIrrigationSchedule();
+
+// Print the schedule and the current run on the serial console
+void printIrrigationSchedule();
+
+// Add schedule state and counters to a telemetry object
+void appendScheduleMetrics(JsonObject metrics);
+
+#endif // IRRIGATION_SCHEDULE_H
@@ -0,0 +1,342 @@
+/*
+ * IriQ Smart Irrigation System - Local API Module
+ *
+ * This module serves the LAN control API with ESPAsyncWebServer:
+ * - GET  /api/state    latest sample, pump and mode state
+ * - POST /api/control  pump_control / automatic_mode form or query fields
+ * - WS   /ws           streams every sample; accepts the same control as JSON
+ *
+ * Requests carry LOCAL_API_TOKEN as a Bearer token (or ?token= for the
+ * WebSocket, which browsers cannot give headers). Handlers run on the
+ * AsyncTCP task, so they never touch the relay: a control request is left in
+ * a one-slot mailbox and applied by localApiLoop() on the loop task.
+ *
+ * A local action is reconciled to Supabase later through the
+ * record_local_control RPC, which stores it as an executed command and
+ * supersedes dashboard commands that were older than it. The newest
+ * unreported action is kept in NVS so it survives a reboot.
+ */
+
+#include "local_api.h"
+#include "config.h"
+
+#if LOCAL_API_ENABLED
+
+#include "api_client.h"
+#include "memory_pool.h"
+#include "logger.h"
+#include "state_store.h"
+#include <WiFi.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
+#include <time.h>
+
+// External variables from main file
+extern String deviceId;
+extern bool pumpStatus;
+extern bool automaticMode;
+
+static AsyncWebServer localServer(LOCAL_API_PORT);
+static AsyncWebSocket localSocket("/ws");
+static LocalControlCallback controlCallback = nullptr;
+
+// Shared with the AsyncTCP task
+static portMUX_TYPE localMux = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+  int moisture;
+  bool pump;
+  bool automatic;
+  unsigned long sampledAt;
+  bool uplink;  // Local actions can be reported to Supabase
+} snapshot = { -1, false, true, 0, false };
+static struct {
+  bool pending;
+  bool pumpControl;
+  bool automaticMode;
+} mailbox = { false, false, true };
+static uint32_t localRequests = 0;
+static uint32_t localRejected = 0;
+
+// Loop task only; the sync fields are persisted by the state store
+static bool syncPending = false;
+static bool syncPump = false;
+static bool syncAutomatic = true;
+static unsigned long syncActionMillis = 0;  // 0 when the action happened before this boot
+static uint32_t syncEpoch = 0;              // Wall-clock time of the action, 0 if the clock was not set
+static unsigned long lastSyncAttempt = 0;
+static uint32_t localActions = 0;
+static uint32_t localSynced = 0;
+
+static bool isTimeSet() {
+  return time(nullptr) > 1600000000;
+}
+
+// Compare without an early exit so timing does not reveal the token prefix
+static bool tokenMatches(const String& token) {
+  const char* expected = LOCAL_API_TOKEN;
+  size_t expectedLength = strlen(expected);
+  uint8_t diff = token.length() != expectedLength;
+  for (size_t i = 0; i < expectedLength; i++) {
+    diff |= (uint8_t)(i < token.length() ? token[i] : 0) ^ (uint8_t)expected[i];
+  }
+  return diff == 0;
+}
+
+static bool isAuthorized(AsyncWebServerRequest* request) {
+  String token;
+  if (request->hasHeader("Authorization")) {
+    String header = request->getHeader("Authorization")->value();
+    if (header.startsWith("Bearer ")) {
+      token = header.substring(7);
+    }
+  } else if (request->hasParam("token")) {
+    token = request->getParam("token")->value();
+  }
+
+  bool authorized = token.length() > 0 && tokenMatches(token);
+  portENTER_CRITICAL(&localMux);
+  localRequests++;
+  if (!authorized) {
+    localRejected++;
+  }
+  portEXIT_CRITICAL(&localMux);
+  return authorized;
+}
+
+static String stateJson(const char* type) {
+  portENTER_CRITICAL(&localMux);
+  int moisture = snapshot.moisture;
+  bool pump = snapshot.pump;
+  bool automatic = snapshot.automatic;
+  unsigned long age = millis() - snapshot.sampledAt;
+  bool uplink = snapshot.uplink;
+  portEXIT_CRITICAL(&localMux);
+
+  DynamicJsonDocument doc(384);
+  if (type != nullptr) {
+    doc["type"] = type;
+  }
+  doc["device_id"] = deviceId;
+  if (moisture >= 0) {
+    doc["moisture_percentage"] = moisture;
+    doc["moisture_digital"] = (moisture < MOISTURE_THRESHOLD);
+    doc["sample_age_ms"] = age;
+  }
+  doc["pump_status"] = pump;
+  doc["automatic_mode"] = automatic;
+  doc["uplink"] = uplink;
+
+  String json;
+  serializeJson(doc, json);
+  return json;
+}
+
+// Leave a control request for the loop task; fields left out keep their state
+static void queueControl(int pump, int automatic) {
+  portENTER_CRITICAL(&localMux);
+  mailbox.pumpControl = pump >= 0 ? pump == 1 : snapshot.pump;
+  mailbox.automaticMode = automatic >= 0 ? automatic == 1 : snapshot.automatic;
+  mailbox.pending = true;
+  portEXIT_CRITICAL(&localMux);
+}
+
+// -1 when the field is missing, otherwise 0 or 1
+static int boolParam(AsyncWebServerRequest* request, const char* name) {
+  const AsyncWebParameter* param = nullptr;
+  if (request->hasParam(name, true)) {
+    param = request->getParam(name, true);
+  } else if (request->hasParam(name)) {
+    param = request->getParam(name);
+  }
+  if (param == nullptr) {
+    return -1;
+  }
+  String value = param->value();
+  return (value == "true" || value == "1" || value == "on") ? 1 : 0;
+}
+
+static void onSocketEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg,
+                          uint8_t* data, size_t len) {
+  if (type == WS_EVT_CONNECT) {
+    client->text(stateJson("state"));
+    return;
+  }
+  if (type != WS_EVT_DATA) {
+    return;
+  }
+
+  // Control messages are small: only whole, unfragmented text frames
+  AwsFrameInfo* info = (AwsFrameInfo*)arg;
+  if (!info->final || info->index != 0 || info->len != len || info->opcode != WS_TEXT) {
+    return;
+  }
+  DynamicJsonDocument doc(256);
+  if (deserializeJson(doc, (const char*)data, len)) {
+    client->text("{\"type\":\"error\",\"message\":\"Invalid JSON\"}");
+    return;
+  }
+  JsonVariant pump = doc["pump_control"];
+  JsonVariant automatic = doc["automatic_mode"];
+  queueControl(pump.is<bool>() ? (int)pump.as<bool>() : -1, automatic.is<bool>() ? (int)automatic.as<bool>() : -1);
+}
+
+// Keep the newest unreported action, in RAM and NVS
+static void recordLocalAction(bool pump, bool automatic) {
+  syncPending = true;
+  syncPump = pump;
+  syncAutomatic = automatic;
+  syncActionMillis = millis();
+  syncEpoch = isTimeSet() ? (uint32_t)time(nullptr) : 0;
+  localActions++;
+}
+
+// Report the pending local action; the server places it in the command
+// history at (now - age) so it supersedes only older dashboard commands
+static bool syncLocalAction() {
+  uint32_t ageMs = 0;
+  if (syncEpoch != 0 && isTimeSet()) {
+    ageMs = ((uint32_t)time(nullptr) - syncEpoch) * 1000UL;
+  } else if (syncActionMillis != 0) {
+    ageMs = millis() - syncActionMillis;
+  }
+
+  ArenaJsonDocument doc(256);
+  doc["p_device_id"] = deviceId;
+  doc["p_pump_control"] = syncPump;
+  doc["p_automatic_mode"] = syncAutomatic;
+  doc["p_age_ms"] = ageMs;
+
+  ArenaString payload(measureJson(doc) + 1);
+  payload.assignJson(doc);
+  ApiResponse response = apiRequest(ENDPOINT_LOCAL_CONTROL, "POST", "rpc/record_local_control", payload.c_str());
+  if (!response.ok()) {
+    if (response.sent) {
+      LOG_W("Error reporting local action (HTTP %d)", response.statusCode);
+    }
+    return false;
+  }
+
+  syncPending = false;
+  localSynced++;
+  LOG_I("Local action reported (pump %s, mode %s, %lu ms ago)", syncPump ? "ON" : "OFF",
+        syncAutomatic ? "AUTOMATIC" : "MANUAL", (unsigned long)ageMs);
+  return true;
+}
+
+void initLocalApi(LocalControlCallback callback) {
+  controlCallback = callback;
+
+  registerState("localsync", "pending", STATE_BOOL, &syncPending, sizeof(syncPending), STATE_COMMIT_DELAY);
+  registerState("localsync", "pump", STATE_BOOL, &syncPump, sizeof(syncPump), STATE_COMMIT_DELAY);
+  registerState("localsync", "automatic", STATE_BOOL, &syncAutomatic, sizeof(syncAutomatic), STATE_COMMIT_DELAY);
+  registerState("localsync", "epoch", STATE_U32, &syncEpoch, sizeof(syncEpoch), STATE_COMMIT_DELAY);
+  if (syncPending) {
+    LOG_I("Local action from before reboot still to be reported");
+  }
+
+  localServer.on("/api/state", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (!isAuthorized(request)) {
+      request->send(401, "application/json", "{\"message\":\"Invalid token\"}");
+      return;
+    }
+    request->send(200, "application/json", stateJson(nullptr));
+  });
+
+  localServer.on("/api/control", HTTP_POST, [](AsyncWebServerRequest* request) {
+    if (!isAuthorized(request)) {
+      request->send(401, "application/json", "{\"message\":\"Invalid token\"}");
+      return;
+    }
+    int pump = boolParam(request, "pump_control");
+    int automatic = boolParam(request, "automatic_mode");
+    if (pump < 0 && automatic < 0) {
+      request->send(400, "application/json", "{\"message\":\"Expected pump_control and/or automatic_mode\"}");
+      return;
+    }
+    queueControl(pump, automatic);
+    // Applied on the next loop pass; the result is streamed on /ws
+    request->send(202, "application/json", "{\"accepted\":true}");
+  });
+
+  localSocket.handleHandshake([](AsyncWebServerRequest* request) { return isAuthorized(request); });
+  localSocket.onEvent(onSocketEvent);
+  localServer.addHandler(&localSocket);
+
+  localServer.onNotFound([](AsyncWebServerRequest* request) {
+    request->send(404, "application/json", "{\"message\":\"Not found\"}");
+  });
+  localServer.begin();
+  LOG_I("Local API listening on port %d", LOCAL_API_PORT);
+}
+
+void localApiLoop() {
+  bool pending;
+  bool requestedPump;
+  bool requestedAutomatic;
+  portENTER_CRITICAL(&localMux);
+  pending = mailbox.pending;
+  requestedPump = mailbox.pumpControl;
+  requestedAutomatic = mailbox.automaticMode;
+  mailbox.pending = false;
+  portEXIT_CRITICAL(&localMux);
+
+  if (pending && controlCallback != nullptr) {
+    LOG_I("Local control: pump %s, mode %s", requestedPump ? "ON" : "OFF", requestedAutomatic ? "AUTOMATIC" : "MANUAL");
+    controlCallback(requestedPump, requestedAutomatic);
+    recordLocalAction(requestedPump, requestedAutomatic);
+    lastSyncAttempt = 0;
+
+    // Show the result right away rather than at the next sample
+    portENTER_CRITICAL(&localMux);
+    snapshot.pump = pumpStatus;
+    snapshot.automatic = automaticMode;
+    portEXIT_CRITICAL(&localMux);
+    if (localSocket.count() > 0) {
+      localSocket.textAll(stateJson("state"));
+    }
+  }
+
+  // Report as soon as Supabase is reachable, retrying while the uplink is down
+  if (syncPending && WiFi.status() == WL_CONNECTED &&
+      (lastSyncAttempt == 0 || millis() - lastSyncAttempt >= LOCAL_SYNC_RETRY)) {
+    lastSyncAttempt = millis();
+    syncLocalAction();
+  }
+
+  // Breaker state is read here, on the loop task, for the handlers
+  bool uplink = WiFi.status() == WL_CONNECTED && !isEndpointOpen(ENDPOINT_LOCAL_CONTROL);
+  portENTER_CRITICAL(&localMux);
+  snapshot.uplink = uplink;
+  portEXIT_CRITICAL(&localMux);
+
+  localSocket.cleanupClients(LOCAL_API_MAX_CLIENTS);
+}
+
+void publishLocalSample(int moistureLevel, bool pump, bool automatic) {
+  portENTER_CRITICAL(&localMux);
+  snapshot.moisture = moistureLevel;
+  snapshot.pump = pump;
+  snapshot.automatic = automatic;
+  snapshot.sampledAt = millis();
+  portEXIT_CRITICAL(&localMux);
+
+  if (localSocket.count() > 0) {
+    localSocket.textAll(stateJson("sample"));
+  }
+}
+
+void appendLocalApiMetrics(JsonObject metrics) {
+  portENTER_CRITICAL(&localMux);
+  uint32_t requests = localRequests;
+  uint32_t rejected = localRejected;
+  portEXIT_CRITICAL(&localMux);
+
+  metrics["local_requests"] = requests;
+  metrics["local_rejected"] = rejected;
+  metrics["local_actions"] = localActions;
+  metrics["local_synced"] = localSynced;
+  metrics["local_sync_pending"] = syncPending;
+  metrics["local_ws_clients"] = localSocket.count();
+}
+
+#endif // LOCAL_API_ENABLED
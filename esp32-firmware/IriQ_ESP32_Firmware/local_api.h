@@ -0,0 +1,31 @@
+/*
+ * IriQ Smart Irrigation System - Local API Header
+ *
+ * Header file for the LAN control API: an asynchronous HTTP and WebSocket
+ * server that serves live readings and takes pump and mode control from the
+ * local network, without going through Supabase.
+ */
+
+#ifndef LOCAL_API_H
+#define LOCAL_API_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Applies a requested pump/mode state; the same path dashboard commands use
+typedef void (*LocalControlCallback)(bool pumpControl, bool automaticMode);
+
+// Start serving (listening works before WiFi is up) and load unsynced actions
+void initLocalApi(LocalControlCallback callback);
+
+// Apply queued local actions and report them to Supabase once reachable;
+// call from the scheduler so control stays on the loop task
+void localApiLoop();
+
+// Publish a sensor sample to /api/state and the WebSocket stream
+void publishLocalSample(int moistureLevel, bool pump, bool automatic);
+
+// Add request and sync counters to a telemetry object
+void appendLocalApiMetrics(JsonObject metrics);
+
+#endif // LOCAL_API_H
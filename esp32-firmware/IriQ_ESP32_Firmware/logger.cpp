@@ -0,0 +1,222 @@
+/*
+ * IriQ Smart Irrigation System - Logger Module
+ *
+ * This module implements buffered, non-blocking logging.
+ * Producers claim a slot in a bounded lock-free ring (one sequence number per
+ * slot), format into it with vsnprintf and publish it. A single low-priority
+ * task drains published slots to Serial. When the ring is full the message
+ * is dropped and counted instead of blocking the caller.
+ */
+
+#include "logger.h"
+#include <atomic>
+#include <freertos/semphr.h>
+
+static_assert((LOG_BUFFER_SLOTS & (LOG_BUFFER_SLOTS - 1)) == 0, "LOG_BUFFER_SLOTS must be a power of two");
+static_assert(LOG_MESSAGE_SIZE <= 255, "LOG_MESSAGE_SIZE must fit in a byte");
+
+struct LogSlot {
+  std::atomic<uint32_t> sequence;
+  uint32_t timestamp;
+  uint8_t level;
+  uint8_t length;
+  char message[LOG_MESSAGE_SIZE];
+};
+
+static LogSlot logSlots[LOG_BUFFER_SLOTS];
+static std::atomic<uint32_t> enqueuePosition(0);
+static uint32_t dequeuePosition = 0;   // Guarded by drainMutex
+static std::atomic<uint32_t> droppedCount(0);
+static uint32_t reportedDropCount = 0;
+static TaskHandle_t drainTaskHandle = nullptr;
+static SemaphoreHandle_t drainMutex = nullptr;  // Serializes the drain task and logFlush()
+
+static const char levelChars[] = { '-', 'E', 'W', 'I', 'D', 'V' };
+
+#if LOG_BINARY_DUMP
+// Binary history kept in RTC memory so it survives soft resets and panics.
+// Fixed-size records so the history stays parseable after wrapping:
+// [u32 timestamp][u8 level][u8 length][LOG_DUMP_TEXT_SIZE bytes message]
+#define LOG_DUMP_MAGIC 0x49514c47  // "IQLG"
+#define LOG_DUMP_RECORD_SIZE 64
+#define LOG_DUMP_TEXT_SIZE (LOG_DUMP_RECORD_SIZE - 6)
+#define LOG_DUMP_RECORDS (LOG_DUMP_SIZE / LOG_DUMP_RECORD_SIZE)
+
+struct LogDump {
+  uint32_t magic;
+  uint32_t head;     // Next record index
+  uint32_t wrapped;  // Non-zero once the history has wrapped
+  uint8_t records[LOG_DUMP_RECORDS][LOG_DUMP_RECORD_SIZE];
+};
+
+RTC_NOINIT_ATTR static LogDump logDump;
+
+static void dumpRecord(const LogSlot& slot) {
+  uint8_t* record = logDump.records[logDump.head];
+  uint8_t length = slot.length < LOG_DUMP_TEXT_SIZE ? slot.length : LOG_DUMP_TEXT_SIZE;
+
+  memcpy(record, &slot.timestamp, 4);
+  record[4] = slot.level;
+  record[5] = length;
+  memcpy(record + 6, slot.message, length);
+
+  if (++logDump.head >= LOG_DUMP_RECORDS) {
+    logDump.head = 0;
+    logDump.wrapped = 1;
+  }
+}
+#endif
+
+static void initSlots() {
+  static bool initialized = false;
+  if (initialized) {
+    return;
+  }
+  for (uint32_t i = 0; i < LOG_BUFFER_SLOTS; i++) {
+    logSlots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  drainMutex = xSemaphoreCreateMutex();
+  initialized = true;
+}
+
+// Drain every published slot; returns the number of messages written
+static uint32_t drainSlots() {
+  uint32_t written = 0;
+  char prefix[24];
+
+  xSemaphoreTake(drainMutex, portMAX_DELAY);
+  uint32_t position = dequeuePosition;
+
+  while (true) {
+    LogSlot& slot = logSlots[position & (LOG_BUFFER_SLOTS - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+      break;  // Not yet published
+    }
+
+    int prefixLength = snprintf(prefix, sizeof(prefix), "[%8lu] %c ",
+                                (unsigned long)slot.timestamp, levelChars[slot.level]);
+    Serial.write((const uint8_t*)prefix, prefixLength);
+    Serial.write((const uint8_t*)slot.message, slot.length);
+    Serial.write((const uint8_t*)"\r\n", 2);
+
+#if LOG_BINARY_DUMP
+    dumpRecord(slot);
+#endif
+
+    slot.sequence.store(position + LOG_BUFFER_SLOTS, std::memory_order_release);
+    position++;
+    written++;
+  }
+  dequeuePosition = position;
+
+  // Report drops since the last drain
+  uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+  if (dropped != reportedDropCount) {
+    int length = snprintf(prefix, sizeof(prefix), "[log] -%lu\r\n", (unsigned long)(dropped - reportedDropCount));
+    Serial.write((const uint8_t*)prefix, length);
+    reportedDropCount = dropped;
+  }
+
+  xSemaphoreGive(drainMutex);
+  return written;
+}
+
+static void logDrainTask(void* parameter) {
+  while (true) {
+    if (drainSlots() == 0) {
+      vTaskDelay(pdMS_TO_TICKS(20));
+    }
+  }
+}
+
+// Start the background drain task
+void initLogger() {
+  initSlots();
+
+#if LOG_BINARY_DUMP
+  if (logDump.magic != LOG_DUMP_MAGIC || logDump.head >= LOG_DUMP_RECORDS) {
+    memset(&logDump, 0, sizeof(logDump));
+    logDump.magic = LOG_DUMP_MAGIC;
+  }
+#endif
+
+  if (drainTaskHandle == nullptr) {
+    // Core 0 at just above idle priority: only runs when the control loop and WiFi stack are idle
+    xTaskCreatePinnedToCore(logDrainTask, "log_drain", 3072, nullptr, tskIDLE_PRIORITY + 1, &drainTaskHandle, 0);
+  }
+}
+
+// Format a message into the ring buffer
+void logWrite(uint8_t level, const char* format, ...) {
+  initSlots();
+
+  uint32_t position = enqueuePosition.load(std::memory_order_relaxed);
+  LogSlot* slot;
+
+  // Claim a free slot
+  while (true) {
+    slot = &logSlots[position & (LOG_BUFFER_SLOTS - 1)];
+    uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int32_t difference = (int32_t)(sequence - position);
+
+    if (difference == 0) {
+      if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (difference < 0) {
+      // Ring is full: drop rather than block
+      droppedCount.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(slot->message, LOG_MESSAGE_SIZE, format, args);
+  va_end(args);
+
+  if (length < 0) {
+    length = 0;
+  } else if (length >= LOG_MESSAGE_SIZE) {
+    length = LOG_MESSAGE_SIZE - 1;  // Truncated
+  }
+
+  slot->timestamp = millis();
+  slot->level = level <= LOG_LEVEL_VERBOSE ? level : LOG_LEVEL_VERBOSE;
+  slot->length = (uint8_t)length;
+
+  // Publish to the drain task
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+// Drain all buffered messages synchronously
+void logFlush() {
+  while (drainSlots() > 0) {
+  }
+  Serial.flush();
+}
+
+// Number of messages dropped because the ring buffer was full
+uint32_t getLogDroppedCount() {
+  return droppedCount.load(std::memory_order_relaxed);
+}
+
+#if LOG_BINARY_DUMP
+// Write the binary log history to the given output.
+// Format: u32 "IQLG" magic, u32 record count, u32 record size, then records oldest first.
+void logDumpBinary(Print& out) {
+  uint32_t header[3] = {
+    LOG_DUMP_MAGIC,
+    logDump.wrapped ? (uint32_t)LOG_DUMP_RECORDS : logDump.head,
+    LOG_DUMP_RECORD_SIZE
+  };
+  out.write((const uint8_t*)header, sizeof(header));
+
+  if (logDump.wrapped) {
+    out.write(logDump.records[logDump.head], (LOG_DUMP_RECORDS - logDump.head) * LOG_DUMP_RECORD_SIZE);
+  }
+  out.write(logDump.records[0], logDump.head * LOG_DUMP_RECORD_SIZE);
+}
+#endif
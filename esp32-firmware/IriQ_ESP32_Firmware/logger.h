@@ -0,0 +1,93 @@
+/*
+ * IriQ Smart Irrigation System - Logger Header
+ *
+ * Header file for the logging module.
+ *
+ * Log calls above LOG_LEVEL (config.h) are removed by the preprocessor,
+ * including the evaluation of their arguments. Enabled calls format into a
+ * lock-free ring buffer and return immediately; a low-priority task drains
+ * the buffer to Serial so the control loop never blocks on the UART.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Log levels
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_BUFFER_SLOTS
+#define LOG_BUFFER_SLOTS 32
+#endif
+
+#ifndef LOG_MESSAGE_SIZE
+#define LOG_MESSAGE_SIZE 120
+#endif
+
+#ifndef LOG_BINARY_DUMP
+#define LOG_BINARY_DUMP 0
+#endif
+
+#ifndef LOG_DUMP_SIZE
+#define LOG_DUMP_SIZE 2048
+#endif
+
+// Start the background drain task
+void initLogger();
+
+// Format a message into the ring buffer (use the LOG_x macros instead)
+void logWrite(uint8_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Drain all buffered messages synchronously (e.g. before a restart)
+void logFlush();
+
+// Number of messages dropped because the ring buffer was full
+uint32_t getLogDroppedCount();
+
+#if LOG_BINARY_DUMP
+// Write the binary log history (survives soft resets) to the given output
+void logDumpBinary(Print& out);
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_V(...) logWrite(LOG_LEVEL_VERBOSE, __VA_ARGS__)
+#else
+#define LOG_V(...) do {} while (0)
+#endif
+
+#endif // LOGGER_H
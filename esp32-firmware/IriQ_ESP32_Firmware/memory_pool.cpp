@@ -0,0 +1,287 @@
+/*
+ * IriQ Smart Irrigation System - Memory Pool Module
+ *
+ * This module replaces the per-request heap churn of the API path:
+ * - an API_ARENA_SIZE arena for JSON documents and the payloads and paths
+ *   built from them; each block carries an 8-byte header, freed blocks are
+ *   popped off the top, so documents that go out of scope in the usual
+ *   reverse order leave the arena empty
+ * - API_RESPONSE_POOL_BLOCKS fixed blocks of API_RESPONSE_BUFFER_SIZE for
+ *   response bodies, instead of a String grown by http.getString()
+ *
+ * Both are statically allocated, so after days of uptime the largest free
+ * heap block is not eaten away by same-sized allocations landing at a new
+ * address every cycle. The arena is only used by the task that called
+ * initMemoryPools(); any other task gets plain heap memory.
+ */
+
+#include "memory_pool.h"
+#include "config.h"
+#include "logger.h"
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define ARENA_ALIGNMENT 8
+
+struct ArenaHeader {
+  uint32_t size;   // Whole block including this header
+  uint32_t freed;  // Released but not yet popped (something above it is live)
+};
+
+alignas(ARENA_ALIGNMENT) static uint8_t arena[API_ARENA_SIZE];
+static size_t arenaTop = 0;
+static TaskHandle_t arenaOwner = nullptr;
+
+static uint8_t poolBlocks[API_RESPONSE_POOL_BLOCKS][API_RESPONSE_BUFFER_SIZE];
+static bool poolInUse[API_RESPONSE_POOL_BLOCKS] = { false };
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+
+char ResponseBuffer::noData[1] = { '\0' };
+
+// Statistics
+static size_t arenaPeak = 0;
+static uint32_t arenaFallbacks = 0;
+static uint8_t poolPeak = 0;
+static uint32_t poolExhausted = 0;
+static uint32_t poolOverflows = 0;
+
+static bool isArenaPointer(const void* pointer) {
+  return pointer >= (const void*)arena && pointer < (const void*)(arena + API_ARENA_SIZE);
+}
+
+static ArenaHeader* headerOf(void* pointer) {
+  return (ArenaHeader*)((uint8_t*)pointer - sizeof(ArenaHeader));
+}
+
+// Pop freed blocks off the top. Blocks are found by walking from the
+// bottom, which stays cheap with the handful of documents alive at once.
+static void popFreedBlocks() {
+  while (arenaTop > 0) {
+    size_t offset = 0;
+    ArenaHeader* last = nullptr;
+    while (offset < arenaTop) {
+      last = (ArenaHeader*)(arena + offset);
+      offset += last->size;
+    }
+    if (last == nullptr || !last->freed) {
+      return;
+    }
+    arenaTop -= last->size;
+  }
+}
+
+void* ArenaAllocator::allocate(size_t size) {
+  size_t blockSize = (sizeof(ArenaHeader) + size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  if (arenaOwner == nullptr || xTaskGetCurrentTaskHandle() != arenaOwner) {
+    return malloc(size);
+  }
+  if (arenaTop + blockSize > API_ARENA_SIZE) {
+    arenaFallbacks++;
+    LOG_D("Arena full (%u of %u bytes used), %u bytes from the heap", (unsigned)arenaTop,
+          (unsigned)API_ARENA_SIZE, (unsigned)size);
+    return malloc(size);
+  }
+
+  ArenaHeader* header = (ArenaHeader*)(arena + arenaTop);
+  header->size = blockSize;
+  header->freed = 0;
+  arenaTop += blockSize;
+  if (arenaTop > arenaPeak) {
+    arenaPeak = arenaTop;
+  }
+  return header + 1;
+}
+
+void ArenaAllocator::deallocate(void* pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  if (!isArenaPointer(pointer)) {
+    free(pointer);
+    return;
+  }
+  headerOf(pointer)->freed = 1;
+  popFreedBlocks();
+}
+
+void* ArenaAllocator::reallocate(void* pointer, size_t newSize) {
+  if (pointer == nullptr) {
+    return allocate(newSize);
+  }
+  if (!isArenaPointer(pointer)) {
+    return realloc(pointer, newSize);
+  }
+
+  ArenaHeader* header = headerOf(pointer);
+  size_t offset = (uint8_t*)header - arena;
+  size_t blockSize = (sizeof(ArenaHeader) + newSize + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+
+  // The top block can grow or shrink in place
+  if (offset + header->size == arenaTop && offset + blockSize <= API_ARENA_SIZE) {
+    arenaTop = offset + blockSize;
+    header->size = blockSize;
+    if (arenaTop > arenaPeak) {
+      arenaPeak = arenaTop;
+    }
+    return pointer;
+  }
+  if (blockSize <= header->size) {
+    return pointer;
+  }
+
+  void* moved = allocate(newSize);
+  if (moved != nullptr) {
+    memcpy(moved, pointer, header->size - sizeof(ArenaHeader));
+    deallocate(pointer);
+  }
+  return moved;
+}
+
+ArenaString::ArenaString(size_t capacity) : capacity(capacity), used(0), overflow(false) {
+  buffer = capacity > 0 ? (char*)ArenaAllocator().allocate(capacity) : nullptr;
+  if (buffer != nullptr) {
+    buffer[0] = '\0';
+  } else {
+    overflow = true;
+  }
+}
+
+ArenaString::~ArenaString() {
+  ArenaAllocator().deallocate(buffer);
+}
+
+ArenaString& ArenaString::operator+=(const char* text) {
+  if (buffer == nullptr) {
+    return *this;
+  }
+  // Keep one byte for the terminator
+  size_t length = strlen(text);
+  size_t room = capacity - 1 - used;
+  size_t stored = length < room ? length : room;
+  memcpy(buffer + used, text, stored);
+  used += stored;
+  buffer[used] = '\0';
+  overflow = overflow || stored < length;
+  return *this;
+}
+
+ArenaString& ArenaString::operator+=(unsigned long number) {
+  char digits[12];
+  snprintf(digits, sizeof(digits), "%lu", number);
+  return *this += digits;
+}
+
+ResponseBuffer::ResponseBuffer() : block(-1), buffer(nullptr), used(0), overflow(false) {}
+
+ResponseBuffer::~ResponseBuffer() {
+  release();
+}
+
+ResponseBuffer::ResponseBuffer(ResponseBuffer&& other)
+    : block(other.block), buffer(other.buffer), used(other.used), overflow(other.overflow) {
+  other.block = -1;
+  other.buffer = nullptr;
+  other.used = 0;
+}
+
+ResponseBuffer& ResponseBuffer::operator=(ResponseBuffer&& other) {
+  if (this != &other) {
+    release();
+    block = other.block;
+    buffer = other.buffer;
+    used = other.used;
+    overflow = other.overflow;
+    other.block = -1;
+    other.buffer = nullptr;
+    other.used = 0;
+  }
+  return *this;
+}
+
+bool ResponseBuffer::acquire() {
+  used = 0;
+  overflow = false;
+  if (buffer != nullptr) {
+    buffer[0] = '\0';
+    return true;
+  }
+
+  uint8_t inUse = 0;
+  portENTER_CRITICAL(&poolMux);
+  for (int i = 0; i < API_RESPONSE_POOL_BLOCKS; i++) {
+    if (!poolInUse[i] && block < 0) {
+      poolInUse[i] = true;
+      block = i;
+    }
+    inUse += poolInUse[i] ? 1 : 0;
+  }
+  if (block < 0) {
+    poolExhausted++;
+  } else if (inUse > poolPeak) {
+    poolPeak = inUse;
+  }
+  portEXIT_CRITICAL(&poolMux);
+
+  if (block < 0) {
+    return false;
+  }
+  buffer = (char*)poolBlocks[block];
+  buffer[0] = '\0';
+  return true;
+}
+
+void ResponseBuffer::release() {
+  if (block >= 0) {
+    portENTER_CRITICAL(&poolMux);
+    poolInUse[block] = false;
+    portEXIT_CRITICAL(&poolMux);
+  }
+  block = -1;
+  buffer = nullptr;
+  used = 0;
+}
+
+size_t ResponseBuffer::write(const uint8_t* bytes, size_t count) {
+  if (buffer == nullptr) {
+    return 0;
+  }
+  // Keep one byte for the terminator
+  size_t room = API_RESPONSE_BUFFER_SIZE - 1 - used;
+  size_t stored = count < room ? count : room;
+  memcpy(buffer + used, bytes, stored);
+  used += stored;
+  buffer[used] = '\0';
+  if (stored < count && !overflow) {
+    overflow = true;
+    poolOverflows++;
+  }
+  return stored;
+}
+
+void initMemoryPools() {
+  arenaOwner = xTaskGetCurrentTaskHandle();
+}
+
+void appendMemoryMetrics(JsonObject metrics) {
+  JsonObject memory = metrics.createNestedObject("memory");
+  memory["free_heap"] = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  memory["min_free_heap"] = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  memory["largest_free_block"] = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  memory["arena_peak"] = arenaPeak;
+  memory["arena_fallbacks"] = arenaFallbacks;
+  memory["pool_peak"] = poolPeak;
+  memory["pool_exhausted"] = poolExhausted;
+  memory["pool_overflows"] = poolOverflows;
+}
+
+void printMemoryReport() {
+  LOG_I("Heap: %u free, %u minimum, %u largest block", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  LOG_I("Arena: %u/%u bytes in use, peak %u, %lu heap fallbacks", (unsigned)arenaTop, (unsigned)API_ARENA_SIZE,
+        (unsigned)arenaPeak, (unsigned long)arenaFallbacks);
+  LOG_I("Response pool: peak %u/%d blocks, %lu exhausted, %lu overflows", poolPeak, API_RESPONSE_POOL_BLOCKS,
+        (unsigned long)poolExhausted, (unsigned long)poolOverflows);
+}
@@ -0,0 +1,103 @@
+/*
+ * IriQ Smart Irrigation System - Memory Pool Header
+ *
+ * Header file for the fixed memory used by the request path: an arena for
+ * request-scoped JSON documents, payloads and paths, and a pool of response
+ * buffers, so a request cycle does not leave holes in the heap.
+ */
+
+#ifndef MEMORY_POOL_H
+#define MEMORY_POOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// ArduinoJson allocator backed by the request arena. Blocks are released in
+// LIFO order as documents go out of scope, so the arena is empty again after
+// every request cycle. Other tasks, and requests that do not fit, fall back
+// to the heap.
+struct ArenaAllocator {
+  void* allocate(size_t size);
+  void deallocate(void* pointer);
+  void* reallocate(void* pointer, size_t newSize);
+};
+
+// Use instead of DynamicJsonDocument for documents built on the loop task
+typedef BasicJsonDocument<ArenaAllocator> ArenaJsonDocument;
+
+// Text for one request (a JSON payload or a path) held on the arena above
+// the documents it was built from, and released with them. Text beyond the
+// capacity given up front is cut off and overflowed() turns true.
+class ArenaString {
+public:
+  explicit ArenaString(size_t capacity);
+  ~ArenaString();
+  ArenaString(const ArenaString&) = delete;
+  ArenaString& operator=(const ArenaString&) = delete;
+
+  ArenaString& operator+=(const char* text);
+  ArenaString& operator+=(const String& text) { return *this += text.c_str(); }
+  ArenaString& operator+=(unsigned long number);
+
+  // Replace the text with a document serialized as JSON; size the string
+  // with measureJson(source) + 1
+  template <typename TSource>
+  void assignJson(const TSource& source) {
+    if (buffer != nullptr) {
+      used = serializeJson(source, buffer, capacity);
+      overflow = overflow || used < measureJson(source);
+    }
+  }
+
+  const char* c_str() const { return buffer != nullptr ? buffer : ""; }
+  size_t length() const { return used; }
+  bool overflowed() const { return overflow; }
+
+private:
+  char* buffer;
+  size_t capacity;
+  size_t used;
+  bool overflow;
+};
+
+// A response body held in a fixed-size pool block; the block goes back to
+// the pool when the buffer is destroyed
+class ResponseBuffer {
+public:
+  ResponseBuffer();
+  ~ResponseBuffer();
+  ResponseBuffer(ResponseBuffer&& other);
+  ResponseBuffer& operator=(ResponseBuffer&& other);
+  ResponseBuffer(const ResponseBuffer&) = delete;
+  ResponseBuffer& operator=(const ResponseBuffer&) = delete;
+
+  // Take a block (or empty the one already held); false if the pool is exhausted
+  bool acquire();
+  void release();
+
+  // Append; bytes beyond the block are dropped and overflowed() turns true
+  size_t write(const uint8_t* bytes, size_t count);
+
+  char* data() { return buffer != nullptr ? buffer : noData; }
+  const char* c_str() const { return buffer != nullptr ? buffer : ""; }
+  size_t length() const { return used; }
+  bool overflowed() const { return overflow; }
+
+private:
+  int block;
+  char* buffer;
+  size_t used;
+  bool overflow;
+  static char noData[1];
+};
+
+// Mark the calling task (the loop task) as the arena owner
+void initMemoryPools();
+
+// Add heap, arena and pool statistics to a telemetry object
+void appendMemoryMetrics(JsonObject metrics);
+
+// Print heap, arena and pool statistics on the serial console
+void printMemoryReport();
+
+#endif // MEMORY_POOL_H
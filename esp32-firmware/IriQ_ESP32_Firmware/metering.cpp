@@ -0,0 +1,271 @@
+/*
+ * IriQ Smart Irrigation System - Metering Module
+ *
+ * This module meters pump runtime and water use. Runtime is integrated
+ * from relay transitions (recordPumpTransition() from setPumpStatus()).
+ * Water is counted from a pulse flow sensor on FLOW_SENSOR_PIN, if one is
+ * fitted. Each run becomes an irrigation event, and everything is also
+ * summed per UTC day.
+ *
+ * All counters live in one NVS blob kept by the state store. A change is
+ * written METER_CHECKPOINT_INTERVAL after it, and on the next pass when a
+ * run starts or ends, the day rolls over or a report was uploaded, so a
+ * power cut loses at most one checkpoint interval of a run. Events carry a
+ * per-device sequence number so re-sending a report after a lost response
+ * does not double count.
+ */
+
+#include "metering.h"
+#include "logger.h"
+#include "state_store.h"
+#include <time.h>
+
+#define METER_STATE_MAGIC 0x49514d31  // "IQM1"
+
+// The pump run in progress
+struct MeterRun {
+  uint8_t active;
+  uint8_t automatic;
+  uint32_t startedAt;
+  uint32_t durationMs;
+  uint32_t volumeMl;
+};
+
+// Persisted as one blob
+struct MeterState {
+  uint32_t magic;
+  uint32_t nextSequence;
+  UsageDay today;
+  UsageDay closedDays[METER_MAX_PENDING_DAYS];
+  uint8_t closedDayCount;
+  UsageEvent events[METER_MAX_PENDING_EVENTS];
+  uint8_t eventCount;
+  MeterRun run;
+};
+
+static MeterState state;
+static int stateSlot = -1;
+static UsageDay reportedToday;  // Today's totals as last uploaded
+
+static volatile uint32_t flowPulses = 0;
+static uint32_t countedPulses = 0;
+static uint32_t pulseRemainder = 0;  // Pulses x 1000 not yet a whole millilitre
+static unsigned long lastAccrualTime = 0;
+static unsigned long runStartTime = 0;
+static bool runStartedThisBoot = false;
+
+static UsageTotals totals;
+
+static uint32_t currentEpoch() {
+  time_t now = time(nullptr);
+  return now < 1600000000 ? 0 : (uint32_t)now;
+}
+
+static uint32_t currentDay() {
+  time_t now = time(nullptr);
+  if (now < 1600000000) {
+    return 0;
+  }
+  struct tm utc;
+  gmtime_r(&now, &utc);
+  return (utc.tm_year + 1900) * 10000 + (utc.tm_mon + 1) * 100 + utc.tm_mday;
+}
+
+static void saveState() {
+  requestStateCommit(stateSlot);
+}
+
+static void rollDay(uint32_t day) {
+  if (day == 0 || day == state.today.day) {
+    return;
+  }
+  if (state.today.day == 0) {
+    // Usage from before the clock was set goes to the first known day
+    state.today.day = day;
+    return;
+  }
+
+  if (state.closedDayCount == METER_MAX_PENDING_DAYS) {
+    LOG_W("Usage of %lu never uploaded, dropping it", (unsigned long)state.closedDays[0].day);
+    memmove(&state.closedDays[0], &state.closedDays[1], sizeof(UsageDay) * (METER_MAX_PENDING_DAYS - 1));
+    state.closedDayCount--;
+  }
+  state.closedDays[state.closedDayCount++] = state.today;
+  memset(&state.today, 0, sizeof(state.today));
+  state.today.day = day;
+  reportedToday = state.today;
+  saveState();
+}
+
+// Add the runtime and flow since the last call
+static void accrue() {
+  unsigned long now = millis();
+  rollDay(currentDay());
+
+  uint32_t pulses = flowPulses;
+  uint32_t scaled = (pulses - countedPulses) * 1000 + pulseRemainder;
+  uint32_t volumeMl = scaled / FLOW_PULSES_PER_LITER;
+  pulseRemainder = scaled % FLOW_PULSES_PER_LITER;
+  countedPulses = pulses;
+  state.today.volumeMl += volumeMl;
+  totals.volumeMl += volumeMl;
+
+  if (state.run.active) {
+    unsigned long elapsed = now - lastAccrualTime;
+    state.run.durationMs += elapsed;
+    state.run.volumeMl += volumeMl;
+    state.today.runtimeMs += elapsed;
+    totals.runtimeMs += elapsed;
+
+    // Date a run that started before the clock was set
+    uint32_t epoch = currentEpoch();
+    if (state.run.startedAt == 0 && epoch != 0 && runStartedThisBoot) {
+      state.run.startedAt = epoch - (now - runStartTime) / 1000;
+    }
+  }
+  lastAccrualTime = now;
+}
+
+static void closeRun() {
+  UsageEvent event;
+  event.sequence = state.nextSequence++;
+  event.startedAt = state.run.startedAt;
+  event.durationMs = state.run.durationMs;
+  event.volumeMl = state.run.volumeMl;
+  event.automatic = state.run.automatic;
+  state.run.active = 0;
+  state.today.events++;
+  totals.events++;
+
+  if (state.eventCount == METER_MAX_PENDING_EVENTS) {
+    // The day totals still include it
+    totals.eventsDropped++;
+    LOG_W("Usage event list full, event %lu kept in the day totals only", (unsigned long)event.sequence);
+    return;
+  }
+  state.events[state.eventCount++] = event;
+  LOG_I("Irrigation event %lu: %lu ms, %lu ml", (unsigned long)event.sequence, (unsigned long)event.durationMs,
+        (unsigned long)event.volumeMl);
+}
+
+// Load the counters from NVS and attach the flow sensor interrupt
+void initMetering() {
+  memset(&state, 0, sizeof(state));
+  state.magic = METER_STATE_MAGIC;
+  // A fresh state (new board, erased flash) must not reuse sequence numbers
+  // the server already holds for this device
+  state.nextSequence = (uint32_t)random(0x7fffffff);
+
+  MeterState fresh = state;
+  stateSlot = registerState("metering", "state", STATE_BYTES, &state, sizeof(state), METER_CHECKPOINT_INTERVAL);
+  if (state.magic != METER_STATE_MAGIC) {
+    state = fresh;
+  }
+
+  // Upload today's totals once after boot
+  memset(&reportedToday, 0, sizeof(reportedToday));
+  lastAccrualTime = millis();
+
+  // Power was lost with the pump on: end the run at its last checkpoint
+  if (state.run.active) {
+    LOG_I("Closing the pump run interrupted by the reset");
+    closeRun();
+    saveState();
+  }
+
+#if FLOW_SENSOR_PIN >= 0
+  pinMode(FLOW_SENSOR_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(FLOW_SENSOR_PIN), onFlowPulse, FALLING);
+#endif
+
+  LOG_I("Metering: today %lu ms, %lu ml, %lu events; %u events and %u days pending upload",
+        (unsigned long)state.today.runtimeMs, (unsigned long)state.today.volumeMl,
+        (unsigned long)state.today.events, state.eventCount, state.closedDayCount);
+}
+
+// Note a relay change
+void recordPumpTransition(bool on, bool automatic) {
+  accrue();
+  if (on == (state.run.active != 0)) {
+    return;
+  }
+
+  if (on) {
+    memset(&state.run, 0, sizeof(state.run));
+    state.run.active = 1;
+    state.run.automatic = automatic ? 1 : 0;
+    state.run.startedAt = currentEpoch();
+    runStartTime = millis();
+    runStartedThisBoot = true;
+  } else {
+    closeRun();
+  }
+  saveState();
+}
+
+// Flow sensor interrupt handler
+void IRAM_ATTR onFlowPulse() {
+  flowPulses++;
+}
+
+// Accrue runtime and flow and roll the day over; the state store checkpoints them
+void meteringLoop() {
+  accrue();
+}
+
+// Fill a report of pending usage
+bool getUsageReport(UsageReport* report) {
+  accrue();
+
+  report->dayCount = 0;
+  for (int i = 0; i < state.closedDayCount; i++) {
+    report->days[report->dayCount++] = state.closedDays[i];
+  }
+  // Today can only be stored under a date once the clock is set
+  if (state.today.day != 0 && memcmp(&state.today, &reportedToday, sizeof(UsageDay)) != 0) {
+    report->days[report->dayCount++] = state.today;
+  }
+
+  report->eventCount = state.eventCount;
+  memcpy(report->events, state.events, sizeof(UsageEvent) * state.eventCount);
+  return report->dayCount > 0 || report->eventCount > 0;
+}
+
+// Drop what an uploaded report covered
+void markUsageReported(const UsageReport& report) {
+  for (int i = 0; i < report.dayCount; i++) {
+    if (report.days[i].day == state.today.day) {
+      reportedToday = report.days[i];
+      continue;
+    }
+    for (int j = 0; j < state.closedDayCount; j++) {
+      if (state.closedDays[j].day == report.days[i].day) {
+        memmove(&state.closedDays[j], &state.closedDays[j + 1], sizeof(UsageDay) * (state.closedDayCount - j - 1));
+        state.closedDayCount--;
+        break;
+      }
+    }
+  }
+
+  // Events closed during the upload stay queued
+  int reported = report.eventCount < state.eventCount ? report.eventCount : state.eventCount;
+  memmove(&state.events[0], &state.events[reported], sizeof(UsageEvent) * (state.eventCount - reported));
+  state.eventCount -= reported;
+  saveState();
+}
+
+// Totals since boot
+UsageTotals getUsageTotals() {
+  accrue();
+  return totals;
+}
+
+// Print today's totals and the pending uploads
+void printUsageReport() {
+  accrue();
+  LOG_I("Usage %lu: pump %lu s, %lu ml, %lu events", (unsigned long)state.today.day,
+        (unsigned long)(state.today.runtimeMs / 1000), (unsigned long)state.today.volumeMl,
+        (unsigned long)state.today.events);
+  LOG_I("Pending upload: %u events, %u closed days; since boot %lu events dropped", state.eventCount,
+        state.closedDayCount, (unsigned long)totals.eventsDropped);
+}
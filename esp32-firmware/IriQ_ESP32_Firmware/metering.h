@@ -0,0 +1,71 @@
+/*
+ * IriQ Smart Irrigation System - Metering Header
+ *
+ * Header file for pump runtime and water usage metering: per-irrigation
+ * events and daily totals, kept in NVS until Supabase has them.
+ */
+
+#ifndef METERING_H
+#define METERING_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// One pump run, from relay on to relay off
+struct UsageEvent {
+  uint32_t sequence;    // Per-device number, makes re-uploads idempotent
+  uint32_t startedAt;   // Epoch seconds, 0 while the clock was not set
+  uint32_t durationMs;
+  uint32_t volumeMl;
+  uint8_t automatic;    // Started by automatic mode
+};
+
+// Totals of one UTC day
+struct UsageDay {
+  uint32_t day;         // YYYYMMDD, 0 until the clock is set
+  uint32_t runtimeMs;
+  uint32_t volumeMl;
+  uint32_t events;
+};
+
+// Everything not yet uploaded
+struct UsageReport {
+  UsageDay days[METER_MAX_PENDING_DAYS + 1];  // Closed days, then today
+  uint8_t dayCount;
+  UsageEvent events[METER_MAX_PENDING_EVENTS];
+  uint8_t eventCount;
+};
+
+// Metered since boot, for diagnostics and the host replay
+struct UsageTotals {
+  uint32_t runtimeMs;
+  uint32_t volumeMl;
+  uint32_t events;
+  uint32_t eventsDropped;  // Closed while the pending list was full (still in the day totals)
+};
+
+// Load the counters from NVS and attach the flow sensor interrupt
+void initMetering();
+
+// Note a relay change; same-state calls are ignored
+void recordPumpTransition(bool on, bool automatic);
+
+// Flow sensor interrupt handler (one pulse)
+void onFlowPulse();
+
+// Accrue runtime and flow and roll the day over; the state store checkpoints them
+void meteringLoop();
+
+// Fill a report of pending usage; false when nothing changed since the last upload
+bool getUsageReport(UsageReport* report);
+
+// Drop what an uploaded report covered
+void markUsageReported(const UsageReport& report);
+
+// Totals since boot
+UsageTotals getUsageTotals();
+
+// Print today's totals and the pending uploads on the serial console
+void printUsageReport();
+
+#endif // METERING_H
@@ -0,0 +1,251 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Transport Module
+ *
+ * This module implements the Supabase API over MQTT. The device keeps one
+ * persistent session (clean session off) and uses the topics under
+ * iriq/<device_id>/:
+ * - telemetry, status, ack: QoS 1 publishes, bridged into the tables
+ * - presence: retained "active" on connect; the broker publishes the retained
+ *   "offline" last will when the session drops, so no heartbeat is needed
+ * - desired: retained newest pending command, pushed by the bridge as soon
+ *   as it is created and cleared once acknowledged
+ */
+
+#include "mqtt_transport.h"
+#include "config.h"
+
+#if USE_MQTT_TRANSPORT
+
+#include "supabase_api.h"
+#include "logger.h"
+#include "telemetry.h"
+#include "memory_pool.h"
+#include <WiFi.h>
+#include <MQTT.h>
+
+// External variables from main file
+extern bool pumpStatus;
+
+static WiFiClient mqttNetwork;
+static MQTTClient mqttClient(MQTT_BUFFER_SIZE);
+
+static String topicPrefix;    // "iriq/<device_id>/"
+static bool mqttConfigured = false;
+static unsigned long lastConnectAttempt = 0;
+static unsigned long connectBackoff = API_BACKOFF_MIN;
+
+// Newest desired state not yet taken by checkForCommands()
+static ControlCommand desiredCommand;
+static bool desiredPending = false;
+static bool desiredArrived = false;
+static String lastAckedIds;   // Ignore the retained copy of a command already acknowledged
+
+static uint32_t mqttConnects = 0;
+static uint32_t mqttPublishFailures = 0;
+
+static const char* PRESENCE_ONLINE = "{\"status\":\"active\"}";
+static const char* PRESENCE_OFFLINE = "{\"status\":\"offline\"}";
+
+// Store an incoming desired state; runs inside mqttClient.loop()
+static void onMqttMessage(String& topic, String& payload) {
+  if (!topic.endsWith("/desired") || payload.length() == 0) {
+    return;
+  }
+
+  ArenaJsonDocument doc(512);
+  DeserializationError error = deserializeJson(doc, payload);
+  if (error) {
+    LOG_W("Error parsing desired state: %s", error.c_str());
+    return;
+  }
+
+  ControlCommand command;
+  command.id = doc["id"].as<String>();
+  command.ids = doc["ids"] | command.id;
+  command.count = doc["count"] | 1;
+  command.pumpControl = doc["pump_control"].as<bool>();
+  command.automaticMode = doc["automatic_mode"].as<bool>();
+  command.userId = doc["user_id"].as<String>();
+  command.valid = command.id.length() > 0;
+
+  if (!command.valid || command.ids == lastAckedIds) {
+    return;
+  }
+
+  desiredCommand = command;
+  desiredPending = true;
+  desiredArrived = true;
+}
+
+// Open the broker session if it is down, with backoff between attempts
+static bool ensureMqttConnected() {
+  if (mqttClient.connected()) {
+    return true;
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  if (lastConnectAttempt != 0 && millis() - lastConnectAttempt < connectBackoff) {
+    return false;
+  }
+  lastConnectAttempt = millis();
+
+  if (!mqttConfigured) {
+    topicPrefix = "iriq/" + deviceId + "/";
+    mqttClient.begin(MQTT_HOST, MQTT_PORT, mqttNetwork);
+    mqttClient.onMessage(onMqttMessage);
+    mqttClient.setKeepAlive(MQTT_KEEPALIVE);
+    mqttClient.setCleanSession(false);
+    mqttClient.setTimeout(MQTT_TIMEOUT);
+    mqttClient.setWill((topicPrefix + "presence").c_str(), PRESENCE_OFFLINE, true, 1);
+    mqttConfigured = true;
+  }
+
+  if (!mqttClient.connect(deviceId.c_str(), deviceId.c_str(), MQTT_PASSWORD)) {
+    LOG_W("MQTT connect to %s:%d failed (error %d, code %d), retrying in %lu ms", MQTT_HOST, MQTT_PORT,
+          (int)mqttClient.lastError(), (int)mqttClient.returnCode(), connectBackoff);
+    connectBackoff = min(connectBackoff * 2, (unsigned long)API_BACKOFF_MAX);
+    return false;
+  }
+  connectBackoff = API_BACKOFF_MIN;
+  mqttConnects++;
+
+  // The session keeps the subscription, but subscribing again is cheap and
+  // covers a broker that lost its session store
+  mqttClient.subscribe(topicPrefix + "desired", 1);
+  mqttClient.publish(topicPrefix + "presence", PRESENCE_ONLINE, true, 1);
+  LOG_I("MQTT connected to %s:%d", MQTT_HOST, MQTT_PORT);
+  return true;
+}
+
+// Publish a JSON document under this device's topic prefix
+static bool publishJson(const char* subtopic, const JsonDocument& doc, bool retained, int qos) {
+  if (!ensureMqttConnected()) {
+    return false;
+  }
+
+  ArenaString topic(topicPrefix.length() + strlen(subtopic) + 1);
+  topic += topicPrefix;
+  topic += subtopic;
+  ArenaString payload(measureJson(doc) + 1);
+  payload.assignJson(doc);
+  if (!mqttClient.publish(topic.c_str(), payload.c_str(), (int)payload.length(), retained, qos)) {
+    mqttPublishFailures++;
+    LOG_W("MQTT publish to %s failed (error %d)", subtopic, (int)mqttClient.lastError());
+    return false;
+  }
+  return true;
+}
+
+bool mqttTransportLoop() {
+  if (ensureMqttConnected()) {
+    mqttClient.loop();
+  }
+  bool arrived = desiredArrived;
+  desiredArrived = false;
+  return arrived;
+}
+
+bool isMqttConnected() {
+  return mqttClient.connected();
+}
+
+void appendMqttMetrics(JsonObject metrics) {
+  metrics["mqtt_connects"] = mqttConnects;
+  metrics["mqtt_publish_failures"] = mqttPublishFailures;
+}
+
+// Send sensor reading (QoS 1)
+bool sendSensorReading(int moistureLevel) {
+  ArenaJsonDocument doc(256);
+  doc["moisture_percentage"] = moistureLevel;
+  doc["moisture_digital"] = (moistureLevel < MOISTURE_THRESHOLD);
+  doc["pump_status"] = pumpStatus;
+
+  bool sent = publishJson("telemetry", doc, false, 1);
+  if (sent) {
+    LOG_D("Sensor reading published");
+  }
+  return sent;
+}
+
+// Publish device status; the bridge upserts it
+bool updateDeviceStatus(bool pumpStatus, bool automaticMode) {
+  ArenaJsonDocument doc(256);
+  doc["pump_status"] = pumpStatus;
+  doc["automatic_mode"] = automaticMode;
+  doc["user_id"] = "2930efc2-0327-47db-9f0b-27901d2bc272";  // Admin user ID from the table structure
+
+  bool sent = publishJson("status", doc, false, 1);
+  if (sent) {
+    LOG_D("Device status published");
+  }
+  return sent;
+}
+
+// The bridge upserts, so there is no separate insert path
+bool insertDeviceStatus(bool pumpStatus, bool automaticMode) {
+  return updateDeviceStatus(pumpStatus, automaticMode);
+}
+
+// Hand over the newest desired state pushed by the bridge, if any
+ControlCommand checkForCommands() {
+  ControlCommand command;
+  command.valid = false;
+  command.count = 0;
+
+  if (!desiredPending) {
+    return command;
+  }
+  desiredPending = false;
+  command = desiredCommand;
+
+  LOG_I("Received %d command(s), applying %s: pump %s, mode %s", command.count, command.id.c_str(),
+        command.pumpControl ? "ON" : "OFF", command.automaticMode ? "AUTOMATIC" : "MANUAL");
+  return command;
+}
+
+// Acknowledge the applied commands; the bridge marks them executed and
+// clears the desired topic
+bool markCommandAsExecuted(const char* commandIds) {
+  char executedAt[24];
+  formatISOTime(executedAt, sizeof(executedAt));
+  ArenaJsonDocument doc(256 + MAX_PENDING_COMMANDS * 40);
+  doc["ids"] = commandIds;
+  doc["executed_at"] = executedAt;
+
+  bool sent = publishJson("ack", doc, false, 1);
+  if (sent) {
+    lastAckedIds = commandIds;
+    LOG_D("Commands %s acknowledged", commandIds);
+  } else {
+    // Apply the retained copy again after reconnecting, then retry the ack
+    lastAckedIds = "";
+  }
+  return sent;
+}
+
+// Presence comes from the session itself (retained "active" plus the last
+// will), so a heartbeat only carries metrics when they are due
+bool sendHeartbeat() {
+  if (!ensureMqttConnected()) {
+    LOG_D("Cannot send heartbeat: MQTT not connected");
+    return false;
+  }
+  if (!isTelemetryDue()) {
+    return true;
+  }
+
+  ArenaJsonDocument doc(3072);
+  doc["status"] = "active";
+  appendTelemetry(doc.createNestedObject("metrics"));
+
+  // Not retained: the retained presence stays the plain "active" message
+  bool sent = publishJson("presence", doc, false, 0);
+  if (sent) {
+    markTelemetrySent();
+  }
+  return sent;
+}
+
+#endif // USE_MQTT_TRANSPORT
@@ -0,0 +1,25 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Transport Header
+ *
+ * Header file for the MQTT transport. With USE_MQTT_TRANSPORT enabled it
+ * provides the supabase_api.h functions over one persistent broker session
+ * instead of PostgREST requests.
+ */
+
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Keep the broker session up and process incoming messages; call from the
+// network task. Returns true when a new desired state has arrived.
+bool mqttTransportLoop();
+
+// True while the broker session is open
+bool isMqttConnected();
+
+// Add connection and publish counters to a telemetry object
+void appendMqttMetrics(JsonObject metrics);
+
+#endif // MQTT_TRANSPORT_H
@@ -0,0 +1,42 @@
+/*
+ * IriQ Smart Irrigation System - Node Protocol Module
+ *
+ * This module seals and checks the frames sensor nodes and the gateway
+ * exchange. ESP-NOW already drops frames with a bad FCS; the checksum here
+ * guards the payload layout across firmware versions and the network id
+ * keeps two installations in radio range apart.
+ */
+
+#include "node_protocol.h"
+#include "config.h"
+
+static uint16_t crc16(const uint8_t* data, size_t length) {
+  uint16_t crc = 0xffff;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// Fill in the header and checksum of a frame
+void sealNodeFrame(NodeFrame* frame, uint8_t type) {
+  frame->magic = NODE_FRAME_MAGIC;
+  frame->version = NODE_PROTOCOL_VERSION;
+  frame->type = type;
+  frame->networkId = NODE_NETWORK_ID;
+  frame->crc = crc16((const uint8_t*)frame, offsetof(NodeFrame, crc));
+}
+
+// Validate a received frame
+bool openNodeFrame(const uint8_t* data, size_t length, NodeFrame* frame) {
+  if (length != sizeof(NodeFrame)) {
+    return false;
+  }
+  memcpy(frame, data, sizeof(NodeFrame));
+  return frame->magic == NODE_FRAME_MAGIC && frame->version == NODE_PROTOCOL_VERSION &&
+         frame->networkId == NODE_NETWORK_ID && frame->crc == crc16(data, offsetof(NodeFrame, crc)) &&
+         (frame->type == NODE_FRAME_READING || frame->type == NODE_FRAME_ACK);
+}
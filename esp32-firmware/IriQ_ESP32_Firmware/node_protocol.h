@@ -0,0 +1,50 @@
+/*
+ * IriQ Smart Irrigation System - Node Protocol Header
+ *
+ * Header file for the frames exchanged over ESP-NOW between battery sensor
+ * nodes and the gateway controller. A node sends one reading per wake-up
+ * and retries until the gateway acknowledges its sequence number.
+ */
+
+#ifndef NODE_PROTOCOL_H
+#define NODE_PROTOCOL_H
+
+#include <Arduino.h>
+
+#define NODE_FRAME_MAGIC 0x49  // 'I'
+#define NODE_PROTOCOL_VERSION 1
+
+enum NodeFrameType : uint8_t {
+  NODE_FRAME_READING = 1,  // Node to gateway
+  NODE_FRAME_ACK = 2       // Gateway to node, echoes the reading's sequence
+};
+
+// Flags of a reading frame
+#define NODE_FLAG_FIRST 0x01        // First frame since power-on; the gateway restarts the sequence
+#define NODE_FLAG_SENSOR_FAULT 0x02 // Moisture could not be read
+
+// Fixed-size frame, little-endian as on the ESP32
+struct __attribute__((packed)) NodeFrame {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint8_t flags;
+  uint32_t networkId;   // NODE_NETWORK_ID, so neighbouring installations ignore each other
+  uint32_t sequence;
+  int16_t moisture;     // Percent
+  uint16_t batteryMv;   // 0 when not measured
+  uint16_t crc;         // CRC-16/CCITT of everything before it
+};
+
+// Fill in the header and checksum of a frame
+void sealNodeFrame(NodeFrame* frame, uint8_t type);
+
+// Validate a received frame; false for foreign, corrupt or unknown frames
+bool openNodeFrame(const uint8_t* data, size_t length, NodeFrame* frame);
+
+// Whether sequence a comes after b, across wrap-around
+inline bool sequenceAfter(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) > 0;
+}
+
+#endif // NODE_PROTOCOL_H
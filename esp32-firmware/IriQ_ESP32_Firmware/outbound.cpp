@@ -0,0 +1,358 @@
+/*
+ * IriQ Smart Irrigation System - Outbound Queue Module
+ *
+ * This module orders everything the device sends to Supabase. Producers
+ * queue small fixed records instead of sending inline, and the outbound
+ * task sends one message per pass from the most urgent class that has one:
+ * - control: device status changes and command acknowledgements; a newer
+ *   status replaces a queued one, acknowledgements are merged, and both are
+ *   retried until sent or rejected
+ * - presence: heartbeats; a newer one replaces a queued one, and a failed
+ *   one falls back to a device status update as before
+ * - telemetry: sensor readings, usage reports and sensor node batches
+ *   (ESPNOW_GATEWAY_ENABLED); the oldest is dropped when
+ *   the class is full, readings older than OUTBOUND_READING_MAX_AGE are
+ *   dropped (Supabase stamps them on arrival), and a message is dropped
+ *   after OUTBOUND_TELEMETRY_ATTEMPTS failed sends
+ *
+ * A message the server rejects as wrong (a 4xx that is not about the token
+ * or rate) is dropped at once in every class, so it cannot hold up the
+ * messages behind it.
+ *
+ * A pump change therefore waits for at most the one request already in
+ * flight. A class that failed waits OUTBOUND_RETRY_DELAY before its next
+ * attempt while the other classes keep going.
+ */
+
+#include "outbound.h"
+#include "config.h"
+#include "logger.h"
+#include "api_client.h"
+#include "supabase_api.h"
+#include "sampler.h"
+#include "metering.h"
+#include "boot_timing.h"
+#include "trace.h"
+
+#define OUTBOUND_SLOTS (OUTBOUND_CONTROL_DEPTH > OUTBOUND_TELEMETRY_DEPTH ? OUTBOUND_CONTROL_DEPTH : OUTBOUND_TELEMETRY_DEPTH)
+
+// Room for two polls' worth of command ids (UUID plus separator)
+#define OUTBOUND_ACK_SIZE (MAX_PENDING_COMMANDS * 2 * 37)
+
+// External variables
+extern bool networkReady;
+extern bool pumpStatus;
+extern bool automaticMode;
+
+enum OutboundKind : uint8_t {
+  MSG_DEVICE_STATUS,
+  MSG_COMMAND_ACK,
+  MSG_HEARTBEAT,
+  MSG_SENSOR_READING,
+  MSG_USAGE_REPORT,
+  MSG_NODE_BATCH
+};
+
+static const char* const kindNames[] = { "status", "ack", "heartbeat", "reading", "usage", "nodes" };
+
+struct OutboundMessage {
+  uint8_t kind;
+  uint8_t attempts;
+  int16_t value;            // Reading, or the pump (bit 0) and mode (bit 1) of a status
+  unsigned long queuedAt;
+};
+
+struct OutboundQueue {
+  const char* name;
+  uint8_t capacity;
+  uint8_t maxAttempts;      // 0: retry until sent
+  OutboundMessage slots[OUTBOUND_SLOTS];
+  uint8_t head;
+  uint8_t count;
+  unsigned long retryAt;
+
+  // Statistics
+  uint8_t peakDepth;
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t dropped;
+  uint32_t rejected;        // Dropped because the server rejected them
+  uint32_t waitTotalMs;
+  uint32_t waitMaxMs;
+};
+
+static OutboundQueue queues[OUTBOUND_CLASS_COUNT] = {
+  { "control", OUTBOUND_CONTROL_DEPTH, 0 },
+  { "presence", 1, 1 },
+  { "telemetry", OUTBOUND_TELEMETRY_DEPTH, OUTBOUND_TELEMETRY_ATTEMPTS },
+};
+
+// Ids of every queued acknowledgement; one ack message sends them all, and
+// command polls skip them until it has
+static char ackIds[OUTBOUND_ACK_SIZE];
+static size_t ackLength = 0;
+
+static OutboundClass classOf(uint8_t kind) {
+  switch (kind) {
+    case MSG_DEVICE_STATUS:
+    case MSG_COMMAND_ACK:
+      return OUTBOUND_CONTROL;
+    case MSG_HEARTBEAT:
+      return OUTBOUND_PRESENCE;
+    default:
+      return OUTBOUND_TELEMETRY;
+  }
+}
+
+static OutboundMessage& headOf(OutboundQueue& queue) {
+  return queue.slots[queue.head];
+}
+
+static OutboundMessage* findQueued(OutboundQueue& queue, uint8_t kind) {
+  for (int i = 0; i < queue.count; i++) {
+    OutboundMessage& message = queue.slots[(queue.head + i) % OUTBOUND_SLOTS];
+    if (message.kind == kind) {
+      return &message;
+    }
+  }
+  return nullptr;
+}
+
+static void clearAcks() {
+  ackLength = 0;
+  ackIds[0] = '\0';
+}
+
+static void popHead(OutboundQueue& queue) {
+  queue.head = (queue.head + 1) % OUTBOUND_SLOTS;
+  queue.count--;
+}
+
+static void dropHead(OutboundQueue& queue, const char* reason) {
+  OutboundMessage& message = headOf(queue);
+  LOG_W("Outbound %s: dropping %s (%s)", queue.name, kindNames[message.kind], reason);
+  if (message.kind == MSG_COMMAND_ACK) {
+    // Unacknowledged commands are fetched again by the next poll
+    clearAcks();
+  }
+  queue.dropped++;
+  popHead(queue);
+}
+
+static void enqueue(uint8_t kind, int value, bool coalesce) {
+  OutboundQueue& queue = queues[classOf(kind)];
+  if (coalesce) {
+    OutboundMessage* queued = findQueued(queue, kind);
+    if (queued != nullptr) {
+      // Keep the original queue time so the wait covers the oldest update
+      queued->value = value;
+      return;
+    }
+  }
+
+  if (queue.count == queue.capacity) {
+    dropHead(queue, "queue full");
+  }
+  OutboundMessage& message = queue.slots[(queue.head + queue.count) % OUTBOUND_SLOTS];
+  message.kind = kind;
+  message.attempts = 0;
+  message.value = value;
+  message.queuedAt = millis();
+  queue.count++;
+  if (queue.count > queue.peakDepth) {
+    queue.peakDepth = queue.count;
+  }
+}
+
+// Queue the device status; replaces a status not yet sent
+void queueDeviceStatus(bool pumpStatus, bool automaticMode) {
+  enqueue(MSG_DEVICE_STATUS, (pumpStatus ? 1 : 0) | (automaticMode ? 2 : 0), true);
+}
+
+// Queue the acknowledgement of executed commands
+void queueCommandAck(const String& commandIds) {
+  if (commandIds.length() == 0 || strstr(ackIds, commandIds.c_str()) != nullptr) {
+    // Polled again before the acknowledgement went out
+    return;
+  }
+
+  size_t separator = ackLength > 0 ? 1 : 0;
+  if (ackLength + separator + commandIds.length() >= sizeof(ackIds)) {
+    queues[OUTBOUND_CONTROL].dropped++;
+    LOG_W("Outbound control: acknowledgement buffer full, commands will be polled again");
+    return;
+  }
+  if (separator) {
+    ackIds[ackLength++] = ',';
+  }
+  memcpy(ackIds + ackLength, commandIds.c_str(), commandIds.length() + 1);
+  ackLength += commandIds.length();
+  enqueue(MSG_COMMAND_ACK, 0, true);
+}
+
+// Ids of applied commands whose acknowledgement is not yet sent
+const char* getUnackedCommandIds() {
+  return ackIds;
+}
+
+// True when the acknowledgement buffer has room for another poll's ids
+bool canQueueCommandAcks() {
+  return ackLength + MAX_PENDING_COMMANDS * 37 < sizeof(ackIds);
+}
+
+// Queue a heartbeat; replaces one not yet sent
+void queueHeartbeat() {
+  enqueue(MSG_HEARTBEAT, 0, true);
+}
+
+// Queue a sensor reading
+void queueSensorReading(int moistureLevel) {
+  enqueue(MSG_SENSOR_READING, moistureLevel, false);
+}
+
+// Queue an upload of pending pump usage; replaces one not yet sent
+void queueUsageReport() {
+  enqueue(MSG_USAGE_REPORT, 0, true);
+}
+
+// Queue an upload of the sensor node readings; replaces one not yet sent
+void queueNodeBatch() {
+  enqueue(MSG_NODE_BATCH, 0, true);
+}
+
+static bool sendMessage(const OutboundMessage& message) {
+  switch (message.kind) {
+    case MSG_DEVICE_STATUS:
+      return updateDeviceStatus((message.value & 1) != 0, (message.value & 2) != 0);
+
+    case MSG_COMMAND_ACK:
+      if (!markCommandAsExecuted(ackIds)) {
+        return false;
+      }
+      clearAcks();
+      return true;
+
+    case MSG_HEARTBEAT:
+      if (!sendHeartbeat()) {
+        return false;
+      }
+      markBootPhase(BOOT_PHASE_FIRST_UPLOAD);
+      return true;
+
+    case MSG_SENSOR_READING: {
+      bool uploaded = sendSensorReading(message.value);
+      TRACE(TRACE_UPLOAD, uploaded);
+      if (!uploaded) {
+        return false;
+      }
+      markReadingUploaded(message.value);
+      markBootPhase(BOOT_PHASE_FIRST_UPLOAD);
+      return true;
+    }
+
+    case MSG_USAGE_REPORT: {
+      UsageReport report;
+      if (!getUsageReport(&report)) {
+        return true;
+      }
+      if (!sendUsageReport(report)) {
+        return false;
+      }
+      markUsageReported(report);
+      return true;
+    }
+
+#if ESPNOW_GATEWAY_ENABLED
+    case MSG_NODE_BATCH: {
+      // Readings that arrive while this one is in flight go with the next batch
+      static NodeBatch batch;
+      if (!getGatewayBatch(&batch)) {
+        return true;
+      }
+      if (!sendNodeReadings(batch)) {
+        return false;
+      }
+      markGatewayBatchUploaded(batch);
+      return true;
+    }
+#endif
+  }
+  return true;
+}
+
+// Send the most urgent queued message
+void outboundLoop() {
+  if (!networkReady) {
+    return;
+  }
+
+  unsigned long now = millis();
+  for (int i = 0; i < OUTBOUND_CLASS_COUNT; i++) {
+    OutboundQueue& queue = queues[i];
+    while (queue.count > 0 && headOf(queue).kind == MSG_SENSOR_READING &&
+           now - headOf(queue).queuedAt > OUTBOUND_READING_MAX_AGE) {
+      dropHead(queue, "stale");
+    }
+    if (queue.count == 0 || (long)(now - queue.retryAt) < 0) {
+      continue;
+    }
+
+    OutboundMessage& message = headOf(queue);
+    takeRequestRejected();  // Only this message's requests count
+    if (sendMessage(message)) {
+      uint32_t wait = now - message.queuedAt;
+      queue.waitTotalMs += wait;
+      if (wait > queue.waitMaxMs) {
+        queue.waitMaxMs = wait;
+      }
+      queue.sent++;
+      popHead(queue);
+      return;
+    }
+
+    queue.failed++;
+    queue.retryAt = millis() + OUTBOUND_RETRY_DELAY;
+    message.attempts++;
+    bool rejected = takeRequestRejected();
+    if (rejected || (queue.maxAttempts > 0 && message.attempts >= queue.maxAttempts)) {
+      uint8_t kind = message.kind;
+      if (rejected) {
+        queue.rejected++;
+        // Nothing was wrong with the connection, so the class goes on at once
+        queue.retryAt = millis();
+      }
+      dropHead(queue, rejected ? "rejected" : "send failed");
+      if (kind == MSG_HEARTBEAT) {
+        LOG_W("Failed to send heartbeat, updating device status instead");
+        queueDeviceStatus(pumpStatus, automaticMode);
+      }
+    }
+    // One request per pass, so newly queued control messages go next
+    return;
+  }
+}
+
+// Messages waiting in a class
+int getOutboundDepth(OutboundClass outboundClass) {
+  return queues[outboundClass].count;
+}
+
+// Add per-class queue statistics to a telemetry object
+void appendOutboundMetrics(JsonObject metrics) {
+  JsonObject outbound = metrics.createNestedObject("outbound");
+  unsigned long now = millis();
+
+  for (int i = 0; i < OUTBOUND_CLASS_COUNT; i++) {
+    OutboundQueue& queue = queues[i];
+    JsonObject entry = outbound.createNestedObject(queue.name);
+    entry["depth"] = queue.count;
+    entry["peak_depth"] = queue.peakDepth;
+    entry["oldest_ms"] = queue.count > 0 ? now - headOf(queue).queuedAt : 0;
+    entry["sent"] = queue.sent;
+    entry["failed"] = queue.failed;
+    entry["dropped"] = queue.dropped;
+    entry["rejected"] = queue.rejected;
+    entry["wait_avg_ms"] = queue.sent > 0 ? queue.waitTotalMs / queue.sent : 0;
+    entry["wait_max_ms"] = queue.waitMaxMs;
+  }
+}
@@ -0,0 +1,58 @@
+/*
+ * IriQ Smart Irrigation System - Outbound Queue Header
+ *
+ * Header file for the outbound queue, which sends everything the device
+ * reports to Supabase in priority order: control-plane messages first, then
+ * heartbeats, then telemetry.
+ */
+
+#ifndef OUTBOUND_H
+#define OUTBOUND_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Priority classes, most urgent first
+enum OutboundClass {
+  OUTBOUND_CONTROL,    // Device status changes and command acknowledgements
+  OUTBOUND_PRESENCE,   // Heartbeats
+  OUTBOUND_TELEMETRY,  // Sensor readings, usage reports and sensor node batches
+  OUTBOUND_CLASS_COUNT
+};
+
+// Queue the device status; replaces a status not yet sent
+void queueDeviceStatus(bool pumpStatus, bool automaticMode);
+
+// Queue the acknowledgement of executed commands (comma-separated ids);
+// merged with acknowledgements not yet sent
+void queueCommandAck(const String& commandIds);
+
+// Ids of applied commands whose acknowledgement is not yet sent
+// (comma-separated, empty when none); command polls skip them
+const char* getUnackedCommandIds();
+
+// True when the acknowledgement buffer has room for another poll's ids
+bool canQueueCommandAcks();
+
+// Queue a heartbeat; replaces one not yet sent
+void queueHeartbeat();
+
+// Queue a sensor reading; the oldest reading is dropped when the class is full
+void queueSensorReading(int moistureLevel);
+
+// Queue an upload of pending pump usage; replaces one not yet sent
+void queueUsageReport();
+
+// Queue an upload of the sensor node readings; replaces one not yet sent
+void queueNodeBatch();
+
+// Send the most urgent queued message (outbound task)
+void outboundLoop();
+
+// Messages waiting in a class
+int getOutboundDepth(OutboundClass outboundClass);
+
+// Add per-class queue statistics to a telemetry object
+void appendOutboundMetrics(JsonObject metrics);
+
+#endif // OUTBOUND_H
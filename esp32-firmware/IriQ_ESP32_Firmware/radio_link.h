@@ -0,0 +1,35 @@
+/*
+ * IriQ Smart Irrigation System - Radio Link Header
+ *
+ * Header file for the short-range link between sensor nodes and the
+ * gateway. The device implementation is ESP-NOW (espnow_link.cpp); the
+ * host simulation in esp32-firmware/replay supplies the same functions
+ * with loss, duplication and reordering.
+ */
+
+#ifndef RADIO_LINK_H
+#define RADIO_LINK_H
+
+#include <Arduino.h>
+
+#define RADIO_MAC_LENGTH 6
+
+// Called from radioPoll() on the caller's task for each received frame
+typedef void (*RadioReceiveCallback)(const uint8_t* mac, const uint8_t* data, size_t length);
+
+// The broadcast address, used by nodes until they have heard their gateway
+extern const uint8_t radioBroadcastMac[RADIO_MAC_LENGTH];
+
+// Start the link on the current WiFi channel
+bool initRadioLink();
+
+// Send a frame to a peer (or radioBroadcastMac); true once it is handed to the radio
+bool radioSend(const uint8_t* mac, const uint8_t* data, size_t length);
+
+// Deliver the frames received since the last call
+void radioPoll(RadioReceiveCallback callback);
+
+// This radio's address
+void getRadioMac(uint8_t* mac);
+
+#endif // RADIO_LINK_H
@@ -0,0 +1,210 @@
+/*
+ * IriQ Smart Irrigation System - Sampler Module
+ *
+ * This module sets how often the moisture sensor is read:
+ * - at the minimum interval while the pump runs, or in automatic mode while
+ *   the reading is within nearThreshold points of MOISTURE_THRESHOLD, so the
+ *   pump goes off within about a second of the soil getting wet enough
+ * - at READING_INTERVAL while the reading moves
+ * - doubling up to the maximum interval while the reading stays stable
+ * - in automatic mode, short enough to sample at least twice before a
+ *   falling reading reaches the threshold band at its current rate
+ *
+ * At fast rates only readings that moved, or one per SAMPLE_UPLOAD_INTERVAL,
+ * are uploaded. The bounds come from the device's row in device_settings,
+ * are kept in NVS, and fall back to the config.h values.
+ */
+
+#include "sampler.h"
+#include "config.h"
+#include "logger.h"
+#include "supabase_api.h"
+#include "api_client.h"
+#include "memory_pool.h"
+#include "state_store.h"
+
+// External variables
+extern String deviceId;
+
+static SamplingSettings settings = { SAMPLE_INTERVAL_MIN, SAMPLE_INTERVAL_MAX, SAMPLE_NEAR_THRESHOLD };
+static bool remoteSettings = false;
+
+// Persisted copy of the remote settings
+static SamplingSettings stored = { SAMPLE_INTERVAL_MIN, SAMPLE_INTERVAL_MAX, SAMPLE_NEAR_THRESHOLD };
+static int minSlot = -1;
+static int maxSlot = -1;
+static int nearSlot = -1;
+
+static unsigned long currentInterval = READING_INTERVAL;
+static int lastMoisture = -1;
+static unsigned long lastSampleTime = 0;
+static int lastUploadedMoisture = -1;
+static unsigned long lastUploadTime = 0;
+
+// Statistics
+static uint32_t samples = 0;
+static uint32_t uploadsSkipped = 0;
+static uint32_t fastSamples = 0;
+
+static unsigned long clampInterval(unsigned long interval) {
+  if (interval < settings.minIntervalMs) {
+    return settings.minIntervalMs;
+  }
+  if (interval > settings.maxIntervalMs) {
+    return settings.maxIntervalMs;
+  }
+  return interval;
+}
+
+// Reject settings that would stall sampling or spin the sensor task
+static bool applySettings(const SamplingSettings& candidate) {
+  if (candidate.minIntervalMs < SAMPLE_INTERVAL_FLOOR || candidate.maxIntervalMs < candidate.minIntervalMs ||
+      candidate.maxIntervalMs > SAMPLE_INTERVAL_CEILING || candidate.nearThreshold < 0 ||
+      candidate.nearThreshold > 100) {
+    LOG_W("Ignoring sampling settings %lu-%lu ms, near %d", candidate.minIntervalMs, candidate.maxIntervalMs,
+          candidate.nearThreshold);
+    return false;
+  }
+  settings = candidate;
+  currentInterval = clampInterval(currentInterval);
+  return true;
+}
+
+// Load the settings last received from Supabase
+void initSampler() {
+  minSlot = registerState("sampling", "min", STATE_U32, &stored.minIntervalMs, sizeof(stored.minIntervalMs),
+                          STATE_COMMIT_DELAY);
+  maxSlot = registerState("sampling", "max", STATE_U32, &stored.maxIntervalMs, sizeof(stored.maxIntervalMs),
+                          STATE_COMMIT_DELAY);
+  nearSlot = registerState("sampling", "near", STATE_I32, &stored.nearThreshold, sizeof(stored.nearThreshold),
+                           STATE_COMMIT_DELAY);
+  if (!isStateStored(minSlot)) {
+    return;
+  }
+
+  remoteSettings = applySettings(stored);
+  LOG_I("Sampling every %lu-%lu ms (stored settings)", settings.minIntervalMs, settings.maxIntervalMs);
+}
+
+// Interval until the next reading
+unsigned long nextSampleInterval(int moisture, bool pump, bool automatic) {
+  unsigned long now = millis();
+  int distance = abs(moisture - MOISTURE_THRESHOLD);
+  int change = lastMoisture < 0 ? 0 : moisture - lastMoisture;
+  unsigned long elapsed = now - lastSampleTime;
+  unsigned long interval;
+
+  if (pump || (automatic && distance <= settings.nearThreshold)) {
+    interval = settings.minIntervalMs;
+  } else if (lastMoisture < 0 || abs(change) >= SAMPLE_STABLE_DELTA) {
+    interval = READING_INTERVAL;
+  } else {
+    // Stable: back off towards the maximum
+    interval = currentInterval * 2;
+  }
+
+  // Heading for the threshold band: sample at least twice before reaching it
+  bool approaching = (moisture > MOISTURE_THRESHOLD && change < 0) || (moisture < MOISTURE_THRESHOLD && change > 0);
+  if (automatic && !pump && approaching && distance > settings.nearThreshold && elapsed > 0) {
+    unsigned long eta = (unsigned long)(distance - settings.nearThreshold) * elapsed / abs(change);
+    if (eta / 2 < interval) {
+      interval = eta / 2;
+    }
+  }
+
+  interval = clampInterval(interval);
+  if (interval != currentInterval) {
+    LOG_D("Sampling interval %lu -> %lu ms (moisture %d%%, pump %s)", currentInterval, interval, moisture,
+          pump ? "ON" : "OFF");
+  }
+
+  currentInterval = interval;
+  lastMoisture = moisture;
+  lastSampleTime = now;
+  samples++;
+  if (interval == settings.minIntervalMs) {
+    fastSamples++;
+  }
+  return interval;
+}
+
+// Whether a reading should be uploaded
+bool shouldUploadReading(int moisture) {
+  if (lastUploadedMoisture < 0 || millis() - lastUploadTime >= SAMPLE_UPLOAD_INTERVAL ||
+      abs(moisture - lastUploadedMoisture) >= SAMPLE_STABLE_DELTA) {
+    return true;
+  }
+  uploadsSkipped++;
+  return false;
+}
+
+// Note a reading that was uploaded
+void markReadingUploaded(int moisture) {
+  lastUploadedMoisture = moisture;
+  lastUploadTime = millis();
+}
+
+// Fetch the device's row from device_settings
+void fetchSamplingSettings() {
+  if (WiFi.status() != WL_CONNECTED || !ensureValidAuth()) {
+    return;
+  }
+
+  ArenaString path(112 + deviceId.length());
+  path += "device_settings?select=sample_interval_min_ms,sample_interval_max_ms,sample_near_threshold"
+          "&device_id=eq.";
+  path += deviceId;
+  ApiResponse response = apiRequest(ENDPOINT_DEVICE_SETTINGS, "GET", path.c_str(), "", API_READ_BODY);
+  if (!response.ok()) {
+    if (response.sent) {
+      LOG_W("Error fetching sampling settings (HTTP %d)", response.statusCode);
+    }
+    return;
+  }
+
+  ArenaJsonDocument doc(256);
+  DeserializationError error = deserializeJson(doc, response.body.data(), response.body.length());
+  if (error) {
+    LOG_W("Error parsing sampling settings: %s", error.c_str());
+    return;
+  }
+
+  // No row: back to the config.h defaults
+  SamplingSettings received = { SAMPLE_INTERVAL_MIN, SAMPLE_INTERVAL_MAX, SAMPLE_NEAR_THRESHOLD };
+  JsonObject row = doc[0];
+  if (!row.isNull()) {
+    received.minIntervalMs = row["sample_interval_min_ms"] | (unsigned long)SAMPLE_INTERVAL_MIN;
+    received.maxIntervalMs = row["sample_interval_max_ms"] | (unsigned long)SAMPLE_INTERVAL_MAX;
+    received.nearThreshold = row["sample_near_threshold"] | SAMPLE_NEAR_THRESHOLD;
+  }
+
+  if (received.minIntervalMs == settings.minIntervalMs && received.maxIntervalMs == settings.maxIntervalMs &&
+      received.nearThreshold == settings.nearThreshold) {
+    return;
+  }
+  if (!applySettings(received)) {
+    return;
+  }
+
+  remoteSettings = !row.isNull();
+  stored = settings;
+  if (!remoteSettings) {
+    clearState(minSlot);
+    clearState(maxSlot);
+    clearState(nearSlot);
+  }
+  LOG_I("Sampling every %lu-%lu ms, minimum within %d%% of the threshold", settings.minIntervalMs,
+        settings.maxIntervalMs, settings.nearThreshold);
+}
+
+// Add sampling statistics to a telemetry object
+void appendSamplerMetrics(JsonObject metrics) {
+  JsonObject sampling = metrics.createNestedObject("sampling");
+  sampling["interval_ms"] = currentInterval;
+  sampling["min_ms"] = settings.minIntervalMs;
+  sampling["max_ms"] = settings.maxIntervalMs;
+  sampling["remote"] = remoteSettings;
+  sampling["samples"] = samples;
+  sampling["fast_samples"] = fastSamples;
+  sampling["uploads_skipped"] = uploadsSkipped;
+}
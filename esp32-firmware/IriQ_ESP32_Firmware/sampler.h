@@ -0,0 +1,40 @@
+/*
+ * IriQ Smart Irrigation System - Sampler Header
+ *
+ * Header file for the adaptive sampler, which picks the interval of the
+ * sensor task from the pump state and how the moisture reading moves.
+ */
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Interval bounds, set from config.h and overridden by device_settings
+struct SamplingSettings {
+  unsigned long minIntervalMs;  // While the pump runs or moisture is near the threshold
+  unsigned long maxIntervalMs;  // Ceiling once the reading is stable
+  int nearThreshold;            // Percentage points around the threshold sampled at the minimum
+};
+
+// Load the settings last received from Supabase (or the config.h defaults)
+void initSampler();
+
+// Interval until the next reading, given the one just taken
+unsigned long nextSampleInterval(int moisture, bool pump, bool automatic);
+
+// Whether a reading should be uploaded; readings taken faster than
+// SAMPLE_UPLOAD_INTERVAL are only sent when they moved
+bool shouldUploadReading(int moisture);
+
+// Note a reading that was uploaded
+void markReadingUploaded(int moisture);
+
+// Fetch the device's row from device_settings and apply it (network task)
+void fetchSamplingSettings();
+
+// Add sampling statistics to a telemetry object
+void appendSamplerMetrics(JsonObject metrics);
+
+#endif // SAMPLER_H
@@ -0,0 +1,118 @@
+/*
+ * IriQ Smart Irrigation System - Scheduler Module
+ * 
+ * This module runs periodic work cooperatively from loop().
+ * Each task has its own interval, so slow jobs such as network uploads never
+ * delay the control tasks by more than one task's runtime.
+ */
+
+#include "scheduler.h"
+#include "logger.h"
+
+struct ScheduledTask {
+  const char* name;
+  TaskCallback callback;
+  unsigned long intervalMs;
+  unsigned long lastRunTime;
+  unsigned long nextDelayMs;   // Delay from lastRunTime until the next run
+  unsigned long maxRuntimeMs;  // Longest observed run, for diagnostics
+  bool enabled;
+};
+
+static ScheduledTask tasks[MAX_SCHEDULED_TASKS];
+static int taskCount = 0;
+
+// Register a periodic task
+int scheduleTask(const char* name, TaskCallback callback, unsigned long intervalMs, unsigned long initialDelayMs) {
+  if (taskCount >= MAX_SCHEDULED_TASKS) {
+    LOG_E("Scheduler full, cannot add task %s", name);
+    return -1;
+  }
+  
+  ScheduledTask& task = tasks[taskCount];
+  task.name = name;
+  task.callback = callback;
+  task.intervalMs = intervalMs;
+  task.lastRunTime = millis();
+  task.nextDelayMs = initialDelayMs;
+  task.maxRuntimeMs = 0;
+  task.enabled = true;
+  
+  return taskCount++;
+}
+
+// Change the interval of a task
+void setTaskInterval(int taskId, unsigned long intervalMs) {
+  if (taskId < 0 || taskId >= taskCount) {
+    return;
+  }
+  tasks[taskId].intervalMs = intervalMs;
+  tasks[taskId].nextDelayMs = intervalMs;
+}
+
+// Run a task on the next scheduler pass
+void runTaskNow(int taskId) {
+  if (taskId < 0 || taskId >= taskCount) {
+    return;
+  }
+  tasks[taskId].enabled = true;
+  tasks[taskId].nextDelayMs = 0;
+}
+
+// Enable or disable a task
+void setTaskEnabled(int taskId, bool enabled) {
+  if (taskId < 0 || taskId >= taskCount) {
+    return;
+  }
+  tasks[taskId].enabled = enabled;
+}
+
+// Run every task that is due
+void runScheduler() {
+  for (int i = 0; i < taskCount; i++) {
+    ScheduledTask& task = tasks[i];
+    
+    if (!task.enabled || millis() - task.lastRunTime < task.nextDelayMs) {
+      continue;
+    }
+    
+    unsigned long startTime = millis();
+    task.lastRunTime = startTime;
+    task.nextDelayMs = task.intervalMs;
+    
+    // One-shot tasks disable themselves before running so they can re-arm
+    if (task.intervalMs == 0) {
+      task.enabled = false;
+    }
+    
+    task.callback();
+    
+    unsigned long runtime = millis() - startTime;
+    if (runtime > task.maxRuntimeMs) {
+      task.maxRuntimeMs = runtime;
+      LOG_D("Task %s new max runtime %lu ms", task.name, runtime);
+    }
+  }
+}
+
+// Milliseconds until the next task is due
+unsigned long getSchedulerIdleTime() {
+  unsigned long idle = 1000;
+  unsigned long now = millis();
+  
+  for (int i = 0; i < taskCount; i++) {
+    if (!tasks[i].enabled) {
+      continue;
+    }
+    unsigned long elapsed = now - tasks[i].lastRunTime;
+    if (elapsed >= tasks[i].nextDelayMs) {
+      return 0;
+    }
+    unsigned long remaining = tasks[i].nextDelayMs - elapsed;
+    if (remaining < idle) {
+      idle = remaining;
+    }
+  }
+  
+  return idle;
+}
@@ -0,0 +1,35 @@
+/*
+ * IriQ Smart Irrigation System - Scheduler Header
+ * 
+ * Header file for the cooperative task scheduler.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+#define MAX_SCHEDULED_TASKS 16
+
+typedef void (*TaskCallback)();
+
+// Register a periodic task; an interval of 0 makes it a one-shot task.
+// Returns the task id, or -1 if the task table is full.
+int scheduleTask(const char* name, TaskCallback callback, unsigned long intervalMs, unsigned long initialDelayMs = 0);
+
+// Change the interval of a task (takes effect from its last run)
+void setTaskInterval(int taskId, unsigned long intervalMs);
+
+// Run a task on the next scheduler pass
+void runTaskNow(int taskId);
+
+// Enable or disable a task
+void setTaskEnabled(int taskId, bool enabled);
+
+// Run every task that is due; call from loop()
+void runScheduler();
+
+// Milliseconds until the next task is due (for idle delays)
+unsigned long getSchedulerIdleTime();
+
+#endif // SCHEDULER_H
@@ -0,0 +1,97 @@
+/*
+ * IriQ Smart Irrigation System - Sensor Node Module
+ *
+ * This module sends a node's reading to the gateway. Every wake-up takes
+ * the next sequence number. The frame is repeated every NODE_ACK_TIMEOUT
+ * until the gateway acknowledges that sequence, for at most
+ * NODE_SEND_ATTEMPTS sends; the gateway drops the repeats it already has.
+ * The first frames go to the broadcast address. After the gateway answers,
+ * the node sends to its address and falls back to broadcast if it stops
+ * answering.
+ *
+ * Nothing blocks here, so the host simulation can step many nodes and the
+ * gateway on one virtual clock.
+ */
+
+#include "sensor_node.h"
+#include "config.h"
+#include "logger.h"
+
+// Node whose frames radioPoll() is delivering
+static SensorNode* pollingNode = nullptr;
+
+static void sendFrame(SensorNode* node) {
+  const uint8_t* destination = node->gatewayKnown ? node->gatewayMac : radioBroadcastMac;
+  if (node->attempts > 0) {
+    node->retries++;
+  }
+  node->attempts++;
+  node->sentAt = millis();
+  if (!radioSend(destination, (const uint8_t*)&node->frame, sizeof(node->frame))) {
+    LOG_D("Node frame %lu not sent", (unsigned long)node->sequence);
+  }
+}
+
+static void onNodeFrame(const uint8_t* mac, const uint8_t* data, size_t length) {
+  SensorNode* node = pollingNode;
+  NodeFrame ack;
+  if (!openNodeFrame(data, length, &ack) || ack.type != NODE_FRAME_ACK || node->state != NODE_WAITING ||
+      ack.sequence != node->sequence) {
+    return;
+  }
+  memcpy(node->gatewayMac, mac, RADIO_MAC_LENGTH);
+  node->gatewayKnown = true;
+  node->acknowledged = true;
+  node->state = NODE_ACKED;
+  node->acked++;
+}
+
+// Reset a node after power-on
+void initSensorNode(SensorNode* node, uint32_t firstSequence) {
+  memset(node, 0, sizeof(*node));
+  node->sequence = firstSequence;
+}
+
+// Send a reading to the gateway
+void beginNodeReading(SensorNode* node, int moisture, uint16_t batteryMv) {
+  node->sequence++;
+  node->readings++;
+  node->attempts = 0;
+  node->state = NODE_WAITING;
+
+  memset(&node->frame, 0, sizeof(node->frame));
+  node->frame.flags = node->acknowledged ? 0 : NODE_FLAG_FIRST;
+  if (moisture < 0) {
+    node->frame.flags |= NODE_FLAG_SENSOR_FAULT;
+  }
+  node->frame.sequence = node->sequence;
+  node->frame.moisture = moisture;
+  node->frame.batteryMv = batteryMv;
+  sealNodeFrame(&node->frame, NODE_FRAME_READING);
+  sendFrame(node);
+}
+
+// Take acknowledgements and retry
+bool nodeLoop(SensorNode* node) {
+  pollingNode = node;
+  radioPoll(onNodeFrame);
+  pollingNode = nullptr;
+
+  if (node->state != NODE_WAITING) {
+    return true;
+  }
+  if (millis() - node->sentAt < NODE_ACK_TIMEOUT) {
+    return false;
+  }
+
+  if (node->attempts >= NODE_SEND_ATTEMPTS) {
+    LOG_W("No acknowledgement for reading %lu from the gateway", (unsigned long)node->sequence);
+    // The gateway may have moved; look for it again next time
+    node->gatewayKnown = false;
+    node->state = NODE_GAVE_UP;
+    node->gaveUp++;
+    return true;
+  }
+  sendFrame(node);
+  return false;
+}
@@ -0,0 +1,50 @@
+/*
+ * IriQ Smart Irrigation System - Sensor Node Header
+ *
+ * Header file for the battery sensor node side of the ESP-NOW link (built
+ * with SENSOR_NODE_MODE): send one reading, wait for the gateway's
+ * acknowledgement with retries, then let the sketch go back to deep sleep.
+ */
+
+#ifndef SENSOR_NODE_H
+#define SENSOR_NODE_H
+
+#include <Arduino.h>
+#include "node_protocol.h"
+#include "radio_link.h"
+
+enum NodeCycleState : uint8_t {
+  NODE_IDLE,
+  NODE_WAITING,   // Sent, waiting for the acknowledgement
+  NODE_ACKED,
+  NODE_GAVE_UP    // NODE_SEND_ATTEMPTS without an acknowledgement
+};
+
+// Node state; on the device it lives in RTC memory across deep sleep
+struct SensorNode {
+  uint32_t sequence;
+  uint8_t gatewayMac[RADIO_MAC_LENGTH];
+  bool gatewayKnown;    // Unicast once the gateway has answered, broadcast until then
+  bool acknowledged;    // The gateway has acknowledged a frame since power-on
+  uint8_t state;
+  uint8_t attempts;
+  unsigned long sentAt;
+  NodeFrame frame;
+
+  // Statistics
+  uint32_t readings;
+  uint32_t acked;
+  uint32_t gaveUp;
+  uint32_t retries;
+};
+
+// Reset a node after power-on; firstSequence should be random
+void initSensorNode(SensorNode* node, uint32_t firstSequence);
+
+// Send a reading to the gateway
+void beginNodeReading(SensorNode* node, int moisture, uint16_t batteryMv);
+
+// Take acknowledgements and retry; true once the reading is acknowledged or given up
+bool nodeLoop(SensorNode* node);
+
+#endif // SENSOR_NODE_H
@@ -7,6 +7,11 @@
 #include "sensors.h"
 #include "config.h"
 #include "supabase_api.h"
+#include "logger.h"
+#include "control_state.h"
+#include "trace.h"
+#include "metering.h"
+#include "outbound.h"
 #include <Arduino.h>
 
 // External variables
@@ -15,6 +20,7 @@ extern const int pumpRelayPin;
 extern bool pumpStatus;
 extern bool automaticMode;
 extern const int ledPin;
+extern int moistureLevel;
 
 // Initialize sensors
 void initSensors() {
@@ -27,8 +33,7 @@ void initSensors() {
   digitalWrite(pumpRelayPin, HIGH);
   pumpStatus = false;
   
-  Serial.println("Sensors initialized");
-  Serial.println("Pump relay initialized to OFF state (pin set HIGH for active LOW relay)");
+  LOG_I("Sensors initialized, pump relay OFF (pin HIGH, active LOW relay)");
 }
 
 // Read moisture sensor with improved accuracy through averaging
@@ -41,6 +46,7 @@ int readMoistureSensor() {
   // Collect multiple samples
   for (int i = 0; i < numReadings; i++) {
     readings[i] = analogRead(moistureSensorPin);
+    TRACE(TRACE_ADC, readings[i]);
     total += readings[i];
     delay(20); // Small delay between readings
   }
@@ -48,10 +54,6 @@ int readMoistureSensor() {
   // Calculate average
   int rawValue = total / numReadings;
   
-  // Print raw value for debugging
-  Serial.print("Moisture sensor raw value (averaged): ");
-  Serial.println(rawValue);
-  
   // Convert to percentage (0-100, where 0 is dry and 100 is wet)
   // FIXED CALIBRATION: For your specific sensor
   // If your sensor reads 4095 when dry and lower values when wet
@@ -79,13 +81,9 @@ int readMoistureSensor() {
     moistureLevel = (moistureLevel * 7 + lastMoistureLevel * 3) / 10;
   }
   lastMoistureLevel = moistureLevel;
+  TRACE(TRACE_READING, moistureLevel);
   
-  Serial.print("Moisture level (smoothed): ");
-  Serial.print(moistureLevel);
-  Serial.println("%");
-  Serial.print("Moisture threshold for pump: ");
-  Serial.print(MOISTURE_THRESHOLD);
-  Serial.println("%");
+  LOG_D("Moisture raw=%d smoothed=%d%% threshold=%d%%", rawValue, moistureLevel, MOISTURE_THRESHOLD);
   
   return moistureLevel;
 }
@@ -105,6 +103,8 @@ void setPumpStatus(bool status) {
   // Most relay modules are active LOW, so we invert the logic
   // This means LOW turns the relay ON, HIGH turns it OFF
   digitalWrite(pumpRelayPin, status ? LOW : HIGH);
+  TRACE(TRACE_PUMP, status);
+  recordPumpTransition(status, automaticMode);
   
   // Double-check that the pin is in the correct state with multiple attempts
   for (int i = 0; i < 3; i++) { // Try multiple times to ensure the relay responds
@@ -114,12 +114,10 @@ void setPumpStatus(bool status) {
   
   // Physically verify the pin state
   int pinState = digitalRead(pumpRelayPin);
-  Serial.print("Verified relay pin state: ");
-  Serial.println(pinState == LOW ? "LOW (ON)" : "HIGH (OFF)");
   
   // If the pin state doesn't match what we want, try again with more force
   if ((status && pinState != LOW) || (!status && pinState != HIGH)) {
-    Serial.println("Relay state verification failed! Trying again with more force...");
+    LOG_W("Relay state verification failed (pin %s), retrying", pinState == LOW ? "LOW" : "HIGH");
     pinMode(pumpRelayPin, OUTPUT); // Re-initialize pin
     digitalWrite(pumpRelayPin, status ? LOW : HIGH); // Set state again
     delay(100); // Longer delay
@@ -134,34 +132,29 @@ void setPumpStatus(bool status) {
     delay(100);
   }
   
-  Serial.print("Pump status set to: ");
-  Serial.println(status ? "ON" : "OFF");
-  Serial.print("Pump relay pin ");
-  Serial.print(pumpRelayPin);
-  Serial.print(" set to ");
-  Serial.println(status ? "LOW (ON)" : "HIGH (OFF)");
-  Serial.println("Note: Relay is ACTIVE LOW - LOW turns relay ON, HIGH turns it OFF");
-  
-  // Update device status in Supabase immediately
-  if (!updateDeviceStatus(pumpStatus, automaticMode)) {
-    Serial.println("Failed to update device status in Supabase. Will retry in next loop.");
-  }
+  LOG_I("Pump %s (relay pin %d %s)", status ? "ON" : "OFF", pumpRelayPin, status ? "LOW" : "HIGH");
+  
+  // Persist so a reboot resumes from this state
+  saveControlState(pumpStatus, automaticMode);
+  
+  // Report the change ahead of any queued telemetry
+  queueDeviceStatus(pumpStatus, automaticMode);
 }
 
 // Set automatic mode
 void setAutomaticMode(bool mode) {
   // Check if we're actually changing the mode
   if (automaticMode == mode) {
-    Serial.print("Automatic mode already set to: ");
-    Serial.println(mode ? "ON" : "OFF");
+    LOG_D("Automatic mode already %s", mode ? "ON" : "OFF");
     return;
   }
   
   // Update the global variable
   automaticMode = mode;
+  TRACE(TRACE_MODE, mode);
   
-  Serial.print("Automatic mode set to: ");
-  Serial.println(mode ? "ON" : "OFF");
+  LOG_I("Mode set to %s", mode ? "AUTOMATIC" : "MANUAL");
+  saveControlState(pumpStatus, automaticMode);
   
   // Blink LED to indicate mode change
   for (int i = 0; i < (mode ? 3 : 1); i++) {
@@ -171,16 +164,68 @@ void setAutomaticMode(bool mode) {
     delay(100);
   }
   
-  // If switching to automatic mode, we might need to immediately
-  // adjust the pump based on moisture levels
-  if (mode) {
-    Serial.println("Switching to automatic mode - pump will be controlled based on moisture levels");
-  } else {
-    Serial.println("Switching to manual mode - pump will be controlled by user commands");
+  // Report the change ahead of any queued telemetry
+  queueDeviceStatus(pumpStatus, automaticMode);
+}
+
+// Handle automatic mode logic
+void handleAutomaticMode() {
+  LOG_D("Automatic mode: moisture %d%%, threshold %d%%, pump %s",
+        moistureLevel, MOISTURE_THRESHOLD, pumpStatus ? "ON" : "OFF");
+  
+  if (moistureLevel < MOISTURE_THRESHOLD && !pumpStatus) {
+    // Soil is too dry and pump is off, turn it on
+    setPumpStatus(true);
+    LOG_I("Automatic mode: Soil too dry, turning pump ON");
+  } else if (moistureLevel >= MOISTURE_THRESHOLD && pumpStatus) {
+    // Soil is wet enough and pump is on, turn it off
+    setPumpStatus(false);
+    LOG_I("Automatic mode: Soil wet enough, turning pump OFF");
+  } else if (moistureLevel >= MOISTURE_THRESHOLD) {
+    // Force pump off if moisture is above threshold, regardless of current state
+    // This ensures the pump is always off when moisture is sufficient
+    if (pumpStatus) {
+      setPumpStatus(false);
+      LOG_I("Automatic mode: Forcing pump OFF as moisture is sufficient");
+    }
+  }
+}
+
+// Apply a requested pump/mode state; shared by remote commands and the LAN API
+void applyControl(bool pumpControl, bool requestedAutomatic) {
+  TRACE(TRACE_COMMAND, pumpControl, requestedAutomatic);
+  
+  // First handle mode changes, as they affect pump behavior
+  if (requestedAutomatic != automaticMode) {
+    // Set the mode first
+    setAutomaticMode(requestedAutomatic);
+    
+    // If switching to automatic mode, immediately apply automatic logic
+    if (requestedAutomatic) {
+      // Skip pump control command since automatic mode will handle it
+      handleAutomaticMode();
+    } else {
+      // If switching to manual mode, apply the requested pump status
+      setPumpStatus(pumpControl);
+    }
+  } 
+  // Only handle pump control commands in manual mode
+  else if (!automaticMode) {
+    // Always apply pump control in manual mode, even if it appears to match current status
+    // This ensures the physical relay state matches the command
+    
+    // Force the pump status to change with extra verification
+    setPumpStatus(pumpControl);
+    
+    // Double-check that the pump status was actually applied
+    delay(200); // Wait for relay to stabilize
+    if (pumpStatus != pumpControl) {
+      LOG_W("Pump status doesn't match command, trying again");
+      setPumpStatus(pumpControl); // Try again
+    }
+  } else if (automaticMode) {
+    LOG_I("Ignoring pump control command in automatic mode");
   }
-  
-  // Update device status in Supabase
-  updateDeviceStatus(pumpStatus, automaticMode);
 }
 
 // Use blinkLED function from main file
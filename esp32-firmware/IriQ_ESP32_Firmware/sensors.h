@@ -15,6 +15,7 @@ extern const int pumpRelayPin;
 extern const int ledPin;
 extern bool pumpStatus;
 extern bool automaticMode;
+extern int moistureLevel;
 
 // Initialize sensors
 void initSensors();
@@ -28,6 +29,12 @@ void setPumpStatus(bool status);
 // Set automatic mode
 void setAutomaticMode(bool mode);
 
+// Switch the pump from the latest reading (automatic mode)
+void handleAutomaticMode();
+
+// Apply a requested pump/mode state; shared by remote commands and the LAN API
+void applyControl(bool pumpControl, bool requestedAutomatic);
+
 // Blink LED to indicate status
 void blinkLED(int times, int delayMs);
 
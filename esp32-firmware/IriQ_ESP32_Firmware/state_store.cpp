@@ -0,0 +1,362 @@
+/*
+ * IriQ Smart Irrigation System - State Store Module
+ *
+ * This module owns every NVS write. A module registers a variable under a
+ * namespace and key; the variable itself is the in-RAM value and the store
+ * keeps a copy of what NVS holds. The state task compares the two:
+ * - a change is written once it has been pending for the slot's delay, so a
+ *   burst of changes costs one write, and a value changed back before then
+ *   costs none
+ * - requestStateCommit() writes a slot on the next pass, for events that
+ *   must survive a reset (a pump run ending)
+ * - at most STATE_MAX_WRITES_PER_PASS slots are written per pass, so the
+ *   loop never stalls on a batch of flash writes
+ * - everything pending is written on restart (esp_restart() shutdown hook)
+ *
+ * Modules never open Preferences themselves, and the writes per namespace
+ * are reported in telemetry.
+ */
+
+#include "state_store.h"
+#include "logger.h"
+#include <Preferences.h>
+#include <esp_system.h>
+
+#define STATE_MAX_SLOTS 24
+#define STATE_MAX_SPACES 8
+
+struct StateSpace {
+  const char* name;
+  Preferences preferences;
+  uint32_t writes;
+};
+
+struct StateSlot {
+  const char* key;
+  uint8_t space;
+  StateType type;
+  bool stored;        // NVS holds a value
+  bool dirty;         // Changed since the last write
+  bool urgent;        // Write on the next pass
+  bool erasePending;  // clearState() not yet applied
+  void* data;
+  uint16_t size;
+  uint16_t shadow;    // Offset of the committed copy
+  unsigned long commitDelay;
+  unsigned long dirtySince;
+  uint32_t writes;
+};
+
+static StateSpace spaces[STATE_MAX_SPACES];
+static int spaceCount = 0;
+static StateSlot slots[STATE_MAX_SLOTS];
+static int slotCount = 0;
+
+// Committed copies of all slots
+static uint8_t shadow[STATE_SHADOW_SIZE];
+static size_t shadowUsed = 0;
+
+// Statistics
+static uint32_t valueWrites = 0;
+static uint32_t bytesWritten = 0;
+static uint32_t valueErases = 0;
+static uint32_t writeFailures = 0;
+static uint32_t deferredWrites = 0;  // Held over by STATE_MAX_WRITES_PER_PASS
+static unsigned long commitMaxUs = 0;
+
+static int openSpace(const char* name) {
+  for (int i = 0; i < spaceCount; i++) {
+    if (strcmp(spaces[i].name, name) == 0) {
+      return i;
+    }
+  }
+  if (spaceCount == STATE_MAX_SPACES) {
+    LOG_E("Too many state namespaces, %s kept in RAM only", name);
+    return -1;
+  }
+  if (!spaces[spaceCount].preferences.begin(name, false)) {
+    LOG_E("Failed to open %s preferences, kept in RAM only", name);
+    return -1;
+  }
+  spaces[spaceCount].name = name;
+  return spaceCount++;
+}
+
+// Size a scalar type must be registered with, 0 for any
+static size_t typeSize(StateType type) {
+  switch (type) {
+    case STATE_BOOL:
+      return sizeof(bool);
+    case STATE_U8:
+      return sizeof(uint8_t);
+    case STATE_I32:
+    case STATE_U32:
+      return sizeof(uint32_t);
+    case STATE_I64:
+      return sizeof(int64_t);
+    default:
+      return 0;
+  }
+}
+
+// Load the stored value into the variable; false when none (or one of another size) is stored
+static bool loadValue(StateSlot& slot, Preferences& preferences) {
+  if (!preferences.isKey(slot.key)) {
+    return false;
+  }
+  switch (slot.type) {
+    case STATE_BOOL:
+      *(bool*)slot.data = preferences.getBool(slot.key, *(bool*)slot.data);
+      return true;
+    case STATE_U8:
+      *(uint8_t*)slot.data = preferences.getUChar(slot.key, *(uint8_t*)slot.data);
+      return true;
+    case STATE_I32:
+      *(int32_t*)slot.data = preferences.getInt(slot.key, *(int32_t*)slot.data);
+      return true;
+    case STATE_U32:
+      *(uint32_t*)slot.data = preferences.getULong(slot.key, *(uint32_t*)slot.data);
+      return true;
+    case STATE_I64:
+      *(int64_t*)slot.data = preferences.getLong64(slot.key, *(int64_t*)slot.data);
+      return true;
+    case STATE_BYTES:
+      return preferences.getBytesLength(slot.key) == slot.size &&
+             preferences.getBytes(slot.key, slot.data, slot.size) == slot.size;
+    case STATE_STRING:
+      return preferences.getString(slot.key, (char*)slot.data, slot.size) > 0;
+  }
+  return false;
+}
+
+// Bytes written, 0 on failure
+static size_t writeValue(StateSlot& slot, Preferences& preferences) {
+  switch (slot.type) {
+    case STATE_BOOL:
+      return preferences.putBool(slot.key, *(bool*)slot.data);
+    case STATE_U8:
+      return preferences.putUChar(slot.key, *(uint8_t*)slot.data);
+    case STATE_I32:
+      return preferences.putInt(slot.key, *(int32_t*)slot.data);
+    case STATE_U32:
+      return preferences.putULong(slot.key, *(uint32_t*)slot.data);
+    case STATE_I64:
+      return preferences.putLong64(slot.key, *(int64_t*)slot.data);
+    case STATE_BYTES:
+      return preferences.putBytes(slot.key, slot.data, slot.size);
+    case STATE_STRING:
+      return preferences.putString(slot.key, (const char*)slot.data);
+  }
+  return 0;
+}
+
+// Bytes that matter for comparison: a string up to and including its NUL
+static size_t valueLength(const StateSlot& slot) {
+  if (slot.type == STATE_STRING) {
+    return strnlen((const char*)slot.data, slot.size - 1) + 1;
+  }
+  return slot.size;
+}
+
+static bool hasChanged(const StateSlot& slot) {
+  return memcmp(slot.data, &shadow[slot.shadow], valueLength(slot)) != 0;
+}
+
+// An empty string is kept as no key at all
+static bool isEmptyValue(const StateSlot& slot) {
+  return slot.type == STATE_STRING && ((const char*)slot.data)[0] == '\0';
+}
+
+static void commitSlot(StateSlot& slot, bool changed) {
+  StateSpace& space = spaces[slot.space];
+
+  if (slot.type == STATE_STRING) {
+    ((char*)slot.data)[slot.size - 1] = '\0';
+  }
+
+  if (changed && !isEmptyValue(slot)) {
+    size_t bytes = writeValue(slot, space.preferences);
+    if (bytes == 0) {
+      writeFailures++;
+      slot.urgent = false;
+      slot.dirtySince = millis();  // Retried after the slot's delay
+      LOG_W("Failed to write %s/%s", space.name, slot.key);
+      return;
+    }
+    slot.stored = true;
+    slot.writes++;
+    space.writes++;
+    valueWrites++;
+    bytesWritten += bytes;
+  } else if (slot.stored) {
+    if (!space.preferences.remove(slot.key)) {
+      writeFailures++;
+      slot.urgent = false;
+      slot.dirtySince = millis();
+      LOG_W("Failed to erase %s/%s", space.name, slot.key);
+      return;
+    }
+    slot.stored = false;
+    valueErases++;
+  }
+
+  memcpy(&shadow[slot.shadow], slot.data, slot.size);
+  slot.dirty = false;
+  slot.urgent = false;
+  slot.erasePending = false;
+}
+
+static void commitPending(bool all) {
+  unsigned long now = millis();
+  unsigned long started = micros();
+  int written = 0;
+
+  for (int i = 0; i < slotCount; i++) {
+    StateSlot& slot = slots[i];
+    bool changed = hasChanged(slot);
+    if (!changed && !slot.erasePending) {
+      // Nothing to write, or changed back before it was written
+      slot.dirty = false;
+      slot.urgent = false;
+      continue;
+    }
+
+    if (!slot.dirty) {
+      slot.dirty = true;
+      slot.dirtySince = now;
+    }
+    if (!all) {
+      if (!slot.urgent && now - slot.dirtySince < slot.commitDelay) {
+        continue;
+      }
+      if (written == STATE_MAX_WRITES_PER_PASS) {
+        deferredWrites++;
+        continue;
+      }
+    }
+    commitSlot(slot, changed);
+    written++;
+  }
+
+  if (written > 0) {
+    unsigned long elapsed = micros() - started;
+    if (elapsed > commitMaxUs) {
+      commitMaxUs = elapsed;
+    }
+  }
+}
+
+// Write pending changes when the device restarts
+void initStateStore() {
+  esp_register_shutdown_handler(commitAllState);
+}
+
+// Register a variable and load its stored value into it
+int registerState(const char* space, const char* key, StateType type, void* data, size_t size,
+                  unsigned long commitDelayMs) {
+  size_t expected = typeSize(type);
+  if (size == 0 || (expected != 0 && size != expected)) {
+    LOG_E("State %s/%s registered with size %u", space, key, (unsigned)size);
+    return -1;
+  }
+  if (slotCount == STATE_MAX_SLOTS || shadowUsed + size > sizeof(shadow)) {
+    LOG_E("State store full, %s/%s kept in RAM only", space, key);
+    return -1;
+  }
+  int spaceIndex = openSpace(space);
+  if (spaceIndex < 0) {
+    return -1;
+  }
+
+  StateSlot& slot = slots[slotCount];
+  memset(&slot, 0, sizeof(slot));
+  slot.key = key;
+  slot.space = spaceIndex;
+  slot.type = type;
+  slot.data = data;
+  slot.size = size;
+  slot.shadow = shadowUsed;
+  slot.commitDelay = commitDelayMs;
+  slot.stored = loadValue(slot, spaces[spaceIndex].preferences);
+  if (type == STATE_STRING) {
+    ((char*)data)[size - 1] = '\0';
+  }
+
+  memcpy(&shadow[slot.shadow], data, size);
+  shadowUsed += size;
+  return slotCount++;
+}
+
+// True when NVS held a value for the slot at registration
+bool isStateStored(int slot) {
+  return slot >= 0 && slot < slotCount && slots[slot].stored;
+}
+
+// Write the slot on the next pass instead of after its delay
+void requestStateCommit(int slot) {
+  if (slot >= 0 && slot < slotCount) {
+    slots[slot].urgent = true;
+  }
+}
+
+// Erase the stored value on the next pass
+void clearState(int slot) {
+  if (slot < 0 || slot >= slotCount) {
+    return;
+  }
+  StateSlot& entry = slots[slot];
+  memcpy(&shadow[entry.shadow], entry.data, entry.size);
+  entry.erasePending = true;
+  entry.urgent = true;
+}
+
+// Write the slots whose delay has passed (state task)
+void stateStoreLoop() {
+  commitPending(false);
+}
+
+// Write every pending change now (restart)
+void commitAllState() {
+  commitPending(true);
+}
+
+// Add write counts to a telemetry object
+void appendStateMetrics(JsonObject metrics) {
+  JsonObject state = metrics.createNestedObject("state");
+  int pending = 0;
+  for (int i = 0; i < slotCount; i++) {
+    if (slots[i].dirty) {
+      pending++;
+    }
+  }
+  state["writes"] = valueWrites;
+  state["bytes"] = bytesWritten;
+  state["erases"] = valueErases;
+  state["failures"] = writeFailures;
+  state["deferred"] = deferredWrites;
+  state["pending"] = pending;
+  state["commit_max_us"] = commitMaxUs;
+
+  JsonObject writes = state.createNestedObject("writes_by_namespace");
+  for (int i = 0; i < spaceCount; i++) {
+    writes[spaces[i].name] = spaces[i].writes;
+  }
+}
+
+// Print the slots and their write counts on the serial console
+void printStateReport() {
+  LOG_I("State store: %d values, %u of %u shadow bytes; %lu writes (%lu bytes), %lu erases, %lu failures",
+        slotCount, (unsigned)shadowUsed, (unsigned)sizeof(shadow), (unsigned long)valueWrites,
+        (unsigned long)bytesWritten, (unsigned long)valueErases, (unsigned long)writeFailures);
+  unsigned long now = millis();
+  for (int i = 0; i < slotCount; i++) {
+    const StateSlot& slot = slots[i];
+    if (slot.dirty) {
+      LOG_I("  %s/%s: %lu writes, change pending for %lu ms", spaces[slot.space].name, slot.key,
+            (unsigned long)slot.writes, now - slot.dirtySince);
+    } else {
+      LOG_I("  %s/%s: %lu writes%s", spaces[slot.space].name, slot.key, (unsigned long)slot.writes,
+            slot.stored ? "" : ", not stored");
+    }
+  }
+}
@@ -0,0 +1,59 @@
+/*
+ * IriQ Smart Irrigation System - State Store Header
+ *
+ * Header file for the persistent state store: module variables registered
+ * under an NVS namespace and key, written back in batches when they change.
+ */
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+// How a variable is kept in NVS; the same Preferences types the modules
+// wrote before the store, so existing values load unchanged
+enum StateType : uint8_t {
+  STATE_BOOL,    // bool
+  STATE_U8,      // uint8_t
+  STATE_I32,     // int32_t
+  STATE_U32,     // uint32_t
+  STATE_I64,     // int64_t
+  STATE_BYTES,   // Fixed-size blob; a stored blob of another size is ignored
+  STATE_STRING   // NUL-terminated char buffer of the registered size
+};
+
+// Write pending changes when the device restarts
+void initStateStore();
+
+// Register a variable and load its stored value into it; the variable keeps
+// its current value when nothing is stored. A change is written once it has
+// been pending for commitDelayMs. Returns the slot, or -1 when the slot table
+// or the shadow is full (the variable is then kept in RAM only).
+int registerState(const char* space, const char* key, StateType type, void* data, size_t size,
+                  unsigned long commitDelayMs);
+
+// True when NVS held a value for the slot at registration
+bool isStateStored(int slot);
+
+// Write the slot on the next pass instead of after its delay
+void requestStateCommit(int slot);
+
+// Erase the stored value; the variable's current value is what a later
+// change is compared against
+void clearState(int slot);
+
+// Write the slots whose delay has passed (state task)
+void stateStoreLoop();
+
+// Write every pending change now (restart)
+void commitAllState();
+
+// Add write counts to a telemetry object
+void appendStateMetrics(JsonObject metrics);
+
+// Print the slots and their write counts on the serial console
+void printStateReport();
+
+#endif // STATE_STORE_H
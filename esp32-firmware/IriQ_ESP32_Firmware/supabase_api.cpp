@@ -8,148 +8,125 @@
 #include "supabase_api.h"
 #include "config.h"
 #include "auth.h"
-#include <HTTPClient.h>
+#include "logger.h"
+#include "api_client.h"
+#include "memory_pool.h"
+#include "outbound.h"
 #include <ArduinoJson.h>
 
 // External variables from main file
-extern const char* supabaseUrl;
-extern const char* supabaseKey;
+extern bool pumpStatus;
 
-// Get ISO formatted time string
-String getISOTime() {
+// Write the ISO formatted time into buffer (21 bytes or more)
+void formatISOTime(char* buffer, size_t size) {
   struct tm timeinfo;
   if(!getLocalTime(&timeinfo)){
-    Serial.println("Failed to obtain time");
-    return String("2025-04-28T00:00:00Z"); // Fallback time if NTP fails
+    LOG_W("Failed to obtain time");
+    snprintf(buffer, size, "2025-04-28T00:00:00Z"); // Fallback time if NTP fails
+    return;
   }
+  strftime(buffer, size, "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
+}
+
+// Get ISO formatted time string
+String getISOTime() {
   char timeStringBuff[30];
-  strftime(timeStringBuff, sizeof(timeStringBuff), "%Y-%m-%dT%H:%M:%SZ", &timeinfo);
+  formatISOTime(timeStringBuff, sizeof(timeStringBuff));
   return String(timeStringBuff);
 }
 
-// Ensure we have a valid authentication token
+// Check for a valid authentication token; the auth task gets a new one,
+// so a request never waits for authentication
 bool ensureValidAuth() {
   if (!isAuthenticated()) {
-    Serial.println("Authentication required, attempting to authenticate...");
-    return authenticateWithSupabase();
+    LOG_D("No valid token yet, waiting for the auth task");
+    return false;
   }
   return true;
 }
 
+// With USE_MQTT_TRANSPORT the functions below come from mqtt_transport.cpp
+#if !USE_MQTT_TRANSPORT
+
 // Send sensor reading to Supabase
 bool sendSensorReading(int moistureLevel) {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot send sensor reading: WiFi not connected");
+    LOG_D("Cannot send sensor reading: WiFi not connected");
     return false;
   }
   
   // Ensure we have a valid authentication token
   if (!ensureValidAuth()) {
-    Serial.println("Cannot send sensor reading: Authentication failed");
+    LOG_W("Cannot send sensor reading: Authentication failed");
     return false;
   }
   
-  Serial.println("Sending moisture reading to Supabase...");
-  
   // Create JSON payload - using the correct column names from Supabase schema
-  DynamicJsonDocument doc(1024);
+  ArenaJsonDocument doc(1024);
   doc["device_id"] = deviceId;
   doc["moisture_percentage"] = moistureLevel;  // Use moisture_percentage instead of moisture_level
   doc["moisture_digital"] = (moistureLevel < MOISTURE_THRESHOLD);  // Add moisture_digital field
+  doc["pump_status"] = pumpStatus;  // Pump state at the time of the reading, for pump-on time rollups
   // Let Supabase handle the timestamp with its default value
   
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
   
   // Send HTTP POST request to Supabase
-  HTTPClient http;
-  http.begin(String(supabaseUrl) + "/rest/v1/sensor_readings");
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  http.addHeader("Prefer", "return=minimal");  // Add Prefer header to minimize response
-  
-  int httpResponseCode = http.POST(jsonPayload);
-  bool success = false;
-  
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    String response = http.getString();
-    Serial.println("HTTP Response code: " + String(httpResponseCode));
-    Serial.println("Response: " + response);
-    success = true;
-  } else if (httpResponseCode == 401 || httpResponseCode == 403) {
-    // Authentication error - try to refresh token
-    Serial.println("Authentication error. Clearing token and will retry next time.");
-    clearAuth();
-  } else {
-    Serial.println("Error sending sensor reading. HTTP Response code: " + String(httpResponseCode));
+  ApiResponse response = apiRequest(ENDPOINT_SENSOR_READINGS, "POST", "sensor_readings", jsonPayload.c_str());
+  
+  if (response.ok()) {
+    LOG_D("Sensor reading sent (HTTP %d)", response.statusCode);
+  } else if (response.sent) {
+    LOG_W("Error sending sensor reading (HTTP %d)", response.statusCode);
   }
   
-  http.end();
-  return success;
+  return response.ok();
 }
 
 // Update device status in Supabase
 bool updateDeviceStatus(bool pumpStatus, bool automaticMode) {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot update device status: WiFi not connected");
+    LOG_D("Cannot update device status: WiFi not connected");
     return false;
   }
   
   // Ensure we have a valid authentication token
   if (!ensureValidAuth()) {
-    Serial.println("Cannot update device status: Authentication failed");
+    LOG_W("Cannot update device status: Authentication failed");
     return false;
   }
   
-  Serial.println("Updating device status in Supabase...");
-  
   // Create JSON payload - match Supabase schema exactly
-  DynamicJsonDocument doc(256);
+  ArenaJsonDocument doc(256);
   doc["device_id"] = deviceId;
   doc["pump_status"] = pumpStatus;
   doc["automatic_mode"] = automaticMode;
   doc["user_id"] = "2930efc2-0327-47db-9f0b-27901d2bc272";  // Admin user ID from the table structure
   
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
+  LOG_V("Device status payload: %s", jsonPayload.c_str());
   
-  Serial.print("Device status payload: ");
-  Serial.println(jsonPayload);
+  ArenaString path(32 + deviceId.length());
+  path += "device_status?device_id=eq.";
+  path += deviceId;
   
   // First try to update the existing record
-  HTTPClient http;
-  String patchUrl = String(supabaseUrl) + "/rest/v1/device_status?device_id=eq." + deviceId;
-  http.begin(patchUrl);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  http.addHeader("Prefer", "return=minimal");
-  
-  // Set timeout to prevent hanging
-  http.setTimeout(5000);
-  
-  int httpResponseCode = http.PATCH(jsonPayload);
-  bool success = false;
-  
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    String response = http.getString();
-    Serial.println("HTTP Response code: " + String(httpResponseCode));
-    Serial.println("Response: " + response);
-    success = true;
-    http.end();
+  ApiResponse response = apiRequest(ENDPOINT_DEVICE_STATUS, "PATCH", path.c_str(), jsonPayload.c_str());
+  
+  if (response.ok()) {
+    LOG_D("Device status updated (HTTP %d)", response.statusCode);
     return true;
-  } else if (httpResponseCode == 401 || httpResponseCode == 403) {
-    // Authentication error - try to refresh token
-    Serial.println("Authentication error. Clearing token and will retry next time.");
-    clearAuth();
-    http.end();
+  } else if (!response.sent || response.statusCode <= 0 || response.statusCode == 401 ||
+             response.statusCode == 403 || response.statusCode >= 500) {
+    // Circuit open, network, auth or server error: inserting would fail the same way
+    if (response.sent) {
+      LOG_W("Error updating device status (HTTP %d)", response.statusCode);
+    }
     return false;
   } else {
-    Serial.println("Error updating device status. HTTP Response code: " + String(httpResponseCode));
-    Serial.print("Error response: ");
-    Serial.println(http.getString());
-    http.end();
+    LOG_W("Error updating device status (HTTP %d)", response.statusCode);
     
     // If update fails, try to create a new record
     return insertDeviceStatus(pumpStatus, automaticMode);
@@ -158,44 +135,25 @@ bool updateDeviceStatus(bool pumpStatus, bool automaticMode) {
 
 // Insert device status as fallback if update fails
 bool insertDeviceStatus(bool pumpStatus, bool automaticMode) {
-  Serial.println("Trying to insert device status instead of update...");
-  
-  HTTPClient http;
-  String url = String(supabaseUrl) + "/rest/v1/device_status";
-  http.begin(url);
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Prefer", "return=minimal");
-  
-  // Set timeout to prevent hanging
-  http.setTimeout(5000);
+  LOG_I("Inserting device status instead of update");
   
   // Create JSON payload
-  DynamicJsonDocument doc(256);
+  ArenaJsonDocument doc(256);
   doc["device_id"] = deviceId;
   doc["pump_status"] = pumpStatus;
   doc["automatic_mode"] = automaticMode;
   doc["user_id"] = "2930efc2-0327-47db-9f0b-27901d2bc272"; // Admin user ID
   
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
   
-  Serial.print("Insert device status payload: ");
-  Serial.println(jsonPayload);
+  ApiResponse response = apiRequest(ENDPOINT_DEVICE_STATUS, "POST", "device_status", jsonPayload.c_str());
   
-  int httpResponseCode = http.POST(jsonPayload);
-  
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    Serial.println("Device status insert successful!");
-    http.end();
+  if (response.ok()) {
+    LOG_I("Device status inserted");
     return true;
   } else {
-    Serial.print("Error inserting device status. HTTP Response code: ");
-    Serial.println(httpResponseCode);
-    Serial.print("Error response: ");
-    Serial.println(http.getString());
-    http.end();
+    LOG_W("Error inserting device status (HTTP %d)", response.statusCode);
     return false;
   }
 }
@@ -204,135 +162,231 @@ bool insertDeviceStatus(bool pumpStatus, bool automaticMode) {
 ControlCommand checkForCommands() {
   ControlCommand command;
   command.valid = false;
+  command.count = 0;
   
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot check for commands: WiFi not connected");
+    LOG_D("Cannot check for commands: WiFi not connected");
     return command;
   }
   
   // Ensure we have a valid authentication token
   if (!ensureValidAuth()) {
-    Serial.println("Cannot check for commands: Authentication failed");
+    LOG_W("Cannot check for commands: Authentication failed");
     return command;
   }
   
-  Serial.println("Checking for control commands...");
-  
-  // Send HTTP GET request to Supabase
-  HTTPClient http;
-  String url = String(supabaseUrl) + "/rest/v1/control_commands?device_id=eq." + deviceId + "&executed=eq.false&order=created_at.desc&limit=1";
-  http.begin(url);
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  // Add caching headers to improve performance
-  http.addHeader("Cache-Control", "no-cache");
-  http.addHeader("Prefer", "return=minimal");
-  
-  Serial.print("Command URL: ");
-  Serial.println(url);
+  if (!canQueueCommandAcks()) {
+    // Commands applied now could not be acknowledged, so every poll would apply them again
+    LOG_D("Cannot check for commands: acknowledgements not yet sent");
+    return command;
+  }
   
-  // Set timeout to 5 seconds for faster response if server is slow
-  http.setTimeout(5000);
+  // Fetch every pending command, oldest first, in a single request. Commands
+  // already applied stay unexecuted until their acknowledgement is sent, so
+  // they are left out rather than applied again.
+  const char* unackedIds = getUnackedCommandIds();
+  ArenaString path(160 + deviceId.length() + strlen(unackedIds));
+  path += "control_commands?select=id,pump_control,automatic_mode,user_id&device_id=eq.";
+  path += deviceId;
+  path += "&executed=eq.false&order=created_at.asc&limit=";
+  path += (unsigned long)MAX_PENDING_COMMANDS;
+  if (unackedIds[0] != '\0') {
+    path += "&id=not.in.(";
+    path += unackedIds;
+    path += ")";
+  }
+  LOG_V("Command path: %s", path.c_str());
   
-  int httpResponseCode = http.GET();
+  ApiResponse response = apiRequest(ENDPOINT_CONTROL_COMMANDS, "GET", path.c_str(), "", API_READ_BODY);
   
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    String response = http.getString();
-    Serial.println("HTTP Response code: " + String(httpResponseCode));
-    Serial.print("Command response: ");
-    Serial.println(response);
+  if (response.ok()) {
+    LOG_V("Command response (HTTP %d): %s", response.statusCode, response.body.c_str());
     
     // Parse JSON response
-    DynamicJsonDocument doc(1024);
-    DeserializationError error = deserializeJson(doc, response);
+    ArenaJsonDocument doc(256 + MAX_PENDING_COMMANDS * 160);
+    DeserializationError error = deserializeJson(doc, response.body.data(), response.body.length());
     
-    if (!error && doc.size() > 0) {
-      // Extract command data
-      JsonObject jsonCommand = doc[0];
-      command.id = jsonCommand["id"].as<String>();
-      command.pumpControl = jsonCommand["pump_control"].as<bool>();
-      Serial.print("Found command ID: ");
-      Serial.println(command.id);
-      Serial.print("Pump control value: ");
-      Serial.println(command.pumpControl ? "ON" : "OFF");
-      command.automaticMode = jsonCommand["automatic_mode"].as<bool>();
+    // Anything but a non-empty list of commands (e.g. an error object) is ignored
+    if (!error && doc.is<JsonArray>() && doc.size() > 0) {
+      // Each command carries the full desired state, so the newest one wins.
+      // The fields are assigned in place, and ids is sized for uuids up
+      // front, so a poll allocates once per field however many it collapses.
+      command.ids.reserve(doc.size() * 37);
+      for (JsonObject jsonCommand : doc.as<JsonArray>()) {
+        command.id = jsonCommand["id"] | "";
+        command.pumpControl = jsonCommand["pump_control"].as<bool>();
+        command.automaticMode = jsonCommand["automatic_mode"].as<bool>();
+        command.userId = jsonCommand["user_id"] | "";
+        
+        if (command.count > 0) {
+          command.ids += ",";
+        }
+        command.ids += command.id;
+        command.count++;
+      }
       command.valid = true;
       
-      Serial.println("Received command:");
-      Serial.print("Command ID: ");
-      Serial.println(command.id);
-      Serial.print("Pump status: ");
-      Serial.println(command.pumpControl ? "ON" : "OFF");
-      Serial.print("Automatic mode: ");
-      Serial.println(command.automaticMode ? "ON" : "OFF");
-    } else {
-      Serial.println("No new commands or error parsing JSON");
+      LOG_I("Received %d command(s), applying %s: pump %s, mode %s", command.count, command.id.c_str(),
+            command.pumpControl ? "ON" : "OFF", command.automaticMode ? "AUTOMATIC" : "MANUAL");
+    } else if (error) {
+      LOG_W("Error parsing command response: %s", error.c_str());
     }
-  } else if (httpResponseCode == 401 || httpResponseCode == 403) {
-    // Authentication error - try to refresh token
-    Serial.println("Authentication error. Clearing token and will retry next time.");
-    clearAuth();
-  } else {
-    Serial.println("Error checking for commands. HTTP Response code: " + String(httpResponseCode));
+  } else if (response.sent) {
+    LOG_W("Error checking for commands (HTTP %d)", response.statusCode);
   }
   
-  http.end();
   return command;
 }
 
-// Mark a command as executed in Supabase
-bool markCommandAsExecuted(String commandId) {
+// Mark commands as executed in Supabase (one id or a comma-separated list)
+bool markCommandAsExecuted(const char* commandIds) {
   if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("Cannot mark command as executed: WiFi not connected");
+    LOG_D("Cannot mark command as executed: WiFi not connected");
     return false;
   }
   
   // Ensure we have a valid authentication token
   if (!ensureValidAuth()) {
-    Serial.println("Cannot mark command as executed: Authentication failed");
+    LOG_W("Cannot mark command as executed: Authentication failed");
     return false;
   }
   
-  Serial.println("Marking command as executed...");
-  Serial.print("Command ID: ");
-  Serial.println(commandId);
-  
   // Create JSON payload
-  DynamicJsonDocument doc(256);
+  char executedAt[24];
+  formatISOTime(executedAt, sizeof(executedAt));
+  ArenaJsonDocument doc(256);
   doc["executed"] = true;
-  doc["executed_at"] = getISOTime();
-  
-  String jsonPayload;
-  serializeJson(doc, jsonPayload);
-  Serial.print("JSON Payload: ");
-  Serial.println(jsonPayload);
-  
-  // Send HTTP PATCH request to Supabase
-  HTTPClient http;
-  String url = String(supabaseUrl) + "/rest/v1/control_commands?id=eq." + commandId;
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
-  http.addHeader("Prefer", "return=minimal");
-  
-  Serial.print("PATCH URL: ");
-  Serial.println(url);
-  
-  int httpResponseCode = http.PATCH(jsonPayload);
-  bool success = false;
-  
-  if (httpResponseCode >= 200 && httpResponseCode < 300) {
-    Serial.println("Command marked as executed. HTTP Response code: " + String(httpResponseCode));
-    success = true;
-  } else if (httpResponseCode == 401 || httpResponseCode == 403) {
-    // Authentication error - try to refresh token
-    Serial.println("Authentication error. Clearing token and will retry next time.");
-    clearAuth();
-  } else {
-    Serial.println("Error marking command as executed. HTTP Response code: " + String(httpResponseCode));
+  doc["executed_at"] = executedAt;
+  
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
+  
+  // Acknowledge every listed command with one HTTP PATCH request, limited to
+  // this device's commands
+  ArenaString path(48 + strlen(commandIds) + deviceId.length());
+  path += "control_commands?id=in.(";
+  path += commandIds;
+  path += ")&device_id=eq.";
+  path += deviceId;
+  ApiResponse response = apiRequest(ENDPOINT_CONTROL_COMMANDS, "PATCH", path.c_str(), jsonPayload.c_str());
+  
+  if (response.ok()) {
+    LOG_D("Commands %s marked as executed (HTTP %d)", commandIds, response.statusCode);
+  } else if (response.sent) {
+    LOG_W("Error marking commands %s as executed (HTTP %d)", commandIds, response.statusCode);
+  }
+  
+  return response.ok();
+}
+
+#endif // !USE_MQTT_TRANSPORT
+
+// Upload pending usage through the record_pump_usage RPC. Reports are rare,
+// so they go over HTTP with either transport.
+bool sendUsageReport(const UsageReport& report) {
+  if (WiFi.status() != WL_CONNECTED) {
+    LOG_D("Cannot send usage: WiFi not connected");
+    return false;
+  }
+  
+  if (!ensureValidAuth()) {
+    LOG_W("Cannot send usage: Authentication failed");
+    return false;
+  }
+  
+  ArenaJsonDocument doc(512 + report.dayCount * 96 + report.eventCount * 128);
+  doc["p_device_id"] = deviceId;
+  
+  JsonArray days = doc.createNestedArray("p_days");
+  for (int i = 0; i < report.dayCount; i++) {
+    const UsageDay& usage = report.days[i];
+    char day[16];
+    snprintf(day, sizeof(day), "%04lu-%02lu-%02lu", (unsigned long)(usage.day / 10000),
+             (unsigned long)(usage.day / 100 % 100), (unsigned long)(usage.day % 100));
+    JsonObject row = days.createNestedObject();
+    row["day"] = day;
+    row["runtime_ms"] = usage.runtimeMs;
+    row["volume_ml"] = usage.volumeMl;
+    row["events"] = usage.events;
+  }
+  
+  JsonArray events = doc.createNestedArray("p_events");
+  for (int i = 0; i < report.eventCount; i++) {
+    const UsageEvent& usage = report.events[i];
+    JsonObject row = events.createNestedObject();
+    row["sequence"] = usage.sequence;
+    if (usage.startedAt != 0) {
+      row["started_at"] = usage.startedAt;
+    }
+    row["duration_ms"] = usage.durationMs;
+    row["volume_ml"] = usage.volumeMl;
+    row["automatic"] = usage.automatic != 0;
+  }
+  
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
+  
+  ApiResponse response = apiRequest(ENDPOINT_PUMP_USAGE, "POST", "rpc/record_pump_usage", jsonPayload.c_str());
+  
+  if (response.ok()) {
+    LOG_D("Usage sent: %d days, %d events (HTTP %d)", report.dayCount, report.eventCount, response.statusCode);
+  } else if (response.sent) {
+    LOG_W("Error sending usage (HTTP %d)", response.statusCode);
+  }
+  
+  return response.ok();
+}
+
+// Upload sensor node readings as one multi-row insert. Every row must carry
+// the same columns, so heard_at is set on all of them or none. created_at is
+// left to Supabase: the rollups track it, and a backdated row would be missed.
+bool sendNodeReadings(const NodeBatch& batch) {
+  if (WiFi.status() != WL_CONNECTED) {
+    LOG_D("Cannot send node readings: WiFi not connected");
+    return false;
+  }
+  
+  if (!ensureValidAuth()) {
+    LOG_W("Cannot send node readings: Authentication failed");
+    return false;
+  }
+  
+  time_t now = time(nullptr);
+  bool clockSet = now > 1600000000;
+  unsigned long nowMs = millis();
+  
+  ArenaJsonDocument doc(256 + batch.count * 192);
+  JsonArray rows = doc.to<JsonArray>();
+  for (int i = 0; i < batch.count; i++) {
+    const NodeReading& reading = batch.readings[i];
+    char nodeId[32];
+    formatNodeDeviceId(reading.mac, nodeId, sizeof(nodeId));
+    
+    JsonObject row = rows.createNestedObject();
+    row["device_id"] = nodeId;
+    row["moisture_percentage"] = reading.moisture;
+    row["moisture_digital"] = (reading.moisture < MOISTURE_THRESHOLD);
+    if (clockSet) {
+      // Record the time the gateway heard the reading, not the upload time
+      time_t heard = now - (nowMs - reading.receivedAt) / 1000;
+      struct tm utc;
+      gmtime_r(&heard, &utc);
+      char heardAt[24];
+      strftime(heardAt, sizeof(heardAt), "%Y-%m-%dT%H:%M:%SZ", &utc);
+      row["heard_at"] = heardAt;
+    }
+  }
+  
+  ArenaString jsonPayload(measureJson(doc) + 1);
+  jsonPayload.assignJson(doc);
+  
+  ApiResponse response = apiRequest(ENDPOINT_SENSOR_READINGS, "POST", "sensor_readings", jsonPayload.c_str());
+  
+  if (response.ok()) {
+    LOG_D("Node readings sent: %d rows (HTTP %d)", batch.count, response.statusCode);
+  } else if (response.sent) {
+    LOG_W("Error sending node readings (HTTP %d)", response.statusCode);
   }
   
-  http.end();
-  return success;
+  return response.ok();
 }
@@ -9,29 +9,40 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
+#include "metering.h"
+#include "gateway.h"
 
 // External variables that need to be defined in the main file
 extern String deviceId;
 
-// Structure to hold control command data
+// Structure to hold control command data.
+// All pending commands are collapsed into the newest one; ids lists every
+// command it covers so they can be acknowledged together.
 struct ControlCommand {
   String id;
   bool pumpControl;
   bool automaticMode;
   String userId;
+  String ids;     // Comma-separated ids of all collapsed commands
+  int count;      // Number of collapsed commands
   bool valid;
 };
 
 // Helper function to get ISO formatted time
 String getISOTime();
 
+// Write the ISO formatted time into buffer (21 bytes or more), without a String
+void formatISOTime(char* buffer, size_t size);
+
 // Function declarations
 bool sendSensorReading(int moistureLevel);
 bool updateDeviceStatus(bool pumpStatus, bool automaticMode);
 bool insertDeviceStatus(bool pumpStatus, bool automaticMode);
 ControlCommand checkForCommands();
-bool markCommandAsExecuted(String commandId);
+bool markCommandAsExecuted(const char* commandIds);
 bool sendHeartbeat();
 bool ensureValidAuth();
+bool sendUsageReport(const UsageReport& report);
+bool sendNodeReadings(const NodeBatch& batch);
 
 #endif // SUPABASE_API_H
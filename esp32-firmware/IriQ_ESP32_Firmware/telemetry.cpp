@@ -0,0 +1,93 @@
+/*
+ * IriQ Smart Irrigation System - Telemetry Module
+ * 
+ * This module gathers metrics from the other modules and attaches them to a
+ * heartbeat every TELEMETRY_INTERVAL, so diagnostics ride along with traffic
+ * the device sends anyway instead of costing extra requests.
+ */
+
+#include "telemetry.h"
+#include "config.h"
+#include "boot_timing.h"
+#include "wifi_manager.h"
+#include "api_client.h"
+#include "auth.h"
+#include "tls_session.h"
+#include "memory_pool.h"
+#include "mqtt_transport.h"
+#include "local_api.h"
+#include "sampler.h"
+#include "outbound.h"
+#include "irrigation_schedule.h"
+#include "state_store.h"
+#include "gateway.h"
+#include "logger.h"
+
+static unsigned long lastTelemetryTime = 0;
+static bool telemetrySentOnce = false;
+static bool bootMetricsSent = false;
+
+// True when the next heartbeat should carry metrics
+bool isTelemetryDue() {
+  // Boot timings go out as soon as boot has fully completed
+  if (!bootMetricsSent && bootPhasesComplete()) {
+    return true;
+  }
+  return !telemetrySentOnce || millis() - lastTelemetryTime >= TELEMETRY_INTERVAL;
+}
+
+#if ESPNOW_GATEWAY_ENABLED
+// Sensor node counters; kept here so gateway.cpp builds without ArduinoJson on the host
+static void appendGatewayMetrics(JsonObject metrics) {
+  GatewayStats stats = getGatewayStats();
+  JsonObject gateway = metrics.createNestedObject("gateway");
+  gateway["nodes"] = stats.nodes;
+  gateway["frames"] = stats.framesReceived;
+  gateway["rejected"] = stats.framesRejected;
+  gateway["readings"] = stats.readings;
+  gateway["duplicates"] = stats.duplicates;
+  gateway["late"] = stats.late;
+  gateway["lost"] = stats.lost;
+  gateway["dropped"] = stats.dropped;
+  gateway["refused"] = stats.refused;
+  gateway["batches"] = stats.batches;
+  gateway["rows"] = stats.rows;
+}
+#endif
+
+// Add all module metrics to a telemetry object
+void appendTelemetry(JsonObject metrics) {
+  metrics["uptime_ms"] = millis();
+  metrics["log_dropped"] = getLogDroppedCount();
+  
+  if (!bootMetricsSent && bootPhasesComplete()) {
+    appendBootMetrics(metrics);
+  }
+  appendWifiMetrics(metrics);
+  appendAuthMetrics(metrics);
+  appendApiMetrics(metrics);
+  appendTlsMetrics(metrics);
+  appendMemoryMetrics(metrics);
+  appendSamplerMetrics(metrics);
+  appendOutboundMetrics(metrics);
+  appendScheduleMetrics(metrics);
+  appendStateMetrics(metrics);
+#if USE_MQTT_TRANSPORT
+  appendMqttMetrics(metrics);
+#endif
+#if LOCAL_API_ENABLED
+  appendLocalApiMetrics(metrics);
+#endif
+#if ESPNOW_GATEWAY_ENABLED
+  appendGatewayMetrics(metrics);
+#endif
+}
+
+// Record that the metrics were delivered
+void markTelemetrySent() {
+  lastTelemetryTime = millis();
+  telemetrySentOnce = true;
+  if (bootPhasesComplete()) {
+    bootMetricsSent = true;
+  }
+}
@@ -0,0 +1,22 @@
+/*
+ * IriQ Smart Irrigation System - Telemetry Header
+ * 
+ * Header file for collecting device metrics into heartbeats.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// True when the next heartbeat should carry metrics
+bool isTelemetryDue();
+
+// Add all module metrics to a telemetry object
+void appendTelemetry(JsonObject metrics);
+
+// Record that the metrics were delivered
+void markTelemetrySent();
+
+#endif // TELEMETRY_H
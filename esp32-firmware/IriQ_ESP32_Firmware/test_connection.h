@@ -48,7 +48,7 @@ bool testHeartbeat() {
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   int httpResponseCode = http.POST(jsonPayload);
@@ -108,7 +108,7 @@ bool testSensorReading() {
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   int httpResponseCode = http.POST(jsonPayload);
@@ -168,7 +168,7 @@ bool testDeviceStatus() {
   http.begin(url);
   http.addHeader("Content-Type", "application/json");
   http.addHeader("apikey", supabaseKey);
-  http.addHeader("Authorization", "Bearer " + getAuthToken());
+  http.addHeader("Authorization", getAuthHeader());
   http.addHeader("Prefer", "return=minimal");
   
   int httpResponseCode = http.POST(jsonPayload);
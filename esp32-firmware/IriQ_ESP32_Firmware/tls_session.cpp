@@ -0,0 +1,401 @@
+/*
+ * IriQ Smart Irrigation System - TLS Session Module
+ *
+ * This module keeps the connection to SUPABASE_URL open between requests
+ * and makes the handshakes it cannot avoid cheaper:
+ * - TLS_ROOT_CA, or the Supabase roots in tls_roots.h when it is "", is
+ *   parsed once and is the only trust anchor, instead of loading and
+ *   searching a certificate bundle on every connect
+ * - after each verified full handshake the session (ticket or session ID)
+ *   is serialized into RTC memory, which survives WiFi drops, soft resets
+ *   and deep sleep but not a power cycle, and is never written to flash
+ * - the next connect offers that session; if the server accepts it the
+ *   handshake skips the certificate exchange and key agreement
+ *
+ * WiFiClientSecure has no way to offer a session, so ResumableTlsClient
+ * runs the handshake itself and then hands the context back to the stock
+ * read/write/stop code. This follows ssl_client.cpp from arduino-esp32 2.x
+ * (mbedTLS 2.28, TLS 1.2).
+ *
+ * Only verified sessions are cached or offered. TLS_INSECURE turns
+ * verification off for testing and then never resumes a session, so an
+ * unauthenticated master secret is never kept in RTC memory.
+ *
+ * An http:// SUPABASE_URL (the ingestion gateway on the LAN) gets the same
+ * keep-alive reuse over a plain socket.
+ */
+
+#include "tls_session.h"
+#include "config.h"
+#include "logger.h"
+#include "tls_roots.h"
+#include <WiFiClientSecure.h>
+#include <esp_attr.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lwip/sockets.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/platform_util.h>
+#include <mbedtls/ssl.h>
+#include <time.h>
+
+// External variables from main file
+extern const char* supabaseUrl;
+
+#define TLS_SESSION_MAGIC 0x49515453  // "IQTS"
+#define TLS_HOST_SIZE 64
+
+// Serialized session in RTC memory; checked by magic and host, and
+// mbedtls_ssl_session_load() rejects anything else that does not parse
+struct TlsSessionCache {
+  uint32_t magic;
+  uint32_t length;
+  uint32_t savedAt;  // Epoch seconds, 0 if the clock was not set
+  char host[TLS_HOST_SIZE];
+  uint8_t data[TLS_SESSION_CACHE_SIZE > 0 ? TLS_SESSION_CACHE_SIZE : 1];
+};
+
+RTC_NOINIT_ATTR static TlsSessionCache sessionCache;
+
+class ResumableTlsClient : public WiFiClientSecure {
+public:
+  // Connect and handshake, offering the cached session. Returns 0 on
+  // success, or a negative mbedTLS / socket error.
+  int connectResumable(const char* host, uint16_t port, const mbedtls_x509_crt* trustAnchor, bool* resumed);
+};
+
+static ResumableTlsClient tlsClient;
+static WiFiClient plainClient;
+
+static String apiHost;
+static uint16_t apiPort = 0;
+static bool apiSecure = true;
+static bool urlParsed = false;
+
+static mbedtls_x509_crt trustAnchor;
+static bool trustAnchorLoaded = false;
+
+// Handshake statistics
+static uint32_t fullHandshakes = 0;
+static uint32_t resumedHandshakes = 0;
+static uint32_t handshakeFailures = 0;
+static uint32_t reusedRequests = 0;
+static uint32_t sessionOverflows = 0;
+static unsigned long lastHandshakeMs = 0;
+static unsigned long totalFullMs = 0;
+static unsigned long totalResumedMs = 0;
+
+static uint32_t epochNow() {
+  time_t now = time(nullptr);
+  return now > 1600000000 ? (uint32_t)now : 0;
+}
+
+static void clearSessionCache() {
+  sessionCache.magic = 0;
+  sessionCache.length = 0;
+}
+
+static bool isSessionCached(const char* host) {
+  if (TLS_SESSION_CACHE_SIZE == 0 || sessionCache.magic != TLS_SESSION_MAGIC ||
+      sessionCache.length == 0 || sessionCache.length > TLS_SESSION_CACHE_SIZE ||
+      strncmp(sessionCache.host, host, TLS_HOST_SIZE) != 0) {
+    return false;
+  }
+  // Only expire when both times are known; a stale session just costs the
+  // full handshake the server falls back to
+  uint32_t now = epochNow();
+  if (now != 0 && sessionCache.savedAt != 0 && now - sessionCache.savedAt > TLS_SESSION_LIFETIME) {
+    clearSessionCache();
+    return false;
+  }
+  return true;
+}
+
+static void saveSession(mbedtls_ssl_context* ssl, const char* host) {
+  if (TLS_SESSION_CACHE_SIZE == 0) {
+    return;
+  }
+
+  mbedtls_ssl_session session;
+  mbedtls_ssl_session_init(&session);
+  size_t length = 0;
+  int ret = mbedtls_ssl_get_session(ssl, &session);
+  if (ret == 0) {
+    ret = mbedtls_ssl_session_save(&session, sessionCache.data, TLS_SESSION_CACHE_SIZE, &length);
+  }
+  mbedtls_ssl_session_free(&session);
+
+  if (ret != 0) {
+    // Usually the peer certificate kept in the session outgrowing the cache
+    if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+      sessionOverflows++;
+    }
+    LOG_D("TLS session not cached (-0x%04x, %u bytes needed)", -ret, (unsigned)length);
+    clearSessionCache();
+    return;
+  }
+
+  strncpy(sessionCache.host, host, TLS_HOST_SIZE - 1);
+  sessionCache.host[TLS_HOST_SIZE - 1] = '\0';
+  sessionCache.length = length;
+  sessionCache.savedAt = epochNow();
+  sessionCache.magic = TLS_SESSION_MAGIC;
+}
+
+int ResumableTlsClient::connectResumable(const char* host, uint16_t port, const mbedtls_x509_crt* anchor,
+                                         bool* resumed) {
+  stop();
+  *resumed = false;
+
+  IPAddress address;
+  if (!WiFi.hostByName(host, address)) {
+    return -1;
+  }
+
+  sslclient_context* ctx = sslclient;
+  ctx->socket = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (ctx->socket < 0) {
+    return -1;
+  }
+
+  // Non-blocking connect with a deadline; the socket stays non-blocking,
+  // which the stock read path expects
+  struct sockaddr_in serverAddress;
+  memset(&serverAddress, 0, sizeof(serverAddress));
+  serverAddress.sin_family = AF_INET;
+  serverAddress.sin_addr.s_addr = (uint32_t)address;
+  serverAddress.sin_port = htons(port);
+
+  fcntl(ctx->socket, F_SETFL, fcntl(ctx->socket, F_GETFL, 0) | O_NONBLOCK);
+  int ret = lwip_connect(ctx->socket, (struct sockaddr*)&serverAddress, sizeof(serverAddress));
+  if (ret < 0 && errno != EINPROGRESS) {
+    return -1;
+  }
+
+  fd_set writeSet;
+  FD_ZERO(&writeSet);
+  FD_SET(ctx->socket, &writeSet);
+  struct timeval timeout = { TLS_HANDSHAKE_TIMEOUT / 1000, (TLS_HANDSHAKE_TIMEOUT % 1000) * 1000 };
+  if (lwip_select(ctx->socket + 1, nullptr, &writeSet, nullptr, &timeout) <= 0) {
+    return -1;
+  }
+  int socketError = 0;
+  socklen_t errorLength = sizeof(socketError);
+  lwip_getsockopt(ctx->socket, SOL_SOCKET, SO_ERROR, &socketError, &errorLength);
+  if (socketError != 0) {
+    return -1;
+  }
+  int enable = 1;
+  lwip_setsockopt(ctx->socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  lwip_setsockopt(ctx->socket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+
+  mbedtls_ssl_init(&ctx->ssl_ctx);
+  mbedtls_ssl_config_init(&ctx->ssl_conf);
+  mbedtls_ctr_drbg_init(&ctx->drbg_ctx);
+  mbedtls_entropy_init(&ctx->entropy_ctx);
+
+  static const char* personalization = "iriq-tls";
+  ret = mbedtls_ctr_drbg_seed(&ctx->drbg_ctx, mbedtls_entropy_func, &ctx->entropy_ctx,
+                              (const unsigned char*)personalization, strlen(personalization));
+  if (ret == 0) {
+    ret = mbedtls_ssl_config_defaults(&ctx->ssl_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+  }
+  if (ret != 0) {
+    return ret;
+  }
+
+  if (anchor != nullptr) {
+    // The CA chain is only read during the handshake, so the shared parsed
+    // anchor is used directly; stop() leaves it alone because _CA_cert is unset
+    mbedtls_ssl_conf_ca_chain(&ctx->ssl_conf, (mbedtls_x509_crt*)anchor, nullptr);
+    mbedtls_ssl_conf_authmode(&ctx->ssl_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+  } else {
+    mbedtls_ssl_conf_authmode(&ctx->ssl_conf, MBEDTLS_SSL_VERIFY_NONE);
+  }
+  mbedtls_ssl_conf_rng(&ctx->ssl_conf, mbedtls_ctr_drbg_random, &ctx->drbg_ctx);
+  mbedtls_ssl_conf_session_tickets(&ctx->ssl_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+  ret = mbedtls_ssl_setup(&ctx->ssl_ctx, &ctx->ssl_conf);
+  if (ret == 0) {
+    ret = mbedtls_ssl_set_hostname(&ctx->ssl_ctx, host);
+  }
+  if (ret != 0) {
+    return ret;
+  }
+  mbedtls_ssl_set_bio(&ctx->ssl_ctx, &ctx->socket, mbedtls_net_send, mbedtls_net_recv, nullptr);
+
+  // Offer the cached session. A resumed handshake keeps its master secret,
+  // a full one derives a new one, which tells the two apart afterwards.
+  unsigned char offeredMaster[48];
+  bool offered = false;
+  if (anchor == nullptr) {
+    clearSessionCache();
+  } else if (isSessionCached(host)) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, sessionCache.data, sessionCache.length) == 0 &&
+        mbedtls_ssl_set_session(&ctx->ssl_ctx, &session) == 0) {
+      memcpy(offeredMaster, session.master, sizeof(offeredMaster));
+      offered = true;
+    } else {
+      clearSessionCache();
+    }
+    mbedtls_ssl_session_free(&session);
+  }
+
+  unsigned long start = millis();
+  while ((ret = mbedtls_ssl_handshake(&ctx->ssl_ctx)) != 0) {
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      break;
+    }
+    if (millis() - start > TLS_HANDSHAKE_TIMEOUT) {
+      ret = MBEDTLS_ERR_SSL_TIMEOUT;
+      break;
+    }
+    vTaskDelay(2);
+  }
+  if (ret == 0 && anchor != nullptr && mbedtls_ssl_get_verify_result(&ctx->ssl_ctx) != 0) {
+    ret = MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+  }
+  if (ret != 0) {
+    if (offered) {
+      // Do not offer a session the server may have choked on again
+      mbedtls_platform_zeroize(offeredMaster, sizeof(offeredMaster));
+      clearSessionCache();
+    }
+    return ret;
+  }
+
+  lastHandshakeMs = millis() - start;
+  *resumed = offered && memcmp(offeredMaster, ctx->ssl_ctx.session->master, sizeof(offeredMaster)) == 0;
+  if (offered) {
+    mbedtls_platform_zeroize(offeredMaster, sizeof(offeredMaster));
+  }
+
+  // A resumed session may carry a fresh ticket, so save after either kind
+  if (anchor != nullptr) {
+    saveSession(&ctx->ssl_ctx, host);
+  }
+  _connected = true;
+  return 0;
+}
+
+// Split SUPABASE_URL into scheme, host and port once
+static void parseApiUrl() {
+  String url = supabaseUrl;
+  apiSecure = !url.startsWith("http://");
+  int hostStart = url.indexOf("://");
+  hostStart = hostStart < 0 ? 0 : hostStart + 3;
+  int hostEnd = url.indexOf('/', hostStart);
+  String authority = hostEnd < 0 ? url.substring(hostStart) : url.substring(hostStart, hostEnd);
+
+  int colon = authority.indexOf(':');
+  if (colon >= 0) {
+    apiHost = authority.substring(0, colon);
+    apiPort = authority.substring(colon + 1).toInt();
+  } else {
+    apiHost = authority;
+    apiPort = apiSecure ? 443 : 80;
+  }
+  urlParsed = true;
+}
+
+static void loadTrustAnchor() {
+  static bool attempted = false;
+  if (attempted) {
+    return;
+  }
+  attempted = true;
+
+  if (TLS_INSECURE) {
+    LOG_W("TLS_INSECURE is set: the Supabase certificate is not verified");
+    return;
+  }
+  const char* pem = strlen(TLS_ROOT_CA) > 0 ? TLS_ROOT_CA : SUPABASE_ROOT_CAS;
+  mbedtls_x509_crt_init(&trustAnchor);
+  int ret = mbedtls_x509_crt_parse(&trustAnchor, (const unsigned char*)pem, strlen(pem) + 1);
+  if (ret != 0) {
+    // Refuse to connect rather than silently dropping verification
+    LOG_E("Error parsing the TLS root CA (-0x%04x)", -ret);
+    return;
+  }
+  trustAnchorLoaded = true;
+}
+
+WiFiClient* openApiConnection(bool* reused) {
+  *reused = false;
+  if (!urlParsed) {
+    parseApiUrl();
+  }
+
+  if (!apiSecure) {
+    if (plainClient.connected()) {
+      *reused = true;
+      reusedRequests++;
+      return &plainClient;
+    }
+    plainClient.stop();
+    return plainClient.connect(apiHost.c_str(), apiPort) ? &plainClient : nullptr;
+  }
+
+  if (tlsClient.connected()) {
+    *reused = true;
+    reusedRequests++;
+    return &tlsClient;
+  }
+
+  loadTrustAnchor();
+  if (!TLS_INSECURE && !trustAnchorLoaded) {
+    handshakeFailures++;
+    return nullptr;
+  }
+
+  bool resumed = false;
+  int ret = tlsClient.connectResumable(apiHost.c_str(), apiPort, trustAnchorLoaded ? &trustAnchor : nullptr, &resumed);
+  if (ret != 0) {
+    handshakeFailures++;
+    tlsClient.stop();
+    LOG_W("TLS connect to %s failed (-0x%04x)", apiHost.c_str(), -ret);
+    return nullptr;
+  }
+
+  if (resumed) {
+    resumedHandshakes++;
+    totalResumedMs += lastHandshakeMs;
+  } else {
+    fullHandshakes++;
+    totalFullMs += lastHandshakeMs;
+  }
+  LOG_D("TLS %s handshake with %s in %lu ms", resumed ? "resumed" : "full", apiHost.c_str(), lastHandshakeMs);
+  return &tlsClient;
+}
+
+void closeApiConnection() {
+  if (apiSecure) {
+    tlsClient.stop();
+  } else {
+    plainClient.stop();
+  }
+}
+
+void appendTlsMetrics(JsonObject metrics) {
+  if (!apiSecure) {
+    return;
+  }
+  JsonObject tls = metrics.createNestedObject("tls");
+  tls["full"] = fullHandshakes;
+  tls["resumed"] = resumedHandshakes;
+  tls["failures"] = handshakeFailures;
+  tls["reused"] = reusedRequests;
+  tls["last_ms"] = lastHandshakeMs;
+  if (fullHandshakes > 0) {
+    tls["avg_full_ms"] = totalFullMs / fullHandshakes;
+  }
+  if (resumedHandshakes > 0) {
+    tls["avg_resumed_ms"] = totalResumedMs / resumedHandshakes;
+  }
+  tls["session_cached"] = sessionCache.magic == TLS_SESSION_MAGIC;
+  tls["session_overflows"] = sessionOverflows;
+  tls["verified"] = trustAnchorLoaded;
+}
@@ -0,0 +1,28 @@
+/*
+ * IriQ Smart Irrigation System - TLS Session Header
+ *
+ * Header file for the connection shared by all Supabase requests: one
+ * keep-alive connection to SUPABASE_URL, verified against a pinned root CA,
+ * with the TLS session cached in RTC memory so a reconnect after a WiFi
+ * drop, reboot or sleep resumes it instead of running a full handshake.
+ */
+
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <WiFi.h>
+
+// Return the open connection to SUPABASE_URL, connecting (and resuming the
+// cached TLS session) if needed. *reused is set when no connect was needed.
+// Returns nullptr if the connection failed.
+WiFiClient* openApiConnection(bool* reused);
+
+// Drop the connection, e.g. after a request failed on it
+void closeApiConnection();
+
+// Add handshake counters and timings to a telemetry object
+void appendTlsMetrics(JsonObject metrics);
+
+#endif // TLS_SESSION_H
@@ -0,0 +1,119 @@
+/*
+ * IriQ Smart Irrigation System - Trace Module
+ *
+ * This module records the inputs of the control logic (raw ADC samples,
+ * commands, request outcomes and latencies) and its outputs (relay and mode
+ * changes) as text lines. Events collect in a RAM buffer and are appended to
+ * /trace.txt on LittleFS every TRACE_FLUSH_INTERVAL or when the buffer
+ * fills; at TRACE_FILE_MAX the file rotates to /trace.old, so flash holds
+ * the latest one to two files' worth of history.
+ *
+ * The "R" console command prints the trace; esp32-firmware/replay reads
+ * that output, stray log lines included, and runs it through sensors.cpp
+ * on the host.
+ */
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include "logger.h"
+#include <LittleFS.h>
+
+#define TRACE_FILE "/trace.txt"
+#define TRACE_OLD_FILE "/trace.old"
+
+static char traceBuffer[TRACE_BUFFER_SIZE];
+static size_t traceLength = 0;
+static bool traceMounted = false;
+static uint32_t traceDropped = 0;
+
+void initTrace() {
+  // Format on first use so a fresh board can record straight away
+  traceMounted = LittleFS.begin(true);
+  if (!traceMounted) {
+    LOG_E("Failed to mount LittleFS, trace kept in RAM only");
+  }
+  traceEvent(TRACE_HEADER, TRACE_FORMAT_VERSION, MOISTURE_THRESHOLD, READING_INTERVAL);
+}
+
+void traceEvent(char type, long a, long b, long c) {
+  char line[64];
+  int length = snprintf(line, sizeof(line), "%c %lu %ld %ld %ld\n", type, millis(), a, b, c);
+  if (length <= 0 || length >= (int)sizeof(line)) {
+    return;
+  }
+
+  if (traceLength + length > sizeof(traceBuffer)) {
+    flushTrace();
+  }
+  if (traceLength + length > sizeof(traceBuffer)) {
+    // Flash unavailable: keep the newest events out rather than block
+    traceDropped++;
+    return;
+  }
+  memcpy(traceBuffer + traceLength, line, length);
+  traceLength += length;
+}
+
+void flushTrace() {
+  if (traceLength == 0 || !traceMounted) {
+    return;
+  }
+
+  File file = LittleFS.open(TRACE_FILE, FILE_APPEND);
+  if (!file) {
+    LOG_W("Failed to open %s", TRACE_FILE);
+    return;
+  }
+  if (traceDropped > 0) {
+    file.printf("# %lu events dropped\n", (unsigned long)traceDropped);
+    traceDropped = 0;
+  }
+  file.write((const uint8_t*)traceBuffer, traceLength);
+  size_t size = file.size();
+  file.close();
+  traceLength = 0;
+
+  if (size >= TRACE_FILE_MAX) {
+    LittleFS.remove(TRACE_OLD_FILE);
+    LittleFS.rename(TRACE_FILE, TRACE_OLD_FILE);
+  }
+}
+
+static void dumpFile(Print& output, const char* path) {
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) {
+    return;
+  }
+  uint8_t chunk[128];
+  while (file.available()) {
+    size_t count = file.read(chunk, sizeof(chunk));
+    output.write(chunk, count);
+  }
+  file.close();
+}
+
+void dumpTrace(Print& output) {
+  flushTrace();
+  output.println("--- trace begin ---");
+  if (traceMounted) {
+    dumpFile(output, TRACE_OLD_FILE);
+    dumpFile(output, TRACE_FILE);
+  }
+  output.write((const uint8_t*)traceBuffer, traceLength);
+  output.println("--- trace end ---");
+}
+
+void clearTrace() {
+  traceLength = 0;
+  traceDropped = 0;
+  if (traceMounted) {
+    LittleFS.remove(TRACE_FILE);
+    LittleFS.remove(TRACE_OLD_FILE);
+  }
+  traceEvent(TRACE_HEADER, TRACE_FORMAT_VERSION, MOISTURE_THRESHOLD, READING_INTERVAL);
+  LOG_I("Trace cleared");
+}
+
+#endif // TRACE_ENABLED
@@ -0,0 +1,50 @@
+/*
+ * IriQ Smart Irrigation System - Trace Header
+ *
+ * Header file for the event trace: raw inputs and control decisions recorded
+ * on the device so a field problem can be replayed through the same control
+ * code on a host (see esp32-firmware/replay).
+ *
+ * One event per line: "<type> <millis> <a> <b> <c>"
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+#define TRACE_FORMAT_VERSION 1
+
+// Event types and their fields
+#define TRACE_HEADER 'H'   // format version, MOISTURE_THRESHOLD, READING_INTERVAL (written at boot)
+#define TRACE_ADC 'A'      // raw ADC sample
+#define TRACE_READING 'R'  // moisture percentage returned by readMoistureSensor()
+#define TRACE_COMMAND 'C'  // command to apply: pump_control, automatic_mode
+#define TRACE_PUMP 'P'     // relay switched: 1 on, 0 off
+#define TRACE_MODE 'M'     // mode changed: 1 automatic, 0 manual
+#define TRACE_REQUEST 'N'  // API request: endpoint, HTTP status (or negative error), latency in ms
+#define TRACE_UPLOAD 'U'   // sensor reading upload: 1 sent, 0 failed
+
+#if TRACE_ENABLED
+#define TRACE(...) traceEvent(__VA_ARGS__)
+#else
+#define TRACE(...) do {} while (0)
+#endif
+
+// Mount the trace file system and write the header event
+void initTrace();
+
+// Record an event (loop task only); flushes to flash when the buffer fills
+void traceEvent(char type, long a, long b = 0, long c = 0);
+
+// Append buffered events to the trace file, rotating it at TRACE_FILE_MAX
+void flushTrace();
+
+// Print the whole trace between begin/end marker lines
+void dumpTrace(Print& output);
+
+// Delete the recorded trace
+void clearTrace();
+
+#endif // TRACE_H
@@ -0,0 +1,241 @@
+/*
+ * IriQ Smart Irrigation System - WiFi Manager Module
+ *
+ * This module owns the WiFi station connection.
+ * - The last BSSID and channel are cached in NVS so reconnects skip the scan;
+ *   a cached access point that does not answer falls back to a scan
+ * - Optional static IP configuration skips DHCP
+ * - Reconnects are non-blocking, with exponential backoff and jitter
+ * - Link up/down events are dispatched to registered callbacks
+ * - Reconnect durations are recorded for telemetry
+ */
+
+#include "wifi_manager.h"
+#include "config.h"
+#include "logger.h"
+#include "state_store.h"
+
+#define MAX_LINK_CALLBACKS 4
+
+enum WifiState {
+  WIFI_STATE_BACKOFF,     // Waiting before the next attempt
+  WIFI_STATE_CONNECTING,  // Attempt in progress
+  WIFI_STATE_CONNECTED
+};
+
+static const char* wifiSsid = nullptr;
+static const char* wifiPassword = nullptr;
+
+static WifiState wifiState = WIFI_STATE_BACKOFF;
+static unsigned long stateStartTime = 0;
+static unsigned long backoffDelay = 0;
+static uint8_t failedAttempts = 0;
+static bool fastAttempt = false;
+static bool scanNext = false;  // The cached access point just timed out
+
+// Cached access point, valid when cachedChannel != 0
+static uint8_t cachedBssid[6] = { 0 };
+static uint8_t cachedChannel = 0;
+static int bssidSlot = -1;
+static int channelSlot = -1;
+
+static LinkEventCallback linkCallbacks[MAX_LINK_CALLBACKS];
+static int linkCallbackCount = 0;
+
+// Reconnect statistics
+static unsigned long outageStartTime = 0;
+static unsigned long lastReconnectMs = 0;
+static unsigned long maxReconnectMs = 0;
+static unsigned long totalReconnectMs = 0;
+static uint32_t reconnectCount = 0;
+static uint32_t fastConnectCount = 0;
+static uint32_t attemptCount = 0;
+
+static void publishLinkEvent(LinkEvent event) {
+  for (int i = 0; i < linkCallbackCount; i++) {
+    linkCallbacks[i](event);
+  }
+}
+
+static void loadCachedAccessPoint() {
+  bssidSlot = registerState("wifi", "bssid", STATE_BYTES, cachedBssid, sizeof(cachedBssid), STATE_COMMIT_DELAY);
+  channelSlot = registerState("wifi", "channel", STATE_U8, &cachedChannel, sizeof(cachedChannel), STATE_COMMIT_DELAY);
+  if (!isStateStored(bssidSlot)) {
+    cachedChannel = 0;
+    clearState(channelSlot);
+  }
+}
+
+static void saveCachedAccessPoint() {
+  uint8_t* bssid = WiFi.BSSID();
+  uint8_t channel = (uint8_t)WiFi.channel();
+
+  if (bssid == nullptr || channel == 0) {
+    return;
+  }
+
+  // The state store writes flash only when the access point changed
+  if (channel != cachedChannel || memcmp(bssid, cachedBssid, sizeof(cachedBssid)) != 0) {
+    memcpy(cachedBssid, bssid, sizeof(cachedBssid));
+    cachedChannel = channel;
+    LOG_I("Cached access point %s on channel %u", WiFi.BSSIDstr().c_str(), cachedChannel);
+  }
+}
+
+static void configureStaticIp() {
+  IPAddress ip, gateway, subnet, dns;
+  if (strlen(WIFI_STATIC_IP) == 0) {
+    return;  // DHCP
+  }
+
+  if (ip.fromString(WIFI_STATIC_IP) && gateway.fromString(WIFI_GATEWAY) &&
+      subnet.fromString(WIFI_SUBNET) && dns.fromString(WIFI_DNS)) {
+    WiFi.config(ip, gateway, subnet, dns);
+  } else {
+    LOG_W("Invalid static IP configuration, using DHCP");
+  }
+}
+
+static void startAttempt() {
+  attemptCount++;
+  fastAttempt = cachedChannel != 0 && !scanNext;
+  scanNext = false;
+
+  if (fastAttempt) {
+    // Join the known access point directly, skipping the channel scan
+    LOG_I("Connecting to WiFi (cached channel %u)", cachedChannel);
+    WiFi.begin(wifiSsid, wifiPassword, cachedChannel, cachedBssid);
+  } else {
+    LOG_I("Connecting to WiFi");
+    WiFi.begin(wifiSsid, wifiPassword);
+  }
+
+  wifiState = WIFI_STATE_CONNECTING;
+  stateStartTime = millis();
+}
+
+static void scheduleRetry() {
+  // Exponential backoff with full jitter: random in [delay/2, delay]
+  unsigned long ceiling = WIFI_BACKOFF_MIN << (failedAttempts < 8 ? failedAttempts : 8);
+  if (ceiling > WIFI_BACKOFF_MAX) {
+    ceiling = WIFI_BACKOFF_MAX;
+  }
+  backoffDelay = ceiling / 2 + esp_random() % (ceiling / 2 + 1);
+
+  if (failedAttempts < 255) {
+    failedAttempts++;
+  }
+
+  wifiState = WIFI_STATE_BACKOFF;
+  stateStartTime = millis();
+  LOG_W("WiFi connect failed, retrying in %lu ms", backoffDelay);
+}
+
+static void handleConnected() {
+  unsigned long duration = millis() - outageStartTime;
+
+  wifiState = WIFI_STATE_CONNECTED;
+  failedAttempts = 0;
+
+  lastReconnectMs = duration;
+  totalReconnectMs += duration;
+  if (duration > maxReconnectMs) {
+    maxReconnectMs = duration;
+  }
+  reconnectCount++;
+  if (fastAttempt) {
+    fastConnectCount++;
+  }
+
+  LOG_I("WiFi connected in %lu ms (%s), IP address: %s", duration,
+        fastAttempt ? "cached" : "scan", WiFi.localIP().toString().c_str());
+
+  saveCachedAccessPoint();
+  publishLinkEvent(LINK_UP);
+}
+
+// Initialize the manager and start the first connection attempt
+void initWifiManager(const char* ssid, const char* password) {
+  wifiSsid = ssid;
+  wifiPassword = password;
+
+  loadCachedAccessPoint();
+
+  // The manager handles reconnects itself; avoid redundant flash writes of credentials
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(false);
+  configureStaticIp();
+
+  outageStartTime = millis();
+  startAttempt();
+}
+
+// Drive reconnects and dispatch link events
+void wifiManagerLoop() {
+  bool connected = WiFi.status() == WL_CONNECTED;
+
+  switch (wifiState) {
+    case WIFI_STATE_CONNECTED:
+      if (connected) {
+        return;
+      }
+      LOG_W("WiFi connection lost, reconnecting...");
+      outageStartTime = millis();
+      publishLinkEvent(LINK_DOWN);
+
+      // First retry is immediate; backoff only applies to repeated failures
+      WiFi.disconnect();
+      startAttempt();
+      break;
+
+    case WIFI_STATE_CONNECTING:
+      if (connected) {
+        handleConnected();
+      } else if (fastAttempt && millis() - stateStartTime >= WIFI_FAST_CONNECT_TIMEOUT) {
+        // The cached access point did not answer: scan this time, but keep
+        // the cache. It is usually the same router rebooting, and the cache
+        // is only rewritten if the scan joins a different access point.
+        LOG_W("Cached access point unavailable, falling back to scan");
+        WiFi.disconnect();
+        scanNext = true;
+        startAttempt();
+      } else if (millis() - stateStartTime >= WIFI_CONNECT_TIMEOUT) {
+        WiFi.disconnect();
+        scheduleRetry();
+      }
+      break;
+
+    case WIFI_STATE_BACKOFF:
+      if (millis() - stateStartTime >= backoffDelay) {
+        startAttempt();
+      }
+      break;
+  }
+}
+
+// True while the station is connected with an IP address
+bool isWifiConnected() {
+  return wifiState == WIFI_STATE_CONNECTED;
+}
+
+// Register a callback for link events
+bool onLinkEvent(LinkEventCallback callback) {
+  if (linkCallbackCount >= MAX_LINK_CALLBACKS) {
+    return false;
+  }
+  linkCallbacks[linkCallbackCount++] = callback;
+  return true;
+}
+
+// Add connectivity metrics to a telemetry object
+void appendWifiMetrics(JsonObject metrics) {
+  JsonObject wifi = metrics.createNestedObject("wifi");
+  wifi["rssi"] = WiFi.RSSI();
+  wifi["attempts"] = attemptCount;
+  wifi["reconnects"] = reconnectCount;
+  wifi["fast_reconnects"] = fastConnectCount;
+  wifi["last_reconnect_ms"] = lastReconnectMs;
+  wifi["max_reconnect_ms"] = maxReconnectMs;
+  wifi["avg_reconnect_ms"] = reconnectCount > 0 ? totalReconnectMs / reconnectCount : 0;
+}
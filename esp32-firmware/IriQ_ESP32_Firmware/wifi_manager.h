@@ -0,0 +1,37 @@
+/*
+ * IriQ Smart Irrigation System - WiFi Manager Header
+ * 
+ * Header file for the connectivity manager.
+ */
+
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+
+// Link events published to the rest of the firmware
+enum LinkEvent {
+  LINK_UP,    // Connected and got an IP address
+  LINK_DOWN   // Connection lost
+};
+
+typedef void (*LinkEventCallback)(LinkEvent event);
+
+// Initialize the manager and start the first connection attempt
+void initWifiManager(const char* ssid, const char* password);
+
+// Drive reconnects and dispatch link events; call regularly from loop context
+void wifiManagerLoop();
+
+// True while the station is connected with an IP address
+bool isWifiConnected();
+
+// Register a callback for link events (called from wifiManagerLoop)
+bool onLinkEvent(LinkEventCallback callback);
+
+// Add connectivity metrics to a telemetry object
+void appendWifiMetrics(JsonObject metrics);
+
+#endif // WIFI_MANAGER_H
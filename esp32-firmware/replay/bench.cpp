@@ -0,0 +1,256 @@
+/*
+ * IriQ Smart Irrigation System - Control Path Benchmarks
+ *
+ * Times the firmware's control code on the host, built from the same
+ * sensors.cpp and scheduler.cpp as the device: moisture conversion and
+ * smoothing, the automatic-mode decision, command application and a
+ * scheduler pass. The request path runs too, against the scripted server
+ * in host/http_fake.cpp: a command poll parsing three pending commands,
+ * and a sensor reading upload. Each case reports ns/op (best of several runs, so a busy
+ * machine inflates it less) and heap allocations per op, counted by the
+ * operator new below.
+ *
+ * delay() advances the virtual clock instead of sleeping, so the relay and
+ * ADC settling delays cost nothing here; the numbers measure the code
+ * around them. Host timings do not translate to the ESP32, but changes in
+ * them (and any new allocation) do.
+ *
+ * Usage: iriq-bench [--json out.json] [--baseline base.json]
+ *                   [--tolerance percent] [--filter name]
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "config.h"
+#include "hal.h"
+#include "http_fake.h"
+#include "memory_pool.h"
+#include "report.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "supabase_api.h"
+
+#define BENCH_REPETITIONS 9
+#define BENCH_MIN_NS 20000000.0  // Grow the iteration count until one run takes 20 ms
+
+static std::atomic<unsigned long> allocationCount(0);
+
+void* operator new(size_t size) {
+  allocationCount++;
+  void* pointer = std::malloc(size != 0 ? size : 1);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+struct BenchResult {
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+// Keep the compiler from dropping a result
+static volatile int sink;
+
+template <typename Body>
+static BenchResult runBench(Body body) {
+  unsigned long iterations = 1;
+  double elapsed = 0;
+  while (true) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+      body(i);
+    }
+    elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (elapsed >= BENCH_MIN_NS || iterations >= (1UL << 30)) {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  BenchResult result = { elapsed / iterations, 0 };
+  for (int run = 0; run < BENCH_REPETITIONS; run++) {
+    unsigned long allocationsBefore = allocationCount;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++) {
+      body(i);
+    }
+    elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    double nsPerOp = elapsed / iterations;
+    if (nsPerOp < result.nsPerOp) {
+      result.nsPerOp = nsPerOp;
+    }
+    result.allocsPerOp = (double)(allocationCount - allocationsBefore) / iterations;
+  }
+  return result;
+}
+
+static void idleTask() {}
+
+static void benchMoisture(Report* report) {
+  // Sweep the whole ADC range so every branch of the conversion runs
+  BenchResult result = runBench([](unsigned long i) {
+    replaySetAdc((int)(1000 + (i * 37) % 3400));
+    sink = readMoistureSensor();
+  });
+  report->emplace_back("read_moisture.ns_per_op", result.nsPerOp);
+  report->emplace_back("read_moisture.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchAutomaticSteady(Report* report) {
+  // The common case: soil wet, pump off, nothing to do
+  automaticMode = true;
+  pumpStatus = false;
+  moistureLevel = MOISTURE_THRESHOLD + 20;
+  BenchResult result = runBench([](unsigned long) {
+    handleAutomaticMode();
+  });
+  report->emplace_back("automatic_steady.ns_per_op", result.nsPerOp);
+  report->emplace_back("automatic_steady.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchAutomaticToggle(Report* report) {
+  // Every decision switches the relay and uploads the device status
+  automaticMode = true;
+  BenchResult result = runBench([](unsigned long i) {
+    moistureLevel = (i & 1) ? MOISTURE_THRESHOLD + 20 : MOISTURE_THRESHOLD - 20;
+    handleAutomaticMode();
+  });
+  report->emplace_back("automatic_toggle.ns_per_op", result.nsPerOp);
+  report->emplace_back("automatic_toggle.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchManualCommand(Report* report) {
+  automaticMode = false;
+  BenchResult result = runBench([](unsigned long i) {
+    applyControl((i & 1) != 0, false);
+  });
+  report->emplace_back("manual_command.ns_per_op", result.nsPerOp);
+  report->emplace_back("manual_command.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchScheduler(Report* report) {
+  // A full table, as on the device, with nothing due
+  for (int i = 0; i < MAX_SCHEDULED_TASKS; i++) {
+    scheduleTask("bench", idleTask, 60000 + i);
+  }
+  BenchResult result = runBench([](unsigned long) {
+    runScheduler();
+    sink = (int)getSchedulerIdleTime();
+  });
+  report->emplace_back("scheduler_pass.ns_per_op", result.nsPerOp);
+  report->emplace_back("scheduler_pass.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchCommandPoll(Report* report) {
+  httpFakeReset();
+  httpFakeSetDefault(200,
+                     "[{\"id\":\"5f0c2a9e-8d43-4b6e-9a1f-3c7d2e8b4a61\",\"pump_control\":true,"
+                     "\"automatic_mode\":false,\"user_id\":\"2930efc2-0327-47db-9f0b-27901d2bc272\"},"
+                     "{\"id\":\"9b3e7d14-2c6a-4f85-b0d9-71e4a5c8f203\",\"pump_control\":false,"
+                     "\"automatic_mode\":false,\"user_id\":\"2930efc2-0327-47db-9f0b-27901d2bc272\"},"
+                     "{\"id\":\"c81a4f6b-0e95-4d27-8b3c-e6f1d9a07c45\",\"pump_control\":true,"
+                     "\"automatic_mode\":true,\"user_id\":\"2930efc2-0327-47db-9f0b-27901d2bc272\"}]");
+  BenchResult result = runBench([](unsigned long) {
+    sink = checkForCommands().count;
+  });
+  report->emplace_back("command_poll.ns_per_op", result.nsPerOp);
+  report->emplace_back("command_poll.allocs_per_op", result.allocsPerOp);
+}
+
+static void benchSensorUpload(Report* report) {
+  httpFakeReset();
+  BenchResult result = runBench([](unsigned long i) {
+    sink = sendSensorReading((int)(i % 101));
+  });
+  report->emplace_back("sensor_upload.ns_per_op", result.nsPerOp);
+  report->emplace_back("sensor_upload.allocs_per_op", result.allocsPerOp);
+}
+
+struct BenchCase {
+  const char* name;
+  void (*run)(Report* report);
+};
+
+static const BenchCase benchCases[] = {
+  { "read_moisture", benchMoisture },
+  { "automatic_steady", benchAutomaticSteady },
+  { "automatic_toggle", benchAutomaticToggle },
+  { "manual_command", benchManualCommand },
+  { "scheduler_pass", benchScheduler },
+  { "command_poll", benchCommandPoll },
+  { "sensor_upload", benchSensorUpload },
+};
+
+static void usage() {
+  std::cerr << "usage: iriq-bench [--json out.json] [--baseline base.json] [--tolerance percent] "
+               "[--filter name]\n";
+}
+
+int main(int argc, char** argv) {
+  std::string jsonPath, baselinePath, filter;
+  double tolerance = 30.0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      jsonPath = argv[++i];
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = std::atof(argv[++i]);
+    } else if (arg == "--filter" && i + 1 < argc) {
+      filter = argv[++i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+
+  initMemoryPools();
+  Report report;
+  for (const BenchCase& bench : benchCases) {
+    if (filter.empty() || std::string(bench.name).find(filter) != std::string::npos) {
+      bench.run(&report);
+    }
+  }
+  printReport(report);
+
+  if (!jsonPath.empty()) {
+    std::ofstream out(jsonPath);
+    writeReportJson(out, report);
+  }
+
+  if (!baselinePath.empty()) {
+    std::map<std::string, double> baseline;
+    if (!loadReport(baselinePath, &baseline)) {
+      std::cerr << "cannot read " << baselinePath << "\n";
+      return 2;
+    }
+    // Timings get the tolerance; any new allocation is a regression
+    std::map<std::string, double> tolerances;
+    for (const auto& metric : report) {
+      bool timing = metric.first.find(".ns_per_op") != std::string::npos;
+      tolerances[metric.first] = timing ? tolerance : 0.0;
+    }
+    if (countRegressions(report, baseline, tolerances) > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
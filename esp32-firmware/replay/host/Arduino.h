@@ -0,0 +1,122 @@
+/*
+ * IriQ Smart Irrigation System - Host Arduino Shim
+ *
+ * The subset of the Arduino core used by the host-built firmware modules,
+ * on a virtual clock: delay() advances millis() instead of sleeping, so a
+ * day of trace replays in well under a second. Pins keep the last written
+ * level; analogRead() returns the ADC samples queued from the trace.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+using std::max;
+using std::min;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define FALLING 0x02
+#define IRAM_ATTR
+
+class String {
+public:
+  String() {}
+  String(const char* text) : value(text != nullptr ? text : "") {}
+  String(const std::string& text) : value(text) {}
+  explicit String(char c) : value(1, c) {}
+  explicit String(int number) : value(std::to_string(number)) {}
+  explicit String(unsigned int number) : value(std::to_string(number)) {}
+  explicit String(long number) : value(std::to_string(number)) {}
+  explicit String(unsigned long number) : value(std::to_string(number)) {}
+
+  // Keeps the capacity, as Arduino's String does
+  String& operator=(const char* text) { value = text != nullptr ? text : ""; return *this; }
+
+  const char* c_str() const { return value.c_str(); }
+  size_t length() const { return value.length(); }
+  bool isEmpty() const { return value.empty(); }
+  bool reserve(unsigned int size) { value.reserve(size); return true; }
+  long toInt() const { return std::atol(value.c_str()); }
+
+  bool concat(const char* text, unsigned int count) { value.append(text, count); return true; }
+  String& operator+=(const String& other) { value += other.value; return *this; }
+  String& operator+=(const char* text) { value += text != nullptr ? text : ""; return *this; }
+  String& operator+=(char c) { value += c; return *this; }
+  String& operator+=(int number) { value += std::to_string(number); return *this; }
+  String& operator+=(unsigned int number) { value += std::to_string(number); return *this; }
+  String& operator+=(long number) { value += std::to_string(number); return *this; }
+  String& operator+=(unsigned long number) { value += std::to_string(number); return *this; }
+
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator==(const char* text) const { return value == (text != nullptr ? text : ""); }
+  bool operator!=(const String& other) const { return value != other.value; }
+  bool operator!=(const char* text) const { return !(*this == text); }
+
+  friend String operator+(const String& left, const String& right) { return String(left.value + right.value); }
+  friend String operator+(const String& left, const char* right) { return String(left.value + right); }
+  friend String operator+(const char* left, const String& right) { return String(left + right.value); }
+
+private:
+  std::string value;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t byte) = 0;
+  virtual size_t write(const uint8_t* bytes, size_t count) {
+    size_t written = 0;
+    while (count-- > 0) {
+      written += write(*bytes++);
+    }
+    return written;
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+unsigned long millis();
+void delay(unsigned long ms);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+// Flow pulses are generated by the replay (hal.cpp), not by interrupts
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int, void (*)(), int) {}
+
+inline long random(long max) {
+  return std::rand() % max;
+}
+
+// Defined in hal.cpp: rand() based, so runs are repeatable
+uint32_t esp_random();
+
+// There is no NTP on the host: always fails, as before the first sync
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,1345 @@
+/*
+ * IriQ Smart Irrigation System - Host ArduinoJson Shim
+ *
+ * The subset of ArduinoJson 6 the host-built firmware modules use, so the
+ * request payloads and response parsing can be checked off the device:
+ * documents, objects, arrays, member and element proxies, `|` defaults,
+ * serializeJson(), measureJson() and deserializeJson().
+ *
+ * A document takes one block of its declared capacity from its allocator,
+ * as ArduinoJson 6 does: values are 16-byte nodes from the front, strings
+ * are stored once from the back, and a value that does not fit is dropped
+ * and sets overflowed(). The same capacities that fit on the ESP32 fit here,
+ * and an ArenaJsonDocument draws from the firmware's arena as on the device.
+ * A const char* value is linked, while char*, char arrays and String are
+ * copied, as ArduinoJson does. Member names are always copied.
+ */
+
+#ifndef HOST_ARDUINOJSON_H
+#define HOST_ARDUINOJSON_H
+
+#include <Arduino.h>
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+namespace hostjson {
+
+enum NodeType : uint8_t {
+  NODE_NULL,
+  NODE_BOOL,
+  NODE_INT,
+  NODE_FLOAT,
+  NODE_LINKED,   // const char* kept by pointer
+  NODE_COPIED,   // String in the document's block
+  NODE_ARRAY,
+  NODE_OBJECT
+};
+
+// One value. References are block offsets plus one, 0 for none; link holds
+// the next sibling's reference above the type.
+struct Node {
+  union {
+    bool boolean;
+    int64_t integer;
+    double real;
+    const char* linked;
+    uint32_t text;
+    struct {
+      uint32_t first;
+      uint32_t last;
+    } children;
+  } value;
+  uint32_t key;
+  uint32_t link;
+};
+
+static_assert(sizeof(Node) == 16, "nodes are as large as ArduinoJson's slots on the ESP32");
+
+inline uint8_t typeOf(const Node* node) {
+  return node != nullptr ? (uint8_t)(node->link & 7) : (uint8_t)NODE_NULL;
+}
+
+inline void setType(Node* node, uint8_t type) {
+  node->link = (node->link & ~7u) | type;
+}
+
+inline bool isString(const Node* node) {
+  return typeOf(node) == NODE_LINKED || typeOf(node) == NODE_COPIED;
+}
+
+// The document's block: nodes grow up from the front, strings down from the back
+struct Pool {
+  uint8_t* buffer = nullptr;
+  size_t capacity = 0;
+  size_t nodesEnd = 0;
+  size_t stringsStart = 0;
+  bool overflowed = false;
+
+  void reset() {
+    nodesEnd = 0;
+    stringsStart = capacity;
+    overflowed = false;
+  }
+
+  Node* at(uint32_t ref) const {
+    return ref != 0 ? (Node*)(buffer + ref - 1) : nullptr;
+  }
+
+  uint32_t refOf(const Node* node) const {
+    return (uint32_t)((const uint8_t*)node - buffer) + 1;
+  }
+
+  const char* string(uint32_t ref) const {
+    return ref != 0 ? (const char*)buffer + ref - 1 : "";
+  }
+
+  Node* allocNode() {
+    if (nodesEnd + sizeof(Node) > stringsStart) {
+      overflowed = true;
+      return nullptr;
+    }
+    Node* node = (Node*)(buffer + nodesEnd);
+    nodesEnd += sizeof(Node);
+    memset(node, 0, sizeof(Node));
+    return node;
+  }
+
+  // Store a string once; returns its reference, 0 when it does not fit
+  uint32_t saveString(const char* text, size_t length) {
+    for (size_t offset = stringsStart; offset < capacity;) {
+      const char* stored = (const char*)buffer + offset;
+      size_t storedLength = strlen(stored);
+      if (storedLength == length && memcmp(stored, text, length) == 0) {
+        return (uint32_t)offset + 1;
+      }
+      offset += storedLength + 1;
+    }
+    if (stringsStart < nodesEnd + length + 1) {
+      overflowed = true;
+      return 0;
+    }
+    stringsStart -= length + 1;
+    memcpy(buffer + stringsStart, text, length);
+    buffer[stringsStart + length] = '\0';
+    return (uint32_t)stringsStart + 1;
+  }
+};
+
+inline const char* stringOf(const Pool* pool, const Node* node) {
+  if (typeOf(node) == NODE_LINKED) {
+    return node->value.linked;
+  }
+  if (typeOf(node) == NODE_COPIED) {
+    return pool->string(node->value.text);
+  }
+  return nullptr;
+}
+
+inline void clearNode(Node* node) {
+  node->value.integer = 0;
+  setType(node, NODE_NULL);
+}
+
+inline void makeContainer(Node* node, uint8_t type) {
+  node->value.children.first = 0;
+  node->value.children.last = 0;
+  setType(node, type);
+}
+
+inline Node* findMember(const Pool* pool, const Node* object, const char* key) {
+  if (typeOf(object) != NODE_OBJECT || key == nullptr) {
+    return nullptr;
+  }
+  for (Node* member = pool->at(object->value.children.first); member != nullptr; member = pool->at(member->link >> 3)) {
+    if (strcmp(pool->string(member->key), key) == 0) {
+      return member;
+    }
+  }
+  return nullptr;
+}
+
+inline Node* appendChild(Pool* pool, Node* parent) {
+  Node* child = pool->allocNode();
+  if (child == nullptr) {
+    return nullptr;
+  }
+  uint32_t ref = pool->refOf(child);
+  Node* last = pool->at(parent->value.children.last);
+  if (last != nullptr) {
+    last->link = (ref << 3) | (last->link & 7);
+  } else {
+    parent->value.children.first = ref;
+  }
+  parent->value.children.last = ref;
+  return child;
+}
+
+inline Node* addMember(Pool* pool, Node* object, const char* key) {
+  uint32_t keyRef = pool->saveString(key, strlen(key));
+  if (keyRef == 0) {
+    return nullptr;
+  }
+  Node* member = appendChild(pool, object);
+  if (member != nullptr) {
+    member->key = keyRef;
+  }
+  return member;
+}
+
+inline Node* elementAt(const Pool* pool, const Node* array, size_t index) {
+  if (typeOf(array) != NODE_ARRAY) {
+    return nullptr;
+  }
+  Node* element = pool->at(array->value.children.first);
+  for (; element != nullptr && index > 0; index--) {
+    element = pool->at(element->link >> 3);
+  }
+  return element;
+}
+
+inline size_t childCount(const Pool* pool, const Node* node) {
+  if (typeOf(node) != NODE_ARRAY && typeOf(node) != NODE_OBJECT) {
+    return 0;
+  }
+  size_t count = 0;
+  for (Node* child = pool->at(node->value.children.first); child != nullptr; child = pool->at(child->link >> 3)) {
+    count++;
+  }
+  return count;
+}
+
+inline void removeChild(Pool* pool, Node* parent, Node* child) {
+  Node* previous = nullptr;
+  for (Node* node = pool->at(parent->value.children.first); node != nullptr; node = pool->at(node->link >> 3)) {
+    if (node == child) {
+      uint32_t next = node->link >> 3;
+      if (previous != nullptr) {
+        previous->link = (next << 3) | (previous->link & 7);
+      } else {
+        parent->value.children.first = next;
+      }
+      if (parent->value.children.last == pool->refOf(node)) {
+        parent->value.children.last = previous != nullptr ? pool->refOf(previous) : 0;
+      }
+      return;
+    }
+    previous = node;
+  }
+}
+
+inline void setString(Pool* pool, Node* node, const char* text, bool copy) {
+  if (text == nullptr) {
+    clearNode(node);
+  } else if (!copy) {
+    node->value.linked = text;
+    setType(node, NODE_LINKED);
+  } else {
+    uint32_t ref = pool->saveString(text, strlen(text));
+    if (ref == 0) {
+      clearNode(node);
+      return;
+    }
+    node->value.text = ref;
+    setType(node, NODE_COPIED);
+  }
+}
+
+// Store a value; false (and the node left null) when it does not fit
+inline bool setValue(Pool*, Node* node, bool value) {
+  node->value.boolean = value;
+  setType(node, NODE_BOOL);
+  return true;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+setValue(Pool*, Node* node, T value) {
+  node->value.integer = (int64_t)value;
+  setType(node, NODE_INT);
+  return true;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, bool>::type setValue(Pool*, Node* node, T value) {
+  node->value.real = value;
+  setType(node, NODE_FLOAT);
+  return true;
+}
+
+inline bool setValue(Pool* pool, Node* node, const char* value) {
+  setString(pool, node, value, false);
+  return value == nullptr || isString(node);
+}
+
+inline bool setValue(Pool* pool, Node* node, char* value) {
+  setString(pool, node, value, true);
+  return value == nullptr || isString(node);
+}
+
+inline bool setValue(Pool* pool, Node* node, const String& value) {
+  setString(pool, node, value.c_str(), true);
+  return isString(node);
+}
+
+inline bool setValue(Pool* pool, Node* node, const std::string& value) {
+  setString(pool, node, value.c_str(), true);
+  return isString(node);
+}
+
+inline bool setValue(Pool*, Node* node, std::nullptr_t) {
+  clearNode(node);
+  return true;
+}
+
+// Reading a value as T, and whether it holds a T
+template <typename T, typename Enable = void>
+struct Converter;
+
+template <>
+struct Converter<bool> {
+  static bool read(const Pool*, const Node* node) {
+    switch (typeOf(node)) {
+      case NODE_BOOL: return node->value.boolean;
+      case NODE_INT: return node->value.integer != 0;
+      case NODE_FLOAT: return node->value.real != 0;
+      default: return false;
+    }
+  }
+  static bool holds(const Node* node) { return typeOf(node) == NODE_BOOL; }
+};
+
+template <typename T>
+struct Converter<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  static T read(const Pool*, const Node* node) {
+    switch (typeOf(node)) {
+      case NODE_BOOL: return (T)(node->value.boolean ? 1 : 0);
+      case NODE_INT: return (T)node->value.integer;
+      case NODE_FLOAT: return (T)node->value.real;
+      default: return 0;
+    }
+  }
+  static bool holds(const Node* node) {
+    if (typeOf(node) != NODE_INT) {
+      return false;
+    }
+    int64_t value = node->value.integer;
+    if (std::is_signed<T>::value) {
+      return value >= (int64_t)std::numeric_limits<T>::min() && value <= (int64_t)std::numeric_limits<T>::max();
+    }
+    return value >= 0 && (uint64_t)value <= (uint64_t)std::numeric_limits<T>::max();
+  }
+};
+
+template <typename T>
+struct Converter<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static T read(const Pool*, const Node* node) {
+    switch (typeOf(node)) {
+      case NODE_INT: return (T)node->value.integer;
+      case NODE_FLOAT: return (T)node->value.real;
+      default: return 0;
+    }
+  }
+  static bool holds(const Node* node) { return typeOf(node) == NODE_INT || typeOf(node) == NODE_FLOAT; }
+};
+
+template <>
+struct Converter<const char*> {
+  static const char* read(const Pool* pool, const Node* node) { return stringOf(pool, node); }
+  static bool holds(const Node* node) { return isString(node); }
+};
+
+// Serialization targets
+struct StringSink {
+  String& out;
+  void put(const char* text, size_t length) { out.concat(text, length); }
+};
+
+struct BufferSink {
+  char* buffer;
+  size_t size;
+  size_t length;
+  void put(const char* text, size_t count) {
+    for (size_t i = 0; i < count && length + 1 < size; i++) {
+      buffer[length++] = text[i];
+    }
+  }
+};
+
+struct PrintSink {
+  Print& out;
+  size_t length;
+  void put(const char* text, size_t count) { length += out.write((const uint8_t*)text, count); }
+};
+
+struct CountSink {
+  size_t length;
+  void put(const char*, size_t count) { length += count; }
+};
+
+template <typename TSink>
+void writeNode(TSink& sink, const Pool* pool, const Node* node);
+
+// Like ArduinoJson 6: a string as is, anything else serialized ("null" for null)
+template <>
+struct Converter<String> {
+  static String read(const Pool* pool, const Node* node) {
+    if (isString(node)) {
+      return String(stringOf(pool, node));
+    }
+    String text;
+    StringSink sink{text};
+    writeNode(sink, pool, node);
+    return text;
+  }
+  static bool holds(const Node* node) { return isString(node); }
+};
+
+template <typename TSink>
+void writeString(TSink& sink, const char* text) {
+  sink.put("\"", 1);
+  for (; *text != '\0'; text++) {
+    char c = *text;
+    switch (c) {
+      case '"': sink.put("\\\"", 2); break;
+      case '\\': sink.put("\\\\", 2); break;
+      case '\b': sink.put("\\b", 2); break;
+      case '\f': sink.put("\\f", 2); break;
+      case '\n': sink.put("\\n", 2); break;
+      case '\r': sink.put("\\r", 2); break;
+      case '\t': sink.put("\\t", 2); break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          sink.put(escaped, snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c));
+        } else {
+          sink.put(&c, 1);
+        }
+    }
+  }
+  sink.put("\"", 1);
+}
+
+template <typename TSink>
+void writeNode(TSink& sink, const Pool* pool, const Node* node) {
+  char number[32];
+  switch (typeOf(node)) {
+    case NODE_BOOL:
+      if (node->value.boolean) {
+        sink.put("true", 4);
+      } else {
+        sink.put("false", 5);
+      }
+      break;
+    case NODE_INT:
+      sink.put(number, snprintf(number, sizeof(number), "%lld", (long long)node->value.integer));
+      break;
+    case NODE_FLOAT:
+      if (std::isnan(node->value.real) || std::isinf(node->value.real)) {
+        sink.put("null", 4);
+      } else {
+        sink.put(number, snprintf(number, sizeof(number), "%.9g", node->value.real));
+      }
+      break;
+    case NODE_LINKED:
+    case NODE_COPIED:
+      writeString(sink, stringOf(pool, node));
+      break;
+    case NODE_ARRAY:
+    case NODE_OBJECT: {
+      bool object = typeOf(node) == NODE_OBJECT;
+      sink.put(object ? "{" : "[", 1);
+      bool first = true;
+      for (Node* child = pool->at(node->value.children.first); child != nullptr; child = pool->at(child->link >> 3)) {
+        if (!first) {
+          sink.put(",", 1);
+        }
+        first = false;
+        if (object) {
+          writeString(sink, pool->string(child->key));
+          sink.put(":", 1);
+        }
+        writeNode(sink, pool, child);
+      }
+      sink.put(object ? "}" : "]", 1);
+      break;
+    }
+    default:
+      sink.put("null", 4);
+  }
+}
+
+}  // namespace hostjson
+
+class DeserializationError {
+public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : code_(code) {}
+  explicit operator bool() const { return code_ != Ok; }
+  bool operator==(Code code) const { return code_ == code; }
+  bool operator!=(Code code) const { return code_ != code; }
+  Code code() const { return code_; }
+
+  const char* c_str() const {
+    static const char* const names[] = { "Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep" };
+    return names[code_];
+  }
+
+private:
+  Code code_;
+};
+
+class JsonVariant;
+class JsonObject;
+class JsonArray;
+template <typename TUpstream>
+class MemberProxy;
+template <typename TUpstream>
+class ElementProxy;
+template <typename TAllocator>
+class BasicJsonDocument;
+
+namespace hostjson {
+
+// What a proxy keeps of its parent: the reference itself, or the root
+// variant of a document (which cannot be copied)
+template <typename T>
+struct Upstream {
+  typedef T type;
+  static const T& of(const T& parent) { return parent; }
+};
+
+template <typename TAllocator>
+struct Upstream<BasicJsonDocument<TAllocator>> {
+  typedef JsonVariant type;
+  static JsonVariant of(const BasicJsonDocument<TAllocator>& doc);
+};
+
+}  // namespace hostjson
+
+// Operations shared by every reference to a value. Derived provides pool(),
+// resolve() (the node, or nullptr) and resolveOrCreate() (for writes).
+template <typename Derived>
+class VariantOperations {
+public:
+  template <typename T>
+  typename std::enable_if<!std::is_same<T, JsonObject>::value && !std::is_same<T, JsonArray>::value &&
+                              !std::is_same<T, JsonVariant>::value,
+                          T>::type
+  as() const {
+    return hostjson::Converter<T>::read(self().pool(), self().resolve());
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value ||
+                              std::is_same<T, JsonVariant>::value,
+                          T>::type
+  as() const;
+
+  template <typename T>
+  bool is() const;
+
+  bool isNull() const {
+    return hostjson::typeOf(self().resolve()) == hostjson::NODE_NULL;
+  }
+
+  size_t size() const {
+    return hostjson::childCount(self().pool(), self().resolve());
+  }
+
+  template <typename T>
+  operator T() const {
+    return as<T>();
+  }
+
+  // The value when it holds a T, otherwise the fallback
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value, T>::type operator|(const T& fallback) const {
+    return hostjson::Converter<T>::holds(self().resolve()) ? as<T>() : fallback;
+  }
+
+  const char* operator|(const char* fallback) const {
+    const char* text = hostjson::stringOf(self().pool(), self().resolve());
+    return text != nullptr ? text : fallback;
+  }
+
+  String operator|(const String& fallback) const {
+    const char* text = hostjson::stringOf(self().pool(), self().resolve());
+    return text != nullptr ? String(text) : fallback;
+  }
+
+  typedef typename hostjson::Upstream<Derived>::type UpstreamRef;
+
+  MemberProxy<UpstreamRef> operator[](const char* key) const;
+  MemberProxy<UpstreamRef> operator[](const String& key) const;
+  ElementProxy<UpstreamRef> operator[](int index) const;
+  ElementProxy<UpstreamRef> operator[](size_t index) const;
+
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, bool>::type set(const T& value) const {
+    hostjson::Node* node = self().resolveOrCreate();
+    return node != nullptr && hostjson::setValue(self().pool(), node, value);
+  }
+
+  template <typename TChar>
+  bool set(TChar* value) const {
+    hostjson::Node* node = self().resolveOrCreate();
+    return node != nullptr && hostjson::setValue(self().pool(), node, value);
+  }
+
+  template <typename T>
+  T to() const;
+
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, bool>::type add(const T& value) const;
+
+  template <typename TChar>
+  bool add(TChar* value) const;
+
+  JsonObject createNestedObject() const;
+  JsonArray createNestedArray() const;
+  JsonObject createNestedObject(const char* key) const;
+  JsonArray createNestedArray(const char* key) const;
+
+  void remove(const char* key) const {
+    hostjson::Node* node = self().resolve();
+    hostjson::Node* member = hostjson::findMember(self().pool(), node, key);
+    if (member != nullptr) {
+      hostjson::removeChild(self().pool(), node, member);
+    }
+  }
+
+  bool containsKey(const char* key) const {
+    return hostjson::findMember(self().pool(), self().resolve(), key) != nullptr;
+  }
+
+protected:
+  const Derived& self() const { return static_cast<const Derived&>(*this); }
+
+  // The node as a container of the given type, converting a null one
+  hostjson::Node* container(uint8_t type) const {
+    hostjson::Node* node = self().resolveOrCreate();
+    if (node == nullptr) {
+      return nullptr;
+    }
+    if (hostjson::typeOf(node) == hostjson::NODE_NULL) {
+      hostjson::makeContainer(node, type);
+    }
+    return hostjson::typeOf(node) == type ? node : nullptr;
+  }
+};
+
+class JsonVariant : public VariantOperations<JsonVariant> {
+public:
+  JsonVariant() : pool_(nullptr), node_(nullptr) {}
+  JsonVariant(hostjson::Pool* pool, hostjson::Node* node) : pool_(pool), node_(node) {}
+
+  hostjson::Pool* pool() const { return pool_; }
+  hostjson::Node* resolve() const { return node_; }
+  hostjson::Node* resolveOrCreate() const { return node_; }
+
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, JsonVariant&>::type operator=(
+      const T& value) {
+    set(value);
+    return *this;
+  }
+
+  template <typename TChar>
+  JsonVariant& operator=(TChar* value) {
+    set(value);
+    return *this;
+  }
+
+private:
+  hostjson::Pool* pool_;
+  hostjson::Node* node_;
+};
+
+class JsonObject : public VariantOperations<JsonObject> {
+public:
+  JsonObject() : pool_(nullptr), node_(nullptr) {}
+  JsonObject(hostjson::Pool* pool, hostjson::Node* node)
+      : pool_(pool), node_(hostjson::typeOf(node) == hostjson::NODE_OBJECT ? node : nullptr) {}
+
+  hostjson::Pool* pool() const { return pool_; }
+  hostjson::Node* resolve() const { return node_; }
+  hostjson::Node* resolveOrCreate() const { return node_; }
+
+  operator JsonVariant() const { return JsonVariant(pool_, node_); }
+
+private:
+  hostjson::Pool* pool_;
+  hostjson::Node* node_;
+};
+
+class JsonArrayIterator {
+public:
+  JsonArrayIterator(hostjson::Pool* pool, hostjson::Node* node) : pool_(pool), node_(node) {}
+  JsonVariant operator*() const { return JsonVariant(pool_, node_); }
+  JsonArrayIterator& operator++() {
+    node_ = pool_->at(node_->link >> 3);
+    return *this;
+  }
+  bool operator!=(const JsonArrayIterator& other) const { return node_ != other.node_; }
+
+private:
+  hostjson::Pool* pool_;
+  hostjson::Node* node_;
+};
+
+class JsonArray : public VariantOperations<JsonArray> {
+public:
+  JsonArray() : pool_(nullptr), node_(nullptr) {}
+  JsonArray(hostjson::Pool* pool, hostjson::Node* node)
+      : pool_(pool), node_(hostjson::typeOf(node) == hostjson::NODE_ARRAY ? node : nullptr) {}
+
+  hostjson::Pool* pool() const { return pool_; }
+  hostjson::Node* resolve() const { return node_; }
+  hostjson::Node* resolveOrCreate() const { return node_; }
+
+  JsonArrayIterator begin() const {
+    return JsonArrayIterator(pool_, node_ != nullptr ? pool_->at(node_->value.children.first) : nullptr);
+  }
+  JsonArrayIterator end() const { return JsonArrayIterator(pool_, nullptr); }
+
+  operator JsonVariant() const { return JsonVariant(pool_, node_); }
+
+private:
+  hostjson::Pool* pool_;
+  hostjson::Node* node_;
+};
+
+// doc["key"]: the member when reading, added (and the parent made an object) when written
+template <typename TUpstream>
+class MemberProxy : public VariantOperations<MemberProxy<TUpstream>> {
+public:
+  MemberProxy(const TUpstream& upstream, const char* key) : upstream_(upstream), key_(key) {}
+  MemberProxy(const MemberProxy& other) = default;
+
+  hostjson::Pool* pool() const { return upstream_.pool(); }
+
+  hostjson::Node* resolve() const {
+    return hostjson::findMember(upstream_.pool(), upstream_.resolve(), key_);
+  }
+
+  hostjson::Node* resolveOrCreate() const {
+    hostjson::Node* parent = upstream_.resolveOrCreate();
+    if (parent == nullptr) {
+      return nullptr;
+    }
+    if (hostjson::typeOf(parent) == hostjson::NODE_NULL) {
+      hostjson::makeContainer(parent, hostjson::NODE_OBJECT);
+    }
+    if (hostjson::typeOf(parent) != hostjson::NODE_OBJECT) {
+      return nullptr;
+    }
+    hostjson::Node* member = hostjson::findMember(upstream_.pool(), parent, key_);
+    return member != nullptr ? member : hostjson::addMember(upstream_.pool(), parent, key_);
+  }
+
+  operator JsonVariant() const { return JsonVariant(pool(), resolve()); }
+
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, MemberProxy&>::type operator=(
+      const T& value) {
+    this->set(value);
+    return *this;
+  }
+
+  template <typename TChar>
+  MemberProxy& operator=(TChar* value) {
+    this->set(value);
+    return *this;
+  }
+
+  MemberProxy& operator=(const MemberProxy& other) {
+    return *this = other.template as<JsonVariant>();
+  }
+
+  MemberProxy& operator=(const JsonVariant& value);
+
+private:
+  TUpstream upstream_;
+  const char* key_;
+};
+
+// array[index]: the element when reading, padded with nulls when written
+template <typename TUpstream>
+class ElementProxy : public VariantOperations<ElementProxy<TUpstream>> {
+public:
+  ElementProxy(const TUpstream& upstream, size_t index) : upstream_(upstream), index_(index) {}
+
+  hostjson::Pool* pool() const { return upstream_.pool(); }
+
+  hostjson::Node* resolve() const {
+    return hostjson::elementAt(upstream_.pool(), upstream_.resolve(), index_);
+  }
+
+  hostjson::Node* resolveOrCreate() const {
+    hostjson::Node* parent = upstream_.resolveOrCreate();
+    if (parent == nullptr) {
+      return nullptr;
+    }
+    if (hostjson::typeOf(parent) == hostjson::NODE_NULL) {
+      hostjson::makeContainer(parent, hostjson::NODE_ARRAY);
+    }
+    if (hostjson::typeOf(parent) != hostjson::NODE_ARRAY) {
+      return nullptr;
+    }
+    hostjson::Node* element = hostjson::elementAt(upstream_.pool(), parent, index_);
+    while (element == nullptr) {
+      if (hostjson::appendChild(upstream_.pool(), parent) == nullptr) {
+        return nullptr;
+      }
+      element = hostjson::elementAt(upstream_.pool(), parent, index_);
+    }
+    return element;
+  }
+
+  operator JsonVariant() const { return JsonVariant(pool(), resolve()); }
+
+  template <typename T>
+  typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, ElementProxy&>::type operator=(
+      const T& value) {
+    this->set(value);
+    return *this;
+  }
+
+  template <typename TChar>
+  ElementProxy& operator=(TChar* value) {
+    this->set(value);
+    return *this;
+  }
+
+private:
+  TUpstream upstream_;
+  size_t index_;
+};
+
+template <typename Derived>
+template <typename T>
+typename std::enable_if<std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value ||
+                            std::is_same<T, JsonVariant>::value,
+                        T>::type
+VariantOperations<Derived>::as() const {
+  return T(self().pool(), self().resolve());
+}
+
+template <typename Derived>
+template <typename T>
+bool VariantOperations<Derived>::is() const {
+  const hostjson::Node* node = self().resolve();
+  if (std::is_same<T, JsonObject>::value) {
+    return hostjson::typeOf(node) == hostjson::NODE_OBJECT;
+  }
+  if (std::is_same<T, JsonArray>::value) {
+    return hostjson::typeOf(node) == hostjson::NODE_ARRAY;
+  }
+  if (std::is_same<T, JsonVariant>::value) {
+    return node != nullptr;
+  }
+  return hostjson::Converter<typename std::conditional<
+      std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value || std::is_same<T, JsonVariant>::value,
+      bool, T>::type>::holds(node);
+}
+
+template <typename Derived>
+MemberProxy<typename VariantOperations<Derived>::UpstreamRef> VariantOperations<Derived>::operator[](
+    const char* key) const {
+  return MemberProxy<UpstreamRef>(hostjson::Upstream<Derived>::of(self()), key);
+}
+
+template <typename Derived>
+MemberProxy<typename VariantOperations<Derived>::UpstreamRef> VariantOperations<Derived>::operator[](
+    const String& key) const {
+  return MemberProxy<UpstreamRef>(hostjson::Upstream<Derived>::of(self()), key.c_str());
+}
+
+template <typename Derived>
+ElementProxy<typename VariantOperations<Derived>::UpstreamRef> VariantOperations<Derived>::operator[](
+    int index) const {
+  return ElementProxy<UpstreamRef>(hostjson::Upstream<Derived>::of(self()), (size_t)index);
+}
+
+template <typename Derived>
+ElementProxy<typename VariantOperations<Derived>::UpstreamRef> VariantOperations<Derived>::operator[](
+    size_t index) const {
+  return ElementProxy<UpstreamRef>(hostjson::Upstream<Derived>::of(self()), index);
+}
+
+template <typename Derived>
+template <typename T>
+T VariantOperations<Derived>::to() const {
+  hostjson::Node* node = self().resolveOrCreate();
+  if (node == nullptr) {
+    return T();
+  }
+  if (std::is_same<T, JsonObject>::value) {
+    hostjson::makeContainer(node, hostjson::NODE_OBJECT);
+  } else if (std::is_same<T, JsonArray>::value) {
+    hostjson::makeContainer(node, hostjson::NODE_ARRAY);
+  } else {
+    hostjson::clearNode(node);
+  }
+  return T(self().pool(), node);
+}
+
+template <typename Derived>
+template <typename T>
+typename std::enable_if<!std::is_array<T>::value && !std::is_pointer<T>::value, bool>::type
+VariantOperations<Derived>::add(const T& value) const {
+  hostjson::Node* array = container(hostjson::NODE_ARRAY);
+  hostjson::Node* element = array != nullptr ? hostjson::appendChild(self().pool(), array) : nullptr;
+  return element != nullptr && hostjson::setValue(self().pool(), element, value);
+}
+
+template <typename Derived>
+template <typename TChar>
+bool VariantOperations<Derived>::add(TChar* value) const {
+  hostjson::Node* array = container(hostjson::NODE_ARRAY);
+  hostjson::Node* element = array != nullptr ? hostjson::appendChild(self().pool(), array) : nullptr;
+  return element != nullptr && hostjson::setValue(self().pool(), element, value);
+}
+
+template <typename Derived>
+JsonObject VariantOperations<Derived>::createNestedObject() const {
+  hostjson::Node* array = container(hostjson::NODE_ARRAY);
+  hostjson::Node* element = array != nullptr ? hostjson::appendChild(self().pool(), array) : nullptr;
+  if (element != nullptr) {
+    hostjson::makeContainer(element, hostjson::NODE_OBJECT);
+  }
+  return JsonObject(self().pool(), element);
+}
+
+template <typename Derived>
+JsonArray VariantOperations<Derived>::createNestedArray() const {
+  hostjson::Node* array = container(hostjson::NODE_ARRAY);
+  hostjson::Node* element = array != nullptr ? hostjson::appendChild(self().pool(), array) : nullptr;
+  if (element != nullptr) {
+    hostjson::makeContainer(element, hostjson::NODE_ARRAY);
+  }
+  return JsonArray(self().pool(), element);
+}
+
+template <typename Derived>
+JsonObject VariantOperations<Derived>::createNestedObject(const char* key) const {
+  return (*this)[key].template to<JsonObject>();
+}
+
+template <typename Derived>
+JsonArray VariantOperations<Derived>::createNestedArray(const char* key) const {
+  return (*this)[key].template to<JsonArray>();
+}
+
+// Copy a value from another document (or another place in this one)
+inline bool copyNode(hostjson::Pool* pool, hostjson::Node* target, const hostjson::Pool* sourcePool,
+                     const hostjson::Node* source) {
+  switch (hostjson::typeOf(source)) {
+    case hostjson::NODE_LINKED:
+      hostjson::setString(pool, target, source->value.linked, false);
+      return true;
+    case hostjson::NODE_COPIED:
+      hostjson::setString(pool, target, sourcePool->string(source->value.text), true);
+      return hostjson::isString(target);
+    case hostjson::NODE_ARRAY:
+    case hostjson::NODE_OBJECT: {
+      bool object = hostjson::typeOf(source) == hostjson::NODE_OBJECT;
+      hostjson::makeContainer(target, hostjson::typeOf(source));
+      for (hostjson::Node* child = sourcePool->at(source->value.children.first); child != nullptr;
+           child = sourcePool->at(child->link >> 3)) {
+        hostjson::Node* copy = object ? hostjson::addMember(pool, target, sourcePool->string(child->key))
+                                      : hostjson::appendChild(pool, target);
+        if (copy == nullptr || !copyNode(pool, copy, sourcePool, child)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      target->value = source->value;
+      hostjson::setType(target, hostjson::typeOf(source));
+      return true;
+  }
+}
+
+template <typename TUpstream>
+MemberProxy<TUpstream>& MemberProxy<TUpstream>::operator=(const JsonVariant& value) {
+  hostjson::Node* node = resolveOrCreate();
+  if (node != nullptr) {
+    copyNode(pool(), node, value.pool(), value.resolve());
+  }
+  return *this;
+}
+
+struct DefaultAllocator {
+  void* allocate(size_t size) { return malloc(size); }
+  void deallocate(void* pointer) { free(pointer); }
+  void* reallocate(void* pointer, size_t size) { return realloc(pointer, size); }
+};
+
+template <typename TAllocator>
+class BasicJsonDocument : public VariantOperations<BasicJsonDocument<TAllocator>> {
+public:
+  explicit BasicJsonDocument(size_t capacity) {
+    pool_.buffer = (uint8_t*)allocator_.allocate(capacity);
+    pool_.capacity = pool_.buffer != nullptr ? capacity : 0;
+    clear();
+  }
+
+  ~BasicJsonDocument() {
+    allocator_.deallocate(pool_.buffer);
+  }
+
+  BasicJsonDocument(const BasicJsonDocument&) = delete;
+  BasicJsonDocument& operator=(const BasicJsonDocument&) = delete;
+
+  hostjson::Pool* pool() const { return &pool_; }
+  hostjson::Node* resolve() const { return &root_; }
+  hostjson::Node* resolveOrCreate() const { return &root_; }
+
+  void clear() {
+    pool_.reset();
+    memset(&root_, 0, sizeof(root_));
+  }
+
+  size_t capacity() const { return pool_.capacity; }
+  size_t memoryUsage() const { return pool_.nodesEnd + (pool_.capacity - pool_.stringsStart); }
+  bool overflowed() const { return pool_.overflowed; }
+
+  template <typename T>
+  T to() {
+    clear();
+    return VariantOperations<BasicJsonDocument<TAllocator>>::template to<T>();
+  }
+
+  operator JsonVariant() const { return JsonVariant(&pool_, &root_); }
+
+private:
+  TAllocator allocator_;
+  mutable hostjson::Pool pool_;
+  mutable hostjson::Node root_;
+};
+
+template <typename TAllocator>
+JsonVariant hostjson::Upstream<BasicJsonDocument<TAllocator>>::of(const BasicJsonDocument<TAllocator>& doc) {
+  return JsonVariant(doc.pool(), doc.resolve());
+}
+
+typedef BasicJsonDocument<DefaultAllocator> DynamicJsonDocument;
+
+// Serialization, appending to a String as ArduinoJson 6 does
+template <typename TSource>
+size_t serializeJson(const TSource& source, String& output) {
+  hostjson::StringSink sink{output};
+  size_t before = output.length();
+  hostjson::writeNode(sink, source.pool(), source.resolve());
+  return output.length() - before;
+}
+
+// Truncated to size - 1 characters and always terminated
+template <typename TSource>
+size_t serializeJson(const TSource& source, char* buffer, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  hostjson::BufferSink sink{buffer, size, 0};
+  hostjson::writeNode(sink, source.pool(), source.resolve());
+  buffer[sink.length] = '\0';
+  return sink.length;
+}
+
+template <typename TSource>
+size_t serializeJson(const TSource& source, Print& output) {
+  hostjson::PrintSink sink{output, 0};
+  hostjson::writeNode(sink, source.pool(), source.resolve());
+  return sink.length;
+}
+
+template <typename TSource>
+size_t measureJson(const TSource& source) {
+  hostjson::CountSink sink{0};
+  hostjson::writeNode(sink, source.pool(), source.resolve());
+  return sink.length;
+}
+
+namespace hostjson {
+
+// Recursive descent parser filling a document's block. Strings are decoded
+// into the free space between nodes and strings, then stored, so parsing
+// needs no memory beyond the document's.
+class Parser {
+public:
+  Parser(Pool* pool, const char* input, size_t length) : pool_(pool), input_(input), end_(input + length) {}
+
+  DeserializationError::Code parse(Node* root) {
+    skipSpace();
+    if (input_ == end_) {
+      return DeserializationError::EmptyInput;
+    }
+    return parseValue(root, 0);
+  }
+
+private:
+  static const int kNestingLimit = 10;
+
+  void skipSpace() {
+    while (input_ < end_ && (*input_ == ' ' || *input_ == '\t' || *input_ == '\n' || *input_ == '\r')) {
+      input_++;
+    }
+  }
+
+  DeserializationError::Code parseValue(Node* node, int depth) {
+    skipSpace();
+    if (input_ == end_) {
+      return DeserializationError::IncompleteInput;
+    }
+    switch (*input_) {
+      case '{': return parseContainer(node, depth, true);
+      case '[': return parseContainer(node, depth, false);
+      case '"': return parseString(node);
+      case 't': return parseLiteral(node, "true", NODE_BOOL, true);
+      case 'f': return parseLiteral(node, "false", NODE_BOOL, false);
+      case 'n': return parseLiteral(node, "null", NODE_NULL, false);
+      default: return parseNumber(node);
+    }
+  }
+
+  DeserializationError::Code parseLiteral(Node* node, const char* word, uint8_t type, bool value) {
+    size_t length = strlen(word);
+    size_t left = (size_t)(end_ - input_);
+    if (memcmp(input_, word, left < length ? left : length) != 0) {
+      return DeserializationError::InvalidInput;
+    }
+    if (left < length) {
+      return DeserializationError::IncompleteInput;
+    }
+    input_ += length;
+    clearNode(node);
+    if (type == NODE_BOOL) {
+      node->value.boolean = value;
+      setType(node, NODE_BOOL);
+    }
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError::Code parseNumber(Node* node) {
+    char text[64];
+    size_t length = 0;
+    bool real = false;
+    while (input_ < end_ && (isdigit((unsigned char)*input_) || *input_ == '-' || *input_ == '+' || *input_ == '.' ||
+                             *input_ == 'e' || *input_ == 'E')) {
+      if (length + 1 >= sizeof(text)) {
+        return DeserializationError::InvalidInput;
+      }
+      real = real || *input_ == '.' || *input_ == 'e' || *input_ == 'E';
+      text[length++] = *input_++;
+    }
+    if (length == 0) {
+      return DeserializationError::InvalidInput;
+    }
+    text[length] = '\0';
+    char* parsedEnd = nullptr;
+    if (real) {
+      node->value.real = strtod(text, &parsedEnd);
+      setType(node, NODE_FLOAT);
+    } else {
+      node->value.integer = strtoll(text, &parsedEnd, 10);
+      setType(node, NODE_INT);
+    }
+    return *parsedEnd == '\0' ? DeserializationError::Ok : DeserializationError::InvalidInput;
+  }
+
+  // Append to the string being decoded in the free space
+  bool putChar(size_t* length, char c) {
+    if (pool_->nodesEnd + *length + 1 >= pool_->stringsStart) {
+      pool_->overflowed = true;
+      return false;
+    }
+    pool_->buffer[pool_->nodesEnd + (*length)++] = (uint8_t)c;
+    return true;
+  }
+
+  // Decode a quoted string and store it; *ref is 0 when it does not fit
+  DeserializationError::Code readString(uint32_t* ref) {
+    size_t length = 0;
+    input_++;  // Opening quote
+    while (input_ < end_ && *input_ != '"') {
+      char c = *input_++;
+      if (c == '\\') {
+        if (input_ == end_) {
+          return DeserializationError::IncompleteInput;
+        }
+        char escaped = *input_++;
+        switch (escaped) {
+          case 'b': c = '\b'; break;
+          case 'f': c = '\f'; break;
+          case 'n': c = '\n'; break;
+          case 'r': c = '\r'; break;
+          case 't': c = '\t'; break;
+          case 'u': {
+            if (end_ - input_ < 4) {
+              return DeserializationError::IncompleteInput;
+            }
+            char hex[5] = { input_[0], input_[1], input_[2], input_[3], '\0' };
+            unsigned code = (unsigned)strtoul(hex, nullptr, 16);
+            input_ += 4;
+            bool stored;
+            if (code < 0x80) {
+              stored = putChar(&length, (char)code);
+            } else if (code < 0x800) {
+              stored = putChar(&length, (char)(0xC0 | (code >> 6))) && putChar(&length, (char)(0x80 | (code & 0x3F)));
+            } else {
+              stored = putChar(&length, (char)(0xE0 | (code >> 12))) &&
+                       putChar(&length, (char)(0x80 | ((code >> 6) & 0x3F))) &&
+                       putChar(&length, (char)(0x80 | (code & 0x3F)));
+            }
+            if (!stored) {
+              return DeserializationError::NoMemory;
+            }
+            continue;
+          }
+          default: c = escaped;
+        }
+      }
+      if (!putChar(&length, c)) {
+        return DeserializationError::NoMemory;
+      }
+    }
+    if (input_ == end_) {
+      return DeserializationError::IncompleteInput;
+    }
+    input_++;  // Closing quote
+
+    // Move the decoded text from the free space to the strings
+    char* decoded = (char*)pool_->buffer + pool_->nodesEnd;
+    for (size_t offset = pool_->stringsStart; offset < pool_->capacity;) {
+      const char* stored = (const char*)pool_->buffer + offset;
+      size_t storedLength = strlen(stored);
+      if (storedLength == length && memcmp(stored, decoded, length) == 0) {
+        *ref = (uint32_t)offset + 1;
+        return DeserializationError::Ok;
+      }
+      offset += storedLength + 1;
+    }
+    if (pool_->stringsStart < pool_->nodesEnd + length + 1) {
+      pool_->overflowed = true;
+      return DeserializationError::NoMemory;
+    }
+    pool_->stringsStart -= length + 1;
+    memmove(pool_->buffer + pool_->stringsStart, decoded, length);
+    pool_->buffer[pool_->stringsStart + length] = '\0';
+    *ref = (uint32_t)pool_->stringsStart + 1;
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError::Code parseString(Node* node) {
+    uint32_t ref = 0;
+    DeserializationError::Code error = readString(&ref);
+    if (error != DeserializationError::Ok) {
+      return error;
+    }
+    node->value.text = ref;
+    setType(node, NODE_COPIED);
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError::Code parseContainer(Node* node, int depth, bool object) {
+    if (depth >= kNestingLimit) {
+      return DeserializationError::TooDeep;
+    }
+    makeContainer(node, object ? NODE_OBJECT : NODE_ARRAY);
+    input_++;  // Opening bracket
+    skipSpace();
+    char close = object ? '}' : ']';
+    if (input_ < end_ && *input_ == close) {
+      input_++;
+      return DeserializationError::Ok;
+    }
+
+    while (true) {
+      uint32_t key = 0;
+      skipSpace();
+      if (object) {
+        if (input_ == end_) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (*input_ != '"') {
+          return DeserializationError::InvalidInput;
+        }
+        DeserializationError::Code error = readString(&key);
+        if (error != DeserializationError::Ok) {
+          return error;
+        }
+        skipSpace();
+        if (input_ == end_) {
+          return DeserializationError::IncompleteInput;
+        }
+        if (*input_++ != ':') {
+          return DeserializationError::InvalidInput;
+        }
+      }
+      Node* child = appendChild(pool_, node);
+      if (child == nullptr) {
+        return DeserializationError::NoMemory;
+      }
+      child->key = key;
+
+      DeserializationError::Code error = parseValue(child, depth + 1);
+      if (error != DeserializationError::Ok) {
+        return error;
+      }
+      skipSpace();
+      if (input_ == end_) {
+        return DeserializationError::IncompleteInput;
+      }
+      char separator = *input_++;
+      if (separator == close) {
+        return DeserializationError::Ok;
+      }
+      if (separator != ',') {
+        return DeserializationError::InvalidInput;
+      }
+    }
+  }
+
+  Pool* pool_;
+  const char* input_;
+  const char* end_;
+};
+
+}  // namespace hostjson
+
+template <typename TAllocator>
+DeserializationError deserializeJson(BasicJsonDocument<TAllocator>& doc, const char* input, size_t length) {
+  doc.clear();
+  if (input == nullptr) {
+    return DeserializationError::EmptyInput;
+  }
+  hostjson::Parser parser(doc.pool(), input, length);
+  DeserializationError::Code code = parser.parse(doc.resolve());
+  if (code != DeserializationError::Ok) {
+    doc.clear();
+  }
+  return code;
+}
+
+template <typename TAllocator>
+DeserializationError deserializeJson(BasicJsonDocument<TAllocator>& doc, const char* input) {
+  return deserializeJson(doc, input, input != nullptr ? strlen(input) : 0);
+}
+
+template <typename TAllocator>
+DeserializationError deserializeJson(BasicJsonDocument<TAllocator>& doc, const String& input) {
+  return deserializeJson(doc, input.c_str(), input.length());
+}
+
+#endif // HOST_ARDUINOJSON_H
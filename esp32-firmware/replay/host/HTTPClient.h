@@ -0,0 +1,41 @@
+/*
+ * IriQ Smart Irrigation System - Host HTTPClient Shim
+ *
+ * HTTPClient as api_client.cpp uses it, answering from the responses
+ * scripted in host/http_fake.h instead of a server. Signatures and error
+ * codes are the Arduino core's, so the same String temporaries are made.
+ */
+
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+public:
+  bool begin(WiFiClient& client, String url);
+  void setReuse(bool reuse);
+  void setTimeout(uint16_t timeout);
+  void addHeader(const String& name, const String& value, bool first = false, bool replace = true);
+  void collectHeaders(const char* headerKeys[], size_t headerKeysCount);
+  int sendRequest(const char* type, uint8_t* payload = nullptr, size_t size = 0);
+  String header(const char* name);
+  int writeToStream(Stream* stream);
+  String getString();
+  void end();
+};
+
+#endif // HOST_HTTPCLIENT_H
@@ -0,0 +1,31 @@
+/*
+ * IriQ Smart Irrigation System - Host WiFi Shim
+ *
+ * The replayed code never touches the radio. The API modules only check
+ * that the station is connected, which it always is here, and hand the
+ * client from openApiConnection() to HTTPClient (host/HTTPClient.h).
+ */
+
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+#define WL_CONNECTED 3
+
+class WiFiClient : public Stream {
+public:
+  size_t write(uint8_t) override { return 1; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+class WiFiClass {
+public:
+  int status() const { return WL_CONNECTED; }
+};
+
+inline WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
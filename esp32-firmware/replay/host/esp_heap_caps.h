@@ -0,0 +1,19 @@
+/*
+ * IriQ Smart Irrigation System - Host Heap Capabilities Shim
+ *
+ * The host heap has no fixed size; the statistics read as zero.
+ */
+
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline size_t heap_caps_get_free_size(uint32_t) { return 0; }
+inline size_t heap_caps_get_minimum_free_size(uint32_t) { return 0; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return 0; }
+
+#endif // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,17 @@
+/*
+ * IriQ Smart Irrigation System - Host FreeRTOS Shim
+ *
+ * The host tools run the firmware on one thread, so critical sections
+ * have nothing to exclude.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+typedef int portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // HOST_FREERTOS_H
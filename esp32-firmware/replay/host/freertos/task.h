@@ -0,0 +1,17 @@
+/*
+ * IriQ Smart Irrigation System - Host FreeRTOS Task Shim
+ *
+ * Everything runs on the one host thread, which stands in for the loop task.
+ */
+
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+typedef void* TaskHandle_t;
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static int loopTask;
+  return &loopTask;
+}
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,205 @@
+/*
+ * IriQ Smart Irrigation System - Replay HAL
+ *
+ * Host implementations of everything sensors.cpp links against outside
+ * itself: the Arduino pin and clock functions, logging, control state
+ * persistence, the state store and the device status uploads. On the device those go out
+ * through the outbound queue, off the control path, so here they cost no
+ * time and take the outcome last recorded for the device_status endpoint.
+ */
+
+#include "hal.h"
+#include "api_client.h"
+#include "control_state.h"
+#include "logger.h"
+#include "metering.h"
+#include "outbound.h"
+#include "sensors.h"
+#include "state_store.h"
+#include "trace.h"
+
+#include <deque>
+
+// Globals the firmware defines in the main sketch
+const int moistureSensorPin = MOISTURE_SENSOR_PIN;
+const int pumpRelayPin = PUMP_RELAY_PIN;
+const int ledPin = LED_PIN;
+bool pumpStatus = false;
+bool automaticMode = true;
+int moistureLevel = 0;
+String deviceId = DEVICE_ID;
+
+static unsigned long virtualMillis = 0;
+static uint8_t pinLevels[64];
+static std::deque<int> adcSamples;
+static int lastAdcSample = 4095;
+static NetworkSample network[ENDPOINT_COUNT];
+static bool verboseLog = false;
+
+// Simulated flow sensor: pulses at flowRate while the relay is on
+static bool relayOn = false;
+static double flowRate = 0;
+static double flowCarry = 0;
+static unsigned long flowUpdatedAt = 0;
+
+static PumpStats stats;
+static bool statsPumpOn = false;
+static unsigned long pumpOnSince = 0;
+static unsigned long lastToggleAt = 0;
+
+static void emitFlowPulses() {
+  if (relayOn && flowRate > 0) {
+    flowCarry += (virtualMillis - flowUpdatedAt) * flowRate / 1000.0;
+    for (; flowCarry >= 1.0; flowCarry -= 1.0) {
+      onFlowPulse();
+    }
+  }
+  flowUpdatedAt = virtualMillis;
+}
+
+unsigned long millis() {
+  return virtualMillis;
+}
+
+void delay(unsigned long ms) {
+  emitFlowPulses();
+  virtualMillis += ms;
+  emitFlowPulses();
+}
+
+uint32_t esp_random() {
+  return ((uint32_t)std::rand() << 16) ^ (uint32_t)std::rand();
+}
+
+bool getLocalTime(struct tm*, uint32_t) {
+  return false;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  pinLevels[pin % 64] = level;
+  if (pin == pumpRelayPin) {
+    // Active LOW relay
+    emitFlowPulses();
+    relayOn = level == LOW;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pinLevels[pin % 64];
+}
+
+uint16_t analogRead(uint8_t) {
+  if (!adcSamples.empty()) {
+    lastAdcSample = adcSamples.front();
+    adcSamples.pop_front();
+  }
+  return lastAdcSample;
+}
+
+void replayAdvanceTo(unsigned long ms) {
+  if (ms > virtualMillis) {
+    emitFlowPulses();
+    virtualMillis = ms;
+    emitFlowPulses();
+  }
+}
+
+void replaySetFlowRate(double pulsesPerSecond) {
+  flowRate = pulsesPerSecond;
+}
+
+void replayQueueAdc(int sample) {
+  adcSamples.push_back(sample);
+}
+
+void replayClearAdc() {
+  adcSamples.clear();
+}
+
+void replaySetAdc(int sample) {
+  lastAdcSample = sample;
+}
+
+void replaySetNetwork(long endpoint, long status, unsigned long latency) {
+  if (endpoint >= 0 && endpoint < ENDPOINT_COUNT) {
+    network[endpoint].status = status;
+    network[endpoint].latency = latency;
+    network[endpoint].seen = true;
+  }
+}
+
+PumpStats replayPumpStats() {
+  PumpStats current = stats;
+  if (statsPumpOn) {
+    current.onMs += virtualMillis - pumpOnSince;
+  }
+  return current;
+}
+
+void replaySetVerbose(bool verbose) {
+  verboseLog = verbose;
+}
+
+void logWrite(uint8_t level, const char* format, ...) {
+  if (!verboseLog) {
+    return;
+  }
+  static const char levels[] = "-EWIDV";
+  fprintf(stderr, "[%8lu] %c ", virtualMillis, levels[level < 6 ? level : 0]);
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fputc('\n', stderr);
+}
+
+// Called by setPumpStatus() and setAutomaticMode() after every change
+void saveControlState(bool pump, bool) {
+  if (pump == statsPumpOn) {
+    return;
+  }
+  if (stats.toggles > 0) {
+    unsigned long interval = virtualMillis - lastToggleAt;
+    if (stats.minToggleIntervalMs == 0 || interval < stats.minToggleIntervalMs) {
+      stats.minToggleIntervalMs = interval;
+    }
+  }
+  if (statsPumpOn) {
+    stats.onMs += virtualMillis - pumpOnSince;
+  } else {
+    pumpOnSince = virtualMillis;
+  }
+  stats.toggles++;
+  lastToggleAt = virtualMillis;
+  statsPumpOn = pump;
+}
+
+bool loadControlState(bool*, bool*) {
+  return false;
+}
+
+// Metered usage stays in RAM for the run; a replay starts with nothing stored
+int registerState(const char*, const char*, StateType, void*, size_t, unsigned long) {
+  return -1;
+}
+
+void requestStateCommit(int) {}
+
+void queueDeviceStatus(bool, bool) {
+  const NetworkSample& sample = network[ENDPOINT_DEVICE_STATUS];
+  stats.statusUploads++;
+  if (sample.seen && (sample.status < 200 || sample.status >= 300)) {
+    stats.statusFailures++;
+  }
+}
+
+void blinkLED(int times, int delayMs) {
+  delay((unsigned long)times * delayMs * 2);
+}
+
+#if TRACE_ENABLED
+// The replay reads the trace; the replayed code does not write one
+void traceEvent(char, long, long, long) {}
+#endif
@@ -0,0 +1,54 @@
+/*
+ * IriQ Smart Irrigation System - Replay HAL Header
+ *
+ * Header file for the host side of the replay: the virtual clock, the ADC
+ * queue, the network model fed from recorded requests, and what the
+ * replayed code did to the relay.
+ */
+
+#ifndef REPLAY_HAL_H
+#define REPLAY_HAL_H
+
+#include <Arduino.h>
+
+// Recorded outcome of the last request to an endpoint
+struct NetworkSample {
+  long status;           // HTTP status, or a negative client error
+  unsigned long latency; // Milliseconds
+  bool seen;
+};
+
+// Pump activity produced by the replayed code
+struct PumpStats {
+  unsigned long toggles;
+  unsigned long onMs;
+  unsigned long minToggleIntervalMs;  // 0 until the second toggle
+  unsigned long statusUploads;
+  unsigned long statusFailures;
+};
+
+// Move the virtual clock forward to ms (never backwards)
+void replayAdvanceTo(unsigned long ms);
+
+// Queue a raw ADC sample for the next analogRead()
+void replayQueueAdc(int sample);
+
+// Drop samples a reading did not consume
+void replayClearAdc();
+
+// Value analogRead() returns once the queue is empty
+void replaySetAdc(int sample);
+
+// Record the outcome of a request to endpoint (ApiEndpoint value)
+void replaySetNetwork(long endpoint, long status, unsigned long latency);
+
+// Pulses per second the simulated flow sensor gives while the relay is on
+void replaySetFlowRate(double pulsesPerSecond);
+
+// Pump statistics up to the current virtual time
+PumpStats replayPumpStats();
+
+// Forward firmware log lines to stderr
+void replaySetVerbose(bool verbose);
+
+#endif // REPLAY_HAL_H
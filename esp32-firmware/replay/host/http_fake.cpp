@@ -0,0 +1,199 @@
+/*
+ * IriQ Smart Irrigation System - Host API Fake
+ *
+ * Everything api_client.cpp, supabase_api.cpp and heartbeat.cpp link
+ * against outside the modules built for the host: HTTPClient, the shared
+ * connection, the token, the acknowledgement queue and the telemetry
+ * schedule, answering from a fixed-size script.
+ */
+
+#include "http_fake.h"
+#include "api_client.h"
+#include "auth.h"
+#include "memory_pool.h"
+#include "outbound.h"
+#include "telemetry.h"
+#include "tls_session.h"
+#include <HTTPClient.h>
+
+#define SCRIPT_SIZE 16
+#define HISTORY_SIZE 8
+
+struct ScriptedResponse {
+  int status;
+  const char* body;
+  const char* retryAfter;
+};
+
+// Globals the firmware defines in the main sketch
+const char* supabaseUrl = "https://iriq.supabase.co";
+const char* supabaseKey = "anon-key";
+
+static ScriptedResponse script[SCRIPT_SIZE];
+static int scriptHead = 0;
+static int scriptTail = 0;
+static ScriptedResponse defaultResponse = { 201, "", "" };
+static ScriptedResponse current = { 0, "", "" };
+
+static FakeRequest history[HISTORY_SIZE];
+static unsigned long requestCount = 0;
+static FakeRequest pending;
+
+static WiFiClient client;
+static bool connectionOpen = false;
+static bool connectionReused = false;
+static bool authenticated = true;
+static unsigned long tokenInvalidations = 0;
+static const char* unackedIds = "";
+static bool ackRoom = true;
+static bool telemetryDue = false;
+static unsigned long telemetrySent = 0;
+
+static void copyText(char* target, size_t size, const char* text) {
+  snprintf(target, size, "%s", text);
+}
+
+void httpFakeReset() {
+  scriptHead = scriptTail = 0;
+  defaultResponse = { 201, "", "" };
+  requestCount = 0;
+  memset(history, 0, sizeof(history));
+  connectionOpen = false;
+  authenticated = true;
+  tokenInvalidations = 0;
+  unackedIds = "";
+  ackRoom = true;
+  telemetryDue = false;
+  telemetrySent = 0;
+}
+
+void httpFakeRespond(int status, const char* body, const char* retryAfter) {
+  if (scriptTail - scriptHead < SCRIPT_SIZE) {
+    script[scriptTail++ % SCRIPT_SIZE] = { status, body, retryAfter };
+  }
+}
+
+void httpFakeSetDefault(int status, const char* body) {
+  defaultResponse = { status, body, "" };
+}
+
+unsigned long httpFakeRequestCount() {
+  return requestCount;
+}
+
+const FakeRequest& httpFakeRequest(int back) {
+  return history[(requestCount + HISTORY_SIZE * 2 - 1 - back) % HISTORY_SIZE];
+}
+
+unsigned long httpFakeTokenInvalidations() {
+  return tokenInvalidations;
+}
+
+void httpFakeSetAuthenticated(bool value) {
+  authenticated = value;
+}
+
+void httpFakeSetUnackedCommandIds(const char* ids, bool roomForMore) {
+  unackedIds = ids;
+  ackRoom = roomForMore;
+}
+
+WiFiClient* openApiConnection(bool* reused) {
+  *reused = connectionReused = connectionOpen;
+  connectionOpen = true;
+  return &client;
+}
+
+void closeApiConnection() {
+  connectionOpen = false;
+}
+
+bool HTTPClient::begin(WiFiClient&, String url) {
+  memset(&pending, 0, sizeof(pending));
+  copyText(pending.url, sizeof(pending.url), url.c_str());
+  pending.reused = connectionReused;
+  return true;
+}
+
+void HTTPClient::setReuse(bool) {}
+
+void HTTPClient::setTimeout(uint16_t) {}
+
+void HTTPClient::addHeader(const String& name, const String& value, bool, bool) {
+  if (name == "Authorization") {
+    copyText(pending.authorization, sizeof(pending.authorization), value.c_str());
+  } else if (name == "Prefer") {
+    copyText(pending.prefer, sizeof(pending.prefer), value.c_str());
+  }
+}
+
+void HTTPClient::collectHeaders(const char*[], size_t) {}
+
+int HTTPClient::sendRequest(const char* type, uint8_t* payload, size_t size) {
+  copyText(pending.method, sizeof(pending.method), type);
+  size_t kept = size < sizeof(pending.payload) - 1 ? size : sizeof(pending.payload) - 1;
+  if (kept > 0) {
+    memcpy(pending.payload, payload, kept);
+  }
+  pending.payload[kept] = '\0';
+  history[requestCount++ % HISTORY_SIZE] = pending;
+  current = scriptHead < scriptTail ? script[scriptHead++ % SCRIPT_SIZE] : defaultResponse;
+  return current.status;
+}
+
+String HTTPClient::header(const char* name) {
+  return strcmp(name, "Retry-After") == 0 ? String(current.retryAfter) : String();
+}
+
+int HTTPClient::writeToStream(Stream* stream) {
+  return (int)stream->write((const uint8_t*)current.body, strlen(current.body));
+}
+
+String HTTPClient::getString() {
+  return String(current.body);
+}
+
+void HTTPClient::end() {}
+
+bool isAuthenticated() {
+  return authenticated;
+}
+
+const String& getAuthHeader() {
+  static String header("Bearer device-token");
+  return header;
+}
+
+void invalidateAuthToken() {
+  tokenInvalidations++;
+}
+
+const char* getUnackedCommandIds() {
+  return unackedIds;
+}
+
+bool canQueueCommandAcks() {
+  return ackRoom;
+}
+
+void httpFakeSetTelemetryDue(bool due) {
+  telemetryDue = due;
+}
+
+unsigned long httpFakeTelemetrySent() {
+  return telemetrySent;
+}
+
+bool isTelemetryDue() {
+  return telemetryDue;
+}
+
+void appendTelemetry(JsonObject metrics) {
+  metrics["uptime_ms"] = millis();
+  appendApiMetrics(metrics);
+  appendMemoryMetrics(metrics);
+}
+
+void markTelemetrySent() {
+  telemetrySent++;
+}
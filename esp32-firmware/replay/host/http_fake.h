@@ -0,0 +1,61 @@
+/*
+ * IriQ Smart Irrigation System - Host API Fake Header
+ *
+ * Header file for the server side of the host-built API modules: scripted
+ * HTTP responses, a record of the requests sent, the keep-alive connection,
+ * and stand-ins for the token (auth.cpp), the acknowledgement queue
+ * (outbound.cpp) and the telemetry schedule (telemetry.cpp). Nothing here
+ * allocates, so a test can count every heap allocation the firmware code
+ * makes.
+ */
+
+#ifndef HTTP_FAKE_H
+#define HTTP_FAKE_H
+
+#include <Arduino.h>
+
+// One request as HTTPClient saw it (truncated to the buffer sizes)
+struct FakeRequest {
+  char method[8];
+  char url[512];
+  char payload[8192];
+  char authorization[64];
+  char prefer[64];
+  bool reused;  // Sent on a kept-alive connection
+};
+
+// Forget the script, the requests, the connection and the fake state:
+// authenticated, no unacknowledged commands, room for acknowledgements,
+// telemetry not due
+void httpFakeReset();
+
+// Answer the next unanswered request. status may be a negative HTTPClient
+// error; body and retryAfter are not copied and must outlive the request.
+void httpFakeRespond(int status, const char* body = "", const char* retryAfter = "");
+
+// Answer for requests beyond the script (initially 201 with no body)
+void httpFakeSetDefault(int status, const char* body = "");
+
+// Requests sent since the reset
+unsigned long httpFakeRequestCount();
+
+// A recent request: 0 is the last one, up to 7 back
+const FakeRequest& httpFakeRequest(int back = 0);
+
+// Times invalidateAuthToken() was called
+unsigned long httpFakeTokenInvalidations();
+
+// What isAuthenticated() returns
+void httpFakeSetAuthenticated(bool authenticated);
+
+// What getUnackedCommandIds() and canQueueCommandAcks() return
+void httpFakeSetUnackedCommandIds(const char* ids, bool roomForMore = true);
+
+// What isTelemetryDue() returns. appendTelemetry() adds the metrics of the
+// modules built for the host (API client and memory pools).
+void httpFakeSetTelemetryDue(bool due);
+
+// Times markTelemetrySent() was called
+unsigned long httpFakeTelemetrySent();
+
+#endif // HTTP_FAKE_H
@@ -0,0 +1,146 @@
+/*
+ * IriQ Smart Irrigation System - Simulated Radio
+ *
+ * Host implementation of radio_link.h. Every send is copied once per
+ * receiver (all other radios for a broadcast) and each copy is lost,
+ * repeated or delayed on its own, drawing from one seeded generator so a
+ * run can be repeated exactly. A held-back frame waits a few extra latency
+ * periods, so frames sent after it arrive first. radioPoll() hands the
+ * selected radio the frames due by millis(), in arrival order.
+ */
+
+#include "sim_radio.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+const uint8_t radioBroadcastMac[RADIO_MAC_LENGTH] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+struct SimFrame {
+  int receiver;
+  uint8_t sender[RADIO_MAC_LENGTH];
+  std::vector<uint8_t> data;
+  unsigned long deliverAt;
+  unsigned long order;  // Send order, to keep equal arrival times stable
+};
+
+struct SimRadio {
+  uint8_t mac[RADIO_MAC_LENGTH];
+};
+
+static SimRadioConfig config;
+static std::mt19937 generator;
+static std::vector<SimRadio> radios;
+static std::vector<SimFrame> inFlight;
+static int selected = 0;
+static unsigned long sendOrder = 0;
+static SimRadioStats stats;
+
+static bool chance(double probability) {
+  return probability > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(generator) < probability;
+}
+
+static unsigned long transitTime() {
+  unsigned long delay = config.latency;
+  if (config.jitter > 0) {
+    delay += std::uniform_int_distribution<unsigned long>(0, config.jitter)(generator);
+  }
+  if (chance(config.reorder)) {
+    delay += (config.latency + config.jitter + 1) * std::uniform_int_distribution<unsigned long>(1, 4)(generator);
+    stats.reordered++;
+  }
+  return delay;
+}
+
+static void transmit(int receiver, const uint8_t* data, size_t length) {
+  if (chance(config.loss)) {
+    stats.lost++;
+    return;
+  }
+  int copies = chance(config.duplicate) ? 2 : 1;
+  if (copies == 2) {
+    stats.duplicated++;
+  }
+  for (int i = 0; i < copies; i++) {
+    SimFrame frame;
+    frame.receiver = receiver;
+    memcpy(frame.sender, radios[selected].mac, RADIO_MAC_LENGTH);
+    frame.data.assign(data, data + length);
+    frame.deliverAt = millis() + transitTime();
+    frame.order = sendOrder++;
+    inFlight.push_back(frame);
+  }
+}
+
+void simConfigureRadio(const SimRadioConfig& newConfig) {
+  config = newConfig;
+  generator.seed(config.seed);
+  inFlight.clear();
+  stats = SimRadioStats();
+}
+
+int simAddRadio(const uint8_t* mac) {
+  SimRadio radio;
+  memcpy(radio.mac, mac, RADIO_MAC_LENGTH);
+  radios.push_back(radio);
+  return radios.size() - 1;
+}
+
+void simSelectRadio(int radio) {
+  selected = radio;
+}
+
+void simClearRadio(int radio) {
+  unsigned long now = millis();
+  inFlight.erase(std::remove_if(inFlight.begin(), inFlight.end(),
+                                [&](const SimFrame& frame) { return frame.receiver == radio && frame.deliverAt <= now; }),
+                 inFlight.end());
+}
+
+SimRadioStats simRadioStats() {
+  return stats;
+}
+
+bool initRadioLink() {
+  return true;
+}
+
+bool radioSend(const uint8_t* mac, const uint8_t* data, size_t length) {
+  stats.sent++;
+  bool broadcast = memcmp(mac, radioBroadcastMac, RADIO_MAC_LENGTH) == 0;
+  for (size_t i = 0; i < radios.size(); i++) {
+    if ((int)i != selected && (broadcast || memcmp(mac, radios[i].mac, RADIO_MAC_LENGTH) == 0)) {
+      transmit(i, data, length);
+    }
+  }
+  // ESP-NOW reports a send as done once it is on the air, not when it arrives
+  return true;
+}
+
+void radioPoll(RadioReceiveCallback callback) {
+  // Take the due frames out first; the callback may send replies
+  unsigned long now = millis();
+  std::vector<SimFrame> due;
+  for (size_t i = 0; i < inFlight.size();) {
+    if (inFlight[i].receiver == selected && inFlight[i].deliverAt <= now) {
+      due.push_back(inFlight[i]);
+      inFlight[i] = inFlight.back();
+      inFlight.pop_back();
+    } else {
+      i++;
+    }
+  }
+  std::sort(due.begin(), due.end(), [](const SimFrame& a, const SimFrame& b) {
+    return a.deliverAt != b.deliverAt ? a.deliverAt < b.deliverAt : a.order < b.order;
+  });
+
+  for (const SimFrame& frame : due) {
+    stats.delivered++;
+    callback(frame.sender, frame.data.data(), frame.data.size());
+  }
+}
+
+void getRadioMac(uint8_t* mac) {
+  memcpy(mac, radios[selected].mac, RADIO_MAC_LENGTH);
+}
@@ -0,0 +1,46 @@
+/*
+ * IriQ Smart Irrigation System - Simulated Radio Header
+ *
+ * Header file for the host implementation of radio_link.h used by
+ * iriq-mesh-sim: any number of radios share one simulated channel on the
+ * virtual clock, which loses, repeats, delays and reorders frames.
+ */
+
+#ifndef SIM_RADIO_H
+#define SIM_RADIO_H
+
+#include "radio_link.h"
+
+struct SimRadioConfig {
+  double loss;            // Probability a frame is lost, per receiver
+  double duplicate;       // Probability a delivered frame arrives twice
+  double reorder;         // Probability a frame is held back behind later ones
+  unsigned long latency;  // Milliseconds from send to delivery
+  unsigned long jitter;   // Extra delay, uniform in [0, jitter]
+  unsigned seed;
+};
+
+struct SimRadioStats {
+  unsigned long sent;
+  unsigned long delivered;
+  unsigned long lost;
+  unsigned long duplicated;
+  unsigned long reordered;
+};
+
+// Set the channel model and clear everything in flight
+void simConfigureRadio(const SimRadioConfig& config);
+
+// Add a radio with the given address; returns its index
+int simAddRadio(const uint8_t* mac);
+
+// Make radioSend(), radioPoll() and getRadioMac() act for a radio
+void simSelectRadio(int radio);
+
+// Discard frames waiting for a radio, as a node's radio is off while it sleeps
+void simClearRadio(int radio);
+
+// Channel counters so far
+SimRadioStats simRadioStats();
+
+#endif // SIM_RADIO_H
@@ -0,0 +1,307 @@
+/*
+ * IriQ Smart Irrigation System - Sensor Node Mesh Simulation
+ *
+ * Runs the firmware's gateway.cpp, sensor_node.cpp and node_protocol.cpp
+ * on the host, with sim_radio.cpp in place of ESP-NOW. Nodes wake every
+ * --interval (each with its own phase and some drift), send one reading
+ * and go back to sleep once it is acknowledged or given up. The gateway
+ * polls the radio every GATEWAY_POLL_INTERVAL and uploads its batches like
+ * the outbound queue would: one request at a time, taking --upload-latency,
+ * failing with probability --upload-fail and retrying after
+ * OUTBOUND_RETRY_DELAY.
+ *
+ * After the run the uploads are checked against what the nodes sent:
+ * - no reading is uploaded twice
+ * - each node's readings are uploaded in sequence order, with the values sent
+ * - every reading a node saw acknowledged is uploaded, unless the gateway
+ *   counted it as dropped from a full batch
+ * Any violation is printed and the exit status is 1.
+ *
+ * Usage: iriq-mesh-sim [--nodes n] [--minutes m] [--interval ms]
+ *                      [--loss p] [--duplicate p] [--reorder p]
+ *                      [--latency ms] [--jitter ms] [--upload-fail p]
+ *                      [--upload-latency ms] [--seed n] [--json out.json]
+ *                      [--verbose]
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "gateway.h"
+#include "hal.h"
+#include "report.h"
+#include "sensor_node.h"
+#include "sim_radio.h"
+
+#define NODE_LOOP_INTERVAL 2  // delay() between nodeLoop() calls in runSensorNode()
+
+struct SimNode {
+  int radio;
+  SensorNode node;
+  unsigned long wakeAt;
+  bool awake;
+  int moisture;
+  std::map<uint32_t, int> sent;  // Sequence to moisture
+  std::set<uint32_t> acked;
+  std::set<uint32_t> uploaded;
+  uint32_t lastUploaded;
+};
+
+struct MeshOptions {
+  int nodes = 8;
+  unsigned long minutes = 240;
+  unsigned long interval = NODE_SLEEP_INTERVAL;
+  double uploadFail = 0;
+  unsigned long uploadLatency = 300;
+  SimRadioConfig radio = { 0.1, 0.02, 0.05, 3, 4, 1 };
+  std::string jsonPath;
+};
+
+static void usage() {
+  std::cerr << "usage: iriq-mesh-sim [--nodes n] [--minutes m] [--interval ms] [--loss p] [--duplicate p] "
+               "[--reorder p] [--latency ms] [--jitter ms] [--upload-fail p] [--upload-latency ms] [--seed n] "
+               "[--json out.json] [--verbose]\n";
+}
+
+static bool parseOptions(int argc, char** argv, MeshOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--nodes" && hasValue) {
+      options->nodes = std::atoi(argv[++i]);
+    } else if (arg == "--minutes" && hasValue) {
+      options->minutes = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--interval" && hasValue) {
+      options->interval = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--loss" && hasValue) {
+      options->radio.loss = std::atof(argv[++i]);
+    } else if (arg == "--duplicate" && hasValue) {
+      options->radio.duplicate = std::atof(argv[++i]);
+    } else if (arg == "--reorder" && hasValue) {
+      options->radio.reorder = std::atof(argv[++i]);
+    } else if (arg == "--latency" && hasValue) {
+      options->radio.latency = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--jitter" && hasValue) {
+      options->radio.jitter = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--upload-fail" && hasValue) {
+      options->uploadFail = std::atof(argv[++i]);
+    } else if (arg == "--upload-latency" && hasValue) {
+      options->uploadLatency = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--seed" && hasValue) {
+      options->radio.seed = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--json" && hasValue) {
+      options->jsonPath = argv[++i];
+    } else if (arg == "--verbose") {
+      replaySetVerbose(true);
+    } else {
+      return false;
+    }
+  }
+  return options->nodes > 0 && options->interval > 0;
+}
+
+struct Mesh {
+  std::vector<SimNode> nodes;
+  std::map<std::vector<uint8_t>, int> nodeByMac;
+  unsigned long rows;
+  unsigned long delayTotal;
+  unsigned long delayMax;
+  unsigned long violations;
+};
+
+static void violation(Mesh* mesh, const std::string& message) {
+  std::cerr << "violation: " << message << "\n";
+  mesh->violations++;
+}
+
+// Check an uploaded batch against what the nodes sent
+static void recordUpload(Mesh* mesh, const NodeBatch& batch) {
+  for (int i = 0; i < batch.count; i++) {
+    const NodeReading& reading = batch.readings[i];
+    auto found = mesh->nodeByMac.find(std::vector<uint8_t>(reading.mac, reading.mac + RADIO_MAC_LENGTH));
+    if (found == mesh->nodeByMac.end()) {
+      violation(mesh, "reading from an unknown node");
+      continue;
+    }
+    SimNode& sim = mesh->nodes[found->second];
+    std::string name = "node " + std::to_string(found->second) + " reading " + std::to_string(reading.sequence);
+    if (!sim.uploaded.insert(reading.sequence).second) {
+      violation(mesh, name + " uploaded twice");
+    } else if (sim.uploaded.size() > 1 && !sequenceAfter(reading.sequence, sim.lastUploaded)) {
+      violation(mesh, name + " uploaded after reading " + std::to_string(sim.lastUploaded));
+    }
+    auto sent = sim.sent.find(reading.sequence);
+    if (sent == sim.sent.end() || sent->second != reading.moisture) {
+      violation(mesh, name + " uploaded with a value the node did not send");
+    }
+    sim.lastUploaded = reading.sequence;
+
+    unsigned long delay = millis() - reading.receivedAt;
+    mesh->delayTotal += delay;
+    mesh->delayMax = std::max(mesh->delayMax, delay);
+    mesh->rows++;
+  }
+}
+
+int main(int argc, char** argv) {
+  MeshOptions options;
+  if (!parseOptions(argc, argv, &options)) {
+    usage();
+    return 2;
+  }
+
+  // Separate from the radio's generator, so channel settings do not change the readings
+  std::mt19937 generator(options.radio.seed + 1);
+  std::uniform_int_distribution<unsigned long> phase(0, options.interval - 1);
+  std::uniform_int_distribution<int> drift(-(int)(options.interval / 50), (int)(options.interval / 50));
+  std::uniform_int_distribution<int> step(-2, 2);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+  simConfigureRadio(options.radio);
+  uint8_t mac[RADIO_MAC_LENGTH] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x00 };
+  int gatewayRadio = simAddRadio(mac);
+  initGateway();
+
+  Mesh mesh = Mesh();
+  mesh.nodes.resize(options.nodes);
+  for (int i = 0; i < options.nodes; i++) {
+    SimNode& sim = mesh.nodes[i];
+    mac[4] = (i + 1) >> 8;
+    mac[5] = (i + 1) & 0xff;
+    sim.radio = simAddRadio(mac);
+    mesh.nodeByMac[std::vector<uint8_t>(mac, mac + RADIO_MAC_LENGTH)] = i;
+    initSensorNode(&sim.node, generator());
+    sim.wakeAt = phase(generator);
+    sim.awake = false;
+    sim.moisture = 30 + i % 40;
+    sim.lastUploaded = 0;
+  }
+
+  unsigned long runEnd = options.minutes * 60000UL;
+  // Time for the last readings to be acknowledged and uploaded
+  unsigned long drainEnd = runEnd + NODE_ACK_TIMEOUT * (NODE_SEND_ATTEMPTS + 1) + GATEWAY_UPLOAD_INTERVAL * 2 +
+                           (options.uploadLatency + OUTBOUND_RETRY_DELAY) * 4;
+
+  bool uploading = false;
+  unsigned long uploadDoneAt = 0, uploadRetryAt = 0;
+  unsigned long uploadAttempts = 0, uploadFailures = 0;
+  NodeBatch batch;
+
+  for (unsigned long now = 0; now <= drainEnd; now++) {
+    replayAdvanceTo(now);
+
+    for (SimNode& sim : mesh.nodes) {
+      if (!sim.awake && now < runEnd && now >= sim.wakeAt) {
+        // A node wakes with its radio off, so nothing sent while it slept is waiting
+        simClearRadio(sim.radio);
+        simSelectRadio(sim.radio);
+        sim.moisture = std::min(100, std::max(0, sim.moisture + step(generator)));
+        beginNodeReading(&sim.node, sim.moisture, 3700);
+        sim.sent[sim.node.sequence] = sim.moisture;
+        sim.awake = true;
+        sim.wakeAt += options.interval + drift(generator);
+      } else if (sim.awake && now % NODE_LOOP_INTERVAL == 0) {
+        simSelectRadio(sim.radio);
+        if (nodeLoop(&sim.node)) {
+          if (sim.node.state == NODE_ACKED) {
+            sim.acked.insert(sim.node.sequence);
+          }
+          sim.awake = false;
+        }
+      }
+    }
+
+    if (now % GATEWAY_POLL_INTERVAL == 0) {
+      simSelectRadio(gatewayRadio);
+      gatewayLoop();
+    }
+
+    if (uploading && now >= uploadDoneAt) {
+      uploading = false;
+      if (uniform(generator) < options.uploadFail) {
+        uploadFailures++;
+        uploadRetryAt = now + OUTBOUND_RETRY_DELAY;
+      } else {
+        recordUpload(&mesh, batch);
+        markGatewayBatchUploaded(batch);
+      }
+    }
+
+    // Past the end of the run nothing else is coming, so send what is left
+    bool due = gatewayBatchDue() || now >= runEnd;
+    if (!uploading && now >= uploadRetryAt && due && getGatewayBatch(&batch)) {
+      uploading = true;
+      uploadAttempts++;
+      uploadDoneAt = now + options.uploadLatency;
+    }
+  }
+
+  GatewayStats gateway = getGatewayStats();
+  unsigned long readings = 0, acked = 0, gaveUp = 0, retries = 0, ackedNotUploaded = 0;
+  for (const SimNode& sim : mesh.nodes) {
+    readings += sim.node.readings;
+    acked += sim.node.acked;
+    gaveUp += sim.node.gaveUp;
+    retries += sim.node.retries;
+    for (uint32_t sequence : sim.acked) {
+      if (sim.uploaded.count(sequence) == 0) {
+        ackedNotUploaded++;
+      }
+    }
+  }
+  if (mesh.rows != gateway.rows) {
+    violation(&mesh, std::to_string(mesh.rows) + " rows uploaded, gateway counted " + std::to_string(gateway.rows));
+  }
+  // Only readings dropped from a full batch may go missing after their acknowledgement
+  if (ackedNotUploaded > gateway.dropped) {
+    violation(&mesh, std::to_string(ackedNotUploaded) + " acknowledged readings never uploaded, " +
+                         std::to_string(gateway.dropped) + " dropped from full batches");
+  }
+
+  SimRadioStats radio = simRadioStats();
+  Report report;
+  report.emplace_back("nodes", options.nodes);
+  report.emplace_back("virtual_ms", millis());
+  report.emplace_back("node_readings", readings);
+  report.emplace_back("node_acked", acked);
+  report.emplace_back("node_gave_up", gaveUp);
+  report.emplace_back("node_retries", retries);
+  report.emplace_back("delivery_ratio", readings > 0 ? (double)mesh.rows / readings : 0.0);
+  report.emplace_back("radio_sent", radio.sent);
+  report.emplace_back("radio_delivered", radio.delivered);
+  report.emplace_back("radio_lost", radio.lost);
+  report.emplace_back("radio_duplicated", radio.duplicated);
+  report.emplace_back("radio_reordered", radio.reordered);
+  report.emplace_back("gateway_nodes", gateway.nodes);
+  report.emplace_back("gateway_rejected", gateway.framesRejected);
+  report.emplace_back("gateway_readings", gateway.readings);
+  report.emplace_back("gateway_duplicates", gateway.duplicates);
+  report.emplace_back("gateway_late", gateway.late);
+  report.emplace_back("gateway_lost", gateway.lost);
+  report.emplace_back("gateway_dropped", gateway.dropped);
+  report.emplace_back("gateway_refused", gateway.refused);
+  report.emplace_back("batches", gateway.batches);
+  report.emplace_back("rows", mesh.rows);
+  report.emplace_back("rows_per_batch", gateway.batches > 0 ? (double)mesh.rows / gateway.batches : 0.0);
+  report.emplace_back("upload_attempts", uploadAttempts);
+  report.emplace_back("upload_failures", uploadFailures);
+  report.emplace_back("upload_delay_avg_ms", mesh.rows > 0 ? (double)mesh.delayTotal / mesh.rows : 0.0);
+  report.emplace_back("upload_delay_max_ms", mesh.delayMax);
+  report.emplace_back("acked_not_uploaded", ackedNotUploaded);
+  report.emplace_back("violations", mesh.violations);
+  printReport(report);
+
+  if (!options.jsonPath.empty()) {
+    std::ofstream out(options.jsonPath);
+    writeReportJson(out, report);
+  }
+  return mesh.violations > 0 ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * IriQ Smart Irrigation System - Trace Replay
+ *
+ * Runs a trace recorded on the device (console command "R") through the
+ * firmware's sensors.cpp on the host: the recorded ADC samples feed
+ * readMoistureSensor(), readings drive handleAutomaticMode() and commands
+ * go through applyControl(), all on a virtual clock. Device status uploads
+ * are queued on the device, so they cost the control path no time here and
+ * take the outcome last recorded for that endpoint. metering.cpp
+ * runs as well, fed by a simulated flow sensor (--flow pulses per second
+ * while the relay is on).
+ *
+ * The report covers what changes when the control code or config.h
+ * changes: readings that no longer match the recording, pump toggles and
+ * on-time, command latency and commands left unapplied. With --baseline it
+ * fails when any of those got worse, so it can gate a change in CI.
+ *
+ * Usage: iriq-replay [--json out.json] [--baseline base.json]
+ *                    [--tolerance percent] [--flow pulses/s] [--verbose] trace.txt
+ */
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "hal.h"
+#include "metering.h"
+#include "report.h"
+#include "sensors.h"
+#include "trace.h"
+
+struct TraceEvent {
+  char type;
+  unsigned long time;
+  long a;
+  long b;
+  long c;
+};
+
+// Metrics where a larger value is a regression
+static const char* const guardedMetrics[] = {
+  "reading_mismatches", "pump_toggles", "commands_not_applied",
+  "command_latency_avg_ms", "command_latency_max_ms", "status_failures",
+};
+
+static void usage() {
+  std::cerr << "usage: iriq-replay [--json out.json] [--baseline base.json] [--tolerance percent] "
+               "[--flow pulses/s] [--verbose] trace.txt\n";
+}
+
+// Keep only event lines; the dump may carry log output and marker lines
+static bool parseEvent(const std::string& line, TraceEvent* event) {
+  if (line.size() < 3 || line[1] != ' ' || std::string("HARCPMNU").find(line[0]) == std::string::npos) {
+    return false;
+  }
+  std::istringstream fields(line.substr(2));
+  event->type = line[0];
+  event->a = event->b = event->c = 0;
+  if (!(fields >> event->time)) {
+    return false;
+  }
+  fields >> event->a >> event->b >> event->c;
+  return true;
+}
+
+static bool loadTrace(const std::string& path, std::vector<TraceEvent>* events) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  TraceEvent event;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (parseEvent(line, &event)) {
+      events->push_back(event);
+    }
+  }
+  return true;
+}
+
+static Report replay(const std::vector<TraceEvent>& events) {
+  unsigned long bootOffset = 0;  // Virtual time at which the current boot started
+  bool booted = false;
+  unsigned long boots = 0;
+  unsigned long readings = 0, readingMismatches = 0;
+  unsigned long commands = 0, commandsNotApplied = 0;
+  unsigned long latencyTotal = 0, latencyMax = 0;
+  unsigned long sensorUploads = 0, sensorFailures = 0;
+  unsigned long requests = 0, requestFailures = 0;
+  unsigned long recordedToggles = 0;
+  long recordedPump = 0;
+  bool pendingReading = false;
+  unsigned long readingStart = 0;
+
+  auto startedAt = std::chrono::steady_clock::now();
+  initMetering();
+
+  for (const TraceEvent& event : events) {
+    unsigned long at = bootOffset + event.time;
+
+    switch (event.type) {
+    case 'H':
+      // Each boot restarts millis() on the device
+      if (booted) {
+        bootOffset = millis();
+        at = bootOffset + event.time;
+      }
+      booted = true;
+      boots++;
+      if (event.b != MOISTURE_THRESHOLD) {
+        std::cerr << "note: trace recorded with MOISTURE_THRESHOLD " << event.b << ", replaying with "
+                  << MOISTURE_THRESHOLD << "\n";
+      }
+      replayAdvanceTo(at);
+      break;
+    case 'A':
+      if (!pendingReading) {
+        pendingReading = true;
+        readingStart = at;
+      }
+      replayQueueAdc((int)event.a);
+      break;
+    case 'R':
+      // The reading started with its first sample
+      replayAdvanceTo(pendingReading ? readingStart : at);
+      moistureLevel = readMoistureSensor();
+      replayClearAdc();
+      pendingReading = false;
+      readings++;
+      if (moistureLevel != event.a) {
+        readingMismatches++;
+      }
+      if (automaticMode) {
+        handleAutomaticMode();
+      }
+      break;
+    case 'C': {
+      replayAdvanceTo(at);
+      unsigned long start = millis();
+      applyControl(event.a != 0, event.b != 0);
+      unsigned long latency = millis() - start;
+      commands++;
+      latencyTotal += latency;
+      if (latency > latencyMax) {
+        latencyMax = latency;
+      }
+      if (!automaticMode && pumpStatus != (event.a != 0)) {
+        commandsNotApplied++;
+      }
+      break;
+    }
+    case 'P':
+      if (event.a != recordedPump) {
+        recordedToggles++;
+        recordedPump = event.a;
+      }
+      break;
+    case 'N':
+      replaySetNetwork(event.a, event.b, (unsigned long)event.c);
+      requests++;
+      if (event.b < 200 || event.b >= 300) {
+        requestFailures++;
+      }
+      break;
+    case 'U':
+      sensorUploads++;
+      if (event.a == 0) {
+        sensorFailures++;
+      }
+      break;
+    default:
+      // 'M' is the outcome of a command or reading replayed above
+      break;
+    }
+  }
+
+  double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startedAt).count();
+  PumpStats pump = replayPumpStats();
+  UsageTotals usage = getUsageTotals();
+
+  Report report;
+  report.emplace_back("events", events.size());
+  report.emplace_back("boots", boots);
+  report.emplace_back("readings", readings);
+  report.emplace_back("reading_mismatches", readingMismatches);
+  report.emplace_back("pump_toggles", pump.toggles);
+  report.emplace_back("recorded_pump_toggles", recordedToggles);
+  report.emplace_back("pump_on_ms", pump.onMs);
+  report.emplace_back("min_toggle_interval_ms", pump.minToggleIntervalMs);
+  report.emplace_back("metered_runtime_ms", usage.runtimeMs);
+  report.emplace_back("metered_volume_ml", usage.volumeMl);
+  report.emplace_back("metered_events", usage.events);
+  report.emplace_back("commands", commands);
+  report.emplace_back("commands_not_applied", commandsNotApplied);
+  report.emplace_back("command_latency_avg_ms", commands > 0 ? (double)latencyTotal / commands : 0.0);
+  report.emplace_back("command_latency_max_ms", latencyMax);
+  report.emplace_back("status_uploads", pump.statusUploads);
+  report.emplace_back("status_failures", pump.statusFailures);
+  report.emplace_back("recorded_requests", requests);
+  report.emplace_back("recorded_request_failures", requestFailures);
+  report.emplace_back("sensor_uploads", sensorUploads);
+  report.emplace_back("sensor_upload_failures", sensorFailures);
+  report.emplace_back("virtual_ms", millis());
+  report.emplace_back("wall_ms", wallMs);
+  report.emplace_back("speedup", wallMs > 0 ? millis() / wallMs : 0.0);
+  return report;
+}
+
+int main(int argc, char** argv) {
+  std::string tracePath, jsonPath, baselinePath;
+  double tolerance = 5.0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--json" && i + 1 < argc) {
+      jsonPath = argv[++i];
+    } else if (arg == "--baseline" && i + 1 < argc) {
+      baselinePath = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = std::atof(argv[++i]);
+    } else if (arg == "--flow" && i + 1 < argc) {
+      replaySetFlowRate(std::atof(argv[++i]));
+    } else if (arg == "--verbose") {
+      replaySetVerbose(true);
+    } else if (tracePath.empty() && arg[0] != '-') {
+      tracePath = arg;
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (tracePath.empty()) {
+    usage();
+    return 2;
+  }
+
+  std::vector<TraceEvent> events;
+  if (!loadTrace(tracePath, &events)) {
+    std::cerr << "cannot read " << tracePath << "\n";
+    return 2;
+  }
+  if (events.empty() || events.front().type != TRACE_HEADER) {
+    std::cerr << "warning: trace does not start with a header event, it may be truncated\n";
+  }
+
+  Report report = replay(events);
+  printReport(report);
+
+  if (!jsonPath.empty()) {
+    std::ofstream out(jsonPath);
+    writeReportJson(out, report);
+  }
+
+  if (!baselinePath.empty()) {
+    std::map<std::string, double> baseline;
+    if (!loadReport(baselinePath, &baseline)) {
+      std::cerr << "cannot read " << baselinePath << "\n";
+      return 2;
+    }
+    std::map<std::string, double> tolerances;
+    for (const char* name : guardedMetrics) {
+      tolerances[name] = tolerance;
+    }
+    if (countRegressions(report, baseline, tolerances) > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * IriQ Smart Irrigation System - Host Report
+ *
+ * Formatting and baseline comparison for the host tools' metric reports.
+ */
+
+#include "report.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+void printReport(const Report& report) {
+  for (const auto& metric : report) {
+    std::printf("%-34s %.1f\n", metric.first.c_str(), metric.second);
+  }
+}
+
+void writeReportJson(std::ostream& out, const Report& report) {
+  out.precision(15);
+  out << "{\n";
+  for (size_t i = 0; i < report.size(); i++) {
+    out << "  \"" << report[i].first << "\": " << report[i].second << (i + 1 < report.size() ? ",\n" : "\n");
+  }
+  out << "}\n";
+}
+
+bool loadReport(const std::string& path, std::map<std::string, double>* values) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    size_t open = line.find('"');
+    size_t close = line.find('"', open + 1);
+    size_t colon = line.find(':', close);
+    if (open == std::string::npos || close == std::string::npos || colon == std::string::npos) {
+      continue;
+    }
+    (*values)[line.substr(open + 1, close - open - 1)] = std::atof(line.c_str() + colon + 1);
+  }
+  return true;
+}
+
+int countRegressions(const Report& report, const std::map<std::string, double>& baseline,
+                     const std::map<std::string, double>& tolerances) {
+  int regressions = 0;
+  for (const auto& metric : report) {
+    auto tolerance = tolerances.find(metric.first);
+    auto previous = baseline.find(metric.first);
+    if (tolerance == tolerances.end() || previous == baseline.end()) {
+      continue;
+    }
+    double limit = previous->second * (1.0 + tolerance->second / 100.0);
+    if (metric.second > limit + 1e-9) {
+      std::cerr << "regression: " << metric.first << " " << previous->second << " -> " << metric.second << "\n";
+      regressions++;
+    }
+  }
+  return regressions;
+}
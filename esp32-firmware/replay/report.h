@@ -0,0 +1,34 @@
+/*
+ * IriQ Smart Irrigation System - Host Report Header
+ *
+ * Header file for the metric reports shared by iriq-replay and iriq-bench:
+ * an ordered list of named values, written as a flat JSON object and read
+ * back as a baseline to compare against.
+ */
+
+#ifndef REPLAY_REPORT_H
+#define REPLAY_REPORT_H
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::vector<std::pair<std::string, double>> Report;
+
+// Print one "name value" line per metric
+void printReport(const Report& report);
+
+// Write the report as {"name": value, ...}
+void writeReportJson(std::ostream& out, const Report& report);
+
+// Read a file written by writeReportJson(); false if it cannot be opened
+bool loadReport(const std::string& path, std::map<std::string, double>* values);
+
+// Count metrics that rose above their baseline by more than the tolerance
+// (percent) given for them; metrics without a tolerance are not compared
+int countRegressions(const Report& report, const std::map<std::string, double>& baseline,
+                     const std::map<std::string, double>& tolerances);
+
+#endif // REPLAY_REPORT_H
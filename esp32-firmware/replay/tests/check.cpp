@@ -0,0 +1,52 @@
+/*
+ * IriQ Smart Irrigation System - Host Test Runner
+ *
+ * Runs the cases of one host test program; see check.h. Each case runs in
+ * a forked child, which starts from the state the firmware's statics have
+ * before any case ran.
+ */
+
+#include "check.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+int checkFailures = 0;
+
+// Run one case in a child process; true if it passed
+static bool runIsolated(const TestCase& test) {
+  fflush(stdout);
+  fflush(stderr);
+  pid_t child = fork();
+  if (child == 0) {
+    test.run();
+    fflush(stdout);
+    fflush(stderr);
+    _exit(checkFailures > 0 ? 1 : 0);
+  }
+  int status = 0;
+  if (child < 0 || waitpid(child, &status, 0) != child) {
+    fprintf(stderr, "cannot run %s\n", test.name);
+    return false;
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int runTests(const TestCase* cases, size_t count, int argc, char** argv) {
+  int failed = 0;
+  bool found = false;
+  for (size_t i = 0; i < count; i++) {
+    if (argc > 1 && strcmp(argv[1], cases[i].name) != 0) {
+      continue;
+    }
+    found = true;
+    bool passed = runIsolated(cases[i]);
+    printf("%-32s %s\n", cases[i].name, passed ? "ok" : "FAILED");
+    failed += passed ? 0 : 1;
+  }
+  if (!found) {
+    fprintf(stderr, "no test case %s\n", argv[1]);
+    return 2;
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * IriQ Smart Irrigation System - Host Test Checks
+ *
+ * Minimal checks for the host tests. Unlike assert() they also run in the
+ * default Release build, report the values compared, and let a case go on
+ * after a failure. A test program runs every case, or the one named on
+ * its command line, each in its own process so the firmware's static state
+ * (breakers, retry budget, arena) starts clean.
+ */
+
+#ifndef REPLAY_CHECK_H
+#define REPLAY_CHECK_H
+
+#include <cstdio>
+#include <cstring>
+
+extern int checkFailures;
+
+#define CHECK(condition)                                                            \
+  do {                                                                              \
+    if (!(condition)) {                                                             \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      checkFailures++;                                                              \
+    }                                                                               \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                        \
+  do {                                                                                    \
+    long long actualValue = (long long)(actual);                                          \
+    long long expectedValue = (long long)(expected);                                      \
+    if (actualValue != expectedValue) {                                                   \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, \
+              actualValue, expectedValue);                                                \
+      checkFailures++;                                                                    \
+    }                                                                                     \
+  } while (0)
+
+#define CHECK_STR(actual, expected)                                                                  \
+  do {                                                                                               \
+    const char* actualText = (actual);                                                               \
+    const char* expectedText = (expected);                                                           \
+    if (strcmp(actualText, expectedText) != 0) {                                                     \
+      fprintf(stderr, "%s:%d: %s is\n  \"%s\"\nexpected\n  \"%s\"\n", __FILE__, __LINE__, #actual, \
+              actualText, expectedText);                                                             \
+      checkFailures++;                                                                               \
+    }                                                                                                \
+  } while (0)
+
+struct TestCase {
+  const char* name;
+  void (*run)();
+};
+
+// Run every case, or the one named by argv[1]; returns 0 if all passed
+int runTests(const TestCase* cases, size_t count, int argc, char** argv);
+
+#define RUN_TESTS(cases, argc, argv) runTests(cases, sizeof(cases) / sizeof(cases[0]), argc, argv)
+
+#endif // REPLAY_CHECK_H
@@ -0,0 +1,295 @@
+/*
+ * IriQ Smart Irrigation System - API Client Tests
+ *
+ * Drives api_client.cpp against the scripted server in host/http_fake.cpp
+ * on the virtual clock: transient retries (never of a POST or PATCH that
+ * may have been applied), the circuit breaker's threshold, exponential
+ * backoff and Retry-After, the shared retry budget, resending after a stale
+ * keep-alive connection, and rejected tokens.
+ */
+
+#include "api_client.h"
+#include "check.h"
+#include "config.h"
+#include "hal.h"
+#include "http_fake.h"
+#include <HTTPClient.h>
+
+static void advance(unsigned long ms) {
+  replayAdvanceTo(millis() + ms);
+}
+
+static ApiResponse post(ApiEndpoint endpoint, uint8_t options = API_RETURN_MINIMAL) {
+  return apiRequest(endpoint, "POST", "sensor_readings", "{}", options);
+}
+
+// A counter from appendApiMetrics()
+static long metric(const char* endpoint, const char* name) {
+  DynamicJsonDocument doc(4096);
+  appendApiMetrics(doc.to<JsonObject>());
+  return endpoint != nullptr ? doc["api"][endpoint][name].as<long>() : doc["api"][name].as<long>();
+}
+
+static String breakerState(const char* endpoint) {
+  DynamicJsonDocument doc(4096);
+  appendApiMetrics(doc.to<JsonObject>());
+  return doc["api"][endpoint]["state"].as<String>();
+}
+
+static void testRequestHeaders() {
+  httpFakeReset();
+  CHECK(post(ENDPOINT_SENSOR_READINGS).ok());
+  CHECK_STR(httpFakeRequest().method, "POST");
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/sensor_readings");
+  CHECK_STR(httpFakeRequest().authorization, "Bearer device-token");
+  CHECK_STR(httpFakeRequest().prefer, "return=minimal");
+
+  apiRequest(ENDPOINT_HEARTBEATS, "POST", "device_presence?on_conflict=device_id", "{}",
+             API_UPSERT | API_RETURN_MINIMAL);
+  CHECK_STR(httpFakeRequest().prefer, "resolution=merge-duplicates,return=minimal");
+
+  apiRequest(ENDPOINT_AUTH, "POST", "device-auth", "{}", API_FUNCTION | API_READ_BODY);
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/functions/v1/device-auth");
+  CHECK_STR(httpFakeRequest().authorization, "Bearer anon-key");
+  CHECK_STR(httpFakeRequest().prefer, "");
+}
+
+static void testReadBody() {
+  httpFakeReset();
+  httpFakeRespond(200, "[{\"id\":\"a\"}]");
+  ApiResponse response = apiRequest(ENDPOINT_CONTROL_COMMANDS, "GET", "control_commands", "", API_READ_BODY);
+  CHECK(response.ok());
+  CHECK_STR(response.body.c_str(), "[{\"id\":\"a\"}]");
+  CHECK_EQ(response.body.length(), 12);
+}
+
+static void testTransientRetry() {
+  httpFakeReset();
+  httpFakeRespond(503);
+  httpFakeRespond(201);
+  ApiResponse response = post(ENDPOINT_SENSOR_READINGS);
+  CHECK(response.ok());
+  CHECK_EQ(httpFakeRequestCount(), 2);
+  CHECK_EQ(metric("sensor_readings", "retries"), 1);
+  CHECK_EQ(metric(nullptr, "retry_budget"), API_RETRY_BUDGET_MAX - 1);
+
+  CHECK(!takeRequestRejected());
+
+  // A client error is not retried and does not count towards the breaker;
+  // the outbound queue drops the message instead of sending it again
+  httpFakeRespond(422);
+  CHECK_EQ(post(ENDPOINT_SENSOR_READINGS).statusCode, 422);
+  CHECK_EQ(httpFakeRequestCount(), 3);
+  CHECK_STR(breakerState("sensor_readings").c_str(), "closed");
+  CHECK(takeRequestRejected());
+  CHECK(!takeRequestRejected());
+}
+
+static void testPostTimeoutNotResent() {
+  httpFakeReset();
+  // The request was written before the timeout, so the row may already exist
+  httpFakeRespond(HTTPC_ERROR_READ_TIMEOUT);
+  httpFakeRespond(201);
+  CHECK_EQ(post(ENDPOINT_SENSOR_READINGS).statusCode, HTTPC_ERROR_READ_TIMEOUT);
+  CHECK_EQ(httpFakeRequestCount(), 1);
+  CHECK_EQ(metric("sensor_readings", "retries"), 0);
+  CHECK_EQ(metric("sensor_readings", "failures"), 1);
+
+  // Not on a kept-alive connection either
+  CHECK(post(ENDPOINT_SENSOR_READINGS).ok());
+  httpFakeRespond(HTTPC_ERROR_READ_TIMEOUT);
+  CHECK_EQ(post(ENDPOINT_SENSOR_READINGS).statusCode, HTTPC_ERROR_READ_TIMEOUT);
+  CHECK(httpFakeRequest().reused);
+  CHECK_EQ(httpFakeRequestCount(), 3);
+  CHECK_EQ(metric("sensor_readings", "retries"), 0);
+}
+
+static void testNonIdempotentNotRepeated() {
+  httpFakeReset();
+  httpFakeSetDefault(201);
+
+  // Lost after the write: neither a POST nor a PATCH goes out twice
+  httpFakeRespond(HTTPC_ERROR_CONNECTION_LOST);
+  CHECK_EQ(post(ENDPOINT_SENSOR_READINGS).statusCode, HTTPC_ERROR_CONNECTION_LOST);
+  CHECK_EQ(httpFakeRequestCount(), 1);
+  httpFakeRespond(HTTPC_ERROR_READ_TIMEOUT);
+  CHECK_EQ(apiRequest(ENDPOINT_CONTROL_COMMANDS, "PATCH", "control_commands?id=in.(c1)", "{}").statusCode,
+           HTTPC_ERROR_READ_TIMEOUT);
+  CHECK_EQ(httpFakeRequestCount(), 2);
+  CHECK_EQ(metric("control_commands", "retries"), 0);
+
+  // Never written: the POST is retried
+  httpFakeRespond(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+  CHECK(post(ENDPOINT_SENSOR_READINGS).ok());
+  CHECK_EQ(httpFakeRequestCount(), 4);
+
+  // A GET is retried after a timeout
+  httpFakeRespond(HTTPC_ERROR_READ_TIMEOUT);
+  CHECK(apiRequest(ENDPOINT_CONTROL_COMMANDS, "GET", "control_commands", "").ok());
+  CHECK_EQ(httpFakeRequestCount(), 6);
+  CHECK_EQ(metric("control_commands", "retries"), 1);
+}
+
+static void testBreakerThreshold() {
+  httpFakeReset();
+  httpFakeSetDefault(503);
+  for (int i = 0; i < API_BREAKER_THRESHOLD; i++) {
+    CHECK(!isEndpointOpen(ENDPOINT_DEVICE_STATUS));
+    CHECK_EQ(post(ENDPOINT_DEVICE_STATUS).statusCode, 503);
+  }
+  CHECK(isEndpointOpen(ENDPOINT_DEVICE_STATUS));
+  CHECK_EQ(httpFakeRequestCount(), API_BREAKER_THRESHOLD * 2);
+
+  // Open: skipped without a request, other endpoints unaffected
+  ApiResponse skipped = post(ENDPOINT_DEVICE_STATUS);
+  CHECK(!skipped.sent);
+  CHECK_EQ(skipped.statusCode, 0);
+  CHECK_EQ(httpFakeRequestCount(), API_BREAKER_THRESHOLD * 2);
+  CHECK_EQ(metric("device_status", "skipped"), 1);
+  CHECK(isEndpointAvailable(ENDPOINT_SENSOR_READINGS));
+
+  // The probe after the backoff closes the breaker again
+  advance(API_BACKOFF_MIN);
+  httpFakeSetDefault(201);
+  CHECK(post(ENDPOINT_DEVICE_STATUS).ok());
+  CHECK_STR(breakerState("device_status").c_str(), "closed");
+}
+
+static void testExponentialBackoff() {
+  httpFakeReset();
+  httpFakeSetDefault(503);
+  for (int i = 0; i < API_BREAKER_THRESHOLD; i++) {
+    post(ENDPOINT_PUMP_USAGE);
+  }
+
+  for (int opening = 0; opening < 12; opening++) {
+    unsigned long ceiling = (unsigned long)API_BACKOFF_MIN << (opening < 8 ? opening : 8);
+    if (ceiling > API_BACKOFF_MAX) {
+      ceiling = API_BACKOFF_MAX;
+    }
+    // Jittered within [ceiling/2, ceiling]
+    unsigned long openedAt = millis();
+    CHECK(isEndpointOpen(ENDPOINT_PUMP_USAGE));
+    replayAdvanceTo(openedAt + ceiling / 2 - 1);
+    CHECK(isEndpointOpen(ENDPOINT_PUMP_USAGE));
+    replayAdvanceTo(openedAt + ceiling);
+    CHECK(!isEndpointOpen(ENDPOINT_PUMP_USAGE));
+
+    // A failed half-open probe is not retried and reopens with twice the ceiling
+    unsigned long requestsBefore = httpFakeRequestCount();
+    CHECK(post(ENDPOINT_PUMP_USAGE).sent);
+    CHECK_EQ(httpFakeRequestCount(), requestsBefore + 1);
+  }
+  CHECK_EQ(metric("pump_usage", "retries"), API_BREAKER_THRESHOLD);
+}
+
+static void testRetryAfter() {
+  httpFakeReset();
+  httpFakeRespond(429, "", "30");
+  CHECK_EQ(post(ENDPOINT_DEVICE_SETTINGS).statusCode, 429);
+  // Not retried against the server's request, and the breaker opens at once
+  CHECK_EQ(httpFakeRequestCount(), 1);
+  unsigned long openedAt = millis();
+  replayAdvanceTo(openedAt + 29999);
+  CHECK(isEndpointOpen(ENDPOINT_DEVICE_SETTINGS));
+  replayAdvanceTo(openedAt + 30000);
+  CHECK(!isEndpointOpen(ENDPOINT_DEVICE_SETTINGS));
+
+  // Capped at API_BACKOFF_MAX
+  httpFakeRespond(503, "", "86400");
+  CHECK(post(ENDPOINT_DEVICE_SETTINGS).sent);
+  openedAt = millis();
+  replayAdvanceTo(openedAt + API_BACKOFF_MAX - 1);
+  CHECK(isEndpointOpen(ENDPOINT_DEVICE_SETTINGS));
+  replayAdvanceTo(openedAt + API_BACKOFF_MAX);
+  CHECK(!isEndpointOpen(ENDPOINT_DEVICE_SETTINGS));
+}
+
+static void testRetryBudget() {
+  httpFakeReset();
+  httpFakeSetDefault(503);
+  // Every endpoint fails until its breaker opens; only the budget's worth is retried
+  ApiEndpoint failing[] = { ENDPOINT_SENSOR_READINGS, ENDPOINT_DEVICE_STATUS, ENDPOINT_CONTROL_COMMANDS,
+                            ENDPOINT_HEARTBEATS };
+  for (ApiEndpoint endpoint : failing) {
+    for (int i = 0; i < API_BREAKER_THRESHOLD; i++) {
+      post(endpoint);
+    }
+  }
+  int calls = 4 * API_BREAKER_THRESHOLD;
+  CHECK_EQ(httpFakeRequestCount(), calls + API_RETRY_BUDGET_MAX);
+  CHECK_EQ(metric(nullptr, "retry_budget"), 0);
+
+  // Exhausted: a failure is not retried
+  post(ENDPOINT_PUMP_USAGE);
+  CHECK_EQ(httpFakeRequestCount(), calls + API_RETRY_BUDGET_MAX + 1);
+
+  // Each success refills API_RETRY_BUDGET_REFILL tenths of a retry
+  httpFakeSetDefault(201);
+  for (int i = 0; i < 10 / API_RETRY_BUDGET_REFILL; i++) {
+    CHECK(post(ENDPOINT_DEVICE_SETTINGS).ok());
+  }
+  CHECK_EQ(metric(nullptr, "retry_budget"), 1);
+  httpFakeRespond(503);
+  CHECK(post(ENDPOINT_DEVICE_SCHEDULES).ok());
+  CHECK_EQ(metric("device_schedules", "retries"), 1);
+  CHECK_EQ(metric(nullptr, "retry_budget"), 0);
+}
+
+static void testStaleConnectionResend() {
+  httpFakeReset();
+  CHECK(post(ENDPOINT_SENSOR_READINGS).ok());
+
+  // The request never got out on the kept-alive connection: sent again on a new one
+  httpFakeRespond(HTTPC_ERROR_SEND_HEADER_FAILED);
+  CHECK(post(ENDPOINT_SENSOR_READINGS).ok());
+  CHECK_EQ(httpFakeRequestCount(), 3);
+  CHECK(httpFakeRequest(1).reused);
+  CHECK(!httpFakeRequest(0).reused);
+  CHECK_EQ(metric("sensor_readings", "retries"), 1);
+  CHECK_EQ(metric("sensor_readings", "failures"), 0);
+
+  // The resend is the request's one retry: a second failure is not retried again
+  httpFakeRespond(HTTPC_ERROR_SEND_HEADER_FAILED);
+  httpFakeRespond(HTTPC_ERROR_CONNECTION_LOST);
+  CHECK_EQ(post(ENDPOINT_SENSOR_READINGS).statusCode, HTTPC_ERROR_CONNECTION_LOST);
+  CHECK_EQ(httpFakeRequestCount(), 5);
+  CHECK_EQ(metric("sensor_readings", "failures"), 1);
+}
+
+static void testRejectedToken() {
+  httpFakeReset();
+  httpFakeSetDefault(401);
+  CHECK_EQ(post(ENDPOINT_DEVICE_STATUS).statusCode, 401);
+  // Not retried; the token is dropped and the breaker paces re-authentication
+  CHECK_EQ(httpFakeRequestCount(), 1);
+  CHECK_EQ(httpFakeTokenInvalidations(), 1);
+  for (int i = 1; i < API_BREAKER_THRESHOLD; i++) {
+    post(ENDPOINT_DEVICE_STATUS);
+  }
+  CHECK(isEndpointOpen(ENDPOINT_DEVICE_STATUS));
+
+  // An edge function's 401 is not about the device token
+  post(ENDPOINT_AUTH, API_FUNCTION);
+  CHECK_EQ(httpFakeTokenInvalidations(), API_BREAKER_THRESHOLD);
+  CHECK(!isEndpointOpen(ENDPOINT_AUTH));
+}
+
+static const TestCase testCases[] = {
+  { "request_headers", testRequestHeaders },
+  { "read_body", testReadBody },
+  { "transient_retry", testTransientRetry },
+  { "post_timeout_not_resent", testPostTimeoutNotResent },
+  { "non_idempotent_not_repeated", testNonIdempotentNotRepeated },
+  { "breaker_threshold", testBreakerThreshold },
+  { "exponential_backoff", testExponentialBackoff },
+  { "retry_after", testRetryAfter },
+  { "retry_budget", testRetryBudget },
+  { "stale_connection_resend", testStaleConnectionResend },
+  { "rejected_token", testRejectedToken },
+};
+
+int main(int argc, char** argv) {
+  initMemoryPools();
+  return RUN_TESTS(testCases, argc, argv);
+}
@@ -0,0 +1,214 @@
+/*
+ * IriQ Smart Irrigation System - Request Path Soak Test
+ *
+ * Runs thousands of the loop's upload cycles (reading, device status,
+ * command poll and acknowledgement, usage, a full node batch, heartbeat
+ * with metrics) against the scripted server in host/http_fake.cpp, on the
+ * virtual clock. Every heap block is tracked by the operator new below:
+ * after warm-up a cycle must leave the live heap exactly as it found it,
+ * free only blocks it allocated itself (so nothing long-lived is swapped
+ * for a new block, which is how a heap fragments), and keep its transient
+ * blocks small. Payloads and documents must fit the arena and the
+ * response pool, without a heap fallback.
+ */
+
+#include "check.h"
+#include "config.h"
+#include "hal.h"
+#include "http_fake.h"
+#include "memory_pool.h"
+#include "supabase_api.h"
+
+#include <cstdlib>
+#include <new>
+
+#define SOAK_CYCLES 5000
+#define SOAK_WARMUP_CYCLES 3
+#define SOAK_CYCLE_MS 60000UL
+#define SOAK_MAX_TRANSIENT_BYTES 1024  // Heap held at once by one cycle
+
+// Each block carries its size and the cycle that allocated it
+struct BlockHeader {
+  size_t size;
+  unsigned long cycle;
+};
+
+static const size_t headerSize = (sizeof(BlockHeader) + 15) & ~(size_t)15;
+
+static size_t liveBytes = 0;
+static size_t liveBlocks = 0;
+static size_t peakLiveBytes = 0;
+static unsigned long allocations = 0;
+static unsigned long olderBlocksFreed = 0;  // Freed by a later cycle than allocated them
+static unsigned long currentCycle = 0;
+
+void* operator new(size_t size) {
+  uint8_t* block = (uint8_t*)std::malloc(headerSize + size);
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  BlockHeader* header = (BlockHeader*)block;
+  header->size = size;
+  header->cycle = currentCycle;
+  liveBytes += size;
+  liveBlocks++;
+  allocations++;
+  if (liveBytes > peakLiveBytes) {
+    peakLiveBytes = liveBytes;
+  }
+  return block + headerSize;
+}
+
+void operator delete(void* pointer) noexcept {
+  if (pointer == nullptr) {
+    return;
+  }
+  BlockHeader* header = (BlockHeader*)((uint8_t*)pointer - headerSize);
+  liveBytes -= header->size;
+  liveBlocks--;
+  if (header->cycle != currentCycle) {
+    olderBlocksFreed++;
+  }
+  std::free(header);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+static void advance(unsigned long ms) {
+  replayAdvanceTo(millis() + ms);
+}
+
+// A full batch from GATEWAY_BATCH_SIZE nodes, different every cycle
+static void fillNodeBatch(NodeBatch& batch, unsigned long cycle) {
+  batch.count = GATEWAY_BATCH_SIZE;
+  for (int i = 0; i < GATEWAY_BATCH_SIZE; i++) {
+    NodeReading& reading = batch.readings[i];
+    const uint8_t mac[RADIO_MAC_LENGTH] = { 0x24, 0x6F, 0x28, 0x0A, (uint8_t)(cycle >> 8), (uint8_t)i };
+    memcpy(reading.mac, mac, sizeof(mac));
+    reading.moisture = (int16_t)((cycle + i) % 101);
+    reading.batteryMv = (uint16_t)(2800 + (cycle + i) % 500);
+    reading.sequence = (uint32_t)(cycle * GATEWAY_BATCH_SIZE + i);
+    reading.receivedAt = millis();
+  }
+}
+
+// Every pending day and event the meter can hold
+static void fillUsageReport(UsageReport& report, unsigned long cycle) {
+  report.dayCount = METER_MAX_PENDING_DAYS + 1;
+  for (int i = 0; i < report.dayCount; i++) {
+    report.days[i] = { (uint32_t)(20250420 + i), (uint32_t)(cycle * 1000 + i), (uint32_t)(cycle * 75 + i),
+                       (uint32_t)(i + 1) };
+  }
+  report.eventCount = METER_MAX_PENDING_EVENTS;
+  for (int i = 0; i < report.eventCount; i++) {
+    report.events[i] = { (uint32_t)(cycle * METER_MAX_PENDING_EVENTS + i), (uint32_t)(1745791200 + i * 600),
+                         (uint32_t)(300000 + i), (uint32_t)(22500 + i), (uint8_t)(i % 2) };
+  }
+}
+
+// Pending commands with real (uuid-sized) ids; their count varies by cycle
+static const char* pendingCommands(unsigned long cycle) {
+  static char body[1024];
+  int count = 1 + (int)(cycle % 3);
+  int length = snprintf(body, sizeof(body), "[");
+  for (int i = 0; i < count; i++) {
+    length += snprintf(body + length, sizeof(body) - length,
+                       "%s{\"id\":\"6b1f0c2e-4d5a-4e8b-9c3d-%012lu\",\"pump_control\":%s,\"automatic_mode\":false,"
+                       "\"user_id\":\"0d9a7c4b-1e2f-4a3b-8c5d-6e7f8a9b0c1d\"}",
+                       i > 0 ? "," : "", cycle * 3 + i, (cycle + i) % 2 ? "true" : "false");
+  }
+  snprintf(body + length, sizeof(body) - length, "]");
+  return body;
+}
+
+// One pass over everything the loop uploads
+static void runCycle(unsigned long cycle) {
+  static NodeBatch batch;
+  static UsageReport report;
+
+  advance(SOAK_CYCLE_MS);
+  CHECK(sendSensorReading((int)(cycle % 101)));
+  CHECK(updateDeviceStatus(cycle % 2 == 0, false));
+
+  httpFakeRespond(200, pendingCommands(cycle));
+  ControlCommand command = checkForCommands();
+  CHECK(command.valid);
+  if (command.valid) {
+    CHECK(markCommandAsExecuted(command.ids.c_str()));
+  }
+
+  fillUsageReport(report, cycle);
+  CHECK(sendUsageReport(report));
+  fillNodeBatch(batch, cycle);
+  CHECK(sendNodeReadings(batch));
+
+  httpFakeSetTelemetryDue(cycle % 5 == 0);
+  CHECK(sendHeartbeat());
+}
+
+// A counter from appendMemoryMetrics()
+static long memoryMetric(const char* name) {
+  DynamicJsonDocument doc(1024);
+  appendMemoryMetrics(doc.to<JsonObject>());
+  return doc["memory"][name].as<long>();
+}
+
+static void testRequestCycles() {
+  httpFakeReset();
+  unsigned long cycle = 1;
+  for (; cycle <= SOAK_WARMUP_CYCLES; cycle++) {
+    currentCycle = cycle;
+    runCycle(cycle);
+  }
+
+  size_t baselineBytes = liveBytes;
+  size_t baselineBlocks = liveBlocks;
+  unsigned long baselineAllocations = allocations;
+  unsigned long baselineRequests = httpFakeRequestCount();
+  unsigned long grownCycles = 0;
+  unsigned long largestTransient = 0;
+
+  for (; cycle <= SOAK_WARMUP_CYCLES + SOAK_CYCLES; cycle++) {
+    currentCycle = cycle;
+    peakLiveBytes = liveBytes;
+    runCycle(cycle);
+    if (liveBytes != baselineBytes || liveBlocks != baselineBlocks) {
+      if (grownCycles++ == 0) {
+        fprintf(stderr, "cycle %lu left %zu bytes in %zu blocks, expected %zu in %zu\n", cycle, liveBytes,
+                liveBlocks, baselineBytes, baselineBlocks);
+      }
+    }
+    if (peakLiveBytes - baselineBytes > largestTransient) {
+      largestTransient = peakLiveBytes - baselineBytes;
+    }
+  }
+  currentCycle = 0;
+
+  unsigned long requests = httpFakeRequestCount() - baselineRequests;
+  printf("%d cycles, %lu requests: %.1f allocations per request, %lu bytes transient at most, arena peak %ld\n",
+         SOAK_CYCLES, requests, (double)(allocations - baselineAllocations) / requests, largestTransient,
+         memoryMetric("arena_peak"));
+
+  // What is left: the URL copy HTTPClient::begin() takes by value, and the
+  // id, userId and ids Strings of the polled command
+  CHECK_EQ(allocations - baselineAllocations, requests + 3 * SOAK_CYCLES);
+  CHECK_EQ(grownCycles, 0);
+  CHECK_EQ(olderBlocksFreed, 0);
+  CHECK(largestTransient <= SOAK_MAX_TRANSIENT_BYTES);
+  CHECK_EQ(httpFakeTelemetrySent(), (SOAK_WARMUP_CYCLES + SOAK_CYCLES) / 5);
+  CHECK_EQ(memoryMetric("arena_fallbacks"), 0);
+  CHECK_EQ(memoryMetric("pool_exhausted"), 0);
+  CHECK_EQ(memoryMetric("pool_overflows"), 0);
+  CHECK(memoryMetric("arena_peak") <= API_ARENA_SIZE);
+}
+
+static const TestCase testCases[] = {
+  { "request_cycles", testRequestCycles },
+};
+
+int main(int argc, char** argv) {
+  initMemoryPools();
+  return RUN_TESTS(testCases, argc, argv);
+}
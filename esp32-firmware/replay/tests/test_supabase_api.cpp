@@ -0,0 +1,189 @@
+/*
+ * IriQ Smart Irrigation System - Supabase API Tests
+ *
+ * Checks the requests supabase_api.cpp builds and the responses it parses,
+ * against the scripted server in host/http_fake.cpp: the command poll and
+ * how pending commands collapse into one, the acknowledgement, and the
+ * exact payloads of readings, device status, usage and node readings.
+ */
+
+#include "check.h"
+#include "config.h"
+#include "hal.h"
+#include "http_fake.h"
+#include "memory_pool.h"
+#include "supabase_api.h"
+
+extern bool pumpStatus;
+
+static const char* const commandPath =
+    "https://iriq.supabase.co/rest/v1/control_commands?select=id,pump_control,automatic_mode,user_id"
+    "&device_id=eq." DEVICE_ID "&executed=eq.false&order=created_at.asc&limit=20";
+
+static void testCommandsCollapse() {
+  httpFakeReset();
+  httpFakeRespond(200,
+                  "[{\"id\":\"c1\",\"pump_control\":true,\"automatic_mode\":false,\"user_id\":\"u1\"},"
+                  "{\"id\":\"c2\",\"pump_control\":false,\"automatic_mode\":true,\"user_id\":\"u1\"},"
+                  "{\"id\":\"c3\",\"pump_control\":true,\"automatic_mode\":false,\"user_id\":\"u2\"}]");
+  ControlCommand command = checkForCommands();
+  CHECK_STR(httpFakeRequest().method, "GET");
+  CHECK_STR(httpFakeRequest().url, commandPath);
+
+  // The newest command carries the desired state; all of them are acknowledged
+  CHECK(command.valid);
+  CHECK_EQ(command.count, 3);
+  CHECK_STR(command.id.c_str(), "c3");
+  CHECK_STR(command.ids.c_str(), "c1,c2,c3");
+  CHECK(command.pumpControl);
+  CHECK(!command.automaticMode);
+  CHECK_STR(command.userId.c_str(), "u2");
+}
+
+static void testCommandsSkipUnacked() {
+  httpFakeReset();
+  httpFakeSetUnackedCommandIds("c1,c2");
+  httpFakeRespond(200, "[]");
+  ControlCommand command = checkForCommands();
+  String expected = String(commandPath) + "&id=not.in.(c1,c2)";
+  CHECK_STR(httpFakeRequest().url, expected.c_str());
+  CHECK(!command.valid);
+  CHECK_EQ(command.count, 0);
+
+  // No room to acknowledge more: no poll at all
+  httpFakeSetUnackedCommandIds("c1,c2", false);
+  CHECK(!checkForCommands().valid);
+  CHECK_EQ(httpFakeRequestCount(), 1);
+}
+
+static void testCommandsRejected() {
+  httpFakeReset();
+  httpFakeRespond(200, "[{\"id\":\"c1\",\"pump_control\":tr");
+  CHECK(!checkForCommands().valid);
+
+  httpFakeRespond(200, "{\"message\":\"not a list\"}");
+  CHECK(!checkForCommands().valid);
+
+  httpFakeRespond(404, "{}");
+  CHECK(!checkForCommands().valid);
+
+  httpFakeSetAuthenticated(false);
+  CHECK(!checkForCommands().valid);
+  CHECK_EQ(httpFakeRequestCount(), 3);
+}
+
+static void testCommandAck() {
+  httpFakeReset();
+  CHECK(markCommandAsExecuted("c1,c2"));
+  CHECK_STR(httpFakeRequest().method, "PATCH");
+  CHECK_STR(httpFakeRequest().url,
+            "https://iriq.supabase.co/rest/v1/control_commands?id=in.(c1,c2)&device_id=eq." DEVICE_ID);
+  // No NTP on the host, so the fallback time
+  CHECK_STR(httpFakeRequest().payload, "{\"executed\":true,\"executed_at\":\"2025-04-28T00:00:00Z\"}");
+}
+
+static void testSensorReadingPayload() {
+  httpFakeReset();
+  pumpStatus = true;
+  CHECK(sendSensorReading(MOISTURE_THRESHOLD - 1));
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/sensor_readings");
+  CHECK_STR(httpFakeRequest().payload,
+            "{\"device_id\":\"" DEVICE_ID "\",\"moisture_percentage\":29,\"moisture_digital\":true,"
+            "\"pump_status\":true}");
+
+  pumpStatus = false;
+  httpFakeRespond(500);
+  httpFakeRespond(500);
+  CHECK(!sendSensorReading(75));
+  CHECK_STR(httpFakeRequest().payload,
+            "{\"device_id\":\"" DEVICE_ID "\",\"moisture_percentage\":75,\"moisture_digital\":false,"
+            "\"pump_status\":false}");
+}
+
+static void testDeviceStatusPayload() {
+  static const char* const payload = "{\"device_id\":\"" DEVICE_ID "\",\"pump_status\":true,\"automatic_mode\":false,"
+                                     "\"user_id\":\"2930efc2-0327-47db-9f0b-27901d2bc272\"}";
+  httpFakeReset();
+  CHECK(updateDeviceStatus(true, false));
+  CHECK_EQ(httpFakeRequestCount(), 1);
+  CHECK_STR(httpFakeRequest().method, "PATCH");
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/device_status?device_id=eq." DEVICE_ID);
+  CHECK_STR(httpFakeRequest().payload, payload);
+
+  // A rejected update falls back to an insert of the same row
+  httpFakeRespond(404);
+  CHECK(updateDeviceStatus(true, false));
+  CHECK_EQ(httpFakeRequestCount(), 3);
+  CHECK_STR(httpFakeRequest().method, "POST");
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/device_status");
+  CHECK_STR(httpFakeRequest().payload, payload);
+
+  // A server error would fail the insert the same way
+  httpFakeRespond(500);
+  httpFakeRespond(500);
+  CHECK(!updateDeviceStatus(true, false));
+  CHECK_EQ(httpFakeRequestCount(), 5);
+}
+
+static void testUsagePayload() {
+  static UsageReport report;
+  report.dayCount = 2;
+  report.days[0] = { 20250427, 600000, 45000, 2 };
+  report.days[1] = { 20250428, 120000, 9000, 1 };
+  report.eventCount = 2;
+  report.events[0] = { 41, 1745791200, 300000, 22500, 1 };
+  report.events[1] = { 42, 0, 120000, 9000, 0 };
+
+  httpFakeReset();
+  CHECK(sendUsageReport(report));
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/rpc/record_pump_usage");
+  CHECK_STR(httpFakeRequest().payload,
+            "{\"p_device_id\":\"" DEVICE_ID "\",\"p_days\":["
+            "{\"day\":\"2025-04-27\",\"runtime_ms\":600000,\"volume_ml\":45000,\"events\":2},"
+            "{\"day\":\"2025-04-28\",\"runtime_ms\":120000,\"volume_ml\":9000,\"events\":1}],\"p_events\":["
+            "{\"sequence\":41,\"started_at\":1745791200,\"duration_ms\":300000,\"volume_ml\":22500,\"automatic\":true},"
+            "{\"sequence\":42,\"duration_ms\":120000,\"volume_ml\":9000,\"automatic\":false}]}");
+}
+
+static void testNodeReadingsPayload() {
+  static NodeBatch batch;
+  batch.count = 2;
+  batch.readings[0] = { { 0x24, 0x6F, 0x28, 0x0A, 0x0B, 0x0C }, 12, 3100, 7, millis() };
+  batch.readings[1] = { { 0x24, 0x6F, 0x28, 0x0A, 0x0B, 0x0D }, 64, 2900, 9, millis() };
+
+  httpFakeReset();
+  CHECK(sendNodeReadings(batch));
+  CHECK_STR(httpFakeRequest().url, "https://iriq.supabase.co/rest/v1/sensor_readings");
+
+  // heard_at comes from the host clock, so check its shape
+  DynamicJsonDocument doc(2048);
+  CHECK(!deserializeJson(doc, httpFakeRequest().payload));
+  CHECK_EQ(doc.size(), 2);
+  CHECK_STR(doc[0]["device_id"].as<const char*>(), NODE_DEVICE_PREFIX "246F280A0B0C");
+  CHECK_EQ(doc[0]["moisture_percentage"].as<int>(), 12);
+  CHECK(doc[0]["moisture_digital"].as<bool>());
+  CHECK_STR(doc[1]["device_id"].as<const char*>(), NODE_DEVICE_PREFIX "246F280A0B0D");
+  CHECK(!doc[1]["moisture_digital"].as<bool>());
+  for (int i = 0; i < 2; i++) {
+    const char* heardAt = doc[i]["heard_at"] | "";
+    CHECK_EQ(strlen(heardAt), 20);
+    CHECK(heardAt[10] == 'T' && heardAt[19] == 'Z');
+    CHECK(!doc[i].containsKey("created_at"));
+  }
+}
+
+static const TestCase testCases[] = {
+  { "commands_collapse", testCommandsCollapse },
+  { "commands_skip_unacked", testCommandsSkipUnacked },
+  { "commands_rejected", testCommandsRejected },
+  { "command_ack", testCommandAck },
+  { "sensor_reading_payload", testSensorReadingPayload },
+  { "device_status_payload", testDeviceStatusPayload },
+  { "usage_payload", testUsagePayload },
+  { "node_readings_payload", testNodeReadingsPayload },
+};
+
+int main(int argc, char** argv) {
+  initMemoryPools();
+  return RUN_TESTS(testCases, argc, argv);
+}
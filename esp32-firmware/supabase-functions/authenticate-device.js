@@ -1,95 +1,133 @@
 // Supabase Edge Function: authenticate-device
 // This function authenticates ESP32 devices and issues JWT tokens
+//
+// A device proves itself with its secret (DEVICE_SECRET in config.h), whose
+// SHA-256 is stored in devices.device_secret_hash (see
+// supabase-setup/device-credentials.sql). The token is signed with the
+// project's JWT secret, so PostgREST applies the device owner's RLS policies
+// to the device's requests. Set it for the function with:
+//   supabase secrets set DEVICE_JWT_SECRET=<project JWT secret>
+// DEVICE_TOKEN_TTL optionally sets the token lifetime in seconds.
+//
+// The firmware refreshes the token in the background before expires_at, so
+// the lifetime can be kept short.
 
 import { createClient } from 'https://esm.sh/@supabase/supabase-js@2'
+import { create, getNumericDate } from 'https://deno.land/x/djwt@v3.0.2/mod.ts'
+
+const TOKEN_TTL_SECONDS = Number(Deno.env.get('DEVICE_TOKEN_TTL') ?? 86400)
+
+const encoder = new TextEncoder()
+
+function jsonResponse(body, status) {
+  return new Response(JSON.stringify(body), { headers: { 'Content-Type': 'application/json' }, status })
+}
+
+async function sha256Hex(text) {
+  const digest = await crypto.subtle.digest('SHA-256', encoder.encode(text))
+  return Array.from(new Uint8Array(digest), (byte) => byte.toString(16).padStart(2, '0')).join('')
+}
+
+// Compare without returning early, so timing does not reveal the matching prefix
+function equalHex(a, b) {
+  if (typeof a !== 'string' || typeof b !== 'string' || a.length !== b.length) {
+    return false
+  }
+  let difference = 0
+  for (let i = 0; i < a.length; i++) {
+    difference |= a.charCodeAt(i) ^ b.charCodeAt(i)
+  }
+  return difference === 0
+}
+
+async function signingKey() {
+  const secret = Deno.env.get('DEVICE_JWT_SECRET')
+  if (!secret) {
+    throw new Error('DEVICE_JWT_SECRET is not set')
+  }
+  return await crypto.subtle.importKey('raw', encoder.encode(secret), { name: 'HMAC', hash: 'SHA-256' }, false, [
+    'sign',
+  ])
+}
 
 // Handle the request
 Deno.serve(async (req) => {
   // Get request data
-  const { device_id, device_type } = await req.json()
-  
+  const { device_id, device_type, device_secret } = await req.json()
+
   // Validate request
-  if (!device_id || !device_type) {
-    return new Response(
-      JSON.stringify({ error: 'Missing required fields' }),
-      { headers: { 'Content-Type': 'application/json' }, status: 400 }
-    )
+  if (!device_id || !device_type || !device_secret) {
+    return jsonResponse({ error: 'Missing required fields' }, 400)
   }
-  
-  // Initialize Supabase client with service role key
-  // IMPORTANT: This uses the service role key which has admin privileges
-  // In production, implement proper security measures
+
+  // Initialize Supabase client with service role key; it only reads the
+  // device row and writes the auth log
   const supabaseAdmin = createClient(
     Deno.env.get('SUPABASE_URL'),
     Deno.env.get('SUPABASE_SERVICE_ROLE_KEY')
   )
-  
+
+  const logAttempt = (userId, success) =>
+    supabaseAdmin.from('device_auth_logs').insert({
+      device_id: device_id,
+      user_id: userId,
+      success: success,
+      ip_address: req.headers.get('x-forwarded-for') || 'unknown',
+      user_agent: req.headers.get('user-agent') || 'unknown'
+    })
+
   try {
     // Check if device exists in the database
     const { data: deviceData, error: deviceError } = await supabaseAdmin
       .from('devices')
-      .select('*')
+      .select('user_id, device_secret_hash')
       .eq('device_id', device_id)
       .single()
-    
+
     if (deviceError || !deviceData) {
       console.error('Device not found:', deviceError)
-      return new Response(
-        JSON.stringify({ error: 'Device not authorized' }),
-        { headers: { 'Content-Type': 'application/json' }, status: 401 }
-      )
+      return jsonResponse({ error: 'Device not authorized' }, 401)
+    }
+
+    // Check the device secret
+    if (!equalHex(await sha256Hex(device_secret), deviceData.device_secret_hash)) {
+      await logAttempt(deviceData.user_id, false)
+      return jsonResponse({ error: 'Device not authorized' }, 401)
     }
-    
+
     // Check if device is linked to a user
     if (!deviceData.user_id) {
-      return new Response(
-        JSON.stringify({ error: 'Device not linked to a user' }),
-        { headers: { 'Content-Type': 'application/json' }, status: 401 }
-      )
-    }
-    
-    // Generate a JWT token for the device
-    // This token will have limited permissions based on the device's role
-    const { data: tokenData, error: tokenError } = await supabaseAdmin.auth.admin.createToken({
-      user_id: deviceData.user_id,
-      exp: Math.floor(Date.now() / 1000) + (60 * 60 * 24) // 24 hours
-    })
-    
-    if (tokenError) {
-      console.error('Token generation error:', tokenError)
-      return new Response(
-        JSON.stringify({ error: 'Authentication failed' }),
-        { headers: { 'Content-Type': 'application/json' }, status: 500 }
-      )
+      return jsonResponse({ error: 'Device not linked to a user' }, 401)
     }
-    
-    // Log the authentication attempt
-    await supabaseAdmin
-      .from('device_auth_logs')
-      .insert({
+
+    // Generate a JWT for the device, acting as the user it belongs to
+    const expiresAt = getNumericDate(TOKEN_TTL_SECONDS)
+    const token = await create(
+      { alg: 'HS256', typ: 'JWT' },
+      {
+        sub: deviceData.user_id,
+        role: 'authenticated',
+        aud: 'authenticated',
         device_id: device_id,
-        user_id: deviceData.user_id,
-        success: true,
-        ip_address: req.headers.get('x-forwarded-for') || 'unknown',
-        user_agent: req.headers.get('user-agent') || 'unknown'
-      })
-    
-    // Return the token
-    return new Response(
-      JSON.stringify({
-        token: tokenData.token,
-        expires_in: 86400, // 24 hours in seconds
-        user_id: deviceData.user_id
-      }),
-      { headers: { 'Content-Type': 'application/json' }, status: 200 }
+        iat: getNumericDate(0),
+        exp: expiresAt
+      },
+      await signingKey()
     )
-    
+
+    // Log the authentication attempt
+    await logAttempt(deviceData.user_id, true)
+
+    // Return the token; expires_in lets a device without a set clock track expiry
+    return jsonResponse({
+      token: token,
+      expires_in: TOKEN_TTL_SECONDS,
+      expires_at: expiresAt,
+      user_id: deviceData.user_id
+    }, 200)
+
   } catch (error) {
     console.error('Authentication error:', error)
-    
-    return new Response(
-      JSON.stringify({ error: 'Internal server error' }),
-      { headers: { 'Content-Type': 'application/json' }, status: 500 }
-    )
+    return jsonResponse({ error: 'Internal server error' }, 500)
   }
 })
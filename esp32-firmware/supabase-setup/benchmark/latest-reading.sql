@@ -0,0 +1,6 @@
+-- Latest reading for one device (moisture-monitor.tsx, dashboard/page.tsx)
+\set device random(0, :devices - 1)
+SELECT * FROM :table
+WHERE device_id = 'esp32_device_' || :device
+ORDER BY created_at DESC
+LIMIT 1;
@@ -0,0 +1,6 @@
+-- 30 days of readings for one device (history-view.tsx)
+\set device random(0, :devices - 1)
+SELECT created_at, moisture_percentage FROM :table
+WHERE device_id = 'esp32_device_' || :device
+  AND created_at >= now() - INTERVAL '30 days'
+ORDER BY created_at DESC;
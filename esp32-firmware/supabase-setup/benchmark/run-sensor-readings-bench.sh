@@ -0,0 +1,33 @@
+#!/bin/sh
+# IriQ Smart Irrigation System - Sensor Readings Benchmark
+# Compares the dashboard's latest-reading and 30-day-range queries on the
+# original table layout and on the partitioned, indexed layout.
+#
+# Usage: ./run-sensor-readings-bench.sh [rows] [devices]
+# Connection settings come from the usual PG* environment variables.
+# Queries run in simple protocol mode because the table name is a variable.
+# Loading 100M rows needs roughly 25 GB of disk and takes a while; pass
+# SKIP_LOAD=1 to rerun the queries against already loaded data.
+
+set -e
+
+ROWS=${1:-100000000}
+DEVICES=${2:-20}
+DURATION=${DURATION:-30}
+CLIENTS=${CLIENTS:-4}
+DIR=$(dirname "$0")
+
+if [ -z "$SKIP_LOAD" ]; then
+  echo "Loading $ROWS rows for $DEVICES devices..."
+  psql -q -v ON_ERROR_STOP=1 -v rows="$ROWS" -v devices="$DEVICES" -f "$DIR/sensor-readings-load.sql"
+fi
+
+for TABLE in bench.readings_flat bench.readings; do
+  for QUERY in latest-reading range-30d; do
+    echo
+    echo "== $QUERY on $TABLE"
+    pgbench -n -c "$CLIENTS" -j "$CLIENTS" -T "$DURATION" -M simple \
+      -D table="$TABLE" -D devices="$DEVICES" -f "$DIR/$QUERY.sql" \
+      | grep -E "latency average|latency stddev|tps"
+  done
+done
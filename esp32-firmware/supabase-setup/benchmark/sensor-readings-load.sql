@@ -0,0 +1,71 @@
+-- IriQ Smart Irrigation System - Sensor Readings Benchmark Data
+-- Loads synthetic readings into two tables in a local "bench" schema:
+-- - bench.readings_flat: the original layout (single table, primary key only)
+-- - bench.readings: the layout from sensor-readings-partitioning.sql
+--
+-- Usage: psql -v rows=100000000 -v devices=20 -f sensor-readings-load.sql
+-- Readings are 3 seconds apart per device and end at now().
+
+\if :{?rows}
+\else
+\set rows 100000000
+\endif
+\if :{?devices}
+\else
+\set devices 20
+\endif
+
+DROP SCHEMA IF EXISTS bench CASCADE;
+CREATE SCHEMA bench;
+
+CREATE TABLE bench.readings_flat (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    device_id TEXT NOT NULL,
+    moisture_percentage NUMERIC NOT NULL,
+    moisture_digital BOOLEAN NOT NULL
+);
+
+CREATE TABLE bench.readings (
+    id UUID NOT NULL DEFAULT gen_random_uuid(),
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    device_id TEXT NOT NULL,
+    moisture_percentage NUMERIC NOT NULL,
+    moisture_digital BOOLEAN NOT NULL,
+    PRIMARY KEY (id, created_at)
+) PARTITION BY RANGE (created_at);
+
+CREATE TABLE bench.readings_default PARTITION OF bench.readings DEFAULT;
+
+-- One partition per month covered by the generated data
+SELECT format(
+    'CREATE TABLE bench.readings_%s PARTITION OF bench.readings FOR VALUES FROM (%L) TO (%L)',
+    to_char(m, 'YYYY_MM'), m, m + INTERVAL '1 month'
+)
+FROM generate_series(
+    date_trunc('month', now() - (:rows / :devices) * INTERVAL '3 seconds'),
+    date_trunc('month', now()),
+    INTERVAL '1 month'
+) AS m
+\gexec
+
+-- Generate into the flat table, then copy, so both hold identical rows
+INSERT INTO bench.readings_flat (created_at, device_id, moisture_percentage, moisture_digital)
+SELECT now() - ((:rows - 1 - n) / :devices) * INTERVAL '3 seconds',
+       'esp32_device_' || (n % :devices),
+       (40 + 30 * sin(n / 5000.0))::NUMERIC(5, 2),
+       sin(n / 5000.0) < 0
+FROM generate_series(0, :rows - 1) AS n;
+
+INSERT INTO bench.readings SELECT * FROM bench.readings_flat;
+
+-- Indexes from sensor-readings-partitioning.sql (only on the partitioned table)
+CREATE INDEX ON bench.readings (device_id, created_at DESC);
+CREATE INDEX ON bench.readings USING BRIN (created_at) WITH (pages_per_range = 32);
+
+VACUUM ANALYZE bench.readings_flat;
+VACUUM ANALYZE bench.readings;
+
+SELECT pg_size_pretty(pg_total_relation_size('bench.readings_flat')) AS flat_size,
+       (SELECT pg_size_pretty(sum(pg_total_relation_size(inhrelid)))
+        FROM pg_inherits WHERE inhparent = 'bench.readings'::regclass) AS partitioned_size;
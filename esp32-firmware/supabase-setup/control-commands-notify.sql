@@ -0,0 +1,29 @@
+-- IriQ Smart Irrigation System - Control Command Notifications
+-- This script lets the MQTT bridge in ingest-gateway push commands to devices
+-- instead of devices polling for them. Every new command sends a NOTIFY on
+-- the iriq_control_commands channel with the device_id as payload; the bridge
+-- LISTENs, reads that device's pending commands and publishes them on the
+-- device's retained desired-state topic.
+--
+-- The payload is only a wake-up: the bridge re-reads the pending commands, so
+-- a notification lost while it was disconnected is covered by the full
+-- resync it runs on every reconnect.
+--
+-- LISTEN needs a session-mode connection, so point the bridge at the direct
+-- database host or the session pooler, not the transaction pooler.
+--
+-- Run after control-commands-supersede.sql.
+
+-- Create function to announce a new command
+CREATE OR REPLACE FUNCTION notify_control_command()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM pg_notify('iriq_control_commands', NEW.device_id);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS control_commands_notify ON public.control_commands;
+CREATE TRIGGER control_commands_notify
+    AFTER INSERT ON public.control_commands
+    FOR EACH ROW EXECUTE FUNCTION notify_control_command();
@@ -0,0 +1,57 @@
+-- IriQ Smart Irrigation System - Superseded Control Commands
+-- This script collapses pending control commands server-side. Every command
+-- carries the full desired pump/mode state, so when a new command arrives any
+-- earlier pending command for the same device is obsolete: it is closed as
+-- superseded and the device only ever finds the newest command pending.
+--
+-- A partial index over pending commands keeps the device poll a single index
+-- probe no matter how many executed commands the table holds.
+--
+-- Run after database-setup.sql.
+
+-- Record when a command ran, or which newer command replaced it
+ALTER TABLE public.control_commands ADD COLUMN IF NOT EXISTS executed_at TIMESTAMP WITH TIME ZONE;
+ALTER TABLE public.control_commands ADD COLUMN IF NOT EXISTS superseded_by UUID;
+
+-- Create function to close earlier pending commands of the same device
+CREATE OR REPLACE FUNCTION supersede_control_commands()
+RETURNS TRIGGER AS $$
+BEGIN
+    -- Superseded commands count as handled (executed = true) so the device
+    -- poll skips them, but keep executed_at NULL since they never ran
+    UPDATE public.control_commands
+    SET executed = TRUE,
+        superseded_by = NEW.id
+    WHERE device_id = NEW.device_id
+      AND NOT executed
+      AND id <> NEW.id
+      AND created_at <= NEW.created_at;
+
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+DROP TRIGGER IF EXISTS control_commands_supersede ON public.control_commands;
+CREATE TRIGGER control_commands_supersede
+    AFTER INSERT ON public.control_commands
+    FOR EACH ROW EXECUTE FUNCTION supersede_control_commands();
+
+-- Close the pending backlog that built up before the trigger existed
+UPDATE public.control_commands c
+SET executed = TRUE,
+    superseded_by = newest.id
+FROM (
+    SELECT DISTINCT ON (device_id) device_id, id, created_at
+    FROM public.control_commands
+    WHERE NOT executed
+    ORDER BY device_id, created_at DESC
+) newest
+WHERE c.device_id = newest.device_id
+  AND NOT c.executed
+  AND c.id <> newest.id;
+
+-- Index only the pending commands: it stays tiny and the device poll
+-- (device_id = X AND executed = false ORDER BY created_at) is one probe
+CREATE INDEX IF NOT EXISTS control_commands_pending_idx
+    ON public.control_commands (device_id, created_at)
+    WHERE NOT executed;
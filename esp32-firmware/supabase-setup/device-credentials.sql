@@ -0,0 +1,55 @@
+-- IriQ Smart Irrigation System - Device Credentials
+-- This script adds the per-device secret the authenticate-device edge
+-- function checks before it issues a device token. Only the secret's
+-- SHA-256 is stored; the secret itself is DEVICE_SECRET in the device's
+-- config.h.
+--
+-- Provisioning: authenticate-device refuses every device whose
+-- device_secret_hash is NULL, including devices registered before this
+-- script. Each one needs a secret before it runs firmware that sets
+-- AUTH_TOKEN_FUNCTION:
+--   1. Find them:
+--        SELECT device_id FROM public.devices WHERE device_secret_hash IS NULL;
+--   2. As the device's owner (or an admin), set a long random secret:
+--        SELECT set_device_secret('esp32_device_1', '<long random secret>');
+--   3. Put the same secret in DEVICE_SECRET in that device's config.h and
+--      flash it. Firmware built with an empty DEVICE_SECRET logs an error at
+--      boot and does not request a token.
+--
+-- Run after database-setup.sql.
+
+-- Enable pgcrypto for digest()
+CREATE EXTENSION IF NOT EXISTS pgcrypto;
+
+-- Add the secret hash to devices
+ALTER TABLE public.devices ADD COLUMN IF NOT EXISTS device_secret_hash TEXT
+    CHECK (device_secret_hash ~ '^[0-9a-f]{64}$');
+
+COMMENT ON COLUMN public.devices.device_secret_hash IS 'Hex SHA-256 of the device secret, checked by the authenticate-device edge function';
+
+-- Create function to set a device secret
+CREATE OR REPLACE FUNCTION set_device_secret(p_device_id TEXT, p_secret TEXT)
+RETURNS VOID AS $$
+BEGIN
+    IF length(p_secret) < 16 THEN
+        RAISE EXCEPTION 'Device secret must be at least 16 characters';
+    END IF;
+
+    UPDATE public.devices
+    SET device_secret_hash = encode(digest(p_secret, 'sha256'), 'hex'),
+        updated_at = now()
+    WHERE device_id = p_device_id
+      AND (user_id = auth.uid() OR EXISTS (
+          SELECT 1 FROM public.profiles
+          WHERE profiles.id = auth.uid()
+          AND profiles.role = 'admin'
+      ));
+
+    IF NOT FOUND THEN
+        RAISE EXCEPTION 'Device % not found', p_device_id;
+    END IF;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public, extensions;
+
+REVOKE ALL ON FUNCTION set_device_secret(TEXT, TEXT) FROM PUBLIC;
+GRANT EXECUTE ON FUNCTION set_device_secret(TEXT, TEXT) TO authenticated;
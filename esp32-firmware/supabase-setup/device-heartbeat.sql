@@ -13,6 +13,9 @@ CREATE TABLE IF NOT EXISTS public.device_heartbeats (
     updated_at TIMESTAMP WITH TIME ZONE DEFAULT now()
 );
 
+-- Device telemetry (boot timings, connectivity and API counters) reported with heartbeats
+ALTER TABLE public.device_heartbeats ADD COLUMN IF NOT EXISTS metrics JSONB;
+
 -- Add comment to the device_heartbeats table
 COMMENT ON TABLE public.device_heartbeats IS 'Tracks online status and heartbeats from ESP32 devices';
 
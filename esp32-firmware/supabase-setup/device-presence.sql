@@ -0,0 +1,150 @@
+-- IriQ Smart Irrigation System - Device Presence
+-- This script keeps one current-presence row per device, updated in place by
+-- every heartbeat, so online status and the device list are primary-key
+-- lookups instead of a search through the heartbeat history.
+--
+-- device_heartbeats remains as a sampled history: a heartbeat is copied into
+-- it only when the status or telemetry changes, or every sample interval,
+-- instead of every HEARTBEAT_INTERVAL (~28.8k rows per device per day).
+--
+-- Run after device-heartbeat.sql.
+
+-- Create device_presence table holding the latest heartbeat of each device
+CREATE TABLE IF NOT EXISTS public.device_presence (
+    device_id TEXT PRIMARY KEY REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    last_seen TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    status TEXT NOT NULL DEFAULT 'online',
+    ip_address TEXT,
+    firmware_version TEXT,
+    metrics JSONB,
+    history_sampled_at TIMESTAMP WITH TIME ZONE
+);
+
+-- Add comment to the device_presence table
+COMMENT ON TABLE public.device_presence IS 'Current online status of each ESP32 device, upserted by heartbeats';
+
+-- Create function to stamp heartbeats and sample them into the history.
+-- last_seen uses the server clock: the device clock may not be synced yet.
+-- An upsert fires the INSERT trigger even when it ends up updating, so
+-- sampling only happens on UPDATE; a new row is sampled by its next heartbeat.
+CREATE OR REPLACE FUNCTION record_device_presence()
+RETURNS TRIGGER AS $$
+DECLARE
+    sample_interval CONSTANT INTERVAL := INTERVAL '5 minutes';
+BEGIN
+    NEW.last_seen := now();
+
+    IF TG_OP = 'INSERT' THEN
+        NEW.history_sampled_at := NULL;
+    ELSIF NEW.status IS DISTINCT FROM OLD.status
+       OR NEW.metrics IS DISTINCT FROM OLD.metrics
+       OR OLD.history_sampled_at IS NULL
+       OR NEW.last_seen - OLD.history_sampled_at >= sample_interval THEN
+        INSERT INTO public.device_heartbeats (device_id, last_seen, status, ip_address, firmware_version, metrics)
+        VALUES (NEW.device_id, NEW.last_seen, NEW.status, NEW.ip_address, NEW.firmware_version, NEW.metrics);
+        NEW.history_sampled_at := NEW.last_seen;
+    END IF;
+
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+DROP TRIGGER IF EXISTS device_presence_record ON public.device_presence;
+CREATE TRIGGER device_presence_record
+    BEFORE INSERT OR UPDATE ON public.device_presence
+    FOR EACH ROW EXECUTE FUNCTION record_device_presence();
+
+-- Seed presence from the newest existing heartbeat of each device
+INSERT INTO public.device_presence (device_id, last_seen, status, ip_address, firmware_version, metrics, history_sampled_at)
+SELECT DISTINCT ON (device_id) device_id, last_seen, status, ip_address, firmware_version, metrics, last_seen
+FROM public.device_heartbeats
+ORDER BY device_id, last_seen DESC
+ON CONFLICT (device_id) DO NOTHING;
+
+-- Speed up per-device history queries on the sampled heartbeats
+CREATE INDEX IF NOT EXISTS device_heartbeats_device_last_seen_idx
+    ON public.device_heartbeats (device_id, last_seen DESC);
+
+-- Create or update the RLS policies for the device_presence table
+ALTER TABLE public.device_presence ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users can view their own device presence
+CREATE POLICY "Users can view their own device presence"
+    ON public.device_presence
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_presence.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Devices can create their own presence row
+CREATE POLICY "Devices can create their own presence"
+    ON public.device_presence
+    FOR INSERT
+    WITH CHECK (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_presence.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Devices can update their own presence row
+CREATE POLICY "Devices can update their own presence"
+    ON public.device_presence
+    FOR UPDATE
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_presence.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can view all device presence
+CREATE POLICY "Admin users can view all device presence"
+    ON public.device_presence
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+-- Replace the history scan with a primary-key lookup
+CREATE OR REPLACE FUNCTION is_device_online(device_id TEXT)
+RETURNS BOOLEAN AS $$
+    SELECT coalesce(
+        (SELECT (CURRENT_TIMESTAMP - last_seen) < INTERVAL '10 minutes'
+         FROM public.device_presence
+         WHERE device_presence.device_id = is_device_online.device_id),
+        FALSE
+    );
+$$ LANGUAGE sql STABLE SECURITY DEFINER;
+
+-- Realtime: the dashboard listens for presence updates
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_publication WHERE pubname = 'supabase_realtime')
+       AND NOT EXISTS (
+           SELECT 1 FROM pg_publication_tables
+           WHERE pubname = 'supabase_realtime' AND tablename = 'device_presence'
+       ) THEN
+        ALTER PUBLICATION supabase_realtime ADD TABLE public.device_presence;
+    END IF;
+END;
+$$;
+
+-- Keep 30 days of sampled heartbeat history if pg_cron is enabled
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_cron') THEN
+        PERFORM cron.schedule('device-heartbeats-retention', '15 3 * * *',
+                              'DELETE FROM public.device_heartbeats WHERE last_seen < now() - INTERVAL ''30 days''');
+    END IF;
+END;
+$$;
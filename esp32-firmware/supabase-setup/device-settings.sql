@@ -0,0 +1,103 @@
+-- IriQ Smart Irrigation System - Device Settings
+-- This script adds per-device settings the firmware reads every
+-- SETTINGS_CHECK_INTERVAL (sampler.cpp). They bound the adaptive sampler:
+-- the sensor is read every sample_interval_min_ms while the pump runs or
+-- the moisture is within sample_near_threshold points of the threshold,
+-- and backs off towards sample_interval_max_ms while the reading is stable.
+--
+-- A device without a row uses the defaults from its config.h. Deleting the
+-- row returns it to them.
+--
+-- Run after database-setup.sql.
+
+-- Create device_settings table
+CREATE TABLE IF NOT EXISTS public.device_settings (
+    device_id TEXT PRIMARY KEY REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    sample_interval_min_ms INTEGER NOT NULL DEFAULT 1000
+        CHECK (sample_interval_min_ms >= 250),
+    sample_interval_max_ms INTEGER NOT NULL DEFAULT 300000
+        CHECK (sample_interval_max_ms <= 3600000),
+    sample_near_threshold INTEGER NOT NULL DEFAULT 5
+        CHECK (sample_near_threshold BETWEEN 0 AND 100),
+    updated_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    CHECK (sample_interval_max_ms >= sample_interval_min_ms)
+);
+
+-- Add comment to the device_settings table
+COMMENT ON TABLE public.device_settings IS 'Per-device sampling bounds, polled by the ESP32 firmware';
+
+-- Create function to stamp changes
+CREATE OR REPLACE FUNCTION touch_device_settings()
+RETURNS TRIGGER AS $$
+BEGIN
+    NEW.updated_at := now();
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS device_settings_touch ON public.device_settings;
+CREATE TRIGGER device_settings_touch
+    BEFORE UPDATE ON public.device_settings
+    FOR EACH ROW EXECUTE FUNCTION touch_device_settings();
+
+-- Create or update the RLS policies for the device_settings table
+ALTER TABLE public.device_settings ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users (and their devices) can view their own device settings
+CREATE POLICY "Users can view their own device settings"
+    ON public.device_settings
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_settings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users can create settings for their own devices
+CREATE POLICY "Users can create their own device settings"
+    ON public.device_settings
+    FOR INSERT
+    WITH CHECK (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_settings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users can update settings of their own devices
+CREATE POLICY "Users can update their own device settings"
+    ON public.device_settings
+    FOR UPDATE
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_settings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users can delete settings of their own devices
+CREATE POLICY "Users can delete their own device settings"
+    ON public.device_settings
+    FOR DELETE
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_settings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can manage all device settings
+CREATE POLICY "Admin users can manage all device settings"
+    ON public.device_settings
+    FOR ALL
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
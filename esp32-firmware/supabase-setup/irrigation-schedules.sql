@@ -0,0 +1,201 @@
+-- IriQ Smart Irrigation System - Irrigation Schedules
+-- This script adds watering windows that run on the device itself
+-- (irrigation_schedule.cpp), so scheduled watering needs no control
+-- commands and keeps working while the device is offline.
+--
+-- The dashboard edits irrigation_schedules. A trigger compiles the enabled
+-- windows of a device into its device_schedules row and bumps the version.
+-- The device fetches that row only when the version differs from the one it
+-- holds. Each entry is [start_minute, duration_minutes, days,
+-- moisture_below]. days is a bit mask with bit 0 for Sunday, and
+-- moisture_below is null for an unconditional window. Windows are in the
+-- device's local time, utc_offset_minutes ahead of UTC.
+--
+-- Schedules only drive the pump while the device is in manual mode.
+--
+-- Run after database-setup.sql.
+
+-- Create irrigation_schedules table, one row per watering window
+CREATE TABLE IF NOT EXISTS public.irrigation_schedules (
+    id UUID PRIMARY KEY DEFAULT uuid_generate_v4(),
+    device_id TEXT NOT NULL REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    name TEXT,
+    start_minute INTEGER NOT NULL CHECK (start_minute BETWEEN 0 AND 1439),
+    duration_minutes INTEGER NOT NULL CHECK (duration_minutes BETWEEN 1 AND 1440),
+    days SMALLINT NOT NULL DEFAULT 127 CHECK (days BETWEEN 1 AND 127),
+    moisture_below INTEGER CHECK (moisture_below BETWEEN 0 AND 100),
+    enabled BOOLEAN NOT NULL DEFAULT TRUE,
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    updated_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now()
+);
+
+-- Add comment to the irrigation_schedules table
+COMMENT ON TABLE public.irrigation_schedules IS 'Watering windows, compiled into device_schedules for the ESP32 firmware';
+
+CREATE INDEX IF NOT EXISTS irrigation_schedules_device_idx
+    ON public.irrigation_schedules (device_id, start_minute);
+
+-- Create device_schedules table, the compiled schedule of each device
+CREATE TABLE IF NOT EXISTS public.device_schedules (
+    device_id TEXT PRIMARY KEY REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    version BIGINT NOT NULL DEFAULT 1,
+    utc_offset_minutes INTEGER NOT NULL DEFAULT 0
+        CHECK (utc_offset_minutes BETWEEN -840 AND 840),
+    entries JSONB NOT NULL DEFAULT '[]'::JSONB,
+    updated_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now()
+);
+
+-- Add comment to the device_schedules table
+COMMENT ON TABLE public.device_schedules IS 'Versioned schedule of each device, polled by the ESP32 firmware';
+
+-- Create function to compile the enabled windows of a device
+CREATE OR REPLACE FUNCTION compile_device_schedule(p_device_id TEXT)
+RETURNS VOID AS $$
+BEGIN
+    INSERT INTO public.device_schedules (device_id, entries)
+    SELECT p_device_id,
+           coalesce(jsonb_agg(jsonb_build_array(s.start_minute, s.duration_minutes, s.days, s.moisture_below)
+                              ORDER BY s.start_minute), '[]'::JSONB)
+    FROM public.irrigation_schedules s
+    WHERE s.device_id = p_device_id AND s.enabled
+    ON CONFLICT (device_id) DO UPDATE SET
+        version = device_schedules.version + 1,
+        entries = EXCLUDED.entries,
+        updated_at = now();
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+-- Create trigger function to recompile after any change to a window
+CREATE OR REPLACE FUNCTION irrigation_schedules_changed()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP <> 'INSERT' THEN
+        PERFORM compile_device_schedule(OLD.device_id);
+    END IF;
+    IF TG_OP <> 'DELETE' AND (TG_OP = 'INSERT' OR NEW.device_id <> OLD.device_id) THEN
+        PERFORM compile_device_schedule(NEW.device_id);
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS irrigation_schedules_compile ON public.irrigation_schedules;
+CREATE TRIGGER irrigation_schedules_compile
+    AFTER INSERT OR UPDATE OR DELETE ON public.irrigation_schedules
+    FOR EACH ROW EXECUTE FUNCTION irrigation_schedules_changed();
+
+-- Create function to stamp window changes
+CREATE OR REPLACE FUNCTION touch_irrigation_schedule()
+RETURNS TRIGGER AS $$
+BEGIN
+    NEW.updated_at := now();
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS irrigation_schedules_touch ON public.irrigation_schedules;
+CREATE TRIGGER irrigation_schedules_touch
+    BEFORE UPDATE ON public.irrigation_schedules
+    FOR EACH ROW EXECUTE FUNCTION touch_irrigation_schedule();
+
+-- Create function to send a changed UTC offset to the device
+CREATE OR REPLACE FUNCTION device_schedules_offset_changed()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF NEW.utc_offset_minutes IS DISTINCT FROM OLD.utc_offset_minutes THEN
+        NEW.version := OLD.version + 1;
+        NEW.updated_at := now();
+    END IF;
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS device_schedules_offset ON public.device_schedules;
+CREATE TRIGGER device_schedules_offset
+    BEFORE UPDATE ON public.device_schedules
+    FOR EACH ROW EXECUTE FUNCTION device_schedules_offset_changed();
+
+-- Users may only set the UTC offset; versions and entries come from the trigger
+REVOKE INSERT, UPDATE ON public.device_schedules FROM authenticated;
+GRANT INSERT (device_id, utc_offset_minutes), UPDATE (utc_offset_minutes)
+    ON public.device_schedules TO authenticated;
+
+-- Create or update the RLS policies for the schedule tables
+ALTER TABLE public.irrigation_schedules ENABLE ROW LEVEL SECURITY;
+ALTER TABLE public.device_schedules ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users can manage the schedules of their own devices
+CREATE POLICY "Users can manage their own irrigation schedules"
+    ON public.irrigation_schedules
+    FOR ALL
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = irrigation_schedules.device_id
+            AND devices.user_id = auth.uid()
+        )
+    )
+    WITH CHECK (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = irrigation_schedules.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users (and their devices) can view their own compiled schedules
+CREATE POLICY "Users can view their own device schedules"
+    ON public.device_schedules
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_schedules.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users can set the UTC offset of their own devices
+CREATE POLICY "Users can set their own device schedule offset"
+    ON public.device_schedules
+    FOR INSERT
+    WITH CHECK (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_schedules.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+CREATE POLICY "Users can update their own device schedule offset"
+    ON public.device_schedules
+    FOR UPDATE
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = device_schedules.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can manage all irrigation schedules
+CREATE POLICY "Admin users can manage all irrigation schedules"
+    ON public.irrigation_schedules
+    FOR ALL
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+-- Policy: Admin users can view all device schedules
+CREATE POLICY "Admin users can view all device schedules"
+    ON public.device_schedules
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
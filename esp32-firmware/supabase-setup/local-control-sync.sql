@@ -0,0 +1,61 @@
+-- IriQ Smart Irrigation System - Local Control Sync
+-- This script records pump/mode changes made through the device's LAN API
+-- (local_api.cpp). The device applies them immediately, even with no route
+-- to Supabase, and reports each one later through record_local_control().
+--
+-- A local action is stored as an already executed command, dated back to
+-- when it happened. The supersede trigger then closes every pending command
+-- created before it, so the newest action wins whichever side issued it: a
+-- dashboard command sent after the local change still reaches the device.
+--
+-- The device calls it with its device token (the owner's JWT), and only for
+-- a device that user owns; a recorded action closes the owner's pending
+-- commands, so nobody else may record one.
+--
+-- Run after control-commands-supersede.sql.
+
+-- Tell dashboard commands apart from actions taken on the LAN
+ALTER TABLE public.control_commands ADD COLUMN IF NOT EXISTS source TEXT NOT NULL DEFAULT 'dashboard';
+
+-- Create function to record a local action
+-- p_age_ms: how long ago the action happened, by the device's clock
+CREATE OR REPLACE FUNCTION record_local_control(
+    p_device_id TEXT,
+    p_pump_control BOOLEAN,
+    p_automatic_mode BOOLEAN,
+    p_age_ms BIGINT DEFAULT 0
+)
+RETURNS UUID AS $$
+DECLARE
+    device_record RECORD;
+    occurred TIMESTAMP WITH TIME ZONE;
+    command_id UUID;
+BEGIN
+    SELECT * INTO device_record FROM public.devices
+    WHERE devices.device_id = p_device_id
+      AND (devices.user_id = auth.uid() OR EXISTS (
+          SELECT 1 FROM public.profiles
+          WHERE profiles.id = auth.uid()
+          AND profiles.role = 'admin'
+      ));
+
+    IF device_record IS NULL THEN
+        RAISE EXCEPTION 'Device not authorized';
+    END IF;
+
+    -- Clamp the age so a bad clock cannot rewrite old history
+    occurred := now() - make_interval(secs => LEAST(GREATEST(p_age_ms, 0), 7 * 24 * 3600 * 1000) / 1000.0);
+
+    INSERT INTO public.control_commands
+        (device_id, user_id, pump_control, automatic_mode, executed, executed_at, created_at, source)
+    VALUES
+        (p_device_id, device_record.user_id, p_pump_control, p_automatic_mode, TRUE, occurred, occurred, 'local')
+    RETURNING id INTO command_id;
+
+    RETURN command_id;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- Devices call this with their device token, never the anon key
+REVOKE ALL ON FUNCTION record_local_control(TEXT, BOOLEAN, BOOLEAN, BIGINT) FROM PUBLIC, anon;
+GRANT EXECUTE ON FUNCTION record_local_control(TEXT, BOOLEAN, BOOLEAN, BIGINT) TO authenticated;
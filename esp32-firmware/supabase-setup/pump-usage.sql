@@ -0,0 +1,146 @@
+-- IriQ Smart Irrigation System - Pump Usage
+-- This script stores the pump runtime and water usage metered on the device
+-- (metering.cpp): one row per irrigation event and one per device per UTC
+-- day. Usage reports read these tables by primary key or index instead of
+-- deriving runtime from the device_status history.
+--
+-- The device sends everything it has not uploaded yet through
+-- record_pump_usage(). Events are keyed by a per-device sequence number and
+-- day rows carry absolute totals, so a report re-sent after a lost response
+-- changes nothing. It is called with the device token (the owner's JWT)
+-- and only accepts reports for a device that user owns.
+--
+-- Run after database-setup.sql.
+
+-- Create pump_usage_events table, one row per pump run
+CREATE TABLE IF NOT EXISTS public.pump_usage_events (
+    device_id TEXT NOT NULL REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    sequence BIGINT NOT NULL,
+    started_at TIMESTAMP WITH TIME ZONE NOT NULL,
+    duration_ms BIGINT NOT NULL,
+    volume_ml BIGINT NOT NULL DEFAULT 0,
+    automatic BOOLEAN NOT NULL DEFAULT FALSE,
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    PRIMARY KEY (device_id, sequence)
+);
+
+-- Add comment to the pump_usage_events table
+COMMENT ON TABLE public.pump_usage_events IS 'Irrigation events metered by the ESP32 firmware';
+
+-- Event lists for a device over a time range, newest first
+CREATE INDEX IF NOT EXISTS pump_usage_events_device_started_idx
+    ON public.pump_usage_events (device_id, started_at DESC);
+
+-- Create pump_usage_daily table, one row per device per UTC day
+CREATE TABLE IF NOT EXISTS public.pump_usage_daily (
+    device_id TEXT NOT NULL REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    day DATE NOT NULL,
+    runtime_ms BIGINT NOT NULL DEFAULT 0,
+    volume_ml BIGINT NOT NULL DEFAULT 0,
+    events INTEGER NOT NULL DEFAULT 0,
+    updated_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    PRIMARY KEY (device_id, day)
+);
+
+-- Add comment to the pump_usage_daily table
+COMMENT ON TABLE public.pump_usage_daily IS 'Daily pump runtime and water usage metered by the ESP32 firmware';
+
+-- Create function to record a usage report
+-- p_days: [{day, runtime_ms, volume_ml, events}], absolute totals per day
+-- p_events: [{sequence, started_at (epoch seconds, optional), duration_ms, volume_ml, automatic}]
+CREATE OR REPLACE FUNCTION record_pump_usage(
+    p_device_id TEXT,
+    p_days JSONB DEFAULT '[]'::JSONB,
+    p_events JSONB DEFAULT '[]'::JSONB
+)
+RETURNS VOID AS $$
+BEGIN
+    IF NOT EXISTS (
+        SELECT 1 FROM public.devices
+        WHERE devices.device_id = p_device_id
+          AND (devices.user_id = auth.uid() OR EXISTS (
+              SELECT 1 FROM public.profiles
+              WHERE profiles.id = auth.uid()
+              AND profiles.role = 'admin'
+          ))
+    ) THEN
+        RAISE EXCEPTION 'Device not authorized';
+    END IF;
+
+    -- Totals only grow within a day, so a stale or repeated report cannot lower them
+    INSERT INTO public.pump_usage_daily (device_id, day, runtime_ms, volume_ml, events)
+    SELECT p_device_id, (d->>'day')::DATE, (d->>'runtime_ms')::BIGINT, (d->>'volume_ml')::BIGINT,
+           (d->>'events')::INTEGER
+    FROM jsonb_array_elements(p_days) AS d
+    ON CONFLICT (device_id, day) DO UPDATE SET
+        runtime_ms = GREATEST(pump_usage_daily.runtime_ms, EXCLUDED.runtime_ms),
+        volume_ml = GREATEST(pump_usage_daily.volume_ml, EXCLUDED.volume_ml),
+        events = GREATEST(pump_usage_daily.events, EXCLUDED.events),
+        updated_at = now();
+
+    -- An event without a start time ran before the device clock was set;
+    -- it ended at most a report interval ago
+    INSERT INTO public.pump_usage_events (device_id, sequence, started_at, duration_ms, volume_ml, automatic)
+    SELECT p_device_id, (e->>'sequence')::BIGINT,
+           coalesce(to_timestamp((e->>'started_at')::BIGINT),
+                    now() - make_interval(secs => (e->>'duration_ms')::BIGINT / 1000.0)),
+           (e->>'duration_ms')::BIGINT, coalesce((e->>'volume_ml')::BIGINT, 0),
+           coalesce((e->>'automatic')::BOOLEAN, FALSE)
+    FROM jsonb_array_elements(p_events) AS e
+    ON CONFLICT (device_id, sequence) DO NOTHING;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER SET search_path = public;
+
+-- Devices call this with their device token, never the anon key
+REVOKE ALL ON FUNCTION record_pump_usage(TEXT, JSONB, JSONB) FROM PUBLIC, anon;
+GRANT EXECUTE ON FUNCTION record_pump_usage(TEXT, JSONB, JSONB) TO authenticated;
+
+-- Create or update the RLS policies for the usage tables
+ALTER TABLE public.pump_usage_events ENABLE ROW LEVEL SECURITY;
+ALTER TABLE public.pump_usage_daily ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users can view their own pump usage events
+CREATE POLICY "Users can view their own pump usage events"
+    ON public.pump_usage_events
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = pump_usage_events.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Users can view their own daily pump usage
+CREATE POLICY "Users can view their own daily pump usage"
+    ON public.pump_usage_daily
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = pump_usage_daily.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can view all pump usage events
+CREATE POLICY "Admin users can view all pump usage events"
+    ON public.pump_usage_events
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+-- Policy: Admin users can view all daily pump usage
+CREATE POLICY "Admin users can view all daily pump usage"
+    ON public.pump_usage_daily
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
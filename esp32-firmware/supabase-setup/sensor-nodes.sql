@@ -0,0 +1,13 @@
+-- IriQ Smart Irrigation System - Sensor Nodes
+-- This script adds the column a gateway controller (ESPNOW_GATEWAY_ENABLED)
+-- stores the time it heard each sensor node reading in.
+--
+-- created_at stays the time the row arrived, stamped by the database: the
+-- rollups advance their watermark on it, so a backdated row would be skipped.
+--
+-- Run after database-setup.sql (and sensor-readings-partitioning.sql if used).
+
+-- Time the gateway heard the reading; NULL for readings sent directly
+ALTER TABLE public.sensor_readings ADD COLUMN IF NOT EXISTS heard_at TIMESTAMP WITH TIME ZONE;
+
+COMMENT ON COLUMN public.sensor_readings.heard_at IS 'Time a gateway controller heard a sensor node reading; created_at is when it was stored';
@@ -0,0 +1,106 @@
+-- IriQ Smart Irrigation System - Sensor Readings Downsampling
+-- This script creates an RPC that returns a chart-ready moisture series with a
+-- fixed number of points for any time range, so the payload sent to the
+-- browser stays constant however many readings the range contains.
+--
+-- Points are picked with Largest-Triangle-Three-Buckets (LTTB): the first
+-- and last readings are kept, the rest are split into equal buckets, and from
+-- each bucket the reading forming the largest triangle with the previously
+-- kept point and the next bucket's average is chosen. Unlike plain averaging
+-- this preserves peaks and dips (e.g. a watering cycle) in the chart.
+--
+-- Run after sensor-readings-partitioning.sql.
+
+-- Create function to downsample a device's readings in a time range
+CREATE OR REPLACE FUNCTION downsample_sensor_readings(
+    p_device_id TEXT,
+    p_from TIMESTAMP WITH TIME ZONE,
+    p_to TIMESTAMP WITH TIME ZONE,
+    p_points INTEGER DEFAULT 500
+)
+RETURNS TABLE (created_at TIMESTAMP WITH TIME ZONE, moisture_percentage NUMERIC) AS $$
+DECLARE
+    times TIMESTAMP WITH TIME ZONE[];
+    xs DOUBLE PRECISION[];
+    ys DOUBLE PRECISION[];
+    n INTEGER;
+    every DOUBLE PRECISION;
+    a INTEGER := 1;
+    next_a INTEGER;
+    avg_start INTEGER;
+    avg_end INTEGER;
+    avg_x DOUBLE PRECISION;
+    avg_y DOUBLE PRECISION;
+    range_start INTEGER;
+    range_end INTEGER;
+    area DOUBLE PRECISION;
+    max_area DOUBLE PRECISION;
+BEGIN
+    -- Served by the (device_id, created_at DESC) index, read backwards
+    SELECT array_agg(r.created_at ORDER BY r.created_at),
+           array_agg(extract(EPOCH FROM r.created_at)::DOUBLE PRECISION ORDER BY r.created_at),
+           array_agg(r.moisture_percentage::DOUBLE PRECISION ORDER BY r.created_at)
+    INTO times, xs, ys
+    FROM public.sensor_readings r
+    WHERE r.device_id = p_device_id
+      AND r.created_at >= p_from
+      AND r.created_at <= p_to;
+
+    n := coalesce(array_length(times, 1), 0);
+
+    -- Nothing to reduce
+    IF n <= p_points OR p_points < 3 THEN
+        RETURN QUERY SELECT t, round(y::NUMERIC, 2) FROM unnest(times, ys) AS u(t, y);
+        RETURN;
+    END IF;
+
+    every := (n - 2)::DOUBLE PRECISION / (p_points - 2);
+
+    created_at := times[1];
+    moisture_percentage := round(ys[1]::NUMERIC, 2);
+    RETURN NEXT;
+
+    FOR i IN 0..p_points - 3 LOOP
+        -- Average of the next bucket (the last bucket looks ahead to the final reading)
+        avg_start := floor((i + 1) * every)::INTEGER + 2;
+        avg_end := least(floor((i + 2) * every)::INTEGER + 2, n + 1);
+        avg_x := 0;
+        avg_y := 0;
+        FOR j IN avg_start..avg_end - 1 LOOP
+            avg_x := avg_x + xs[j];
+            avg_y := avg_y + ys[j];
+        END LOOP;
+        avg_x := avg_x / (avg_end - avg_start);
+        avg_y := avg_y / (avg_end - avg_start);
+
+        -- Reading in the current bucket with the largest triangle
+        range_start := floor(i * every)::INTEGER + 2;
+        range_end := floor((i + 1) * every)::INTEGER + 2;
+        max_area := -1;
+        FOR j IN range_start..range_end - 1 LOOP
+            area := abs((xs[a] - avg_x) * (ys[j] - ys[a]) - (xs[a] - xs[j]) * (avg_y - ys[a]));
+            IF area > max_area THEN
+                max_area := area;
+                next_a := j;
+            END IF;
+        END LOOP;
+
+        created_at := times[next_a];
+        moisture_percentage := round(ys[next_a]::NUMERIC, 2);
+        RETURN NEXT;
+        a := next_a;
+    END LOOP;
+
+    created_at := times[n];
+    moisture_percentage := round(ys[n]::NUMERIC, 2);
+    RETURN NEXT;
+END;
+$$ LANGUAGE plpgsql STABLE SECURITY INVOKER;
+
+-- Add comment to the downsampling function
+COMMENT ON FUNCTION downsample_sensor_readings(TEXT, TIMESTAMP WITH TIME ZONE, TIMESTAMP WITH TIME ZONE, INTEGER)
+    IS 'Returns at most p_points readings for a device and time range, chosen with LTTB';
+
+-- Runs with the caller's rights, so the sensor_readings RLS policies still apply
+GRANT EXECUTE ON FUNCTION downsample_sensor_readings(TEXT, TIMESTAMP WITH TIME ZONE, TIMESTAMP WITH TIME ZONE, INTEGER)
+    TO authenticated;
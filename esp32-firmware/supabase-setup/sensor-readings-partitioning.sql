@@ -0,0 +1,226 @@
+-- IriQ Smart Irrigation System - Sensor Readings Partitioning
+-- This script converts sensor_readings into a table partitioned by month,
+-- adds the indexes the dashboard queries need and a retention job.
+--
+-- At one reading every 3 seconds a device writes ~28.8k rows per day. Every
+-- dashboard query filters on device_id and orders by created_at, so:
+-- - (device_id, created_at DESC) serves "latest reading" and per-device ranges
+-- - BRIN on created_at keeps time-range scans cheap at a fraction of the size
+-- - Monthly partitions let retention drop whole months instead of DELETEing rows
+--
+-- Run once after database-setup.sql. Existing rows are copied into the new table.
+
+BEGIN;
+
+-- Create the partitioned table alongside the existing one
+-- (the primary key must include the partition key)
+CREATE TABLE IF NOT EXISTS public.sensor_readings_partitioned (
+    id UUID NOT NULL DEFAULT uuid_generate_v4(),
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    device_id TEXT NOT NULL,
+    moisture_percentage NUMERIC NOT NULL,
+    moisture_digital BOOLEAN NOT NULL,
+    PRIMARY KEY (id, created_at)
+) PARTITION BY RANGE (created_at);
+
+-- Catch-all for rows outside the prepared months, so inserts never fail;
+-- create_sensor_readings_partition moves a month's rows out when it creates it
+CREATE TABLE IF NOT EXISTS public.sensor_readings_default
+    PARTITION OF public.sensor_readings_partitioned DEFAULT;
+
+-- Create function to create the partition holding a given month
+CREATE OR REPLACE FUNCTION create_sensor_readings_partition(target_month DATE)
+RETURNS TEXT AS $$
+DECLARE
+    partition_start DATE := date_trunc('month', target_month)::DATE;
+    partition_end DATE := (date_trunc('month', target_month) + INTERVAL '1 month')::DATE;
+    partition_name TEXT := 'sensor_readings_' || to_char(partition_start, 'YYYY_MM');
+    parent_name TEXT;
+BEGIN
+    -- Before the swap below the parent still has its temporary name
+    SELECT CASE WHEN to_regclass('public.sensor_readings_partitioned') IS NOT NULL
+                THEN 'sensor_readings_partitioned' ELSE 'sensor_readings' END
+    INTO parent_name;
+
+    IF to_regclass('public.' || partition_name) IS NULL THEN
+        -- The default partition may already hold rows of this month, which
+        -- would make the new partition fail; move them into it first. The
+        -- function runs in one transaction, so no row is lost or seen twice.
+        EXECUTE format(
+            'CREATE TABLE public.%I (LIKE public.%I INCLUDING DEFAULTS INCLUDING CONSTRAINTS)',
+            partition_name, parent_name
+        );
+        IF to_regclass('public.sensor_readings_default') IS NOT NULL THEN
+            -- Attaching locks it anyway; locking first keeps new rows of
+            -- this month from landing there after the move
+            LOCK TABLE public.sensor_readings_default IN ACCESS EXCLUSIVE MODE;
+            EXECUTE format(
+                'WITH moved AS ('
+                '    DELETE FROM public.sensor_readings_default WHERE created_at >= %L AND created_at < %L RETURNING *'
+                ') INSERT INTO public.%I SELECT * FROM moved',
+                partition_start, partition_end, partition_name
+            );
+        END IF;
+        -- Attaching creates the partition's indexes from the parent's
+        EXECUTE format(
+            'ALTER TABLE public.%I ATTACH PARTITION public.%I FOR VALUES FROM (%L) TO (%L)',
+            parent_name, partition_name, partition_start, partition_end
+        );
+    END IF;
+
+    RETURN partition_name;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+-- Create function to prepare the current and upcoming months
+CREATE OR REPLACE FUNCTION ensure_sensor_readings_partitions(months_ahead INTEGER DEFAULT 2)
+RETURNS VOID AS $$
+BEGIN
+    FOR i IN 0..months_ahead LOOP
+        PERFORM create_sensor_readings_partition((now() + make_interval(months => i))::DATE);
+    END LOOP;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+-- Create function to drop partitions entirely older than the retention period
+CREATE OR REPLACE FUNCTION drop_old_sensor_readings_partitions(retention INTERVAL DEFAULT INTERVAL '12 months')
+RETURNS INTEGER AS $$
+DECLARE
+    part RECORD;
+    cutoff DATE := date_trunc('month', now() - retention)::DATE;
+    dropped INTEGER := 0;
+BEGIN
+    FOR part IN
+        SELECT child.relname
+        FROM pg_inherits
+        JOIN pg_class parent ON parent.oid = pg_inherits.inhparent
+        JOIN pg_class child ON child.oid = pg_inherits.inhrelid
+        WHERE parent.relname = 'sensor_readings'
+          AND child.relname ~ '^sensor_readings_[0-9]{4}_[0-9]{2}$'
+    LOOP
+        -- A partition named for month M holds [M, M + 1 month)
+        IF (to_date(substring(part.relname FROM '[0-9]{4}_[0-9]{2}$'), 'YYYY_MM') + INTERVAL '1 month') <= cutoff THEN
+            EXECUTE format('DROP TABLE public.%I', part.relname);
+            dropped := dropped + 1;
+        END IF;
+    END LOOP;
+
+    RETURN dropped;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+-- Prepare partitions covering the existing data and the coming months
+DO $$
+DECLARE
+    oldest TIMESTAMP WITH TIME ZONE;
+    current_month DATE;
+BEGIN
+    IF to_regclass('public.sensor_readings') IS NOT NULL THEN
+        SELECT min(created_at) INTO oldest FROM public.sensor_readings;
+    END IF;
+
+    current_month := date_trunc('month', coalesce(oldest, now()))::DATE;
+    WHILE current_month <= now() LOOP
+        PERFORM create_sensor_readings_partition(current_month);
+        current_month := (current_month + INTERVAL '1 month')::DATE;
+    END LOOP;
+
+    PERFORM ensure_sensor_readings_partitions();
+END;
+$$;
+
+-- Indexes are declared on the parent and created on every partition
+CREATE INDEX IF NOT EXISTS sensor_readings_device_created_idx
+    ON public.sensor_readings_partitioned (device_id, created_at DESC);
+CREATE INDEX IF NOT EXISTS sensor_readings_created_brin_idx
+    ON public.sensor_readings_partitioned USING BRIN (created_at) WITH (pages_per_range = 32);
+
+-- Copy existing rows and swap the tables
+DO $$
+BEGIN
+    IF to_regclass('public.sensor_readings') IS NOT NULL THEN
+        INSERT INTO public.sensor_readings_partitioned (id, created_at, device_id, moisture_percentage, moisture_digital)
+        SELECT id, created_at, device_id::TEXT, moisture_percentage, moisture_digital
+        FROM public.sensor_readings;
+
+        ALTER TABLE public.sensor_readings RENAME TO sensor_readings_unpartitioned;
+    END IF;
+END;
+$$;
+
+ALTER TABLE public.sensor_readings_partitioned RENAME TO sensor_readings;
+
+-- Add comment to the sensor_readings table
+COMMENT ON TABLE public.sensor_readings IS 'Moisture readings from ESP32 devices, partitioned by month of created_at';
+
+-- Create or update the RLS policies for the sensor_readings table
+ALTER TABLE public.sensor_readings ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users can view their own sensor readings
+CREATE POLICY "Users can view their own sensor readings"
+    ON public.sensor_readings
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = sensor_readings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Devices can insert their own readings
+CREATE POLICY "Devices can insert their own readings"
+    ON public.sensor_readings
+    FOR INSERT
+    WITH CHECK (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = sensor_readings.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can view all sensor readings
+CREATE POLICY "Admin users can view all sensor readings"
+    ON public.sensor_readings
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+COMMIT;
+
+-- Realtime: publish partition changes under the parent table name so the
+-- dashboard's 'sensor_readings' subscriptions keep working
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_publication WHERE pubname = 'supabase_realtime') THEN
+        ALTER PUBLICATION supabase_realtime SET (publish_via_partition_root = true);
+        IF NOT EXISTS (
+            SELECT 1 FROM pg_publication_tables
+            WHERE pubname = 'supabase_realtime' AND tablename = 'sensor_readings'
+        ) THEN
+            ALTER PUBLICATION supabase_realtime ADD TABLE public.sensor_readings;
+        END IF;
+    END IF;
+END;
+$$;
+
+-- Schedule partition maintenance if pg_cron is enabled
+-- (otherwise call these two functions from any external scheduler)
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_cron') THEN
+        PERFORM cron.schedule('sensor-readings-partitions', '0 3 * * *',
+                              'SELECT ensure_sensor_readings_partitions()');
+        PERFORM cron.schedule('sensor-readings-retention', '30 3 * * *',
+                              'SELECT drop_old_sensor_readings_partitions(INTERVAL ''12 months'')');
+    END IF;
+END;
+$$;
+
+-- After verifying the migration, the old table can be removed:
+-- DROP TABLE public.sensor_readings_unpartitioned;
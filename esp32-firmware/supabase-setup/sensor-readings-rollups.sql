@@ -0,0 +1,199 @@
+-- IriQ Smart Irrigation System - Sensor Readings Rollups
+-- This script creates hourly and daily rollups of sensor_readings so history
+-- charts over days or weeks read a few hundred rows instead of every reading.
+--
+-- Rollups are maintained incrementally: refresh_sensor_readings_rollups()
+-- aggregates only the readings that arrived since its last run (tracked by a
+-- watermark) and merges them into the existing buckets. It is scheduled every
+-- minute with pg_cron when available.
+--
+-- Run after sensor-readings-partitioning.sql.
+
+-- Pump state at the time of each reading, reported by the firmware and used
+-- for pump-on time
+ALTER TABLE public.sensor_readings ADD COLUMN IF NOT EXISTS pump_status BOOLEAN;
+
+-- Create hourly rollup table
+CREATE TABLE IF NOT EXISTS public.sensor_readings_hourly (
+    device_id TEXT NOT NULL,
+    bucket TIMESTAMP WITH TIME ZONE NOT NULL,
+    moisture_min NUMERIC NOT NULL,
+    moisture_max NUMERIC NOT NULL,
+    moisture_sum NUMERIC NOT NULL,
+    reading_count INTEGER NOT NULL,
+    moisture_avg NUMERIC GENERATED ALWAYS AS (round(moisture_sum / NULLIF(reading_count, 0), 2)) STORED,
+    pump_on_seconds INTEGER NOT NULL DEFAULT 0,
+    PRIMARY KEY (device_id, bucket)
+);
+
+-- Create daily rollup table (days are UTC)
+CREATE TABLE IF NOT EXISTS public.sensor_readings_daily (
+    device_id TEXT NOT NULL,
+    bucket TIMESTAMP WITH TIME ZONE NOT NULL,
+    moisture_min NUMERIC NOT NULL,
+    moisture_max NUMERIC NOT NULL,
+    moisture_sum NUMERIC NOT NULL,
+    reading_count INTEGER NOT NULL,
+    moisture_avg NUMERIC GENERATED ALWAYS AS (round(moisture_sum / NULLIF(reading_count, 0), 2)) STORED,
+    pump_on_seconds INTEGER NOT NULL DEFAULT 0,
+    PRIMARY KEY (device_id, bucket)
+);
+
+-- Add comments to the rollup tables
+COMMENT ON TABLE public.sensor_readings_hourly IS 'Hourly moisture min/max/avg/count and pump-on time per device';
+COMMENT ON TABLE public.sensor_readings_daily IS 'Daily (UTC) moisture min/max/avg/count and pump-on time per device';
+
+-- Create watermark table tracking how far the rollups have been refreshed
+CREATE TABLE IF NOT EXISTS public.sensor_readings_rollup_state (
+    id BOOLEAN PRIMARY KEY DEFAULT TRUE CHECK (id),
+    processed_until TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT '-infinity'
+);
+
+INSERT INTO public.sensor_readings_rollup_state (id) VALUES (TRUE) ON CONFLICT DO NOTHING;
+
+-- Create function to merge new readings into the rollups.
+-- Readings newer than now() - settle are left for the next run so rows from
+-- transactions still in flight are not skipped. Pump-on time credits the gap
+-- since the previous reading (capped at max_gap) when the pump was on then.
+CREATE OR REPLACE FUNCTION refresh_sensor_readings_rollups(
+    settle INTERVAL DEFAULT INTERVAL '10 seconds',
+    max_gap INTERVAL DEFAULT INTERVAL '60 seconds'
+)
+RETURNS INTEGER AS $$
+DECLARE
+    range_start TIMESTAMP WITH TIME ZONE;
+    range_end TIMESTAMP WITH TIME ZONE := now() - settle;
+    merged INTEGER;
+BEGIN
+    -- Serialize concurrent refreshes on the watermark row
+    SELECT processed_until INTO range_start
+    FROM public.sensor_readings_rollup_state
+    WHERE id
+    FOR UPDATE;
+
+    IF range_start >= range_end THEN
+        RETURN 0;
+    END IF;
+
+    CREATE TEMPORARY TABLE rollup_delta ON COMMIT DROP AS
+    WITH readings AS (
+        -- Include max_gap of history so the first new reading knows its predecessor
+        SELECT device_id,
+               created_at,
+               moisture_percentage,
+               lag(created_at) OVER w AS previous_at,
+               lag(pump_status) OVER w AS previous_pump_status
+        FROM public.sensor_readings
+        WHERE created_at > range_start - max_gap
+          AND created_at <= range_end
+        WINDOW w AS (PARTITION BY device_id ORDER BY created_at)
+    )
+    SELECT device_id,
+           date_trunc('hour', created_at AT TIME ZONE 'UTC') AT TIME ZONE 'UTC' AS bucket,
+           min(moisture_percentage) AS moisture_min,
+           max(moisture_percentage) AS moisture_max,
+           sum(moisture_percentage) AS moisture_sum,
+           count(*)::INTEGER AS reading_count,
+           coalesce(sum(extract(EPOCH FROM least(created_at - previous_at, max_gap)))
+                    FILTER (WHERE previous_pump_status), 0)::INTEGER AS pump_on_seconds
+    FROM readings
+    WHERE created_at > range_start
+    GROUP BY 1, 2;
+
+    INSERT INTO public.sensor_readings_hourly AS h
+        (device_id, bucket, moisture_min, moisture_max, moisture_sum, reading_count, pump_on_seconds)
+    SELECT device_id, bucket, moisture_min, moisture_max, moisture_sum, reading_count, pump_on_seconds
+    FROM rollup_delta
+    ON CONFLICT (device_id, bucket) DO UPDATE SET
+        moisture_min = least(h.moisture_min, EXCLUDED.moisture_min),
+        moisture_max = greatest(h.moisture_max, EXCLUDED.moisture_max),
+        moisture_sum = h.moisture_sum + EXCLUDED.moisture_sum,
+        reading_count = h.reading_count + EXCLUDED.reading_count,
+        pump_on_seconds = h.pump_on_seconds + EXCLUDED.pump_on_seconds;
+
+    GET DIAGNOSTICS merged = ROW_COUNT;
+
+    INSERT INTO public.sensor_readings_daily AS d
+        (device_id, bucket, moisture_min, moisture_max, moisture_sum, reading_count, pump_on_seconds)
+    SELECT device_id,
+           date_trunc('day', bucket AT TIME ZONE 'UTC') AT TIME ZONE 'UTC',
+           min(moisture_min), max(moisture_max), sum(moisture_sum), sum(reading_count), sum(pump_on_seconds)
+    FROM rollup_delta
+    GROUP BY 1, 2
+    ON CONFLICT (device_id, bucket) DO UPDATE SET
+        moisture_min = least(d.moisture_min, EXCLUDED.moisture_min),
+        moisture_max = greatest(d.moisture_max, EXCLUDED.moisture_max),
+        moisture_sum = d.moisture_sum + EXCLUDED.moisture_sum,
+        reading_count = d.reading_count + EXCLUDED.reading_count,
+        pump_on_seconds = d.pump_on_seconds + EXCLUDED.pump_on_seconds;
+
+    UPDATE public.sensor_readings_rollup_state SET processed_until = range_end WHERE id;
+
+    DROP TABLE rollup_delta;
+    RETURN merged;
+END;
+$$ LANGUAGE plpgsql SECURITY DEFINER;
+
+-- Backfill the rollups from the existing readings
+SELECT refresh_sensor_readings_rollups();
+
+-- Create or update the RLS policies for the rollup tables
+ALTER TABLE public.sensor_readings_hourly ENABLE ROW LEVEL SECURITY;
+ALTER TABLE public.sensor_readings_daily ENABLE ROW LEVEL SECURITY;
+ALTER TABLE public.sensor_readings_rollup_state ENABLE ROW LEVEL SECURITY;
+
+-- Policy: Users can view their own hourly rollups
+CREATE POLICY "Users can view their own hourly rollups"
+    ON public.sensor_readings_hourly
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = sensor_readings_hourly.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can view all hourly rollups
+CREATE POLICY "Admin users can view all hourly rollups"
+    ON public.sensor_readings_hourly
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+-- Policy: Users can view their own daily rollups
+CREATE POLICY "Users can view their own daily rollups"
+    ON public.sensor_readings_daily
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.devices
+            WHERE devices.device_id = sensor_readings_daily.device_id
+            AND devices.user_id = auth.uid()
+        )
+    );
+
+-- Policy: Admin users can view all daily rollups
+CREATE POLICY "Admin users can view all daily rollups"
+    ON public.sensor_readings_daily
+    FOR SELECT
+    USING (
+        EXISTS (
+            SELECT 1 FROM public.profiles
+            WHERE profiles.id = auth.uid() AND profiles.role = 'admin'
+        )
+    );
+
+-- Schedule the incremental refresh if pg_cron is enabled
+DO $$
+BEGIN
+    IF EXISTS (SELECT 1 FROM pg_extension WHERE extname = 'pg_cron') THEN
+        PERFORM cron.schedule('sensor-readings-rollups', '* * * * *',
+                              'SELECT refresh_sensor_readings_rollups()');
+    END IF;
+END;
+$$;
@@ -0,0 +1,131 @@
+-- IriQ Smart Irrigation System - Ingestion Gateway Local Schema
+-- This script creates the subset of the Supabase schema the gateway writes,
+-- without the auth schema, RLS or realtime, for load testing against a
+-- plain Postgres container. Production uses the supabase-setup scripts.
+
+CREATE TABLE IF NOT EXISTS public.devices (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    device_id TEXT NOT NULL UNIQUE,
+    device_name TEXT NOT NULL,
+    device_type TEXT NOT NULL,
+    user_id UUID,
+    created_at TIMESTAMP WITH TIME ZONE DEFAULT now(),
+    updated_at TIMESTAMP WITH TIME ZONE DEFAULT now()
+);
+
+CREATE TABLE IF NOT EXISTS public.sensor_readings (
+    id UUID NOT NULL DEFAULT gen_random_uuid(),
+    device_id TEXT NOT NULL,
+    moisture_percentage DOUBLE PRECISION NOT NULL,
+    moisture_digital BOOLEAN,
+    pump_status BOOLEAN,
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    heard_at TIMESTAMP WITH TIME ZONE
+);
+
+CREATE INDEX IF NOT EXISTS sensor_readings_device_created_idx
+    ON public.sensor_readings (device_id, created_at DESC);
+
+CREATE TABLE IF NOT EXISTS public.device_status (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    device_id TEXT NOT NULL UNIQUE,
+    pump_status BOOLEAN NOT NULL DEFAULT FALSE,
+    automatic_mode BOOLEAN NOT NULL DEFAULT TRUE,
+    updated_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    user_id UUID NOT NULL
+);
+
+CREATE TABLE IF NOT EXISTS public.device_heartbeats (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    device_id TEXT NOT NULL,
+    last_seen TIMESTAMP WITH TIME ZONE DEFAULT now(),
+    status TEXT DEFAULT 'online',
+    ip_address TEXT,
+    firmware_version TEXT,
+    metrics JSONB
+);
+
+CREATE TABLE IF NOT EXISTS public.device_presence (
+    device_id TEXT PRIMARY KEY REFERENCES public.devices(device_id) ON DELETE CASCADE,
+    last_seen TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    status TEXT NOT NULL DEFAULT 'online',
+    ip_address TEXT,
+    firmware_version TEXT,
+    metrics JSONB,
+    history_sampled_at TIMESTAMP WITH TIME ZONE
+);
+
+-- Same sampling trigger as supabase-setup/device-presence.sql
+CREATE OR REPLACE FUNCTION record_device_presence()
+RETURNS TRIGGER AS $$
+DECLARE
+    sample_interval CONSTANT INTERVAL := INTERVAL '5 minutes';
+BEGIN
+    NEW.last_seen := now();
+
+    IF TG_OP = 'INSERT' THEN
+        NEW.history_sampled_at := NULL;
+    ELSIF NEW.status IS DISTINCT FROM OLD.status
+       OR NEW.metrics IS DISTINCT FROM OLD.metrics
+       OR OLD.history_sampled_at IS NULL
+       OR NEW.last_seen - OLD.history_sampled_at >= sample_interval THEN
+        INSERT INTO public.device_heartbeats (device_id, last_seen, status, ip_address, firmware_version, metrics)
+        VALUES (NEW.device_id, NEW.last_seen, NEW.status, NEW.ip_address, NEW.firmware_version, NEW.metrics);
+        NEW.history_sampled_at := NEW.last_seen;
+    END IF;
+
+    RETURN NEW;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS device_presence_record ON public.device_presence;
+CREATE TRIGGER device_presence_record
+    BEFORE INSERT OR UPDATE ON public.device_presence
+    FOR EACH ROW EXECUTE FUNCTION record_device_presence();
+
+CREATE TABLE IF NOT EXISTS public.control_commands (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    created_at TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT now(),
+    device_id TEXT NOT NULL,
+    pump_control BOOLEAN NOT NULL,
+    automatic_mode BOOLEAN NOT NULL DEFAULT TRUE,
+    user_id UUID,
+    executed BOOLEAN NOT NULL DEFAULT FALSE,
+    executed_at TIMESTAMP WITH TIME ZONE,
+    superseded_by UUID,
+    source TEXT NOT NULL DEFAULT 'dashboard'
+);
+
+CREATE INDEX IF NOT EXISTS control_commands_pending_idx
+    ON public.control_commands (device_id, created_at)
+    WHERE NOT executed;
+
+-- Wake the MQTT bridge when a command is queued (see supabase-setup/control-commands-notify.sql)
+CREATE OR REPLACE FUNCTION notify_control_command()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM pg_notify('iriq_control_commands', NEW.device_id);
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS control_commands_notify ON public.control_commands;
+CREATE TRIGGER control_commands_notify
+    AFTER INSERT ON public.control_commands
+    FOR EACH ROW EXECUTE FUNCTION notify_control_command();
+
+CREATE TABLE IF NOT EXISTS public.device_auth_logs (
+    id UUID PRIMARY KEY DEFAULT gen_random_uuid(),
+    device_id TEXT NOT NULL,
+    user_id UUID,
+    success BOOLEAN NOT NULL,
+    ip_address TEXT,
+    user_agent TEXT,
+    created_at TIMESTAMP WITH TIME ZONE DEFAULT now()
+);
+
+-- Register the simulator's devices (sim-device-00001 ... sim-device-10000)
+INSERT INTO public.devices (device_id, device_name, device_type)
+SELECT 'sim-device-' || lpad(i::TEXT, 5, '0'), 'Simulated device ' || i, 'esp32'
+FROM generate_series(1, 10000) AS i
+ON CONFLICT (device_id) DO NOTHING;
@@ -0,0 +1,35 @@
+/*
+ * IriQ Smart Irrigation System - Gateway Configuration Header
+ *
+ * Header file for the ingestion gateway settings.
+ */
+
+#ifndef GATEWAY_CONFIG_H
+#define GATEWAY_CONFIG_H
+
+#include <string>
+
+struct GatewayConfig {
+  int port = 8080;                  // HTTP listen port
+  std::string databaseUrl;          // libpq connection string
+  std::string deviceKey;            // Key devices send as apikey / Bearer token
+  int workers = 4;                  // Request worker threads
+  int flushIntervalMs = 200;        // Maximum time a write waits before it is flushed
+  size_t flushBatchRows = 5000;     // Flush early once this many rows are queued
+  size_t maxQueuedRows = 200000;    // Writes beyond this are rejected with 503
+  int deviceRefreshSeconds = 60;    // How often the authorized device list is reloaded
+  int idleTimeoutSeconds = 120;     // Close keep-alive connections idle this long
+  std::string readKey;              // Key for GET /v1/latest; the route is off when empty
+  size_t cacheCapacity = 65536;     // Devices held in the latest-state cache
+  std::string mqttHost;             // Broker for the MQTT bridge; the bridge is off when empty
+  int mqttPort = 1883;
+  std::string mqttUsername;
+  std::string mqttPassword;
+  std::string mqttClientId = "iriq-gateway-bridge";  // Fixed, so the broker keeps the session
+  int presenceRefreshSeconds = 60;  // How often last_seen is refreshed for connected MQTT devices
+};
+
+// Read settings from IRIQ_GATEWAY_* environment variables
+GatewayConfig loadConfigFromEnvironment();
+
+#endif // GATEWAY_CONFIG_H
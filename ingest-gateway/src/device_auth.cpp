@@ -0,0 +1,142 @@
+/*
+ * IriQ Smart Irrigation System - Device Authentication
+ *
+ * The registered device ids and their users are cached in memory and
+ * reloaded from the devices table in the background, so authorizing a
+ * request never touches the database.
+ */
+
+#include "device_auth.h"
+
+#include <libpq-fe.h>
+
+#include <chrono>
+#include <cstdio>
+
+DeviceRegistry::DeviceRegistry(const GatewayConfig& config) : config_(config) {}
+
+DeviceRegistry::~DeviceRegistry() {
+  stop();
+}
+
+// Load the device list and start the periodic refresh
+bool DeviceRegistry::start() {
+  bool loaded = reload();
+  refreshThread_ = std::thread(&DeviceRegistry::refreshLoop, this);
+  return loaded;
+}
+
+void DeviceRegistry::stop() {
+  {
+    std::lock_guard<std::mutex> lock(stopMutex_);
+    stopping_ = true;
+  }
+  stopSignal_.notify_all();
+  if (refreshThread_.joinable()) {
+    refreshThread_.join();
+  }
+}
+
+bool DeviceRegistry::reload() {
+  PGconn* connection = PQconnectdb(config_.databaseUrl.c_str());
+  if (PQstatus(connection) != CONNECTION_OK) {
+    std::fprintf(stderr, "[registry] Connection failed: %s", PQerrorMessage(connection));
+    PQfinish(connection);
+    return false;
+  }
+
+  PGresult* result = PQexec(connection, "SELECT device_id, coalesce(user_id::TEXT, '') FROM public.devices");
+  bool ok = PQresultStatus(result) == PGRES_TUPLES_OK;
+  if (ok) {
+    std::unordered_map<std::string, std::string> devices;
+    int rows = PQntuples(result);
+    devices.reserve((size_t)rows);
+    for (int i = 0; i < rows; i++) {
+      devices.emplace(PQgetvalue(result, i, 0), PQgetvalue(result, i, 1));
+    }
+    std::unique_lock<std::shared_mutex> lock(devicesMutex_);
+    devices_.swap(devices);
+  } else {
+    std::fprintf(stderr, "[registry] Device query failed: %s", PQerrorMessage(connection));
+  }
+  PQclear(result);
+  PQfinish(connection);
+  return ok;
+}
+
+void DeviceRegistry::refreshLoop() {
+  std::unique_lock<std::mutex> lock(stopMutex_);
+  while (!stopping_) {
+    stopSignal_.wait_for(lock, std::chrono::seconds(config_.deviceRefreshSeconds));
+    if (stopping_) {
+      break;
+    }
+    lock.unlock();
+    reload();  // Keep the previous list if the reload fails
+    lock.lock();
+  }
+}
+
+// Compare without an early exit so timing does not reveal the key prefix
+bool constantTimeEquals(const std::string& a, const std::string& b) {
+  unsigned char difference = a.size() == b.size() ? 0 : 1;
+  for (size_t i = 0; i < a.size(); i++) {
+    difference |= (unsigned char)(a[i] ^ b[i % (b.empty() ? 1 : b.size())]);
+  }
+  return difference == 0 && !b.empty();
+}
+
+// Check the key once per connection
+AuthResult DeviceRegistry::authenticate(const HttpRequest& request, ConnectionContext& context) const {
+  if (context.authenticated) {
+    return AUTH_OK;
+  }
+
+  std::string key = request.header("apikey");
+  if (key.empty()) {
+    std::string authorization = request.header("authorization");
+    if (authorization.compare(0, 7, "Bearer ") == 0) {
+      key = authorization.substr(7);
+    }
+  }
+  if (key.empty()) {
+    return AUTH_MISSING_KEY;
+  }
+  if (!constantTimeEquals(key, config_.deviceKey)) {
+    return AUTH_BAD_KEY;
+  }
+
+  context.authenticated = true;
+  return AUTH_OK;
+}
+
+// Bind the connection to deviceId, or confirm it is the bound device or
+// another device of the same user
+AuthResult DeviceRegistry::authorizeDevice(const std::string& deviceId, ConnectionContext& context) const {
+  std::shared_lock<std::shared_mutex> lock(devicesMutex_);
+  auto device = devices_.find(deviceId);
+  if (!context.deviceId.empty()) {
+    if (context.deviceId == deviceId) {
+      return AUTH_OK;
+    }
+    auto bound = devices_.find(context.deviceId);
+    bool sameUser = device != devices_.end() && bound != devices_.end() && !device->second.empty() &&
+                    device->second == bound->second;
+    return sameUser ? AUTH_OK : AUTH_WRONG_DEVICE;
+  }
+  if (device == devices_.end()) {
+    return AUTH_UNKNOWN_DEVICE;
+  }
+  context.deviceId = deviceId;
+  return AUTH_OK;
+}
+
+bool DeviceRegistry::isKnown(const std::string& deviceId) const {
+  std::shared_lock<std::shared_mutex> lock(devicesMutex_);
+  return devices_.count(deviceId) > 0;
+}
+
+size_t DeviceRegistry::deviceCount() const {
+  std::shared_lock<std::shared_mutex> lock(devicesMutex_);
+  return devices_.size();
+}
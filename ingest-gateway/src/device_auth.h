@@ -0,0 +1,76 @@
+/*
+ * IriQ Smart Irrigation System - Device Authentication Header
+ *
+ * Header file for connection-level device authentication. A connection
+ * presents the device key once and is then bound to the first device_id it
+ * writes for, so later requests on it skip the key check entirely. It may
+ * also write for the other devices of that device's user.
+ */
+
+#ifndef GATEWAY_DEVICE_AUTH_H
+#define GATEWAY_DEVICE_AUTH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "config.h"
+#include "http.h"
+
+// Per-connection state, owned by the event loop and handed to one worker at a time
+struct ConnectionContext {
+  uint64_t id = 0;
+  std::string peerAddress;
+  bool authenticated = false;
+  std::string deviceId;  // Bound on the first request that names a device
+};
+
+enum AuthResult {
+  AUTH_OK,
+  AUTH_MISSING_KEY,   // 401
+  AUTH_BAD_KEY,       // 401
+  AUTH_UNKNOWN_DEVICE,  // 403
+  AUTH_WRONG_DEVICE   // 403: the connection is bound to another device (of another user)
+};
+
+// Compare without an early exit so timing does not reveal the key prefix
+bool constantTimeEquals(const std::string& a, const std::string& b);
+
+class DeviceRegistry {
+public:
+  explicit DeviceRegistry(const GatewayConfig& config);
+  ~DeviceRegistry();
+
+  // Load the device list and start the periodic refresh
+  bool start();
+  void stop();
+
+  // Check the key once per connection
+  AuthResult authenticate(const HttpRequest& request, ConnectionContext& context) const;
+
+  // Bind the connection to deviceId, or confirm it is the bound device or
+  // another device of the same user (the sensor nodes of a gateway controller)
+  AuthResult authorizeDevice(const std::string& deviceId, ConnectionContext& context) const;
+
+  bool isKnown(const std::string& deviceId) const;
+  size_t deviceCount() const;
+
+private:
+  bool reload();
+  void refreshLoop();
+
+  const GatewayConfig& config_;
+  mutable std::shared_mutex devicesMutex_;
+  std::unordered_map<std::string, std::string> devices_;  // device_id to user_id ("" when unowned)
+
+  std::mutex stopMutex_;
+  std::condition_variable stopSignal_;
+  bool stopping_ = false;
+  std::thread refreshThread_;
+};
+
+#endif // GATEWAY_DEVICE_AUTH_H
@@ -0,0 +1,375 @@
+/*
+ * IriQ Smart Irrigation System - Event Loop
+ *
+ * Level-triggered epoll over non-blocking sockets. Each connection has at
+ * most one request with a worker at a time; reading is paused meanwhile, so
+ * pipelined requests are answered in order and a slow database cannot make
+ * a single device buffer unbounded input.
+ */
+
+#include "event_loop.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+static const uint64_t LISTEN_ID = 0;
+static const uint64_t WAKE_ID = UINT64_MAX;
+static const size_t READ_CHUNK = 16384;
+static const int MAX_EVENTS = 256;
+
+EventLoop::EventLoop(const GatewayConfig& config, ThreadPool& pool, Handler handler)
+    : config_(config), pool_(pool), handler_(std::move(handler)) {
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = WAKE_ID;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+}
+
+EventLoop::~EventLoop() {
+  for (auto& entry : connections_) {
+    if (entry.second->fd >= 0) {
+      ::close(entry.second->fd);
+    }
+  }
+  if (listenFd_ >= 0) ::close(listenFd_);
+  if (wakeFd_ >= 0) ::close(wakeFd_);
+  if (epollFd_ >= 0) ::close(epollFd_);
+}
+
+// Bind the listen socket; false on failure
+bool EventLoop::listen() {
+  listenFd_ = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listenFd_ < 0) {
+    std::perror("[server] socket");
+    return false;
+  }
+
+  int enable = 1;
+  int disable = 0;
+  setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  setsockopt(listenFd_, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+
+  sockaddr_in6 address{};
+  address.sin6_family = AF_INET6;
+  address.sin6_addr = in6addr_any;
+  address.sin6_port = htons((uint16_t)config_.port);
+  if (bind(listenFd_, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(listenFd_, SOMAXCONN) < 0) {
+    std::perror("[server] bind/listen");
+    return false;
+  }
+
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.u64 = LISTEN_ID;
+  return epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event) == 0;
+}
+
+// Safe to call from a signal handler
+void EventLoop::stop() {
+  stopping_ = true;
+  uint64_t one = 1;
+  ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+  (void)ignored;
+}
+
+// Serve until stop() is called
+void EventLoop::run() {
+  epoll_event events[MAX_EVENTS];
+  auto lastSweep = std::chrono::steady_clock::now();
+
+  while (!stopping_) {
+    int count = epoll_wait(epollFd_, events, MAX_EVENTS, 1000);
+    if (count < 0 && errno != EINTR) {
+      std::perror("[server] epoll_wait");
+      break;
+    }
+
+    for (int i = 0; i < count; i++) {
+      uint64_t id = events[i].data.u64;
+      if (id == LISTEN_ID) {
+        acceptConnections();
+        continue;
+      }
+      if (id == WAKE_ID) {
+        uint64_t value;
+        while (read(wakeFd_, &value, sizeof(value)) > 0) {
+        }
+        drainCompletions();
+        continue;
+      }
+
+      auto it = connections_.find(id);
+      if (it == connections_.end()) {
+        continue;
+      }
+      Connection& connection = *it->second;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        closeConnection(id);
+        continue;
+      }
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+        handleReadable(connection);
+        if (connections_.find(id) == connections_.end()) {
+          continue;
+        }
+      }
+      if (events[i].events & EPOLLOUT) {
+        handleWritable(connection);
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastSweep >= std::chrono::seconds(1)) {
+      closeIdleConnections();
+      lastSweep = now;
+    }
+  }
+}
+
+void EventLoop::acceptConnections() {
+  while (true) {
+    sockaddr_storage peer{};
+    socklen_t peerLength = sizeof(peer);
+    int fd = accept4(listenFd_, (sockaddr*)&peer, &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        std::perror("[server] accept");
+      }
+      return;
+    }
+
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    auto connection = std::make_unique<Connection>();
+    connection->fd = fd;
+    connection->context.id = nextId_++;
+    connection->lastActivity = std::chrono::steady_clock::now();
+
+    char text[INET6_ADDRSTRLEN] = "";
+    if (peer.ss_family == AF_INET6) {
+      const sockaddr_in6* address = (const sockaddr_in6*)&peer;
+      inet_ntop(AF_INET6, &address->sin6_addr, text, sizeof(text));
+      // Show IPv4 clients without the ::ffff: prefix
+      if (std::strncmp(text, "::ffff:", 7) == 0) {
+        std::memmove(text, text + 7, std::strlen(text + 7) + 1);
+      }
+    } else if (peer.ss_family == AF_INET) {
+      inet_ntop(AF_INET, &((const sockaddr_in*)&peer)->sin_addr, text, sizeof(text));
+    }
+    connection->context.peerAddress = text;
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.u64 = connection->context.id;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      ::close(fd);
+      continue;
+    }
+    connections_[connection->context.id] = std::move(connection);
+    connectionCount_ = connections_.size();
+  }
+}
+
+void EventLoop::handleReadable(Connection& connection) {
+  char buffer[READ_CHUNK];
+  while (true) {
+    ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      connection.input.append(buffer, (size_t)received);
+      connection.lastActivity = std::chrono::steady_clock::now();
+      continue;
+    }
+    if (received == 0) {
+      connection.peerClosed = true;
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      connection.peerClosed = true;
+      connection.input.clear();
+    }
+    break;
+  }
+
+  uint64_t id = connection.context.id;
+  dispatch(connection);
+  if (connections_.find(id) == connections_.end()) {
+    return;  // Closed after a malformed request
+  }
+
+  // Nothing left to answer on a half-closed connection
+  if (connection.peerClosed && !connection.busy && connection.output.empty()) {
+    closeConnection(connection.context.id);
+    return;
+  }
+  updateInterest(connection);
+}
+
+void EventLoop::handleWritable(Connection& connection) {
+  while (!connection.output.empty()) {
+    ssize_t sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+    if (sent > 0) {
+      connection.output.erase(0, (size_t)sent);
+      continue;
+    }
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    closeConnection(connection.context.id);
+    return;
+  }
+
+  if (connection.output.empty() && (connection.closeAfterWrite || (connection.peerClosed && !connection.busy))) {
+    closeConnection(connection.context.id);
+    return;
+  }
+  updateInterest(connection);
+}
+
+void EventLoop::dispatch(Connection& connection) {
+  if (connection.busy || connection.closeAfterWrite) {
+    return;
+  }
+
+  auto request = std::make_shared<HttpRequest>();
+  HttpParseResult result = parseHttpRequest(connection.input, *request);
+  if (result == HTTP_INCOMPLETE) {
+    updateInterest(connection);
+    return;
+  }
+  if (result == HTTP_ERROR) {
+    HttpResponse response;
+    response.status = 400;
+    response.body = "{\"message\":\"Malformed request\"}";
+    response.close = true;
+    sendResponse(connection, response);
+    return;
+  }
+
+  connection.busy = true;
+  updateInterest(connection);
+
+  uint64_t id = connection.context.id;
+  ConnectionContext* context = &connection.context;
+  bool queued = pool_.submit([this, id, context, request]() {
+    HttpResponse response = handler_(*request, *context);
+    if (!request->keepAlive) {
+      response.close = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(completionsMutex_);
+      completions_.push_back(Completion{id, std::move(response)});
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+    (void)ignored;
+  });
+
+  if (!queued) {
+    connection.busy = false;
+    HttpResponse response;
+    response.status = 503;
+    response.close = true;
+    sendResponse(connection, response);
+  }
+}
+
+void EventLoop::drainCompletions() {
+  std::vector<Completion> completions;
+  {
+    std::lock_guard<std::mutex> lock(completionsMutex_);
+    completions.swap(completions_);
+  }
+
+  for (auto& completion : completions) {
+    auto it = connections_.find(completion.connectionId);
+    if (it == connections_.end()) {
+      continue;
+    }
+    Connection& connection = *it->second;
+    connection.busy = false;
+    if (connection.abandoned) {
+      closeConnection(completion.connectionId);
+      continue;
+    }
+    connection.lastActivity = std::chrono::steady_clock::now();
+    sendResponse(connection, completion.response);
+    if (connections_.find(completion.connectionId) == connections_.end()) {
+      continue;
+    }
+    // Answer the next pipelined request, if one is already buffered
+    dispatch(connection);
+  }
+}
+
+void EventLoop::sendResponse(Connection& connection, const HttpResponse& response) {
+  connection.output += response.serialize();
+  if (response.close) {
+    connection.closeAfterWrite = true;
+  }
+  handleWritable(connection);
+}
+
+void EventLoop::updateInterest(Connection& connection) {
+  uint32_t events = 0;
+  if (!connection.busy && !connection.closeAfterWrite && !connection.peerClosed) {
+    events |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (!connection.output.empty()) {
+    events |= EPOLLOUT;
+  }
+
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = connection.context.id;
+  epoll_ctl(epollFd_, EPOLL_CTL_MOD, connection.fd, &event);
+}
+
+void EventLoop::closeConnection(uint64_t id) {
+  auto it = connections_.find(id);
+  if (it == connections_.end()) {
+    return;
+  }
+  Connection& connection = *it->second;
+  if (connection.busy) {
+    // A worker still holds the context; finish closing when it completes
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    connection.abandoned = true;
+    return;
+  }
+  epoll_ctl(epollFd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+  ::close(connection.fd);
+  connections_.erase(it);
+  connectionCount_ = connections_.size();
+}
+
+void EventLoop::closeIdleConnections() {
+  auto cutoff = std::chrono::steady_clock::now() - std::chrono::seconds(config_.idleTimeoutSeconds);
+  std::vector<uint64_t> idle;
+  for (auto& entry : connections_) {
+    if (!entry.second->busy && entry.second->lastActivity < cutoff) {
+      idle.push_back(entry.first);
+    }
+  }
+  for (uint64_t id : idle) {
+    closeConnection(id);
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ * IriQ Smart Irrigation System - Event Loop Header
+ *
+ * Header file for the epoll-based HTTP server. One thread owns every socket:
+ * it accepts, reads, parses and writes without blocking, and hands complete
+ * requests to the thread pool. Workers return responses through a queue and
+ * an eventfd, so sockets are never touched from two threads.
+ */
+
+#ifndef GATEWAY_EVENT_LOOP_H
+#define GATEWAY_EVENT_LOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+#include "device_auth.h"
+#include "http.h"
+#include "thread_pool.h"
+
+class EventLoop {
+public:
+  using Handler = std::function<HttpResponse(const HttpRequest&, ConnectionContext&)>;
+
+  EventLoop(const GatewayConfig& config, ThreadPool& pool, Handler handler);
+  ~EventLoop();
+
+  // Bind the listen socket; false on failure
+  bool listen();
+
+  // Serve until stop() is called
+  void run();
+
+  // Safe to call from a signal handler
+  void stop();
+
+  size_t connectionCount() const { return connectionCount_.load(); }
+
+private:
+  struct Connection {
+    int fd = -1;
+    ConnectionContext context;
+    std::string input;
+    std::string output;
+    bool busy = false;         // A request is with a worker
+    bool closeAfterWrite = false;
+    bool peerClosed = false;
+    bool abandoned = false;    // Closed while busy; freed when the worker completes
+    std::chrono::steady_clock::time_point lastActivity;
+  };
+
+  struct Completion {
+    uint64_t connectionId;
+    HttpResponse response;
+  };
+
+  void acceptConnections();
+  void handleReadable(Connection& connection);
+  void handleWritable(Connection& connection);
+  void dispatch(Connection& connection);
+  void drainCompletions();
+  void sendResponse(Connection& connection, const HttpResponse& response);
+  void updateInterest(Connection& connection);
+  void closeConnection(uint64_t id);
+  void closeIdleConnections();
+
+  const GatewayConfig& config_;
+  ThreadPool& pool_;
+  Handler handler_;
+
+  int epollFd_ = -1;
+  int listenFd_ = -1;
+  int wakeFd_ = -1;
+  std::atomic<bool> stopping_{false};
+
+  uint64_t nextId_ = 1;
+  std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+  std::atomic<size_t> connectionCount_{0};
+
+  std::mutex completionsMutex_;
+  std::vector<Completion> completions_;
+};
+
+#endif // GATEWAY_EVENT_LOOP_H
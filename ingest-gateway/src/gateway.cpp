@@ -0,0 +1,495 @@
+/*
+ * IriQ Smart Irrigation System - Gateway
+ *
+ * Writes are validated, queued on the PgWriter and acknowledged at once
+ * (201/204); the firmware already treats any 2xx as success. Readings, status
+ * and heartbeats also update the latest-state cache. The one database read,
+ * pending control commands, is a single indexed query on a per-worker
+ * connection.
+ */
+
+#include "gateway.h"
+
+#include <libpq-fe.h>
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+static const char* REST_PREFIX = "/rest/v1/";
+static const int DEFAULT_COMMAND_LIMIT = 20;
+static const int MAX_COMMAND_LIMIT = 100;
+
+static HttpResponse jsonError(int status, const std::string& message) {
+  HttpResponse response;
+  response.status = status;
+  response.body = "{\"message\":";
+  appendJsonString(response.body, message);
+  response.body += '}';
+  return response;
+}
+
+static HttpResponse emptyResponse(int status) {
+  HttpResponse response;
+  response.status = status;
+  return response;
+}
+
+static HttpResponse queueFull() {
+  return jsonError(503, "Ingestion queue full, retry later");
+}
+
+bool isUuid(const std::string& text) {
+  if (text.size() != 36) {
+    return false;
+  }
+  for (size_t i = 0; i < text.size(); i++) {
+    bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+    if (dash ? text[i] != '-' : !std::isxdigit((unsigned char)text[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// "YYYY-MM-DDTHH:MM:SSZ", the only form the firmware sends
+static bool isUtcTimestamp(const std::string& text) {
+  static const char pattern[] = "dddd-dd-ddTdd:dd:ddZ";
+  if (text.size() != sizeof(pattern) - 1) {
+    return false;
+  }
+  for (size_t i = 0; i < text.size(); i++) {
+    if (pattern[i] == 'd' ? !std::isdigit((unsigned char)text[i]) : text[i] != pattern[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Value of a PostgREST "column=eq.value" filter, or empty
+static std::string equalsFilter(const HttpRequest& request, const std::string& column) {
+  auto it = request.query.find(column);
+  if (it == request.query.end() || it->second.compare(0, 3, "eq.") != 0) {
+    return "";
+  }
+  return it->second.substr(3);
+}
+
+// One command id from "eq.<id>" or several from "in.(<id>,<id>)"
+static bool parseIdFilter(const std::string& filter, std::vector<std::string>& ids) {
+  std::string list;
+  if (filter.compare(0, 3, "eq.") == 0) {
+    list = filter.substr(3);
+  } else if (filter.compare(0, 4, "in.(") == 0 && filter.back() == ')') {
+    list = filter.substr(4, filter.size() - 5);
+  } else {
+    return false;
+  }
+
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string id = list.substr(start, end - start);
+    if (!isUuid(id)) {
+      return false;
+    }
+    ids.push_back(id);
+    start = end + 1;
+  }
+  return !ids.empty();
+}
+
+// Per-worker read connection, reopened after failures
+static PGconn* readConnection(const std::string& databaseUrl) {
+  struct Holder {
+    PGconn* connection = nullptr;
+    ~Holder() {
+      if (connection != nullptr) PQfinish(connection);
+    }
+  };
+  thread_local Holder holder;
+
+  if (holder.connection != nullptr && PQstatus(holder.connection) != CONNECTION_OK) {
+    PQfinish(holder.connection);
+    holder.connection = nullptr;
+  }
+  if (holder.connection == nullptr) {
+    holder.connection = PQconnectdb(databaseUrl.c_str());
+    if (PQstatus(holder.connection) != CONNECTION_OK) {
+      std::fprintf(stderr, "[gateway] Read connection failed: %s", PQerrorMessage(holder.connection));
+      PQfinish(holder.connection);
+      holder.connection = nullptr;
+    }
+  }
+  return holder.connection;
+}
+
+Gateway::Gateway(const GatewayConfig& config, DeviceRegistry& registry, PgWriter& writer, LatestStateCache& latest)
+    : config_(config), registry_(registry), writer_(writer), latest_(latest) {}
+
+// Entry point for worker threads
+HttpResponse Gateway::handle(const HttpRequest& request, ConnectionContext& context) {
+  requests_++;
+
+  if (request.path == "/health") {
+    return health();
+  }
+  if (request.path.compare(0, 10, "/v1/latest") == 0 && request.method == "GET" && !config_.readKey.empty()) {
+    return getLatest(request);
+  }
+  if (request.path.compare(0, 9, REST_PREFIX) != 0) {
+    return jsonError(404, "Not found");
+  }
+
+  switch (registry_.authenticate(request, context)) {
+    case AUTH_OK:
+      break;
+    case AUTH_MISSING_KEY:
+      rejected_++;
+      return jsonError(401, "No API key found in request");
+    default:
+      rejected_++;
+      return jsonError(401, "Invalid API key");
+  }
+
+  std::string table = request.path.substr(9);
+  JsonValue body;
+  bool hasBody = !request.body.empty();
+  if (hasBody && !JsonValue::parse(request.body, body)) {
+    return jsonError(400, "Malformed JSON body");
+  }
+
+  if (table == "sensor_readings" && request.method == "POST") {
+    return postReadings(body, context);
+  }
+  if ((table == "device_presence" || table == "device_heartbeats") && request.method == "POST") {
+    return postPresence(body, context);
+  }
+  if (table == "device_status" && (request.method == "POST" || request.method == "PATCH")) {
+    return writeStatus(request, body, context);
+  }
+  if (table == "control_commands" && request.method == "GET") {
+    return getCommands(request, context);
+  }
+  if (table == "control_commands" && request.method == "PATCH") {
+    return ackCommands(request, context);
+  }
+  if (table == "device_auth_logs" && request.method == "POST") {
+    return postAuthLog(body, context);
+  }
+  return jsonError(404, "Not found");
+}
+
+// Authorize deviceId for this connection; fills response on failure
+bool Gateway::authorizeDevice(const std::string& deviceId, ConnectionContext& context, HttpResponse& response) {
+  if (deviceId.empty()) {
+    response = jsonError(400, "device_id is required");
+    return false;
+  }
+  switch (registry_.authorizeDevice(deviceId, context)) {
+    case AUTH_OK:
+      return true;
+    case AUTH_WRONG_DEVICE:
+      rejected_++;
+      response = jsonError(403, "Connection is bound to a device of another user");
+      return false;
+    default:
+      rejected_++;
+      response = jsonError(403, "Unknown device");
+      return false;
+  }
+}
+
+HttpResponse Gateway::health() const {
+  WriterStats stats = writer_.stats();
+  char buffer[512];
+  std::snprintf(buffer, sizeof(buffer),
+                "{\"status\":\"ok\",\"connections\":%zu,\"devices\":%zu,\"requests\":%llu,\"rejected\":%llu,"
+                "\"queued_rows\":%zu,\"flushes\":%llu,\"flushed_rows\":%llu,\"failed_flushes\":%llu,"
+                "\"dropped_rows\":%llu,\"last_flush_ms\":%.2f,\"cached_devices\":%zu,"
+                "\"cache_overflows\":%llu}",
+                connectionCounter_ ? connectionCounter_() : (size_t)0, registry_.deviceCount(),
+                (unsigned long long)requests_.load(), (unsigned long long)rejected_.load(), stats.queuedRows,
+                (unsigned long long)stats.flushes, (unsigned long long)stats.flushedRows,
+                (unsigned long long)stats.failedFlushes, (unsigned long long)stats.droppedRows, stats.lastFlushMs,
+                latest_.size(), (unsigned long long)latest_.overflows());
+  HttpResponse response;
+  response.body = buffer;
+  if (bridge_ != nullptr) {
+    BridgeStats bridge = bridge_->stats();
+    std::snprintf(buffer, sizeof(buffer),
+                  ",\"mqtt\":{\"connected\":%s,\"messages\":%llu,\"rejected\":%llu,\"desired_published\":%llu,"
+                  "\"online_devices\":%zu}}",
+                  bridge.connected ? "true" : "false", (unsigned long long)bridge.messages,
+                  (unsigned long long)bridge.rejected, (unsigned long long)bridge.desiredPublished,
+                  bridge.onlineDevices);
+    response.body.pop_back();
+    response.body += buffer;
+  }
+  return response;
+}
+
+// GET /v1/latest/<device_id>, or /v1/latest?device_id=in.(a,b) for several
+HttpResponse Gateway::getLatest(const HttpRequest& request) const {
+  std::string key = request.header("x-iriq-read-key");
+  if (key.empty()) {
+    std::string authorization = request.header("authorization");
+    if (authorization.compare(0, 7, "Bearer ") == 0) {
+      key = authorization.substr(7);
+    }
+  }
+  if (!constantTimeEquals(key, config_.readKey)) {
+    return jsonError(401, "Invalid read key");
+  }
+
+  HttpResponse response;
+  DeviceSnapshot snapshot;
+
+  if (request.path.size() > 11 && request.path[10] == '/') {
+    if (!latest_.lookup(request.path.substr(11), snapshot)) {
+      return jsonError(404, "No state for device");
+    }
+    response.body = latestStateJson(snapshot);
+    return response;
+  }
+
+  auto filter = request.query.find("device_id");
+  if (request.path != "/v1/latest" || filter == request.query.end() || filter->second.compare(0, 4, "in.(") != 0 ||
+      filter->second.back() != ')') {
+    return jsonError(400, "Expected /v1/latest/<device_id> or ?device_id=in.(...)");
+  }
+
+  // Devices without state are left out of the array
+  std::string list = filter->second.substr(4, filter->second.size() - 5);
+  response.body = "[";
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    if (latest_.lookup(list.substr(start, end - start), snapshot)) {
+      if (response.body.size() > 1) {
+        response.body += ',';
+      }
+      response.body += latestStateJson(snapshot);
+    }
+    start = end + 1;
+  }
+  response.body += ']';
+  return response;
+}
+
+// POST /rest/v1/sensor_readings with one reading or an array of readings
+HttpResponse Gateway::postReadings(const JsonValue& body, ConnectionContext& context) {
+  std::vector<const JsonValue*> objects;
+  if (body.isObject()) {
+    objects.push_back(&body);
+  } else if (body.isArray()) {
+    for (const auto& item : body.items()) {
+      objects.push_back(&item);
+    }
+  }
+  if (objects.empty()) {
+    return jsonError(400, "Expected a reading object or array");
+  }
+
+  // Readings are stamped on arrival; the device clock may not be synced
+  std::string receivedAt = utcTimestamp();
+  std::vector<ReadingRow> rows;
+  rows.reserve(objects.size());
+
+  for (const JsonValue* object : objects) {
+    HttpResponse response;
+    if (!object->isObject()) {
+      return jsonError(400, "Expected a reading object");
+    }
+    // A gateway controller uploads the readings of its sensor nodes, each a
+    // device of the controller's user, in one request
+    std::string deviceId = (*object)["device_id"].asString();
+    if (!authorizeDevice(deviceId, context, response)) {
+      return response;
+    }
+    const JsonValue& moisture = (*object)["moisture_percentage"];
+    if (moisture.type() != JsonValue::NUMBER) {
+      return jsonError(400, "moisture_percentage must be a number");
+    }
+
+    ReadingRow row;
+    row.deviceId = deviceId;
+    row.moisturePercentage = moisture.asNumber();
+    row.moistureDigital = (*object)["moisture_digital"].asBool();
+    const JsonValue& pump = (*object)["pump_status"];
+    row.pumpStatus = pump.type() == JsonValue::BOOL ? (pump.asBool() ? 1 : 0) : -1;
+    row.createdAt = receivedAt;
+    const JsonValue& heardAt = (*object)["heard_at"];
+    if (heardAt.type() != JsonValue::NUL) {
+      // Set by a gateway controller for its sensor nodes
+      if (!isUtcTimestamp(heardAt.asString())) {
+        return jsonError(400, "heard_at must be a UTC timestamp");
+      }
+      row.heardAt = heardAt.asString();
+    }
+    rows.push_back(std::move(row));
+  }
+
+  for (const auto& row : rows) {
+    if (!writer_.addReading(row)) {
+      return queueFull();
+    }
+  }
+  // Rows are in order, so each device ends up with its newest reading
+  int64_t now = currentTimeMillis();
+  for (const auto& row : rows) {
+    latest_.updateReading(row.deviceId, row.moisturePercentage, row.moistureDigital, row.pumpStatus, now);
+  }
+  return emptyResponse(201);
+}
+
+// POST /rest/v1/device_presence?on_conflict=device_id (heartbeat upsert)
+HttpResponse Gateway::postPresence(const JsonValue& body, ConnectionContext& context) {
+  HttpResponse response;
+  if (!body.isObject()) {
+    return jsonError(400, "Expected a heartbeat object");
+  }
+  std::string deviceId = body["device_id"].asString();
+  if (!authorizeDevice(deviceId, context, response)) {
+    return response;
+  }
+
+  PresenceRow row;
+  row.deviceId = deviceId;
+  row.status = body["status"].asString("online");
+  row.ipAddress = body["ip_address"].asString();
+  row.firmwareVersion = body["firmware_version"].asString();
+  if (body["metrics"].isObject()) {
+    row.metrics = body["metrics"].dump();
+  }
+  std::string status = row.status;
+  if (!writer_.addPresence(std::move(row))) {
+    return queueFull();
+  }
+  latest_.updatePresence(deviceId, status, currentTimeMillis());
+  return emptyResponse(201);
+}
+
+// PATCH /rest/v1/device_status?device_id=eq.X, or POST to create the row
+HttpResponse Gateway::writeStatus(const HttpRequest& request, const JsonValue& body, ConnectionContext& context) {
+  HttpResponse response;
+  if (!body.isObject()) {
+    return jsonError(400, "Expected a status object");
+  }
+  std::string deviceId = request.method == "PATCH" ? equalsFilter(request, "device_id") : body["device_id"].asString();
+  if (!authorizeDevice(deviceId, context, response)) {
+    return response;
+  }
+
+  StatusRow row;
+  row.deviceId = deviceId;
+  row.pumpStatus = body["pump_status"].asBool();
+  row.automaticMode = body["automatic_mode"].asBool(true);
+  row.userId = body["user_id"].asString();
+  if (!isUuid(row.userId)) {
+    return jsonError(400, "user_id must be a UUID");
+  }
+  bool pumpStatus = row.pumpStatus;
+  bool automaticMode = row.automaticMode;
+  if (!writer_.addStatus(std::move(row))) {
+    return queueFull();
+  }
+  latest_.updateStatus(deviceId, pumpStatus, automaticMode, currentTimeMillis());
+  return emptyResponse(request.method == "PATCH" ? 204 : 201);
+}
+
+// GET /rest/v1/control_commands?device_id=eq.X&executed=eq.false&limit=N
+HttpResponse Gateway::getCommands(const HttpRequest& request, ConnectionContext& context) {
+  HttpResponse response;
+  std::string deviceId = equalsFilter(request, "device_id");
+  if (!authorizeDevice(deviceId, context, response)) {
+    return response;
+  }
+
+  int limit = DEFAULT_COMMAND_LIMIT;
+  auto limitParam = request.query.find("limit");
+  if (limitParam != request.query.end()) {
+    limit = std::atoi(limitParam->second.c_str());
+    if (limit < 1 || limit > MAX_COMMAND_LIMIT) {
+      limit = MAX_COMMAND_LIMIT;
+    }
+  }
+
+  PGconn* connection = readConnection(config_.databaseUrl);
+  if (connection == nullptr) {
+    return jsonError(503, "Database unavailable");
+  }
+
+  std::string limitText = std::to_string(limit);
+  const char* params[2] = {deviceId.c_str(), limitText.c_str()};
+  PGresult* result = PQexecParams(connection,
+                                  "SELECT coalesce(json_agg(json_build_object('id', id, 'pump_control', pump_control, "
+                                  "'automatic_mode', automatic_mode, 'user_id', user_id) ORDER BY created_at), '[]'::json) "
+                                  "FROM ("
+                                  "SELECT id, pump_control, automatic_mode, user_id, created_at "
+                                  "FROM public.control_commands "
+                                  "WHERE device_id = $1 AND NOT executed "
+                                  "ORDER BY created_at ASC LIMIT $2::int) c",
+                                  2, nullptr, params, nullptr, nullptr, 0);
+  if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+    std::fprintf(stderr, "[gateway] Command query failed: %s", PQerrorMessage(connection));
+    PQclear(result);
+    return jsonError(503, "Database unavailable");
+  }
+  response.body = PQgetvalue(result, 0, 0);
+  PQclear(result);
+  return response;
+}
+
+// PATCH /rest/v1/control_commands?id=in.(...)[&device_id=eq.X] marking commands executed
+HttpResponse Gateway::ackCommands(const HttpRequest& request, ConnectionContext& context) {
+  auto filter = request.query.find("id");
+  std::vector<std::string> ids;
+  if (filter == request.query.end() || !parseIdFilter(filter->second, ids)) {
+    return jsonError(400, "Expected id=eq.<uuid> or id=in.(<uuid>,...)");
+  }
+
+  // Acknowledgements only ever cover the commands of an authorized device; a
+  // connection that has not named its device must name it here
+  HttpResponse response;
+  std::string deviceId = equalsFilter(request, "device_id");
+  if (deviceId.empty()) {
+    deviceId = context.deviceId;
+  }
+  if (!authorizeDevice(deviceId, context, response)) {
+    return response;
+  }
+
+  std::vector<CommandAck> acks;
+  acks.reserve(ids.size());
+  for (auto& id : ids) {
+    acks.push_back(CommandAck{deviceId, std::move(id)});
+  }
+  return writer_.addCommandAcks(std::move(acks)) ? emptyResponse(204) : queueFull();
+}
+
+// POST /rest/v1/device_auth_logs
+HttpResponse Gateway::postAuthLog(const JsonValue& body, ConnectionContext& context) {
+  HttpResponse response;
+  if (!body.isObject()) {
+    return jsonError(400, "Expected an auth log object");
+  }
+  std::string deviceId = body["device_id"].asString();
+  if (!authorizeDevice(deviceId, context, response)) {
+    return response;
+  }
+
+  AuthLogRow row;
+  row.deviceId = deviceId;
+  row.success = body["success"].asBool(true);
+  row.ipAddress = body["ip_address"].asString(context.peerAddress);
+  row.userAgent = body["user_agent"].asString();
+  row.createdAt = utcTimestamp();
+  return writer_.addAuthLog(std::move(row)) ? emptyResponse(201) : queueFull();
+}
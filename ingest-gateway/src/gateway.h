@@ -0,0 +1,64 @@
+/*
+ * IriQ Smart Irrigation System - Gateway Header
+ *
+ * Header file for the request router. Device routes mirror the PostgREST
+ * paths the firmware already calls, so a device is pointed at the gateway by
+ * changing its Supabase URL only. GET /v1/latest serves the dashboard's
+ * current-value reads from the latest-state cache.
+ */
+
+#ifndef GATEWAY_GATEWAY_H
+#define GATEWAY_GATEWAY_H
+
+#include <atomic>
+#include <functional>
+
+#include "config.h"
+#include "device_auth.h"
+#include "http.h"
+#include "json.h"
+#include "latest_state.h"
+#include "mqtt_bridge.h"
+#include "pg_writer.h"
+
+// True for a canonical 8-4-4-4-12 hex UUID
+bool isUuid(const std::string& text);
+
+class Gateway {
+public:
+  Gateway(const GatewayConfig& config, DeviceRegistry& registry, PgWriter& writer, LatestStateCache& latest);
+
+  // Entry point for worker threads
+  HttpResponse handle(const HttpRequest& request, ConnectionContext& context);
+
+  // Source of the open connection count reported by /health
+  void setConnectionCounter(std::function<size_t()> counter) { connectionCounter_ = std::move(counter); }
+
+  // Bridge whose counters /health reports, when MQTT is enabled
+  void setBridge(const MqttBridge* bridge) { bridge_ = bridge; }
+
+private:
+  HttpResponse health() const;
+  HttpResponse getLatest(const HttpRequest& request) const;
+  HttpResponse postReadings(const JsonValue& body, ConnectionContext& context);
+  HttpResponse postPresence(const JsonValue& body, ConnectionContext& context);
+  HttpResponse writeStatus(const HttpRequest& request, const JsonValue& body, ConnectionContext& context);
+  HttpResponse getCommands(const HttpRequest& request, ConnectionContext& context);
+  HttpResponse ackCommands(const HttpRequest& request, ConnectionContext& context);
+  HttpResponse postAuthLog(const JsonValue& body, ConnectionContext& context);
+
+  // Authorize deviceId for this connection; fills response on failure
+  bool authorizeDevice(const std::string& deviceId, ConnectionContext& context, HttpResponse& response);
+
+  const GatewayConfig& config_;
+  DeviceRegistry& registry_;
+  PgWriter& writer_;
+  LatestStateCache& latest_;
+  std::function<size_t()> connectionCounter_;
+  const MqttBridge* bridge_ = nullptr;
+
+  std::atomic<uint64_t> requests_{0};
+  std::atomic<uint64_t> rejected_{0};
+};
+
+#endif // GATEWAY_GATEWAY_H
@@ -0,0 +1,191 @@
+/*
+ * IriQ Smart Irrigation System - HTTP Module
+ *
+ * Incremental HTTP/1.1 request parsing: a request is only consumed from the
+ * connection buffer once its headers and full body have arrived.
+ */
+
+#include "http.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+static std::string toLower(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return text;
+}
+
+static std::string trim(const std::string& text) {
+  size_t start = text.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return "";
+  }
+  size_t end = text.find_last_not_of(" \t");
+  return text.substr(start, end - start + 1);
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Decode %XX escapes in a URL component
+std::string urlDecode(const std::string& text) {
+  std::string out;
+  out.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '%' && i + 2 < text.size() && hexValue(text[i + 1]) >= 0 && hexValue(text[i + 2]) >= 0) {
+      out += (char)(hexValue(text[i + 1]) * 16 + hexValue(text[i + 2]));
+      i += 2;
+    } else {
+      out += text[i];
+    }
+  }
+  return out;
+}
+
+static void parseQuery(const std::string& queryString, std::map<std::string, std::string>& query) {
+  size_t start = 0;
+  while (start < queryString.size()) {
+    size_t end = queryString.find('&', start);
+    if (end == std::string::npos) {
+      end = queryString.size();
+    }
+    std::string pair = queryString.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (equals == std::string::npos) {
+      query[urlDecode(pair)] = "";
+    } else {
+      query[urlDecode(pair.substr(0, equals))] = urlDecode(pair.substr(equals + 1));
+    }
+    start = end + 1;
+  }
+}
+
+// Header value or empty string
+std::string HttpRequest::header(const std::string& name) const {
+  auto it = headers.find(name);
+  return it != headers.end() ? it->second : std::string();
+}
+
+// Parse one request from the front of buffer
+HttpParseResult parseHttpRequest(std::string& buffer, HttpRequest& request) {
+  size_t headerEnd = buffer.find("\r\n\r\n");
+  if (headerEnd == std::string::npos) {
+    return buffer.size() > HTTP_MAX_HEADER_BYTES ? HTTP_ERROR : HTTP_INCOMPLETE;
+  }
+  if (headerEnd > HTTP_MAX_HEADER_BYTES) {
+    return HTTP_ERROR;
+  }
+
+  request = HttpRequest();
+
+  // Request line: METHOD SP target SP version
+  size_t lineEnd = buffer.find("\r\n");
+  std::string requestLine = buffer.substr(0, lineEnd);
+  size_t firstSpace = requestLine.find(' ');
+  size_t secondSpace = requestLine.find(' ', firstSpace + 1);
+  if (firstSpace == std::string::npos || secondSpace == std::string::npos) {
+    return HTTP_ERROR;
+  }
+  request.method = requestLine.substr(0, firstSpace);
+  std::string target = requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+  std::string version = requestLine.substr(secondSpace + 1);
+  if (version.compare(0, 5, "HTTP/") != 0) {
+    return HTTP_ERROR;
+  }
+
+  size_t questionMark = target.find('?');
+  request.path = urlDecode(target.substr(0, questionMark));
+  if (questionMark != std::string::npos) {
+    parseQuery(target.substr(questionMark + 1), request.query);
+  }
+
+  // Header lines
+  size_t position = lineEnd + 2;
+  while (position < headerEnd) {
+    size_t end = buffer.find("\r\n", position);
+    std::string line = buffer.substr(position, end - position);
+    position = end + 2;
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      return HTTP_ERROR;
+    }
+    request.headers[toLower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+  }
+
+  if (!request.header("transfer-encoding").empty()) {
+    return HTTP_ERROR;  // Chunked bodies are not supported
+  }
+
+  size_t contentLength = 0;
+  std::string lengthHeader = request.header("content-length");
+  if (!lengthHeader.empty()) {
+    char* end = nullptr;
+    unsigned long parsed = std::strtoul(lengthHeader.c_str(), &end, 10);
+    if (end == lengthHeader.c_str() || *end != '\0' || parsed > HTTP_MAX_BODY_BYTES) {
+      return HTTP_ERROR;
+    }
+    contentLength = parsed;
+  }
+
+  size_t bodyStart = headerEnd + 4;
+  if (buffer.size() < bodyStart + contentLength) {
+    return HTTP_INCOMPLETE;
+  }
+  request.body = buffer.substr(bodyStart, contentLength);
+
+  std::string connection = toLower(request.header("connection"));
+  if (version == "HTTP/1.0") {
+    request.keepAlive = connection == "keep-alive";
+  } else {
+    request.keepAlive = connection != "close";
+  }
+
+  buffer.erase(0, bodyStart + contentLength);
+  return HTTP_COMPLETE;
+}
+
+static const char* reasonPhrase(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+  }
+}
+
+// Serialize status line, headers and body
+std::string HttpResponse::serialize() const {
+  std::string out;
+  out.reserve(128 + body.size());
+  out += "HTTP/1.1 ";
+  out += std::to_string(status);
+  out += ' ';
+  out += reasonPhrase(status);
+  out += "\r\nContent-Length: ";
+  out += std::to_string(body.size());
+  if (!body.empty()) {
+    out += "\r\nContent-Type: ";
+    out += contentType;
+  }
+  if (status == 503 || status == 429) {
+    out += "\r\nRetry-After: 5";
+  }
+  out += close ? "\r\nConnection: close\r\n\r\n" : "\r\nConnection: keep-alive\r\n\r\n";
+  out += body;
+  return out;
+}
@@ -0,0 +1,52 @@
+/*
+ * IriQ Smart Irrigation System - HTTP Header
+ *
+ * Header file for the minimal HTTP/1.1 request parser and response writer.
+ * Supports what the firmware's HTTPClient sends: Content-Length bodies,
+ * keep-alive and pipelining. Chunked request bodies are rejected.
+ */
+
+#ifndef GATEWAY_HTTP_H
+#define GATEWAY_HTTP_H
+
+#include <map>
+#include <string>
+
+#define HTTP_MAX_HEADER_BYTES 8192
+#define HTTP_MAX_BODY_BYTES 65536
+
+struct HttpRequest {
+  std::string method;
+  std::string path;                          // Without the query string
+  std::map<std::string, std::string> query;  // Decoded query parameters
+  std::map<std::string, std::string> headers;  // Lower-case names
+  std::string body;
+  bool keepAlive = true;
+
+  // Header value or empty string
+  std::string header(const std::string& name) const;
+};
+
+struct HttpResponse {
+  int status = 200;
+  std::string body;
+  std::string contentType = "application/json";
+  bool close = false;
+
+  // Serialize status line, headers and body
+  std::string serialize() const;
+};
+
+enum HttpParseResult {
+  HTTP_INCOMPLETE,  // Need more bytes
+  HTTP_COMPLETE,    // A request was parsed and removed from the buffer
+  HTTP_ERROR        // Malformed or oversized; reply 400 and close
+};
+
+// Parse one request from the front of buffer
+HttpParseResult parseHttpRequest(std::string& buffer, HttpRequest& request);
+
+// Decode %XX escapes in a URL component ('+' is kept: it appears in timestamps)
+std::string urlDecode(const std::string& text);
+
+#endif // GATEWAY_HTTP_H
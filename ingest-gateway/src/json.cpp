@@ -0,0 +1,355 @@
+/*
+ * IriQ Smart Irrigation System - JSON Module
+ *
+ * Recursive-descent JSON parser and compact serializer.
+ * Nesting depth is capped so hostile payloads cannot exhaust the stack.
+ */
+
+#include "json.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+static const JsonValue nullValue;
+static const int MAX_DEPTH = 16;
+
+class JsonParser {
+public:
+  explicit JsonParser(const std::string& text) : text_(text) {}
+
+  bool parseDocument(JsonValue& out) {
+    skipWhitespace();
+    if (!parseValue(out, 0)) {
+      return false;
+    }
+    skipWhitespace();
+    return pos_ == text_.size();
+  }
+
+private:
+  const std::string& text_;
+  size_t pos_ = 0;
+
+  void skipWhitespace() {
+    while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+                                   text_[pos_] == '\n' || text_[pos_] == '\r')) {
+      pos_++;
+    }
+  }
+
+  bool consumeLiteral(const char* literal) {
+    size_t length = std::char_traits<char>::length(literal);
+    if (text_.compare(pos_, length, literal) != 0) {
+      return false;
+    }
+    pos_ += length;
+    return true;
+  }
+
+  bool parseValue(JsonValue& out, int depth) {
+    if (depth > MAX_DEPTH || pos_ >= text_.size()) {
+      return false;
+    }
+
+    char c = text_[pos_];
+    if (c == '{') {
+      return parseObject(out, depth);
+    } else if (c == '[') {
+      return parseArray(out, depth);
+    } else if (c == '"') {
+      out.type_ = JsonValue::STRING;
+      return parseString(out.string_);
+    } else if (c == 't' && consumeLiteral("true")) {
+      out.type_ = JsonValue::BOOL;
+      out.bool_ = true;
+      return true;
+    } else if (c == 'f' && consumeLiteral("false")) {
+      out.type_ = JsonValue::BOOL;
+      out.bool_ = false;
+      return true;
+    } else if (c == 'n' && consumeLiteral("null")) {
+      out.type_ = JsonValue::NUL;
+      return true;
+    }
+    return parseNumber(out);
+  }
+
+  bool parseNumber(JsonValue& out) {
+    const char* start = text_.c_str() + pos_;
+    char* end = nullptr;
+    double value = std::strtod(start, &end);
+    if (end == start || !std::isfinite(value)) {
+      return false;
+    }
+    pos_ += (size_t)(end - start);
+    out.type_ = JsonValue::NUMBER;
+    out.number_ = value;
+    return true;
+  }
+
+  static void appendUtf8(std::string& out, unsigned codepoint) {
+    if (codepoint < 0x80) {
+      out += (char)codepoint;
+    } else if (codepoint < 0x800) {
+      out += (char)(0xC0 | (codepoint >> 6));
+      out += (char)(0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+      out += (char)(0xE0 | (codepoint >> 12));
+      out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+      out += (char)(0x80 | (codepoint & 0x3F));
+    } else {
+      out += (char)(0xF0 | (codepoint >> 18));
+      out += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+      out += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+      out += (char)(0x80 | (codepoint & 0x3F));
+    }
+  }
+
+  bool parseHex4(unsigned& value) {
+    if (pos_ + 4 > text_.size()) {
+      return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+      char c = text_[pos_++];
+      value <<= 4;
+      if (c >= '0' && c <= '9') value |= (unsigned)(c - '0');
+      else if (c >= 'a' && c <= 'f') value |= (unsigned)(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F') value |= (unsigned)(c - 'A' + 10);
+      else return false;
+    }
+    return true;
+  }
+
+  bool parseString(std::string& out) {
+    pos_++;  // Opening quote
+    while (pos_ < text_.size()) {
+      char c = text_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if ((unsigned char)c < 0x20) {
+        return false;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ >= text_.size()) {
+        return false;
+      }
+      char escape = text_[pos_++];
+      switch (escape) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          unsigned codepoint;
+          if (!parseHex4(codepoint)) {
+            return false;
+          }
+          // Surrogate pair
+          if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+            unsigned low;
+            if (!consumeLiteral("\\u") || !parseHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+              return false;
+            }
+            codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+          }
+          appendUtf8(out, codepoint);
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  bool parseArray(JsonValue& out, int depth) {
+    out.type_ = JsonValue::ARRAY;
+    pos_++;
+    skipWhitespace();
+    if (pos_ < text_.size() && text_[pos_] == ']') {
+      pos_++;
+      return true;
+    }
+    while (true) {
+      out.items_.emplace_back();
+      skipWhitespace();
+      if (!parseValue(out.items_.back(), depth + 1)) {
+        return false;
+      }
+      skipWhitespace();
+      if (pos_ >= text_.size()) {
+        return false;
+      }
+      char c = text_[pos_++];
+      if (c == ']') {
+        return true;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+
+  bool parseObject(JsonValue& out, int depth) {
+    out.type_ = JsonValue::OBJECT;
+    pos_++;
+    skipWhitespace();
+    if (pos_ < text_.size() && text_[pos_] == '}') {
+      pos_++;
+      return true;
+    }
+    while (true) {
+      skipWhitespace();
+      if (pos_ >= text_.size() || text_[pos_] != '"') {
+        return false;
+      }
+      out.members_.emplace_back();
+      if (!parseString(out.members_.back().first)) {
+        return false;
+      }
+      skipWhitespace();
+      if (pos_ >= text_.size() || text_[pos_++] != ':') {
+        return false;
+      }
+      skipWhitespace();
+      if (!parseValue(out.members_.back().second, depth + 1)) {
+        return false;
+      }
+      skipWhitespace();
+      if (pos_ >= text_.size()) {
+        return false;
+      }
+      char c = text_[pos_++];
+      if (c == '}') {
+        return true;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+};
+
+bool JsonValue::asBool(bool fallback) const {
+  return type_ == BOOL ? bool_ : fallback;
+}
+
+double JsonValue::asNumber(double fallback) const {
+  return type_ == NUMBER ? number_ : fallback;
+}
+
+std::string JsonValue::asString(const std::string& fallback) const {
+  return type_ == STRING ? string_ : fallback;
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const {
+  if (type_ == OBJECT) {
+    for (const auto& member : members_) {
+      if (member.first == key) {
+        return member.second;
+      }
+    }
+  }
+  return nullValue;
+}
+
+bool JsonValue::has(const std::string& key) const {
+  if (type_ != OBJECT) {
+    return false;
+  }
+  for (const auto& member : members_) {
+    if (member.first == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Append text as a quoted, escaped JSON string
+void appendJsonString(std::string& out, const std::string& text) {
+  out += '"';
+  for (char c : text) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if ((unsigned char)c < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned)c);
+          out += escaped;
+        } else {
+          out += c;
+        }
+    }
+  }
+  out += '"';
+}
+
+std::string JsonValue::dump() const {
+  std::string out;
+  switch (type_) {
+    case NUL:
+      out = "null";
+      break;
+    case BOOL:
+      out = bool_ ? "true" : "false";
+      break;
+    case NUMBER: {
+      char buffer[32];
+      if (number_ == std::floor(number_) && std::fabs(number_) < 1e15) {
+        std::snprintf(buffer, sizeof(buffer), "%.0f", number_);
+      } else {
+        std::snprintf(buffer, sizeof(buffer), "%.17g", number_);
+      }
+      out = buffer;
+      break;
+    }
+    case STRING:
+      appendJsonString(out, string_);
+      break;
+    case ARRAY:
+      out += '[';
+      for (size_t i = 0; i < items_.size(); i++) {
+        if (i > 0) out += ',';
+        out += items_[i].dump();
+      }
+      out += ']';
+      break;
+    case OBJECT:
+      out += '{';
+      for (size_t i = 0; i < members_.size(); i++) {
+        if (i > 0) out += ',';
+        appendJsonString(out, members_[i].first);
+        out += ':';
+        out += members_[i].second.dump();
+      }
+      out += '}';
+      break;
+  }
+  return out;
+}
+
+// Parse text; returns false (and leaves out as null) on malformed input
+bool JsonValue::parse(const std::string& text, JsonValue& out) {
+  JsonValue parsed;
+  JsonParser parser(text);
+  if (!parser.parseDocument(parsed)) {
+    out = JsonValue();
+    return false;
+  }
+  out = std::move(parsed);
+  return true;
+}
@@ -0,0 +1,58 @@
+/*
+ * IriQ Smart Irrigation System - JSON Header
+ *
+ * Header file for the small JSON reader/writer used by the gateway.
+ * Device payloads are tiny flat objects, so a compact DOM is enough.
+ */
+
+#ifndef GATEWAY_JSON_H
+#define GATEWAY_JSON_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class JsonValue {
+public:
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  JsonValue() = default;
+
+  Type type() const { return type_; }
+  bool isNull() const { return type_ == NUL; }
+  bool isObject() const { return type_ == OBJECT; }
+  bool isArray() const { return type_ == ARRAY; }
+
+  // Typed access with a fallback when the value has another type
+  bool asBool(bool fallback = false) const;
+  double asNumber(double fallback = 0) const;
+  std::string asString(const std::string& fallback = "") const;
+
+  // Object member, or a shared null value when missing
+  const JsonValue& operator[](const std::string& key) const;
+  bool has(const std::string& key) const;
+
+  const std::vector<JsonValue>& items() const { return items_; }
+  const std::vector<std::pair<std::string, JsonValue>>& members() const { return members_; }
+
+  // Serialize back to compact JSON text
+  std::string dump() const;
+
+  // Parse text; returns false (and leaves out as null) on malformed input
+  static bool parse(const std::string& text, JsonValue& out);
+
+private:
+  friend class JsonParser;
+
+  Type type_ = NUL;
+  bool bool_ = false;
+  double number_ = 0;
+  std::string string_;
+  std::vector<JsonValue> items_;
+  std::vector<std::pair<std::string, JsonValue>> members_;
+};
+
+// Append text as a quoted, escaped JSON string
+void appendJsonString(std::string& out, const std::string& text);
+
+#endif // GATEWAY_JSON_H
@@ -0,0 +1,384 @@
+/*
+ * IriQ Smart Irrigation System - Latest State
+ *
+ * Each slot stores its values as a handful of atomic words guarded by a
+ * sequence counter: writers make it odd, store, and make it even again;
+ * readers copy the words and retry if the counter moved. Slots are never
+ * removed, so a pointer read from the table stays valid for the process.
+ */
+
+#include "latest_state.h"
+
+#include <libpq-fe.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "json.h"
+#include "pg_writer.h"
+
+namespace {
+
+enum SlotWord {
+  WORD_MOISTURE,        // double bits
+  WORD_READING_FLAGS,   // READING_* bits
+  WORD_READING_AT,
+  WORD_STATUS_FLAGS,    // STATUS_* bits
+  WORD_STATUS_AT,
+  WORD_PRESENCE_AT,     // 0 when no heartbeat was seen
+  WORD_PRESENCE_TEXT,   // Presence status, 16 bytes NUL padded
+  WORD_PRESENCE_TEXT_2,
+  WORD_COUNT
+};
+
+const uint64_t READING_PRESENT = 1;
+const uint64_t READING_DIGITAL = 2;
+const uint64_t READING_PUMP_KNOWN = 4;
+const uint64_t READING_PUMP_ON = 8;
+
+const uint64_t STATUS_PRESENT = 1;
+const uint64_t STATUS_PUMP = 2;
+const uint64_t STATUS_AUTOMATIC = 4;
+
+const size_t PRESENCE_TEXT_BYTES = 16;
+
+uint64_t hashDeviceId(const std::string& deviceId) {
+  uint64_t hash = 1469598103934665603ULL;  // FNV-1a
+  for (unsigned char c : deviceId) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+uint64_t doubleBits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double bitsDouble(uint64_t bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+struct LatestStateCache::Slot {
+  explicit Slot(const std::string& id) : deviceId(id) {
+    for (auto& word : words) {
+      word.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  const std::string deviceId;
+  std::atomic<uint32_t> sequence{0};
+  std::atomic<uint64_t> words[WORD_COUNT];
+
+  void lock() {
+    uint32_t current = sequence.load(std::memory_order_relaxed);
+    while ((current & 1) != 0 ||
+           !sequence.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel,
+                                           std::memory_order_relaxed)) {
+      std::this_thread::yield();
+      current = sequence.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void unlock() {
+    sequence.fetch_add(1, std::memory_order_release);
+  }
+
+  void set(SlotWord word, uint64_t value) {
+    words[word].store(value, std::memory_order_relaxed);
+  }
+
+  // Consistent copy of every word
+  void read(uint64_t (&out)[WORD_COUNT]) const {
+    while (true) {
+      uint32_t before = sequence.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        for (int i = 0; i < WORD_COUNT; i++) {
+          out[i] = words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+          return;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+};
+
+LatestStateCache::LatestStateCache(size_t capacity) {
+  size_t buckets = 1024;
+  while (buckets < capacity * 2) {
+    buckets <<= 1;  // Keep the table at most half full
+  }
+  mask_ = buckets - 1;
+  buckets_.reset(new std::atomic<Slot*>[buckets]);
+  for (size_t i = 0; i < buckets; i++) {
+    buckets_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+LatestStateCache::~LatestStateCache() {
+  for (size_t i = 0; i <= mask_; i++) {
+    delete buckets_[i].load(std::memory_order_relaxed);
+  }
+}
+
+const LatestStateCache::Slot* LatestStateCache::find(const std::string& deviceId) const {
+  size_t index = hashDeviceId(deviceId) & mask_;
+  for (size_t probe = 0; probe <= mask_; probe++) {
+    const Slot* slot = buckets_[(index + probe) & mask_].load(std::memory_order_acquire);
+    if (slot == nullptr) {
+      return nullptr;
+    }
+    if (slot->deviceId == deviceId) {
+      return slot;
+    }
+  }
+  return nullptr;
+}
+
+LatestStateCache::Slot* LatestStateCache::findOrInsert(const std::string& deviceId) {
+  size_t index = hashDeviceId(deviceId) & mask_;
+  std::unique_ptr<Slot> created;
+
+  for (size_t probe = 0; probe <= mask_; probe++) {
+    std::atomic<Slot*>& bucket = buckets_[(index + probe) & mask_];
+    Slot* slot = bucket.load(std::memory_order_acquire);
+    if (slot == nullptr) {
+      if (size_.load(std::memory_order_relaxed) * 2 > mask_) {
+        break;  // Full: keep probe chains short for readers
+      }
+      if (!created) {
+        created.reset(new Slot(deviceId));
+      }
+      if (bucket.compare_exchange_strong(slot, created.get(), std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+        size_.fetch_add(1, std::memory_order_relaxed);
+        return created.release();
+      }
+      // Lost the race; slot now holds the winner
+    }
+    if (slot->deviceId == deviceId) {
+      return slot;
+    }
+  }
+
+  overflows_.fetch_add(1, std::memory_order_relaxed);
+  return nullptr;
+}
+
+void LatestStateCache::updateReading(const std::string& deviceId, double moisturePercentage, bool moistureDigital,
+                                     int pumpStatus, int64_t atMs) {
+  Slot* slot = findOrInsert(deviceId);
+  if (slot == nullptr) {
+    return;
+  }
+  uint64_t flags = READING_PRESENT;
+  if (moistureDigital) flags |= READING_DIGITAL;
+  if (pumpStatus >= 0) flags |= READING_PUMP_KNOWN;
+  if (pumpStatus == 1) flags |= READING_PUMP_ON;
+
+  slot->lock();
+  slot->set(WORD_MOISTURE, doubleBits(moisturePercentage));
+  slot->set(WORD_READING_FLAGS, flags);
+  slot->set(WORD_READING_AT, (uint64_t)atMs);
+  slot->unlock();
+}
+
+void LatestStateCache::updateStatus(const std::string& deviceId, bool pumpStatus, bool automaticMode, int64_t atMs) {
+  Slot* slot = findOrInsert(deviceId);
+  if (slot == nullptr) {
+    return;
+  }
+  uint64_t flags = STATUS_PRESENT;
+  if (pumpStatus) flags |= STATUS_PUMP;
+  if (automaticMode) flags |= STATUS_AUTOMATIC;
+
+  slot->lock();
+  slot->set(WORD_STATUS_FLAGS, flags);
+  slot->set(WORD_STATUS_AT, (uint64_t)atMs);
+  slot->unlock();
+}
+
+void LatestStateCache::updatePresence(const std::string& deviceId, const std::string& status, int64_t atMs) {
+  Slot* slot = findOrInsert(deviceId);
+  if (slot == nullptr) {
+    return;
+  }
+  uint64_t text[2] = {0, 0};
+  std::memcpy(text, status.data(), std::min(status.size(), PRESENCE_TEXT_BYTES - 1));
+
+  slot->lock();
+  slot->set(WORD_PRESENCE_AT, (uint64_t)atMs);
+  slot->set(WORD_PRESENCE_TEXT, text[0]);
+  slot->set(WORD_PRESENCE_TEXT_2, text[1]);
+  slot->unlock();
+}
+
+// Lock-free read of one device; false when the device has no state yet
+bool LatestStateCache::lookup(const std::string& deviceId, DeviceSnapshot& out) const {
+  const Slot* slot = find(deviceId);
+  if (slot == nullptr) {
+    return false;
+  }
+
+  uint64_t words[WORD_COUNT];
+  slot->read(words);
+
+  out = DeviceSnapshot();
+  out.deviceId = deviceId;
+
+  uint64_t readingFlags = words[WORD_READING_FLAGS];
+  out.hasReading = (readingFlags & READING_PRESENT) != 0;
+  out.moisturePercentage = bitsDouble(words[WORD_MOISTURE]);
+  out.moistureDigital = (readingFlags & READING_DIGITAL) != 0;
+  out.pumpStatus = (readingFlags & READING_PUMP_KNOWN) ? ((readingFlags & READING_PUMP_ON) ? 1 : 0) : -1;
+  out.readingAtMs = (int64_t)words[WORD_READING_AT];
+
+  uint64_t statusFlags = words[WORD_STATUS_FLAGS];
+  out.hasStatus = (statusFlags & STATUS_PRESENT) != 0;
+  out.statusPump = (statusFlags & STATUS_PUMP) != 0;
+  out.automaticMode = (statusFlags & STATUS_AUTOMATIC) != 0;
+  out.statusAtMs = (int64_t)words[WORD_STATUS_AT];
+
+  out.hasPresence = words[WORD_PRESENCE_AT] != 0;
+  out.lastSeenMs = (int64_t)words[WORD_PRESENCE_AT];
+  char text[PRESENCE_TEXT_BYTES];
+  std::memcpy(text, &words[WORD_PRESENCE_TEXT], PRESENCE_TEXT_BYTES);
+  text[PRESENCE_TEXT_BYTES - 1] = '\0';
+  out.presenceStatus = text;
+  return true;
+}
+
+// Serialize a snapshot as the JSON served by GET /v1/latest
+std::string latestStateJson(const DeviceSnapshot& snapshot) {
+  std::string out = "{\"device_id\":";
+  appendJsonString(out, snapshot.deviceId);
+
+  out += ",\"reading\":";
+  if (snapshot.hasReading) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.10g", snapshot.moisturePercentage);
+    out += "{\"moisture_percentage\":";
+    out += buffer;
+    out += ",\"moisture_digital\":";
+    out += snapshot.moistureDigital ? "true" : "false";
+    out += ",\"pump_status\":";
+    out += snapshot.pumpStatus < 0 ? "null" : (snapshot.pumpStatus == 1 ? "true" : "false");
+    out += ",\"created_at\":";
+    appendJsonString(out, formatTimestamp(snapshot.readingAtMs));
+    out += '}';
+  } else {
+    out += "null";
+  }
+
+  out += ",\"status\":";
+  if (snapshot.hasStatus) {
+    out += "{\"pump_status\":";
+    out += snapshot.statusPump ? "true" : "false";
+    out += ",\"automatic_mode\":";
+    out += snapshot.automaticMode ? "true" : "false";
+    out += ",\"updated_at\":";
+    appendJsonString(out, formatTimestamp(snapshot.statusAtMs));
+    out += '}';
+  } else {
+    out += "null";
+  }
+
+  out += ",\"presence\":";
+  if (snapshot.hasPresence) {
+    out += "{\"status\":";
+    appendJsonString(out, snapshot.presenceStatus);
+    out += ",\"last_seen\":";
+    appendJsonString(out, formatTimestamp(snapshot.lastSeenMs));
+    out += '}';
+  } else {
+    out += "null";
+  }
+
+  out += '}';
+  return out;
+}
+
+static bool seedQuery(PGconn* connection, const char* query, int columns,
+                      void (*apply)(LatestStateCache&, PGresult*, int), LatestStateCache& cache) {
+  PGresult* result = PQexec(connection, query);
+  bool ok = PQresultStatus(result) == PGRES_TUPLES_OK && PQnfields(result) == columns;
+  if (ok) {
+    for (int row = 0; row < PQntuples(result); row++) {
+      apply(cache, result, row);
+    }
+  } else {
+    std::fprintf(stderr, "[latest] Seed query failed: %s", PQerrorMessage(connection));
+  }
+  PQclear(result);
+  return ok;
+}
+
+static bool boolColumn(PGresult* result, int row, int column) {
+  return !PQgetisnull(result, row, column) && PQgetvalue(result, row, column)[0] == 't';
+}
+
+static int64_t millisColumn(PGresult* result, int row, int column) {
+  return std::strtoll(PQgetvalue(result, row, column), nullptr, 10);
+}
+
+// Seed the cache from Postgres so reads are correct right after a restart
+bool seedLatestState(const GatewayConfig& config, LatestStateCache& cache) {
+  PGconn* connection = PQconnectdb(config.databaseUrl.c_str());
+  if (PQstatus(connection) != CONNECTION_OK) {
+    std::fprintf(stderr, "[latest] Connection failed: %s", PQerrorMessage(connection));
+    PQfinish(connection);
+    return false;
+  }
+
+  // One index probe per device on (device_id, created_at DESC)
+  bool ok = seedQuery(connection,
+                      "SELECT d.device_id, r.moisture_percentage, r.moisture_digital, r.pump_status, "
+                      "(extract(epoch FROM r.created_at) * 1000)::BIGINT "
+                      "FROM public.devices d CROSS JOIN LATERAL ("
+                      "SELECT moisture_percentage, moisture_digital, pump_status, created_at "
+                      "FROM public.sensor_readings s WHERE s.device_id = d.device_id "
+                      "ORDER BY s.created_at DESC LIMIT 1) r",
+                      5,
+                      [](LatestStateCache& target, PGresult* result, int row) {
+                        target.updateReading(PQgetvalue(result, row, 0), std::atof(PQgetvalue(result, row, 1)),
+                                             boolColumn(result, row, 2),
+                                             PQgetisnull(result, row, 3) ? -1 : (boolColumn(result, row, 3) ? 1 : 0),
+                                             millisColumn(result, row, 4));
+                      },
+                      cache);
+
+  ok = seedQuery(connection,
+                 "SELECT device_id, pump_status, automatic_mode, (extract(epoch FROM updated_at) * 1000)::BIGINT "
+                 "FROM public.device_status",
+                 4,
+                 [](LatestStateCache& target, PGresult* result, int row) {
+                   target.updateStatus(PQgetvalue(result, row, 0), boolColumn(result, row, 1),
+                                       boolColumn(result, row, 2), millisColumn(result, row, 3));
+                 },
+                 cache) && ok;
+
+  ok = seedQuery(connection,
+                 "SELECT device_id, status, (extract(epoch FROM last_seen) * 1000)::BIGINT FROM public.device_presence",
+                 3,
+                 [](LatestStateCache& target, PGresult* result, int row) {
+                   target.updatePresence(PQgetvalue(result, row, 0), PQgetvalue(result, row, 1),
+                                         millisColumn(result, row, 2));
+                 },
+                 cache) && ok;
+
+  PQfinish(connection);
+  return ok;
+}
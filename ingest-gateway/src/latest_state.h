@@ -0,0 +1,81 @@
+/*
+ * IriQ Smart Irrigation System - Latest State Header
+ *
+ * Header file for the in-memory cache of each device's latest reading,
+ * status and presence. The gateway updates it on every accepted write and
+ * serves the dashboard's "current value" reads from it.
+ *
+ * Reads never lock: devices live in a fixed-capacity open-addressing table
+ * whose slots are only ever added, and each slot's values are published
+ * under a sequence counter (seqlock), so a reader retries instead of waiting.
+ */
+
+#ifndef GATEWAY_LATEST_STATE_H
+#define GATEWAY_LATEST_STATE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+struct DeviceSnapshot {
+  std::string deviceId;
+
+  bool hasReading = false;
+  double moisturePercentage = 0;
+  bool moistureDigital = false;
+  int pumpStatus = -1;  // -1 when the reading did not include it
+  int64_t readingAtMs = 0;
+
+  bool hasStatus = false;
+  bool statusPump = false;
+  bool automaticMode = false;
+  int64_t statusAtMs = 0;
+
+  bool hasPresence = false;
+  std::string presenceStatus;
+  int64_t lastSeenMs = 0;
+};
+
+class LatestStateCache {
+public:
+  explicit LatestStateCache(size_t capacity);
+  ~LatestStateCache();
+
+  LatestStateCache(const LatestStateCache&) = delete;
+  LatestStateCache& operator=(const LatestStateCache&) = delete;
+
+  // Writers; a device beyond capacity is counted and ignored
+  void updateReading(const std::string& deviceId, double moisturePercentage, bool moistureDigital, int pumpStatus,
+                     int64_t atMs);
+  void updateStatus(const std::string& deviceId, bool pumpStatus, bool automaticMode, int64_t atMs);
+  void updatePresence(const std::string& deviceId, const std::string& status, int64_t atMs);
+
+  // Lock-free read of one device; false when the device has no state yet
+  bool lookup(const std::string& deviceId, DeviceSnapshot& out) const;
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  uint64_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot;
+
+  Slot* findOrInsert(const std::string& deviceId);
+  const Slot* find(const std::string& deviceId) const;
+
+  size_t mask_;
+  std::unique_ptr<std::atomic<Slot*>[]> buckets_;
+  std::atomic<size_t> size_{0};
+  std::atomic<uint64_t> overflows_{0};
+};
+
+// Seed the cache from Postgres so reads are correct right after a restart
+bool seedLatestState(const GatewayConfig& config, LatestStateCache& cache);
+
+// Serialize a snapshot as the JSON served by GET /v1/latest
+std::string latestStateJson(const DeviceSnapshot& snapshot);
+
+#endif // GATEWAY_LATEST_STATE_H
@@ -0,0 +1,86 @@
+/*
+ * IriQ Smart Irrigation System - Ingestion Gateway
+ *
+ * Terminates device HTTP traffic and bulk-writes it to Postgres.
+ * See ../README.md for configuration and the load test.
+ */
+
+#include <signal.h>
+
+#include <cstdio>
+
+#include "config.h"
+#include "device_auth.h"
+#include "event_loop.h"
+#include "gateway.h"
+#include "latest_state.h"
+#include "mqtt_bridge.h"
+#include "pg_writer.h"
+#include "thread_pool.h"
+
+static EventLoop* runningLoop = nullptr;
+
+static void handleSignal(int) {
+  if (runningLoop != nullptr) {
+    runningLoop->stop();
+  }
+}
+
+int main() {
+  GatewayConfig config = loadConfigFromEnvironment();
+  if (config.deviceKey.empty()) {
+    std::fprintf(stderr, "IRIQ_GATEWAY_DEVICE_KEY must be set\n");
+    return 1;
+  }
+
+  DeviceRegistry registry(config);
+  if (!registry.start()) {
+    std::fprintf(stderr, "[gateway] Device list unavailable, retrying every %d s\n", config.deviceRefreshSeconds);
+  }
+
+  LatestStateCache latest(config.cacheCapacity);
+  if (!config.readKey.empty() && !seedLatestState(config, latest)) {
+    std::fprintf(stderr, "[gateway] Latest state not seeded; it fills as devices report\n");
+  }
+
+  PgWriter writer(config);
+  writer.start();
+
+  ThreadPool pool(config.workers);
+  Gateway gateway(config, registry, writer, latest);
+  EventLoop loop(config, pool, [&gateway](const HttpRequest& request, ConnectionContext& context) {
+    return gateway.handle(request, context);
+  });
+  gateway.setConnectionCounter([&loop] { return loop.connectionCount(); });
+
+  // Devices on the MQTT transport reach the same batches through the bridge
+  MqttBridge bridge(config, registry, writer, latest);
+  if (!config.mqttHost.empty()) {
+    bridge.start();
+    gateway.setBridge(&bridge);
+  }
+
+  if (!loop.listen()) {
+    return 1;
+  }
+
+  runningLoop = &loop;
+  signal(SIGINT, handleSignal);
+  signal(SIGTERM, handleSignal);
+  signal(SIGPIPE, SIG_IGN);
+
+  std::printf("[gateway] Listening on port %d with %d workers, %zu devices registered\n", config.port, config.workers,
+              registry.deviceCount());
+  std::fflush(stdout);
+  loop.run();
+
+  // Workers post completions to the loop, so drain them before it goes away;
+  // then flush whatever is still queued
+  std::printf("[gateway] Shutting down\n");
+  pool.stop();
+  bridge.stop();
+  writer.stop();
+  registry.stop();
+  runningLoop = nullptr;
+  return 0;
+}
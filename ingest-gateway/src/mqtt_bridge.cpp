@@ -0,0 +1,409 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Bridge
+ *
+ * Two threads: the broker thread owns the MQTT connection, turns device
+ * messages into PgWriter rows and publishes desired states; the command
+ * thread LISTENs for new control commands and hands their desired state to
+ * the broker thread. A message is acknowledged to the broker only once its
+ * row is queued, so a full queue makes the broker hold and redeliver it.
+ */
+
+#include "mqtt_bridge.h"
+
+#include <libpq-fe.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include "gateway.h"
+#include "json.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const char* TOPIC_PREFIX = "iriq/";
+static const char* NOTIFY_CHANNEL = "iriq_control_commands";
+static const int KEEP_ALIVE_SECONDS = 30;
+static const int BACKOFF_MIN_MS = 1000;
+static const int BACKOFF_MAX_MS = 30000;
+
+// Split "iriq/<device_id>/<kind>"; false for anything else
+static bool parseTopic(const std::string& topic, std::string& deviceId, std::string& kind) {
+  size_t prefixLength = std::char_traits<char>::length(TOPIC_PREFIX);
+  if (topic.compare(0, prefixLength, TOPIC_PREFIX) != 0) {
+    return false;
+  }
+  size_t slash = topic.find('/', prefixLength);
+  if (slash == std::string::npos || slash == prefixLength || topic.find('/', slash + 1) != std::string::npos) {
+    return false;
+  }
+  deviceId = topic.substr(prefixLength, slash - prefixLength);
+  kind = topic.substr(slash + 1);
+  return true;
+}
+
+static std::string desiredTopic(const std::string& deviceId) {
+  return TOPIC_PREFIX + deviceId + "/desired";
+}
+
+MqttBridge::MqttBridge(const GatewayConfig& config, DeviceRegistry& registry, PgWriter& writer,
+                       LatestStateCache& latest)
+    : config_(config), registry_(registry), writer_(writer), latest_(latest) {}
+
+MqttBridge::~MqttBridge() {
+  stop();
+}
+
+void MqttBridge::start() {
+  if (config_.mqttHost.empty()) {
+    return;
+  }
+  stopping_ = false;
+  brokerThread_ = std::thread([this] { runBroker(); });
+  commandThread_ = std::thread([this] { runCommands(); });
+}
+
+void MqttBridge::stop() {
+  stopping_ = true;
+  if (brokerThread_.joinable()) brokerThread_.join();
+  if (commandThread_.joinable()) commandThread_.join();
+}
+
+BridgeStats MqttBridge::stats() const {
+  BridgeStats stats;
+  stats.connected = connected_.load();
+  stats.messages = messages_.load();
+  stats.rejected = rejected_.load();
+  stats.desiredPublished = desiredPublished_.load();
+  stats.onlineDevices = onlineCount_.load();
+  return stats;
+}
+
+bool MqttBridge::sleepUnlessStopping(int milliseconds) const {
+  for (int waited = 0; waited < milliseconds && !stopping_; waited += 100) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return !stopping_;
+}
+
+void MqttBridge::runBroker() {
+  MqttOptions options;
+  options.host = config_.mqttHost;
+  options.port = config_.mqttPort;
+  options.clientId = config_.mqttClientId;
+  options.username = config_.mqttUsername;
+  options.password = config_.mqttPassword;
+  options.keepAliveSeconds = KEEP_ALIVE_SECONDS;
+  options.cleanSession = false;
+
+  int backoffMs = BACKOFF_MIN_MS;
+  while (!stopping_) {
+    MqttClient client;
+    if (!client.connect(options)) {
+      sleepUnlessStopping(backoffMs);
+      backoffMs = std::min(backoffMs * 2, BACKOFF_MAX_MS);
+      continue;
+    }
+    backoffMs = BACKOFF_MIN_MS;
+
+    // Subscribing again also delivers every retained presence message, which
+    // rebuilds the set of connected devices
+    client.subscribe({"iriq/+/telemetry", "iriq/+/status", "iriq/+/presence", "iriq/+/ack"}, 1);
+    std::printf("[bridge] Connected to %s:%d (%s session)\n", options.host.c_str(), options.port,
+                client.sessionPresent() ? "resumed" : "new");
+    std::fflush(stdout);
+
+    client_ = &client;
+    connected_ = true;
+    online_.clear();
+    resyncCommands_ = true;
+
+    auto handler = [this](const MqttMessage& message) { return handleMessage(message); };
+    while (!stopping_ && client.poll(100, handler)) {
+      publishDesired(client);
+      refreshPresence();
+    }
+
+    connected_ = false;
+    client_ = nullptr;
+    if (stopping_) {
+      client.disconnect();
+    } else {
+      std::fprintf(stderr, "[bridge] Broker connection lost, reconnecting\n");
+    }
+  }
+}
+
+bool MqttBridge::handleMessage(const MqttMessage& message) {
+  std::string deviceId;
+  std::string kind;
+  if (!parseTopic(message.topic, deviceId, kind) || !registry_.isKnown(deviceId)) {
+    rejected_++;
+    return true;
+  }
+  // An empty payload only clears a retained message
+  if (message.payload.empty()) {
+    return true;
+  }
+  // Retained messages replay old state on subscribe. Writing them would stamp
+  // a fresh last_seen, so they only tell which devices are still connected.
+  if (message.retained) {
+    if (kind == "presence") {
+      JsonValue body;
+      JsonValue::parse(message.payload, body);
+      if (body["status"].asString() == "offline") {
+        online_.erase(deviceId);
+      } else {
+        online_.emplace(deviceId, Clock::time_point());
+      }
+      onlineCount_ = online_.size();
+    }
+    return true;
+  }
+
+  JsonValue body;
+  if (!JsonValue::parse(message.payload, body) || !body.isObject()) {
+    rejected_++;
+    return true;
+  }
+  messages_++;
+  int64_t now = currentTimeMillis();
+
+  if (kind == "telemetry") {
+    const JsonValue& moisture = body["moisture_percentage"];
+    if (moisture.type() != JsonValue::NUMBER) {
+      rejected_++;
+      return true;
+    }
+    ReadingRow row;
+    row.deviceId = deviceId;
+    row.moisturePercentage = moisture.asNumber();
+    row.moistureDigital = body["moisture_digital"].asBool();
+    const JsonValue& pump = body["pump_status"];
+    row.pumpStatus = pump.type() == JsonValue::BOOL ? (pump.asBool() ? 1 : 0) : -1;
+    row.createdAt = formatTimestamp(now);
+    ReadingRow newest = row;
+    if (!writer_.addReading(std::move(row))) {
+      return false;
+    }
+    latest_.updateReading(deviceId, newest.moisturePercentage, newest.moistureDigital, newest.pumpStatus, now);
+  } else if (kind == "status") {
+    StatusRow row;
+    row.deviceId = deviceId;
+    row.pumpStatus = body["pump_status"].asBool();
+    row.automaticMode = body["automatic_mode"].asBool(true);
+    row.userId = body["user_id"].asString();
+    if (!isUuid(row.userId)) {
+      rejected_++;
+      return true;
+    }
+    bool pumpStatus = row.pumpStatus;
+    bool automaticMode = row.automaticMode;
+    if (!writer_.addStatus(std::move(row))) {
+      return false;
+    }
+    latest_.updateStatus(deviceId, pumpStatus, automaticMode, now);
+  } else if (kind == "presence") {
+    PresenceRow row;
+    row.deviceId = deviceId;
+    row.status = body["status"].asString("online");
+    row.ipAddress = body["ip_address"].asString();
+    row.firmwareVersion = body["firmware_version"].asString();
+    if (body["metrics"].isObject()) {
+      row.metrics = body["metrics"].dump();
+    }
+    std::string status = row.status;
+    if (!writer_.addPresence(std::move(row))) {
+      return false;
+    }
+    latest_.updatePresence(deviceId, status, now);
+
+    // The last will marks a device offline; anything else means connected
+    if (status == "offline") {
+      online_.erase(deviceId);
+    } else {
+      online_[deviceId] = Clock::now();
+    }
+    onlineCount_ = online_.size();
+  } else if (kind == "ack") {
+    return handleAck(deviceId, message.payload);
+  } else {
+    rejected_++;
+  }
+  return true;
+}
+
+// {"ids":"<uuid>,<uuid>"}: the device applied the desired state covering these commands
+bool MqttBridge::handleAck(const std::string& deviceId, const std::string& payload) {
+  JsonValue body;
+  JsonValue::parse(payload, body);
+
+  std::vector<CommandAck> acks;
+  std::stringstream list(body["ids"].asString());
+  std::string id;
+  while (std::getline(list, id, ',')) {
+    if (isUuid(id)) {
+      acks.push_back(CommandAck{deviceId, id});
+    }
+  }
+  if (acks.empty()) {
+    rejected_++;
+    return true;
+  }
+
+  // Clear the desired topic unless a newer command has been published since
+  auto published = publishedCommand_.find(deviceId);
+  bool current = published == publishedCommand_.end() ||
+                 std::any_of(acks.begin(), acks.end(),
+                             [&published](const CommandAck& ack) { return ack.commandId == published->second; });
+
+  if (!writer_.addCommandAcks(std::move(acks))) {
+    return false;
+  }
+  if (current && client_ != nullptr) {
+    client_->publish(desiredTopic(deviceId), "", 1, true);
+    if (published != publishedCommand_.end()) {
+      publishedCommand_.erase(published);
+    }
+  }
+  return true;
+}
+
+void MqttBridge::publishDesired(MqttClient& client) {
+  std::unordered_map<std::string, Desired> pending;
+  {
+    std::lock_guard<std::mutex> lock(outboxMutex_);
+    pending.swap(outbox_);
+  }
+  for (auto& entry : pending) {
+    Desired& desired = entry.second;
+    if (!client.publish(desiredTopic(desired.deviceId), desired.payload, 1, true)) {
+      // Connection lost: the resync after reconnecting publishes it again
+      return;
+    }
+    publishedCommand_[desired.deviceId] = desired.commandId;
+    desiredPublished_++;
+  }
+}
+
+// Devices on MQTT only send presence when they connect, so keep last_seen
+// fresh for the ones whose session is still open
+void MqttBridge::refreshPresence() {
+  Clock::time_point now = Clock::now();
+  if (now - lastRefresh_ < std::chrono::seconds(1)) {
+    return;
+  }
+  lastRefresh_ = now;
+
+  std::chrono::seconds interval(config_.presenceRefreshSeconds);
+  int64_t nowMs = currentTimeMillis();
+  for (auto& entry : online_) {
+    if (now - entry.second < interval) {
+      continue;
+    }
+    PresenceRow row;
+    row.deviceId = entry.first;
+    row.status = "active";
+    if (!writer_.addPresence(std::move(row))) {
+      return;
+    }
+    latest_.updatePresence(entry.first, "active", nowMs);
+    entry.second = now;
+  }
+}
+
+void MqttBridge::runCommands() {
+  PGconn* connection = nullptr;
+  int backoffMs = BACKOFF_MIN_MS;
+
+  while (!stopping_) {
+    if (connection == nullptr) {
+      connection = PQconnectdb(config_.databaseUrl.c_str());
+      PGresult* result = nullptr;
+      if (PQstatus(connection) == CONNECTION_OK) {
+        result = PQexec(connection, (std::string("LISTEN ") + NOTIFY_CHANNEL).c_str());
+      }
+      if (result == nullptr || PQresultStatus(result) != PGRES_COMMAND_OK) {
+        std::fprintf(stderr, "[bridge] Command listener failed: %s", PQerrorMessage(connection));
+        PQclear(result);
+        PQfinish(connection);
+        connection = nullptr;
+        sleepUnlessStopping(backoffMs);
+        backoffMs = std::min(backoffMs * 2, BACKOFF_MAX_MS);
+        continue;
+      }
+      PQclear(result);
+      backoffMs = BACKOFF_MIN_MS;
+      // Commands may have arrived while nobody was listening
+      resyncCommands_ = true;
+    }
+
+    bool ok = true;
+    if (resyncCommands_.exchange(false)) {
+      ok = queueDesired(connection, nullptr);
+    }
+
+    if (ok) {
+      pollfd descriptor{PQsocket(connection), POLLIN, 0};
+      if (::poll(&descriptor, 1, 500) > 0) {
+        ok = PQconsumeInput(connection) == 1;
+      }
+    }
+    while (ok) {
+      PGnotify* notify = PQnotifies(connection);
+      if (notify == nullptr) {
+        break;
+      }
+      ok = queueDesired(connection, notify->extra);
+      PQfreemem(notify);
+    }
+
+    if (!ok) {
+      std::fprintf(stderr, "[bridge] Command listener lost: %s", PQerrorMessage(connection));
+      PQfinish(connection);
+      connection = nullptr;
+      resyncCommands_ = true;
+    }
+  }
+  if (connection != nullptr) {
+    PQfinish(connection);
+  }
+}
+
+// Queue the desired state of one device (or of every device when deviceId is
+// null) built from its pending commands; the newest command wins and the ids
+// of all of them are listed so one ack closes them together
+bool MqttBridge::queueDesired(PGconn* connection, const char* deviceId) {
+  const char* params[1] = {deviceId};
+  PGresult* result = PQexecParams(connection,
+                                  "SELECT device_id, (array_agg(id ORDER BY created_at DESC))[1]::text, "
+                                  "json_build_object("
+                                  "'id', (array_agg(id ORDER BY created_at DESC))[1], "
+                                  "'ids', string_agg(id::text, ',' ORDER BY created_at), "
+                                  "'count', count(*), "
+                                  "'pump_control', (array_agg(pump_control ORDER BY created_at DESC))[1], "
+                                  "'automatic_mode', (array_agg(automatic_mode ORDER BY created_at DESC))[1], "
+                                  "'user_id', (array_agg(user_id ORDER BY created_at DESC))[1])::text "
+                                  "FROM public.control_commands "
+                                  "WHERE NOT executed AND ($1::text IS NULL OR device_id = $1) "
+                                  "GROUP BY device_id",
+                                  1, nullptr, params, nullptr, nullptr, 0);
+  if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+    PQclear(result);
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(outboxMutex_);
+    for (int row = 0; row < PQntuples(result); row++) {
+      Desired desired;
+      desired.deviceId = PQgetvalue(result, row, 0);
+      desired.commandId = PQgetvalue(result, row, 1);
+      desired.payload = PQgetvalue(result, row, 2);
+      outbox_[desired.deviceId] = std::move(desired);
+    }
+  }
+  PQclear(result);
+  return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Bridge Header
+ *
+ * Header file for the bridge between an MQTT broker and the existing tables.
+ * Devices on the MQTT transport publish under iriq/<device_id>/:
+ *
+ *   telemetry  QoS 1   sensor reading       -> sensor_readings
+ *   status     QoS 1   pump and mode state  -> device_status
+ *   presence   QoS 1   retained "active", LWT "offline", periodic metrics
+ *                                           -> device_presence
+ *   ack        QoS 1   executed command ids -> control_commands.executed
+ *
+ * and subscribe to iriq/<device_id>/desired, a retained message carrying the
+ * newest pending command. The bridge publishes it when Postgres notifies a
+ * new command (LISTEN iriq_control_commands) and clears it once acknowledged.
+ * Writes go through the same PgWriter batches as HTTP traffic.
+ */
+
+#ifndef GATEWAY_MQTT_BRIDGE_H
+#define GATEWAY_MQTT_BRIDGE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "config.h"
+#include "device_auth.h"
+#include "latest_state.h"
+#include "mqtt_client.h"
+#include "pg_writer.h"
+
+struct BridgeStats {
+  bool connected = false;
+  uint64_t messages = 0;
+  uint64_t rejected = 0;
+  uint64_t desiredPublished = 0;
+  size_t onlineDevices = 0;
+};
+
+class MqttBridge {
+public:
+  MqttBridge(const GatewayConfig& config, DeviceRegistry& registry, PgWriter& writer, LatestStateCache& latest);
+  ~MqttBridge();
+
+  // Start the broker and command threads; no-op when no broker is configured
+  void start();
+  void stop();
+
+  BridgeStats stats() const;
+
+private:
+  // Newest pending command of one device, as published on its desired topic
+  struct Desired {
+    std::string deviceId;
+    std::string commandId;
+    std::string payload;
+  };
+
+  void runBroker();
+  void runCommands();
+  bool handleMessage(const MqttMessage& message);
+  bool handleAck(const std::string& deviceId, const std::string& payload);
+  void publishDesired(MqttClient& client);
+  void refreshPresence();
+  bool queueDesired(struct pg_conn* connection, const char* deviceId);
+  bool sleepUnlessStopping(int milliseconds) const;
+
+  const GatewayConfig& config_;
+  DeviceRegistry& registry_;
+  PgWriter& writer_;
+  LatestStateCache& latest_;
+
+  std::atomic<bool> stopping_{false};
+  std::thread brokerThread_;
+  std::thread commandThread_;
+
+  // Handed from the command thread to the broker thread, which owns the client
+  std::mutex outboxMutex_;
+  std::unordered_map<std::string, Desired> outbox_;  // Newest per device
+  std::atomic<bool> resyncCommands_{true};
+
+  // Broker thread only
+  MqttClient* client_ = nullptr;
+  std::chrono::steady_clock::time_point lastRefresh_;
+  std::unordered_map<std::string, std::string> publishedCommand_;  // Device -> command on its desired topic
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point> online_;  // Device -> last presence write
+
+  std::atomic<bool> connected_{false};
+  std::atomic<uint64_t> messages_{0};
+  std::atomic<uint64_t> rejected_{0};
+  std::atomic<uint64_t> desiredPublished_{0};
+  std::atomic<size_t> onlineCount_{0};
+};
+
+#endif // GATEWAY_MQTT_BRIDGE_H
@@ -0,0 +1,353 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Client
+ *
+ * Packets are encoded and decoded by hand (MQTT 3.1.1, section 2-3). Sends
+ * block with a timeout; reads are driven by poll() so the owning thread can
+ * interleave its own work between packets.
+ */
+
+#include "mqtt_client.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+using Clock = std::chrono::steady_clock;
+
+enum MqttPacketType {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14
+};
+
+static const size_t MAX_PACKET_BYTES = 262144;
+static const int CONNECT_TIMEOUT_MS = 10000;
+static const size_t READ_CHUNK = 16384;
+
+static void appendUint16(std::string& out, uint16_t value) {
+  out += (char)(value >> 8);
+  out += (char)(value & 0xFF);
+}
+
+static void appendString(std::string& out, const std::string& text) {
+  appendUint16(out, (uint16_t)text.size());
+  out += text;
+}
+
+static uint16_t readUint16(const std::string& data, size_t offset) {
+  return (uint16_t)(((uint8_t)data[offset] << 8) | (uint8_t)data[offset + 1]);
+}
+
+static int connectSocket(const std::string& host, int port) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  std::string portText = std::to_string(port);
+  if (getaddrinfo(host.c_str(), portText.c_str(), &hints, &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+
+  if (fd >= 0) {
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    timeval timeout{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  }
+  return fd;
+}
+
+MqttClient::~MqttClient() {
+  close();
+}
+
+bool MqttClient::connect(const MqttOptions& options) {
+  close();
+  fd_ = connectSocket(options.host, options.port);
+  if (fd_ < 0) {
+    std::fprintf(stderr, "[mqtt] Cannot reach %s:%d\n", options.host.c_str(), options.port);
+    return false;
+  }
+  keepAliveSeconds_ = options.keepAliveSeconds;
+
+  uint8_t flags = options.cleanSession ? 0x02 : 0x00;
+  if (!options.username.empty()) flags |= 0x80;
+  if (!options.password.empty()) flags |= 0x40;
+
+  std::string body;
+  appendString(body, "MQTT");
+  body += (char)4;  // Protocol level 3.1.1
+  body += (char)flags;
+  appendUint16(body, (uint16_t)keepAliveSeconds_);
+  appendString(body, options.clientId);
+  if (!options.username.empty()) appendString(body, options.username);
+  if (!options.password.empty()) appendString(body, options.password);
+
+  if (!sendPacket(MQTT_CONNECT << 4, body)) {
+    close();
+    return false;
+  }
+
+  // CONNACK is always the first packet back
+  Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+  uint8_t header = 0;
+  std::string reply;
+  while (!nextPacket(header, reply)) {
+    int remaining = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+    if (remaining <= 0 || !readAvailable(remaining)) {
+      std::fprintf(stderr, "[mqtt] No CONNACK from %s:%d\n", options.host.c_str(), options.port);
+      close();
+      return false;
+    }
+  }
+  if ((header >> 4) != MQTT_CONNACK || reply.size() != 2 || reply[1] != 0) {
+    std::fprintf(stderr, "[mqtt] Connection refused (code %d)\n", reply.size() == 2 ? (int)reply[1] : -1);
+    close();
+    return false;
+  }
+  sessionPresent_ = (reply[0] & 0x01) != 0;
+  pingOutstanding_ = false;
+  return true;
+}
+
+bool MqttClient::subscribe(const std::vector<std::string>& filters, int qos) {
+  std::string body;
+  appendUint16(body, nextPacketId_++);
+  if (nextPacketId_ == 0) nextPacketId_ = 1;
+  for (const auto& filter : filters) {
+    appendString(body, filter);
+    body += (char)qos;
+  }
+  return sendPacket((MQTT_SUBSCRIBE << 4) | 0x02, body);
+}
+
+bool MqttClient::publish(const std::string& topic, const std::string& payload, int qos, bool retain) {
+  std::string body;
+  appendString(body, topic);
+  if (qos > 0) {
+    appendUint16(body, nextPacketId_++);
+    if (nextPacketId_ == 0) nextPacketId_ = 1;
+  }
+  body += payload;
+  uint8_t header = (uint8_t)((MQTT_PUBLISH << 4) | (qos > 0 ? 0x02 : 0x00) | (retain ? 0x01 : 0x00));
+  return sendPacket(header, body);
+}
+
+bool MqttClient::poll(int timeoutMs, const MessageHandler& handler) {
+  if (fd_ < 0) {
+    return false;
+  }
+
+  // Keep-alive: ping after half the interval without traffic from us, and
+  // give up when the broker has not answered within a full interval
+  Clock::time_point now = Clock::now();
+  if (keepAliveSeconds_ > 0) {
+    if (pingOutstanding_ && now - pingSent_ > std::chrono::seconds(keepAliveSeconds_)) {
+      std::fprintf(stderr, "[mqtt] Broker stopped answering pings\n");
+      close();
+      return false;
+    }
+    if (!pingOutstanding_ && now - lastSent_ >= std::chrono::milliseconds(keepAliveSeconds_ * 500)) {
+      if (!sendPacket(MQTT_PINGREQ << 4, "")) {
+        return false;
+      }
+      pingOutstanding_ = true;
+      pingSent_ = now;
+    }
+  }
+
+  uint8_t header = 0;
+  std::string body;
+  bool handled = false;
+  while (nextPacket(header, body)) {
+    handled = true;
+    if (!handlePacket(header, body, handler)) {
+      return false;
+    }
+  }
+  if (handled) {
+    return true;
+  }
+
+  if (!readAvailable(timeoutMs)) {
+    return false;
+  }
+  while (nextPacket(header, body)) {
+    if (!handlePacket(header, body, handler)) {
+      return false;
+    }
+  }
+  return fd_ >= 0;
+}
+
+void MqttClient::disconnect() {
+  if (fd_ >= 0) {
+    sendPacket(MQTT_DISCONNECT << 4, "");
+  }
+  close();
+}
+
+bool MqttClient::sendPacket(uint8_t header, const std::string& body) {
+  if (fd_ < 0) {
+    return false;
+  }
+
+  std::string packet;
+  packet.reserve(body.size() + 5);
+  packet += (char)header;
+  size_t length = body.size();
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    if (length > 0) digit |= 0x80;
+    packet += (char)digit;
+  } while (length > 0);
+  packet += body;
+
+  size_t offset = 0;
+  while (offset < packet.size()) {
+    ssize_t sent = send(fd_, packet.data() + offset, packet.size() - offset, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      std::fprintf(stderr, "[mqtt] Send failed, connection closed\n");
+      close();
+      return false;
+    }
+    offset += (size_t)sent;
+  }
+  lastSent_ = Clock::now();
+  return true;
+}
+
+// Wait for input and append it to the buffer; false when the connection closed
+bool MqttClient::readAvailable(int timeoutMs) {
+  pollfd descriptor{fd_, POLLIN, 0};
+  int ready = ::poll(&descriptor, 1, timeoutMs);
+  if (ready <= 0) {
+    return ready == 0;
+  }
+
+  char chunk[READ_CHUNK];
+  ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+  if (received <= 0) {
+    std::fprintf(stderr, "[mqtt] Connection closed by broker\n");
+    close();
+    return false;
+  }
+  input_.append(chunk, (size_t)received);
+  return true;
+}
+
+// Take one complete packet off the buffer, if there is one
+bool MqttClient::nextPacket(uint8_t& header, std::string& body) {
+  if (input_.size() < 2) {
+    return false;
+  }
+
+  size_t length = 0;
+  size_t multiplier = 1;
+  size_t offset = 1;
+  while (true) {
+    if (offset >= input_.size()) {
+      return false;
+    }
+    uint8_t digit = (uint8_t)input_[offset++];
+    length += (digit & 0x7F) * multiplier;
+    if ((digit & 0x80) == 0) {
+      break;
+    }
+    multiplier *= 128;
+    if (offset > 4) {
+      length = MAX_PACKET_BYTES + 1;  // Malformed length: treated as oversized
+      break;
+    }
+  }
+  if (length > MAX_PACKET_BYTES) {
+    std::fprintf(stderr, "[mqtt] Oversized or malformed packet, dropping connection\n");
+    close();
+    return false;
+  }
+  if (input_.size() < offset + length) {
+    return false;
+  }
+
+  header = (uint8_t)input_[0];
+  body.assign(input_, offset, length);
+  input_.erase(0, offset + length);
+  return true;
+}
+
+bool MqttClient::handlePacket(uint8_t header, const std::string& body, const MessageHandler& handler) {
+  switch (header >> 4) {
+    case MQTT_PUBLISH: {
+      if (body.size() < 2) {
+        return true;
+      }
+      MqttMessage message;
+      message.qos = (header >> 1) & 0x03;
+      message.retained = (header & 0x01) != 0;
+      size_t topicLength = readUint16(body, 0);
+      size_t offset = 2 + topicLength + (message.qos > 0 ? 2 : 0);
+      if (offset > body.size()) {
+        return true;
+      }
+      message.topic.assign(body, 2, topicLength);
+      message.payload.assign(body, offset, std::string::npos);
+      if (handler && !handler(message)) {
+        close();
+        return false;
+      }
+      if (message.qos > 0) {
+        std::string ack;
+        appendUint16(ack, readUint16(body, 2 + topicLength));
+        return sendPacket(MQTT_PUBACK << 4, ack);
+      }
+      return true;
+    }
+    case MQTT_SUBACK:
+      for (size_t i = 2; i < body.size(); i++) {
+        if ((uint8_t)body[i] == 0x80) {
+          std::fprintf(stderr, "[mqtt] Broker rejected a subscription\n");
+        }
+      }
+      return true;
+    case MQTT_PINGRESP:
+      pingOutstanding_ = false;
+      return true;
+    default:
+      // PUBACK for our own publishes needs no action
+      return true;
+  }
+}
+
+void MqttClient::close() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  input_.clear();
+}
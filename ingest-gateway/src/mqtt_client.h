@@ -0,0 +1,84 @@
+/*
+ * IriQ Smart Irrigation System - MQTT Client Header
+ *
+ * Header file for the minimal MQTT 3.1.1 client used by the bridge. It
+ * covers what the bridge needs: one blocking TCP connection, persistent
+ * sessions, QoS 0/1 publish and subscribe, and retained messages. Not
+ * thread-safe; one thread owns the client.
+ */
+
+#ifndef GATEWAY_MQTT_CLIENT_H
+#define GATEWAY_MQTT_CLIENT_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct MqttOptions {
+  std::string host;
+  int port = 1883;
+  std::string clientId;
+  std::string username;
+  std::string password;
+  int keepAliveSeconds = 30;
+  bool cleanSession = false;  // Keep subscriptions and queued QoS 1 messages across reconnects
+};
+
+struct MqttMessage {
+  std::string topic;
+  std::string payload;
+  int qos = 0;
+  bool retained = false;
+};
+
+class MqttClient {
+public:
+  // Return false to leave a QoS 1 message unacknowledged: the connection is
+  // dropped and the broker redelivers it when the session resumes
+  using MessageHandler = std::function<bool(const MqttMessage&)>;
+
+  MqttClient() = default;
+  ~MqttClient();
+
+  MqttClient(const MqttClient&) = delete;
+  MqttClient& operator=(const MqttClient&) = delete;
+
+  // Open the socket, send CONNECT and wait for CONNACK
+  bool connect(const MqttOptions& options);
+
+  // Subscribe to filters at one QoS; the SUBACK is checked by poll()
+  bool subscribe(const std::vector<std::string>& filters, int qos);
+
+  // Publish; a QoS 1 PUBACK is consumed by poll() without being waited for
+  bool publish(const std::string& topic, const std::string& payload, int qos, bool retain);
+
+  // Wait up to timeoutMs for packets, hand PUBLISHes to handler (acknowledged
+  // after it accepts them) and keep the connection alive. False once it is lost.
+  bool poll(int timeoutMs, const MessageHandler& handler);
+
+  void disconnect();
+  bool connected() const { return fd_ >= 0; }
+
+  // True when the broker resumed a stored session on the last connect
+  bool sessionPresent() const { return sessionPresent_; }
+
+private:
+  bool sendPacket(uint8_t header, const std::string& body);
+  bool readAvailable(int timeoutMs);
+  bool nextPacket(uint8_t& header, std::string& body);
+  bool handlePacket(uint8_t header, const std::string& body, const MessageHandler& handler);
+  void close();
+
+  int fd_ = -1;
+  std::string input_;
+  uint16_t nextPacketId_ = 1;
+  int keepAliveSeconds_ = 30;
+  bool sessionPresent_ = false;
+  bool pingOutstanding_ = false;
+  std::chrono::steady_clock::time_point lastSent_;
+  std::chrono::steady_clock::time_point pingSent_;
+};
+
+#endif // GATEWAY_MQTT_CLIENT_H
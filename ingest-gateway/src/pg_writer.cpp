@@ -0,0 +1,433 @@
+/*
+ * IriQ Smart Irrigation System - Postgres Writer
+ *
+ * One flush = one transaction:
+ *   - readings and auth logs are streamed with COPY into their tables
+ *   - presence and status are coalesced to the latest row per device, COPYed
+ *     into temporary staging tables and applied with one upsert each
+ *   - command acknowledgements are COPYed and applied with one UPDATE
+ * Handlers validate every field before queueing. A batch that fails because
+ * the connection dropped is kept and retried; one the database rejects while
+ * the connection is healthy is dropped so it cannot block later batches.
+ */
+
+#include "pg_writer.h"
+
+#include <libpq-fe.h>
+
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+// Milliseconds since the Unix epoch
+int64_t currentTimeMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// ISO 8601 UTC timestamp with milliseconds
+std::string formatTimestamp(int64_t epochMs) {
+  std::time_t seconds = (std::time_t)(epochMs / 1000);
+  std::tm parts;
+  gmtime_r(&seconds, &parts);
+  char buffer[40];
+  size_t length = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &parts);
+  std::snprintf(buffer + length, sizeof(buffer) - length, ".%03dZ", (int)(epochMs % 1000));
+  return buffer;
+}
+
+// Current UTC time as an ISO 8601 timestamp with milliseconds
+std::string utcTimestamp() {
+  return formatTimestamp(currentTimeMillis());
+}
+
+// Append one COPY text-format field (NULL when empty and nullable)
+static void appendField(std::string& out, const std::string& value, bool nullWhenEmpty = false) {
+  if (nullWhenEmpty && value.empty()) {
+    out += "\\N";
+    return;
+  }
+  for (char c : value) {
+    switch (c) {
+      case '\\': out += "\\\\"; break;
+      case '\t': out += "\\t"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      default: out += c;
+    }
+  }
+}
+
+static void appendBool(std::string& out, bool value) {
+  out += value ? 't' : 'f';
+}
+
+static void appendNumber(std::string& out, double value) {
+  char buffer[32];
+  std::snprintf(buffer, sizeof(buffer), "%.10g", value);
+  out += buffer;
+}
+
+size_t PgWriter::Batch::rows() const {
+  return readings.size() + presence.size() + status.size() + acks.size() + authLogs.size();
+}
+
+// Put a failed batch back behind rows queued since; newer device state wins
+void PgWriter::Batch::mergeOlder(Batch& older) {
+  readings.insert(readings.end(), older.readings.begin(), older.readings.end());
+  for (auto& entry : older.presence) {
+    presence.emplace(entry.first, std::move(entry.second));
+  }
+  for (auto& entry : older.status) {
+    status.emplace(entry.first, std::move(entry.second));
+  }
+  acks.insert(acks.end(), older.acks.begin(), older.acks.end());
+  authLogs.insert(authLogs.end(), older.authLogs.begin(), older.authLogs.end());
+}
+
+PgWriter::PgWriter(const GatewayConfig& config) : config_(config) {}
+
+PgWriter::~PgWriter() {
+  stop();
+  if (connection_ != nullptr) {
+    PQfinish(connection_);
+  }
+}
+
+void PgWriter::start() {
+  flushThread_ = std::thread(&PgWriter::run, this);
+}
+
+// Flush what is queued and stop the flush thread
+void PgWriter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  if (flushThread_.joinable()) {
+    flushThread_.join();
+  }
+}
+
+bool PgWriter::hasRoom(size_t rows) {
+  return pending_.rows() + rows <= config_.maxQueuedRows;
+}
+
+// Wake the flush thread early once a full batch is waiting (mutex_ held)
+void PgWriter::rowsAdded() {
+  if (pending_.rows() >= config_.flushBatchRows) {
+    wake_.notify_one();
+  }
+}
+
+bool PgWriter::addReading(ReadingRow row) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!hasRoom(1)) {
+    return false;
+  }
+  pending_.readings.push_back(std::move(row));
+  rowsAdded();
+  return true;
+}
+
+bool PgWriter::addPresence(PresenceRow row) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!hasRoom(1)) {
+    return false;
+  }
+  auto& slot = pending_.presence[row.deviceId];
+  // Keep the last metrics seen in this batch when a later heartbeat has none
+  if (row.metrics.empty()) {
+    row.metrics = std::move(slot.metrics);
+  }
+  slot = std::move(row);
+  rowsAdded();
+  return true;
+}
+
+bool PgWriter::addStatus(StatusRow row) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!hasRoom(1)) {
+    return false;
+  }
+  pending_.status[row.deviceId] = std::move(row);
+  rowsAdded();
+  return true;
+}
+
+bool PgWriter::addCommandAcks(std::vector<CommandAck> acks) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!hasRoom(acks.size())) {
+    return false;
+  }
+  pending_.acks.insert(pending_.acks.end(), acks.begin(), acks.end());
+  rowsAdded();
+  return true;
+}
+
+bool PgWriter::addAuthLog(AuthLogRow row) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!hasRoom(1)) {
+    return false;
+  }
+  pending_.authLogs.push_back(std::move(row));
+  rowsAdded();
+  return true;
+}
+
+WriterStats PgWriter::stats() const {
+  WriterStats stats;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.queuedRows = pending_.rows();
+  }
+  stats.flushes = flushes_.load();
+  stats.flushedRows = flushedRows_.load();
+  stats.failedFlushes = failedFlushes_.load();
+  stats.droppedRows = droppedRows_.load();
+  stats.lastFlushMs = lastFlushMs_.load();
+  return stats;
+}
+
+void PgWriter::run() {
+  int failures = 0;
+
+  while (true) {
+    Batch batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait_for(lock, std::chrono::milliseconds(config_.flushIntervalMs),
+                     [this] { return stopping_ || pending_.rows() >= config_.flushBatchRows; });
+      if (pending_.rows() == 0) {
+        if (stopping_) {
+          break;
+        }
+        continue;
+      }
+      std::swap(batch, pending_);
+    }
+
+    if (flush(batch)) {
+      failures = 0;
+      continue;
+    }
+
+    failedFlushes_++;
+
+    // The connection survived, so the database rejected the data itself:
+    // retrying would block every later batch behind it
+    if (connection_ != nullptr) {
+      droppedRows_ += batch.rows();
+      std::fprintf(stderr, "[writer] Batch rejected, dropped %zu rows\n", batch.rows());
+      continue;
+    }
+
+    failures++;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_ && failures >= 3) {
+      droppedRows_ += batch.rows() + pending_.rows();
+      std::fprintf(stderr, "[writer] Giving up on %zu rows at shutdown\n", batch.rows() + pending_.rows());
+      break;
+    }
+    if (pending_.rows() + batch.rows() <= config_.maxQueuedRows) {
+      pending_.mergeOlder(batch);
+    } else {
+      droppedRows_ += batch.rows();
+      std::fprintf(stderr, "[writer] Queue full, dropped %zu rows\n", batch.rows());
+    }
+    // Back off while the database is unreachable: 0.5 s, 1 s, 2 s ... 10 s
+    int delayMs = failures >= 5 ? 10000 : 250 << failures;
+    wake_.wait_for(lock, std::chrono::milliseconds(delayMs), [this] { return stopping_; });
+  }
+}
+
+bool PgWriter::connect() {
+  connection_ = PQconnectdb(config_.databaseUrl.c_str());
+  if (PQstatus(connection_) != CONNECTION_OK) {
+    std::fprintf(stderr, "[writer] Connection failed: %s", PQerrorMessage(connection_));
+    PQfinish(connection_);
+    connection_ = nullptr;
+    return false;
+  }
+
+  // Staging tables live for the session and are emptied by every commit
+  bool ok = exec("CREATE TEMP TABLE gateway_presence (device_id TEXT, status TEXT, ip_address TEXT, "
+                 "firmware_version TEXT, metrics JSONB) ON COMMIT DELETE ROWS") &&
+            exec("CREATE TEMP TABLE gateway_status (device_id TEXT, pump_status BOOLEAN, "
+                 "automatic_mode BOOLEAN, user_id UUID) ON COMMIT DELETE ROWS") &&
+            exec("CREATE TEMP TABLE gateway_acks (device_id TEXT, id UUID) ON COMMIT DELETE ROWS");
+  if (!ok) {
+    PQfinish(connection_);
+    connection_ = nullptr;
+  }
+  return ok;
+}
+
+bool PgWriter::exec(const char* statement) {
+  PGresult* result = PQexec(connection_, statement);
+  bool ok = PQresultStatus(result) == PGRES_COMMAND_OK;
+  if (!ok) {
+    std::fprintf(stderr, "[writer] %s", PQerrorMessage(connection_));
+  }
+  PQclear(result);
+  return ok;
+}
+
+bool PgWriter::copyRows(const char* statement, const std::string& data) {
+  PGresult* result = PQexec(connection_, statement);
+  bool ok = PQresultStatus(result) == PGRES_COPY_IN;
+  PQclear(result);
+  if (!ok) {
+    std::fprintf(stderr, "[writer] COPY failed to start: %s", PQerrorMessage(connection_));
+    return false;
+  }
+
+  ok = PQputCopyData(connection_, data.data(), (int)data.size()) == 1 && PQputCopyEnd(connection_, nullptr) == 1;
+  while ((result = PQgetResult(connection_)) != nullptr) {
+    if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+      ok = false;
+    }
+    PQclear(result);
+  }
+  if (!ok) {
+    std::fprintf(stderr, "[writer] COPY failed: %s", PQerrorMessage(connection_));
+  }
+  return ok;
+}
+
+bool PgWriter::flush(const Batch& batch) {
+  if (connection_ == nullptr && !connect()) {
+    return false;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  bool ok = exec("BEGIN");
+
+  if (ok && !batch.readings.empty()) {
+    std::string data;
+    data.reserve(batch.readings.size() * 80);
+    for (const auto& row : batch.readings) {
+      appendField(data, row.deviceId);
+      data += '\t';
+      appendNumber(data, row.moisturePercentage);
+      data += '\t';
+      appendBool(data, row.moistureDigital);
+      data += '\t';
+      if (row.pumpStatus < 0) {
+        data += "\\N";
+      } else {
+        appendBool(data, row.pumpStatus == 1);
+      }
+      data += '\t';
+      appendField(data, row.createdAt);
+      data += '\t';
+      appendField(data, row.heardAt, true);
+      data += '\n';
+    }
+    ok = copyRows("COPY public.sensor_readings (device_id, moisture_percentage, moisture_digital, pump_status, "
+                  "created_at, heard_at) FROM STDIN",
+                  data);
+  }
+
+  if (ok && !batch.presence.empty()) {
+    std::string data;
+    for (const auto& entry : batch.presence) {
+      const PresenceRow& row = entry.second;
+      appendField(data, row.deviceId);
+      data += '\t';
+      appendField(data, row.status);
+      data += '\t';
+      appendField(data, row.ipAddress, true);
+      data += '\t';
+      appendField(data, row.firmwareVersion, true);
+      data += '\t';
+      appendField(data, row.metrics, true);
+      data += '\n';
+    }
+    ok = copyRows("COPY gateway_presence FROM STDIN", data) &&
+         exec("INSERT INTO public.device_presence (device_id, status, ip_address, firmware_version, metrics) "
+              "SELECT device_id, status, ip_address, firmware_version, metrics FROM gateway_presence "
+              "ON CONFLICT (device_id) DO UPDATE SET "
+              "status = EXCLUDED.status, "
+              "ip_address = coalesce(EXCLUDED.ip_address, device_presence.ip_address), "
+              "firmware_version = coalesce(EXCLUDED.firmware_version, device_presence.firmware_version), "
+              "metrics = coalesce(EXCLUDED.metrics, device_presence.metrics)");
+  }
+
+  if (ok && !batch.status.empty()) {
+    std::string data;
+    for (const auto& entry : batch.status) {
+      const StatusRow& row = entry.second;
+      appendField(data, row.deviceId);
+      data += '\t';
+      appendBool(data, row.pumpStatus);
+      data += '\t';
+      appendBool(data, row.automaticMode);
+      data += '\t';
+      appendField(data, row.userId);
+      data += '\n';
+    }
+    ok = copyRows("COPY gateway_status FROM STDIN", data) &&
+         exec("INSERT INTO public.device_status (device_id, pump_status, automatic_mode, user_id) "
+              "SELECT device_id, pump_status, automatic_mode, user_id FROM gateway_status "
+              "ON CONFLICT (device_id) DO UPDATE SET "
+              "pump_status = EXCLUDED.pump_status, "
+              "automatic_mode = EXCLUDED.automatic_mode, "
+              "user_id = EXCLUDED.user_id, "
+              "updated_at = now()");
+  }
+
+  if (ok && !batch.acks.empty()) {
+    std::string data;
+    for (const auto& ack : batch.acks) {
+      appendField(data, ack.deviceId);
+      data += '\t';
+      appendField(data, ack.commandId);
+      data += '\n';
+    }
+    // A device can only acknowledge its own commands
+    ok = copyRows("COPY gateway_acks FROM STDIN", data) &&
+         exec("UPDATE public.control_commands c "
+              "SET executed = TRUE, executed_at = coalesce(c.executed_at, now()) "
+              "FROM gateway_acks a "
+              "WHERE c.id = a.id AND c.device_id = a.device_id AND NOT c.executed");
+  }
+
+  if (ok && !batch.authLogs.empty()) {
+    std::string data;
+    for (const auto& row : batch.authLogs) {
+      appendField(data, row.deviceId);
+      data += '\t';
+      appendBool(data, row.success);
+      data += '\t';
+      appendField(data, row.ipAddress, true);
+      data += '\t';
+      appendField(data, row.userAgent, true);
+      data += '\t';
+      appendField(data, row.createdAt);
+      data += '\n';
+    }
+    ok = copyRows("COPY public.device_auth_logs (device_id, success, ip_address, user_agent, created_at) FROM STDIN",
+                  data);
+  }
+
+  ok = ok && exec("COMMIT");
+
+  if (!ok) {
+    if (PQstatus(connection_) == CONNECTION_OK) {
+      PGresult* result = PQexec(connection_, "ROLLBACK");
+      PQclear(result);
+    } else {
+      PQfinish(connection_);
+      connection_ = nullptr;
+    }
+    return false;
+  }
+
+  double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+  flushes_++;
+  flushedRows_ += batch.rows();
+  lastFlushMs_ = elapsedMs;
+  return true;
+}
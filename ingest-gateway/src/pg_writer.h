@@ -0,0 +1,137 @@
+/*
+ * IriQ Smart Irrigation System - Postgres Writer Header
+ *
+ * Header file for the batching writer. Request handlers only append rows to
+ * an in-memory batch; a single flush thread writes the batch from every
+ * device in one transaction using COPY, so database cost scales with flushes
+ * rather than with requests.
+ *
+ * Durability: a request is acknowledged once its row is queued. Rows queued
+ * at the moment of a crash (at most flushIntervalMs of traffic) are lost;
+ * failed flushes are retried while the queue stays under maxQueuedRows.
+ */
+
+#ifndef GATEWAY_PG_WRITER_H
+#define GATEWAY_PG_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "config.h"
+
+struct ReadingRow {
+  std::string deviceId;
+  double moisturePercentage = 0;
+  bool moistureDigital = false;
+  int pumpStatus = -1;  // -1 when the firmware did not send it
+  std::string createdAt;
+  std::string heardAt;  // Empty unless a gateway controller relayed the reading
+};
+
+struct PresenceRow {
+  std::string deviceId;
+  std::string status;
+  std::string ipAddress;
+  std::string firmwareVersion;
+  std::string metrics;  // JSON text, empty when the heartbeat carried none
+};
+
+struct StatusRow {
+  std::string deviceId;
+  bool pumpStatus = false;
+  bool automaticMode = false;
+  std::string userId;
+};
+
+struct CommandAck {
+  std::string deviceId;
+  std::string commandId;
+};
+
+struct AuthLogRow {
+  std::string deviceId;
+  bool success = true;
+  std::string ipAddress;
+  std::string userAgent;
+  std::string createdAt;
+};
+
+struct WriterStats {
+  size_t queuedRows = 0;
+  uint64_t flushes = 0;
+  uint64_t flushedRows = 0;
+  uint64_t failedFlushes = 0;
+  uint64_t droppedRows = 0;
+  double lastFlushMs = 0;
+};
+
+class PgWriter {
+public:
+  explicit PgWriter(const GatewayConfig& config);
+  ~PgWriter();
+
+  void start();
+  // Flush what is queued and stop the flush thread
+  void stop();
+
+  // Queue rows; false when the queue is full and the caller should answer 503
+  bool addReading(ReadingRow row);
+  bool addPresence(PresenceRow row);
+  bool addStatus(StatusRow row);
+  bool addCommandAcks(std::vector<CommandAck> acks);
+  bool addAuthLog(AuthLogRow row);
+
+  WriterStats stats() const;
+
+private:
+  struct Batch {
+    std::vector<ReadingRow> readings;
+    std::unordered_map<std::string, PresenceRow> presence;  // Latest per device
+    std::unordered_map<std::string, StatusRow> status;      // Latest per device
+    std::vector<CommandAck> acks;
+    std::vector<AuthLogRow> authLogs;
+
+    size_t rows() const;
+    void mergeOlder(Batch& older);
+  };
+
+  bool hasRoom(size_t rows);
+  void rowsAdded();
+  void run();
+  bool connect();
+  bool flush(const Batch& batch);
+  bool copyRows(const char* statement, const std::string& data);
+  bool exec(const char* statement);
+
+  const GatewayConfig& config_;
+  struct pg_conn* connection_ = nullptr;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  Batch pending_;
+  bool stopping_ = false;
+  std::thread flushThread_;
+
+  std::atomic<uint64_t> flushes_{0};
+  std::atomic<uint64_t> flushedRows_{0};
+  std::atomic<uint64_t> failedFlushes_{0};
+  std::atomic<uint64_t> droppedRows_{0};
+  std::atomic<double> lastFlushMs_{0};
+};
+
+// Milliseconds since the Unix epoch
+int64_t currentTimeMillis();
+
+// ISO 8601 UTC timestamp with milliseconds
+std::string formatTimestamp(int64_t epochMs);
+
+// Current UTC time as an ISO 8601 timestamp with milliseconds
+std::string utcTimestamp();
+
+#endif // GATEWAY_PG_WRITER_H
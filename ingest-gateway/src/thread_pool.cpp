@@ -0,0 +1,73 @@
+/*
+ * IriQ Smart Irrigation System - Thread Pool
+ *
+ * Workers take tasks from a single FIFO queue. Handlers are short (parse,
+ * enqueue a write, or one indexed read), so one queue is enough.
+ */
+
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+  for (int i = 0; i < threads; i++) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  stop();
+}
+
+// Queue a task; returns false once the pool is stopping
+bool ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+      return false;
+    }
+    tasks_.push_back(std::move(task));
+  }
+  available_.notify_one();
+  return true;
+}
+
+// Finish queued tasks and join the workers
+void ThreadPool::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ && workers_.empty()) {
+      return;
+    }
+    stopping_ = true;
+  }
+  available_.notify_all();
+  for (auto& worker : workers_) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers_.clear();
+}
+
+size_t ThreadPool::queued() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return tasks_.size();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;  // Stopping and drained
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,44 @@
+/*
+ * IriQ Smart Irrigation System - Thread Pool Header
+ *
+ * Header file for the fixed-size worker pool that runs request handlers
+ * off the event loop thread.
+ */
+
+#ifndef GATEWAY_THREAD_POOL_H
+#define GATEWAY_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  explicit ThreadPool(int threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Queue a task; returns false once the pool is stopping
+  bool submit(std::function<void()> task);
+
+  // Finish queued tasks and join the workers
+  void stop();
+
+  size_t queued() const;
+
+private:
+  void workerLoop();
+
+  mutable std::mutex mutex_;
+  std::condition_variable available_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> workers_;
+  bool stopping_ = false;
+};
+
+#endif // GATEWAY_THREAD_POOL_H
@@ -0,0 +1,317 @@
+/*
+ * IriQ Smart Irrigation System - Device Simulator
+ *
+ * Load generator for the ingestion gateway. Each simulated device keeps one
+ * keep-alive connection and, every interval, sends what the firmware sends:
+ * a sensor reading, a heartbeat and a command poll, plus an occasional status
+ * update. Reports throughput and request latency percentiles.
+ *
+ * Usage: iriq-device-sim --key KEY [--host 127.0.0.1] [--port 8080]
+ *          [--devices 100] [--threads 8] [--interval-ms 1000] [--duration-s 30]
+ *          [--prefix sim-device-]
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct SimulatorOptions {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  std::string key;
+  int devices = 100;
+  int threads = 8;
+  int intervalMs = 1000;
+  int durationSeconds = 30;
+  std::string prefix = "sim-device-";
+};
+
+struct SimulatedDevice {
+  std::string id;
+  int fd = -1;
+  std::string buffer;
+  Clock::time_point nextSend;
+  unsigned cycle = 0;
+};
+
+struct ThreadResult {
+  std::vector<double> latenciesMs;
+  uint64_t failures = 0;
+  uint64_t reconnects = 0;
+};
+
+static const char* SIM_USER_ID = "00000000-0000-4000-8000-000000000001";
+
+static int connectTo(const SimulatorOptions& options) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  std::string port = std::to_string(options.port);
+  if (getaddrinfo(options.host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+    return -1;
+  }
+
+  int fd = -1;
+  for (addrinfo* address = addresses; address != nullptr; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+
+  if (fd >= 0) {
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    timeval timeout{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+  return fd;
+}
+
+static bool sendAll(int fd, const std::string& data) {
+  size_t offset = 0;
+  while (offset < data.size()) {
+    ssize_t sent = send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      return false;
+    }
+    offset += (size_t)sent;
+  }
+  return true;
+}
+
+// Read one response; returns the status code or -1 on a broken connection
+static int readResponse(SimulatedDevice& device, bool& serverClosed) {
+  char chunk[4096];
+  while (true) {
+    size_t headerEnd = device.buffer.find("\r\n\r\n");
+    if (headerEnd != std::string::npos) {
+      size_t contentLength = 0;
+      size_t lengthAt = device.buffer.find("Content-Length: ");
+      if (lengthAt != std::string::npos && lengthAt < headerEnd) {
+        contentLength = std::strtoul(device.buffer.c_str() + lengthAt + 16, nullptr, 10);
+      }
+      if (device.buffer.size() >= headerEnd + 4 + contentLength) {
+        int status = std::atoi(device.buffer.c_str() + 9);
+        size_t closeAt = device.buffer.find("Connection: close");
+        serverClosed = closeAt != std::string::npos && closeAt < headerEnd;
+        device.buffer.erase(0, headerEnd + 4 + contentLength);
+        return status;
+      }
+    }
+    ssize_t received = recv(device.fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return -1;
+    }
+    device.buffer.append(chunk, (size_t)received);
+  }
+}
+
+static std::string buildRequest(const SimulatorOptions& options, const char* method, const std::string& target,
+                                const std::string& body) {
+  std::string request = std::string(method) + " " + target + " HTTP/1.1\r\n";
+  request += "Host: " + options.host + "\r\n";
+  request += "apikey: " + options.key + "\r\n";
+  request += "Authorization: Bearer " + options.key + "\r\n";
+  request += "Prefer: return=minimal\r\n";
+  if (!body.empty()) {
+    request += "Content-Type: application/json\r\n";
+  }
+  request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+  request += body;
+  return request;
+}
+
+// One request/response exchange, reconnecting once if the socket went stale
+static bool exchange(const SimulatorOptions& options, SimulatedDevice& device, const std::string& request,
+                     ThreadResult& result) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (device.fd < 0) {
+      device.fd = connectTo(options);
+      device.buffer.clear();
+      if (device.fd < 0) {
+        return false;
+      }
+      if (attempt > 0 || device.cycle > 0) {
+        result.reconnects++;
+      }
+    }
+
+    auto started = Clock::now();
+    bool serverClosed = false;
+    int status = sendAll(device.fd, request) ? readResponse(device, serverClosed) : -1;
+    if (status < 0) {
+      close(device.fd);
+      device.fd = -1;
+      continue;
+    }
+
+    result.latenciesMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - started).count());
+    if (serverClosed) {
+      close(device.fd);
+      device.fd = -1;
+    }
+    return status >= 200 && status < 300;
+  }
+  return false;
+}
+
+static void runDevices(const SimulatorOptions& options, std::vector<SimulatedDevice>& devices, Clock::time_point end,
+                       ThreadResult& result) {
+  while (Clock::now() < end) {
+    // Serve the device that is due first
+    auto next = std::min_element(devices.begin(), devices.end(), [](const SimulatedDevice& a, const SimulatedDevice& b) {
+      return a.nextSend < b.nextSend;
+    });
+    if (next->nextSend > end) {
+      break;
+    }
+    std::this_thread::sleep_until(next->nextSend);
+
+    SimulatedDevice& device = *next;
+    double moisture = 20.0 + (double)((device.cycle * 7919u + device.id.size()) % 600) / 10.0;
+    bool pumpOn = moisture < 35.0;
+
+    char reading[256];
+    std::snprintf(reading, sizeof(reading),
+                  "{\"device_id\":\"%s\",\"moisture_percentage\":%.1f,\"moisture_digital\":%s,\"pump_status\":%s}",
+                  device.id.c_str(), moisture, moisture < 40.0 ? "true" : "false", pumpOn ? "true" : "false");
+    if (!exchange(options, device, buildRequest(options, "POST", "/rest/v1/sensor_readings", reading), result)) {
+      result.failures++;
+    }
+
+    std::string heartbeat = "{\"device_id\":\"" + device.id + "\",\"status\":\"active\"}";
+    if (!exchange(options, device,
+                  buildRequest(options, "POST", "/rest/v1/device_presence?on_conflict=device_id", heartbeat), result)) {
+      result.failures++;
+    }
+
+    std::string poll = "/rest/v1/control_commands?select=id,pump_control,automatic_mode,user_id&device_id=eq." +
+                       device.id + "&executed=eq.false&order=created_at.asc&limit=20";
+    if (!exchange(options, device, buildRequest(options, "GET", poll, ""), result)) {
+      result.failures++;
+    }
+
+    if (device.cycle % 10 == 0) {
+      std::string status = "{\"device_id\":\"" + device.id + "\",\"pump_status\":" + (pumpOn ? "true" : "false") +
+                           ",\"automatic_mode\":true,\"user_id\":\"" + SIM_USER_ID + "\"}";
+      if (!exchange(options, device,
+                    buildRequest(options, "PATCH", "/rest/v1/device_status?device_id=eq." + device.id, status),
+                    result)) {
+        result.failures++;
+      }
+    }
+
+    device.cycle++;
+    device.nextSend += std::chrono::milliseconds(options.intervalMs);
+  }
+
+  for (auto& device : devices) {
+    if (device.fd >= 0) {
+      close(device.fd);
+    }
+  }
+}
+
+static bool parseOptions(int argc, char** argv, SimulatorOptions& options) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    std::string value = argv[i + 1];
+    if (flag == "--host") options.host = value;
+    else if (flag == "--port") options.port = std::atoi(value.c_str());
+    else if (flag == "--key") options.key = value;
+    else if (flag == "--devices") options.devices = std::atoi(value.c_str());
+    else if (flag == "--threads") options.threads = std::atoi(value.c_str());
+    else if (flag == "--interval-ms") options.intervalMs = std::atoi(value.c_str());
+    else if (flag == "--duration-s") options.durationSeconds = std::atoi(value.c_str());
+    else if (flag == "--prefix") options.prefix = value;
+    else return false;
+  }
+  return (argc % 2) == 1 && !options.key.empty() && options.devices > 0 && options.threads > 0 &&
+         options.intervalMs > 0 && options.durationSeconds > 0;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = (size_t)(fraction * (double)(sorted.size() - 1));
+  return sorted[index];
+}
+
+int main(int argc, char** argv) {
+  SimulatorOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    std::fprintf(stderr,
+                 "Usage: %s --key KEY [--host H] [--port P] [--devices N] [--threads T] "
+                 "[--interval-ms MS] [--duration-s S] [--prefix P]\n",
+                 argv[0]);
+    return 2;
+  }
+  options.threads = std::min(options.threads, options.devices);
+
+  // Spread device start times over one interval so load is steady
+  auto start = Clock::now();
+  auto end = start + std::chrono::seconds(options.durationSeconds);
+  std::vector<std::vector<SimulatedDevice>> groups((size_t)options.threads);
+  for (int i = 0; i < options.devices; i++) {
+    char id[64];
+    std::snprintf(id, sizeof(id), "%s%05d", options.prefix.c_str(), i + 1);
+    SimulatedDevice device;
+    device.id = id;
+    device.nextSend = start + std::chrono::milliseconds((long)options.intervalMs * i / options.devices);
+    groups[(size_t)(i % options.threads)].push_back(std::move(device));
+  }
+
+  std::vector<ThreadResult> results((size_t)options.threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < options.threads; t++) {
+    threads.emplace_back(runDevices, std::cref(options), std::ref(groups[(size_t)t]), end, std::ref(results[(size_t)t]));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<double> latencies;
+  uint64_t failures = 0;
+  uint64_t reconnects = 0;
+  for (auto& result : results) {
+    latencies.insert(latencies.end(), result.latenciesMs.begin(), result.latenciesMs.end());
+    failures += result.failures;
+    reconnects += result.reconnects;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::printf("devices:     %d over %d threads, %d ms interval\n", options.devices, options.threads,
+              options.intervalMs);
+  std::printf("requests:    %zu in %.1f s (%.0f req/s)\n", latencies.size(), elapsedSeconds,
+              (double)latencies.size() / elapsedSeconds);
+  std::printf("failures:    %llu, reconnects: %llu\n", (unsigned long long)failures, (unsigned long long)reconnects);
+  std::printf("latency ms:  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(latencies, 0.50),
+              percentile(latencies, 0.90), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+import { createClient } from '@supabase/supabase-js'
+import { NextResponse } from 'next/server'
+import { Database } from '@/lib/database.types'
+import type { LatestState } from '@/lib/latest'
+
+const supabaseUrl = process.env.NEXT_PUBLIC_SUPABASE_URL || ''
+const supabaseAnonKey = process.env.NEXT_PUBLIC_SUPABASE_ANON_KEY || ''
+
+// Ingestion gateway serving the latest-state cache (optional)
+const gatewayUrl = process.env.IRIQ_GATEWAY_URL || ''
+const gatewayReadKey = process.env.IRIQ_GATEWAY_READ_KEY || ''
+
+// How long a verified (session, device) pair is trusted before RLS is asked again
+const ACCESS_CACHE_MS = 60 * 1000
+const ACCESS_CACHE_LIMIT = 10000
+const accessCache = new Map<string, number>()
+
+// Supabase client acting as the signed-in user, so RLS applies
+function clientForToken(token: string) {
+  return createClient<Database>(supabaseUrl, supabaseAnonKey, {
+    global: { headers: { Authorization: `Bearer ${token}` } },
+    auth: { persistSession: false, autoRefreshToken: false }
+  })
+}
+
+async function canReadDevice(
+  client: ReturnType<typeof clientForToken>,
+  token: string,
+  deviceId: string
+): Promise<boolean> {
+  const key = `${token}:${deviceId}`
+  const expiresAt = accessCache.get(key)
+  if (expiresAt && expiresAt > Date.now()) return true
+
+  // RLS only returns the device to its owner or an admin
+  const { data, error } = await client
+    .from('devices')
+    .select('device_id')
+    .eq('device_id', deviceId)
+    .maybeSingle()
+
+  if (error || !data) return false
+
+  if (accessCache.size >= ACCESS_CACHE_LIMIT) accessCache.clear()
+  accessCache.set(key, Date.now() + ACCESS_CACHE_MS)
+  return true
+}
+
+async function fetchFromGateway(deviceId: string): Promise<LatestState | null> {
+  if (!gatewayUrl || !gatewayReadKey) return null
+
+  try {
+    const response = await fetch(`${gatewayUrl}/v1/latest/${encodeURIComponent(deviceId)}`, {
+      headers: { 'x-iriq-read-key': gatewayReadKey },
+      cache: 'no-store',
+      signal: AbortSignal.timeout(1000)
+    })
+    return response.ok ? await response.json() : null
+  } catch (error) {
+    console.error('Gateway latest-state request failed:', error)
+    return null
+  }
+}
+
+// Same data straight from Postgres when the gateway is not available
+async function fetchFromDatabase(
+  client: ReturnType<typeof clientForToken>,
+  deviceId: string
+): Promise<LatestState> {
+  const [reading, status, presence] = await Promise.all([
+    client
+      .from('sensor_readings')
+      .select('moisture_percentage, moisture_digital, pump_status, created_at')
+      .eq('device_id', deviceId)
+      .order('created_at', { ascending: false })
+      .limit(1)
+      .maybeSingle(),
+    client
+      .from('device_status')
+      .select('pump_status, automatic_mode, updated_at')
+      .eq('device_id', deviceId)
+      .maybeSingle(),
+    client
+      .from('device_presence')
+      .select('status, last_seen')
+      .eq('device_id', deviceId)
+      .maybeSingle()
+  ])
+
+  return {
+    device_id: deviceId,
+    reading: reading.data
+      ? {
+          moisture_percentage: reading.data.moisture_percentage,
+          moisture_digital: Boolean(reading.data.moisture_digital),
+          pump_status: reading.data.pump_status ?? null,
+          created_at: reading.data.created_at
+        }
+      : null,
+    status: status.data ?? null,
+    presence: presence.data ?? null
+  }
+}
+
+export async function GET(
+  request: Request,
+  { params }: { params: Promise<{ deviceId: string }> }
+) {
+  const { deviceId } = await params
+  const authorization = request.headers.get('authorization') || ''
+  const token = authorization.startsWith('Bearer ') ? authorization.slice(7) : ''
+
+  if (!token) {
+    return NextResponse.json({ error: 'Not authenticated' }, { status: 401 })
+  }
+
+  try {
+    const client = clientForToken(token)
+    if (!(await canReadDevice(client, token, deviceId))) {
+      return NextResponse.json({ error: 'Device not found' }, { status: 404 })
+    }
+
+    const state = (await fetchFromGateway(deviceId)) ?? (await fetchFromDatabase(client, deviceId))
+    return NextResponse.json(state, { headers: { 'Cache-Control': 'no-store' } })
+  } catch (error) {
+    console.error('Exception in latest route:', error)
+    return NextResponse.json({ error: 'Internal server error' }, { status: 500 })
+  }
+}
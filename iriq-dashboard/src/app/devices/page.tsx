@@ -57,17 +57,15 @@ export default function DevicesPage() {
           }]
         }
 
-        // Get the latest heartbeat for each device
+        // Get the current presence row of each device (one row per device, keyed by device_id)
         const deviceIds = finalDeviceData.map((device) => device.device_id)
         
         let heartbeatData: any[] = []
         if (deviceIds.length > 0) {
           const { data: heartbeats, error: heartbeatError } = await supabase
-            .from('device_heartbeats')
-            .select('*')
+            .from('device_presence')
+            .select('device_id, last_seen, status')
             .in('device_id', deviceIds)
-            .order('last_seen', { ascending: false })
-            .limit(deviceIds.length)
           
           if (heartbeatError) {
             throw heartbeatError
@@ -86,8 +84,10 @@ export default function DevicesPage() {
           let online = false
           if (latestHeartbeat) {
             const lastSeen = new Date(latestHeartbeat.last_seen)
-            // Consider device online if heartbeat is within the last 10 minutes
-            online = now.getTime() - lastSeen.getTime() < 10 * 60 * 1000
+            // Consider device online if heartbeat is within the last 10 minutes,
+            // unless its MQTT last will has already reported it offline
+            online = latestHeartbeat.status !== 'offline' &&
+              now.getTime() - lastSeen.getTime() < 10 * 60 * 1000
           }
           
           return {
@@ -66,16 +66,15 @@ export function DeviceStatus({ compact = false }: DeviceStatusProps) {
           }];
         }
 
-        // Get the latest heartbeat for each device
+        // Get the current presence row of each device (one row per device, keyed by device_id)
         const deviceIds = finalDeviceData.map((device) => device.device_id);
         
         let heartbeatData: any[] = [];
         if (deviceIds.length > 0) {
           const { data: heartbeats, error: heartbeatError } = await supabase
-            .from('device_heartbeats')
-            .select('*')
-            .in('device_id', deviceIds)
-            .order('last_seen', { ascending: false });
+            .from('device_presence')
+            .select('device_id, last_seen, status')
+            .in('device_id', deviceIds);
 
           if (heartbeatError) {
             throw heartbeatError;
@@ -94,8 +93,10 @@ export function DeviceStatus({ compact = false }: DeviceStatusProps) {
           let online = false;
           if (latestHeartbeat) {
             const lastSeen = new Date(latestHeartbeat.last_seen);
-            // Consider device online if heartbeat is within the last 10 minutes
-            online = now.getTime() - lastSeen.getTime() < 10 * 60 * 1000;
+            // Consider device online if heartbeat is within the last 10 minutes,
+            // unless its MQTT last will has already reported it offline
+            online = latestHeartbeat.status !== 'offline' &&
+              now.getTime() - lastSeen.getTime() < 10 * 60 * 1000;
           }
 
           return {
@@ -121,15 +122,15 @@ export function DeviceStatus({ compact = false }: DeviceStatusProps) {
     // Get device IDs for subscriptions and polling
     const deviceIds = devices.map(device => device.device_id);
     
-    // Set up optimized real-time subscription for heartbeats
+    // Set up optimized real-time subscription for presence updates
     const heartbeatSubscription = supabase
-      .channel('device_heartbeats_changes')
+      .channel('device_presence_changes')
       .on(
         'postgres_changes',
         {
           event: '*',
           schema: 'public',
-          table: 'device_heartbeats',
+          table: 'device_presence',
         },
         (payload) => {
           console.log('Received heartbeat update:', payload.new);
@@ -1,8 +1,9 @@
 "use client"
 
-import { useState, useEffect, useRef } from 'react'
+import { useState, useEffect, useRef, useMemo } from 'react'
 import { supabase } from '@/lib/supabase'
 import { useAuth } from '@/lib/auth'
+import { fetchMoistureHistory, pickHistoryResolution, historyRefreshInterval, HistoryPoint, HistoryResolution } from '@/lib/history'
 import { formatDate, getMoistureStatusColor, calculateMoistureStatus } from '@/lib/utils'
 import { motion, AnimatePresence } from 'framer-motion'
 import {
@@ -18,17 +19,27 @@ import {
   Area
 } from 'recharts'
 
-type SensorReading = {
-  id: string
-  created_at: string
-  moisture_percentage: number
-  moisture_digital: boolean
+type DateRange = '24h' | '7d' | '30d' | 'custom'
+
+type ChartPoint = {
+  time: string
+  moisture: number
+  status: ReturnType<typeof calculateMoistureStatus>
 }
 
-type DateRange = '24h' | '7d' | '30d' | 'custom'
+const toChartPoint = (reading: HistoryPoint): ChartPoint => ({
+  time: formatDate(reading.created_at),
+  moisture: reading.moisture_percentage,
+  status: calculateMoistureStatus(reading.moisture_percentage)
+})
 
 export default function HistoryView({ compact = false }: { compact?: boolean } = {}) {
-  const [readings, setReadings] = useState<SensorReading[]>([])
+  // The series lives in refs so realtime readings are appended in O(1);
+  // bumping the revision re-renders the chart
+  const readingsRef = useRef<HistoryPoint[]>([])
+  const chartPointsRef = useRef<ChartPoint[]>([])
+  const [revision, setRevision] = useState(0)
+  const [resolution, setResolution] = useState<HistoryResolution>('raw')
   const [loading, setLoading] = useState(true)
   const [error, setError] = useState<string | null>(null)
   const [dateRange, setDateRange] = useState<DateRange>('24h')
@@ -39,43 +50,41 @@ export default function HistoryView({ compact = false }: { compact?: boolean } =
   useEffect(() => {
     if (!user) return
 
+    // Resolve the selected range
+    const now = new Date()
+    let fromDate: Date
+    let toDate = now
+    
+    if (dateRange === '7d') {
+      fromDate = new Date(now.getTime() - 7 * 24 * 60 * 60 * 1000)
+    } else if (dateRange === '30d') {
+      fromDate = new Date(now.getTime() - 30 * 24 * 60 * 60 * 1000)
+    } else if (dateRange === 'custom' && startDate && endDate) {
+      fromDate = new Date(startDate)
+      toDate = new Date(endDate)
+      toDate.setHours(23, 59, 59, 999) // End of the day
+    } else {
+      fromDate = new Date(now.getTime() - 24 * 60 * 60 * 1000)
+    }
+    
+    // Long ranges read the hourly/daily rollups instead of every raw reading
+    const rangeResolution = pickHistoryResolution(fromDate, toDate)
+    const isLiveRange = dateRange !== 'custom'
+    setResolution(rangeResolution)
+
     const fetchHistoricalData = async () => {
       try {
         setLoading(true)
         
-        let query = supabase
-          .from('sensor_readings')
-          .select('*')
-          .eq('device_id', 'esp32_device_1')
-          .order('created_at', { ascending: true })
+        // Live ranges end now, so move the window forward on every refresh
+        const to = isLiveRange ? new Date() : toDate
+        const from = isLiveRange ? new Date(to.getTime() - (toDate.getTime() - fromDate.getTime())) : fromDate
+        const data = await fetchMoistureHistory('esp32_device_1', from, to, rangeResolution)
         
-        // Apply date filtering
-        const now = new Date()
-        let fromDate: Date | null = null
-        
-        if (dateRange === '24h') {
-          fromDate = new Date(now.getTime() - 24 * 60 * 60 * 1000)
-        } else if (dateRange === '7d') {
-          fromDate = new Date(now.getTime() - 7 * 24 * 60 * 60 * 1000)
-        } else if (dateRange === '30d') {
-          fromDate = new Date(now.getTime() - 30 * 24 * 60 * 60 * 1000)
-        } else if (dateRange === 'custom' && startDate && endDate) {
-          fromDate = new Date(startDate)
-          const toDate = new Date(endDate)
-          toDate.setHours(23, 59, 59, 999) // End of the day
-          query = query.lte('created_at', toDate.toISOString())
-        }
-        
-        if (fromDate) {
-          query = query.gte('created_at', fromDate.toISOString())
-        }
-        
-        const { data, error: fetchError } = await query
-        
-        if (fetchError) throw fetchError
-        
-        console.log('Fetched historical data:', data?.length || 0, 'readings')
-        setReadings(data as SensorReading[])
+        console.log('Fetched historical data:', data.length, rangeResolution, 'points')
+        readingsRef.current = data
+        chartPointsRef.current = data.map(toChartPoint)
+        setRevision(r => r + 1)
       } catch (err) {
         console.error('Error fetching historical data:', err)
         setError('Failed to fetch historical data')
@@ -86,30 +95,48 @@ export default function HistoryView({ compact = false }: { compact?: boolean } =
 
     fetchHistoricalData()
     
-    // Set up real-time subscription for new readings
-    const readingsSubscription = supabase
-      .channel('history_readings_changes')
-      .on('postgres_changes', { 
-        event: 'INSERT', 
-        schema: 'public', 
-        table: 'sensor_readings',
-        filter: `device_id=eq.esp32_device_1`
-      }, (payload) => {
-        console.log('New reading for history:', payload.new)
-        // Add the new reading to our existing readings
-        setReadings(prev => [...prev, payload.new as SensorReading].sort(
-          (a, b) => new Date(a.created_at).getTime() - new Date(b.created_at).getTime()
-        ))
-      })
-      .subscribe()
+    // Raw charts take new readings in real time; rollup charts only need the periodic refresh
+    const readingsSubscription = rangeResolution === 'raw' && isLiveRange
+      ? supabase
+          .channel('history_readings_changes')
+          .on('postgres_changes', { 
+            event: 'INSERT', 
+            schema: 'public', 
+            table: 'sensor_readings',
+            filter: `device_id=eq.esp32_device_1`
+          }, (payload) => {
+            console.log('New reading for history:', payload.new)
+            const reading = payload.new as { id: string; created_at: string; moisture_percentage: number }
+            const series = readingsRef.current
+            const last = series[series.length - 1]
+            
+            // Readings arrive in time order, so append without re-sorting;
+            // anything not newer than the series is already covered by it
+            if (last && Date.parse(reading.created_at) <= Date.parse(last.created_at)) return
+            
+            const point: HistoryPoint = {
+              id: reading.id,
+              created_at: reading.created_at,
+              moisture_percentage: reading.moisture_percentage,
+              moisture_min: reading.moisture_percentage,
+              moisture_max: reading.moisture_percentage,
+              reading_count: 1,
+              pump_on_seconds: 0
+            }
+            series.push(point)
+            chartPointsRef.current.push(toChartPoint(point))
+            setRevision(r => r + 1)
+          })
+          .subscribe()
+      : null
     
     // Add a polling fallback for reliability
     const pollingInterval = setInterval(() => {
       fetchHistoricalData();
-    }, 30000); // Poll every 30 seconds to keep chart updated
+    }, historyRefreshInterval(rangeResolution));
     
     return () => {
-      readingsSubscription.unsubscribe();
+      readingsSubscription?.unsubscribe();
       clearInterval(pollingInterval);
     };
   }, [user, dateRange, startDate, endDate])
@@ -118,11 +145,9 @@ export default function HistoryView({ compact = false }: { compact?: boolean } =
     setDateRange(range)
   }
 
-  const chartData = readings.map(reading => ({
-    time: formatDate(reading.created_at),
-    moisture: reading.moisture_percentage,
-    status: calculateMoistureStatus(reading.moisture_percentage)
-  }))
+  const readings = readingsRef.current
+  // Recharts only redraws for a new array reference
+  const chartData = useMemo(() => chartPointsRef.current.slice(), [revision])
 
   if (loading) {
     return (
@@ -350,7 +375,9 @@ export default function HistoryView({ compact = false }: { compact?: boolean } =
                 <span className="text-sm font-medium text-[#002E1F]/70">Moisture Trends</span>
               </div>
               <div className="text-xs font-medium px-2 py-1 rounded-full bg-[#7AD63D]/10 text-[#7AD63D]">
-                {chartData.length > 0 ? `${chartData.length} readings` : 'No data'}
+                {chartData.length > 0
+                  ? resolution === 'raw' ? `${chartData.length} readings` : `${chartData.length} ${resolution} averages`
+                  : 'No data'}
               </div>
             </div>
             <div className="flex-grow h-full" style={{ minHeight: '250px' }}>
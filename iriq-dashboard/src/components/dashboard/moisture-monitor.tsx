@@ -2,6 +2,7 @@
 
 import { useState, useEffect, useRef } from 'react'
 import { supabase } from '@/lib/supabase'
+import { fetchLatestState } from '@/lib/latest'
 import { calculateMoistureStatus, getMoistureStatusColor } from '@/lib/utils'
 import { useAuth } from '@/lib/auth'
 import { motion, AnimatePresence } from 'framer-motion'
@@ -28,17 +29,10 @@ export default function MoistureMonitor({ compact = false }: { compact?: boolean
         setLoading(true)
         
         // Fetch the latest moisture reading from the ESP32 device
-        const { data, error } = await supabase
-          .from('sensor_readings')
-          .select('*')
-          .eq('device_id', 'esp32_device_1') // Use the ESP32 device ID
-          .order('created_at', { ascending: false })
-          .limit(1)
-          .single()
+        const latest = await fetchLatestState('esp32_device_1') // Use the ESP32 device ID
+        if (!latest?.reading) throw new Error('No readings yet')
         
-        if (error) throw error
-        
-        setMoistureData(data as MoistureData)
+        setMoistureData(latest.reading)
       } catch (err) {
         console.error('Error fetching moisture data:', err)
         setError('Failed to fetch moisture data')
@@ -66,17 +60,10 @@ export default function MoistureMonitor({ compact = false }: { compact?: boolean
     // Add a polling fallback for reliability with increased frequency
     const pollingInterval = setInterval(async () => {
       try {
-        const { data, error } = await supabase
-          .from('sensor_readings')
-          .select('*')
-          .eq('device_id', 'esp32_device_1')
-          .order('created_at', { ascending: false })
-          .limit(1)
-          .single()
-        
-        if (!error && data) {
-          console.log('Polling moisture update:', data);
-          setMoistureData(data as MoistureData)
+        // Served from the gateway's latest-state cache when it is configured
+        const latest = await fetchLatestState('esp32_device_1')
+        if (latest?.reading) {
+          setMoistureData(latest.reading)
         }
       } catch (err) {
         // Silent fail for polling - subscription is primary method
@@ -42,6 +42,7 @@ export interface Database {
           device_id: string
           moisture_percentage: number
           moisture_digital: number
+          pump_status: boolean | null
           user_id: string
         }
         Insert: {
@@ -50,6 +51,7 @@ export interface Database {
           device_id: string
           moisture_percentage: number
           moisture_digital: number
+          pump_status?: boolean | null
           user_id: string
         }
         Update: {
@@ -58,6 +60,7 @@ export interface Database {
           device_id?: string
           moisture_percentage?: number
           moisture_digital?: number
+          pump_status?: boolean | null
           user_id?: string
         }
       }
@@ -69,6 +72,7 @@ export interface Database {
           pump_status: boolean
           automatic_mode: boolean
           last_seen: string
+          updated_at: string
           user_id: string
         }
         Insert: {
@@ -78,6 +82,7 @@ export interface Database {
           pump_status: boolean
           automatic_mode: boolean
           last_seen?: string
+          updated_at?: string
           user_id: string
         }
         Update: {
@@ -87,6 +92,7 @@ export interface Database {
           pump_status?: boolean
           automatic_mode?: boolean
           last_seen?: string
+          updated_at?: string
           user_id?: string
         }
       }
@@ -99,6 +105,9 @@ export interface Database {
           automatic_mode: boolean
           user_id: string
           executed: boolean
+          executed_at: string | null
+          superseded_by: string | null
+          source: string
         }
         Insert: {
           id?: string
@@ -108,6 +117,9 @@ export interface Database {
           automatic_mode: boolean
           user_id: string
           executed?: boolean
+          executed_at?: string | null
+          superseded_by?: string | null
+          source?: string
         }
         Update: {
           id?: string
@@ -117,6 +129,230 @@ export interface Database {
           automatic_mode?: boolean
           user_id?: string
           executed?: boolean
+          executed_at?: string | null
+          superseded_by?: string | null
+          source?: string
+        }
+      }
+      sensor_readings_hourly: {
+        Row: {
+          device_id: string
+          bucket: string
+          moisture_min: number
+          moisture_max: number
+          moisture_sum: number
+          reading_count: number
+          moisture_avg: number
+          pump_on_seconds: number
+        }
+        Insert: {
+          device_id: string
+          bucket: string
+          moisture_min: number
+          moisture_max: number
+          moisture_sum: number
+          reading_count: number
+          pump_on_seconds?: number
+        }
+        Update: {
+          device_id?: string
+          bucket?: string
+          moisture_min?: number
+          moisture_max?: number
+          moisture_sum?: number
+          reading_count?: number
+          pump_on_seconds?: number
+        }
+      }
+      sensor_readings_daily: {
+        Row: {
+          device_id: string
+          bucket: string
+          moisture_min: number
+          moisture_max: number
+          moisture_sum: number
+          reading_count: number
+          moisture_avg: number
+          pump_on_seconds: number
+        }
+        Insert: {
+          device_id: string
+          bucket: string
+          moisture_min: number
+          moisture_max: number
+          moisture_sum: number
+          reading_count: number
+          pump_on_seconds?: number
+        }
+        Update: {
+          device_id?: string
+          bucket?: string
+          moisture_min?: number
+          moisture_max?: number
+          moisture_sum?: number
+          reading_count?: number
+          pump_on_seconds?: number
+        }
+      }
+      device_presence: {
+        Row: {
+          device_id: string
+          last_seen: string
+          status: string
+          ip_address: string | null
+          firmware_version: string | null
+          metrics: Json | null
+          history_sampled_at: string | null
+        }
+        Insert: {
+          device_id: string
+          last_seen?: string
+          status?: string
+          ip_address?: string | null
+          firmware_version?: string | null
+          metrics?: Json | null
+          history_sampled_at?: string | null
+        }
+        Update: {
+          device_id?: string
+          last_seen?: string
+          status?: string
+          ip_address?: string | null
+          firmware_version?: string | null
+          metrics?: Json | null
+          history_sampled_at?: string | null
+        }
+      }
+      device_settings: {
+        Row: {
+          device_id: string
+          sample_interval_min_ms: number
+          sample_interval_max_ms: number
+          sample_near_threshold: number
+          updated_at: string
+        }
+        Insert: {
+          device_id: string
+          sample_interval_min_ms?: number
+          sample_interval_max_ms?: number
+          sample_near_threshold?: number
+          updated_at?: string
+        }
+        Update: {
+          device_id?: string
+          sample_interval_min_ms?: number
+          sample_interval_max_ms?: number
+          sample_near_threshold?: number
+          updated_at?: string
+        }
+      }
+      pump_usage_events: {
+        Row: {
+          device_id: string
+          sequence: number
+          started_at: string
+          duration_ms: number
+          volume_ml: number
+          automatic: boolean
+          created_at: string
+        }
+        Insert: {
+          device_id: string
+          sequence: number
+          started_at: string
+          duration_ms: number
+          volume_ml?: number
+          automatic?: boolean
+          created_at?: string
+        }
+        Update: {
+          device_id?: string
+          sequence?: number
+          started_at?: string
+          duration_ms?: number
+          volume_ml?: number
+          automatic?: boolean
+          created_at?: string
+        }
+      }
+      pump_usage_daily: {
+        Row: {
+          device_id: string
+          day: string
+          runtime_ms: number
+          volume_ml: number
+          events: number
+          updated_at: string
+        }
+        Insert: {
+          device_id: string
+          day: string
+          runtime_ms?: number
+          volume_ml?: number
+          events?: number
+          updated_at?: string
+        }
+        Update: {
+          device_id?: string
+          day?: string
+          runtime_ms?: number
+          volume_ml?: number
+          events?: number
+          updated_at?: string
+        }
+      }
+      irrigation_schedules: {
+        Row: {
+          id: string
+          device_id: string
+          name: string | null
+          start_minute: number
+          duration_minutes: number
+          days: number
+          moisture_below: number | null
+          enabled: boolean
+          created_at: string
+          updated_at: string
+        }
+        Insert: {
+          id?: string
+          device_id: string
+          name?: string | null
+          start_minute: number
+          duration_minutes: number
+          days?: number
+          moisture_below?: number | null
+          enabled?: boolean
+          created_at?: string
+          updated_at?: string
+        }
+        Update: {
+          id?: string
+          device_id?: string
+          name?: string | null
+          start_minute?: number
+          duration_minutes?: number
+          days?: number
+          moisture_below?: number | null
+          enabled?: boolean
+          created_at?: string
+          updated_at?: string
+        }
+      }
+      device_schedules: {
+        Row: {
+          device_id: string
+          version: number
+          utc_offset_minutes: number
+          entries: Json
+          updated_at: string
+        }
+        Insert: {
+          device_id: string
+          utc_offset_minutes?: number
+        }
+        Update: {
+          utc_offset_minutes?: number
         }
       }
     }
@@ -124,7 +360,24 @@ export interface Database {
       [_ in never]: never
     }
     Functions: {
-      [_ in never]: never
+      is_device_online: {
+        Args: {
+          device_id: string
+        }
+        Returns: boolean
+      }
+      downsample_sensor_readings: {
+        Args: {
+          p_device_id: string
+          p_from: string
+          p_to: string
+          p_points?: number
+        }
+        Returns: {
+          created_at: string
+          moisture_percentage: number
+        }[]
+      }
     }
     Enums: {
       [_ in never]: never
@@ -0,0 +1,92 @@
+import { supabase } from './supabase'
+
+export type HistoryResolution = 'raw' | 'hourly' | 'daily'
+
+export type HistoryPoint = {
+  id: string
+  created_at: string
+  moisture_percentage: number
+  moisture_min: number
+  moisture_max: number
+  reading_count: number
+  pump_on_seconds: number
+}
+
+const HOUR_MS = 60 * 60 * 1000
+const DAY_MS = 24 * HOUR_MS
+
+// Number of points the server downsamples raw readings to
+export const HISTORY_CHART_POINTS = 500
+
+// Pick the coarsest resolution that still gives a detailed chart:
+// downsampled raw readings up to 2 days, hourly up to 30 days (720 points), then daily
+export function pickHistoryResolution(from: Date, to: Date): HistoryResolution {
+  const span = to.getTime() - from.getTime()
+  if (span <= 2 * DAY_MS) return 'raw'
+  if (span <= 30 * DAY_MS) return 'hourly'
+  return 'daily'
+}
+
+// How often a chart at this resolution needs refreshing
+export function historyRefreshInterval(resolution: HistoryResolution): number {
+  switch (resolution) {
+    case 'raw': return 30 * 1000
+    case 'hourly': return 5 * 60 * 1000
+    case 'daily': return 60 * 60 * 1000
+  }
+}
+
+// Fetch moisture history for a device from raw readings or the rollup tables,
+// ordered oldest first
+export async function fetchMoistureHistory(
+  deviceId: string,
+  from: Date,
+  to: Date,
+  resolution: HistoryResolution = pickHistoryResolution(from, to)
+): Promise<HistoryPoint[]> {
+  if (resolution === 'raw') {
+    // Downsampled server-side (LTTB), so the payload size does not depend on the range
+    const { data, error } = await supabase.rpc('downsample_sensor_readings', {
+      p_device_id: deviceId,
+      p_from: from.toISOString(),
+      p_to: to.toISOString(),
+      p_points: HISTORY_CHART_POINTS
+    })
+
+    if (error) throw error
+
+    return (data ?? []).map(reading => ({
+      id: `raw-${reading.created_at}`,
+      created_at: reading.created_at,
+      moisture_percentage: reading.moisture_percentage,
+      moisture_min: reading.moisture_percentage,
+      moisture_max: reading.moisture_percentage,
+      reading_count: 1,
+      pump_on_seconds: 0
+    }))
+  }
+
+  const table = resolution === 'hourly' ? 'sensor_readings_hourly' : 'sensor_readings_daily'
+  const bucketMs = resolution === 'hourly' ? HOUR_MS : DAY_MS
+
+  // Include the bucket that contains the start of the range
+  const { data, error } = await supabase
+    .from(table)
+    .select('bucket, moisture_avg, moisture_min, moisture_max, reading_count, pump_on_seconds')
+    .eq('device_id', deviceId)
+    .gt('bucket', new Date(from.getTime() - bucketMs).toISOString())
+    .lte('bucket', to.toISOString())
+    .order('bucket', { ascending: true })
+
+  if (error) throw error
+
+  return (data ?? []).map(bucket => ({
+    id: `${resolution}-${bucket.bucket}`,
+    created_at: bucket.bucket,
+    moisture_percentage: Number(bucket.moisture_avg),
+    moisture_min: Number(bucket.moisture_min),
+    moisture_max: Number(bucket.moisture_max),
+    reading_count: bucket.reading_count,
+    pump_on_seconds: bucket.pump_on_seconds
+  }))
+}
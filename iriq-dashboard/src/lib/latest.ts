@@ -0,0 +1,38 @@
+import { supabase } from './supabase'
+
+// Latest reading, status and presence of a device, as served by /api/latest
+export type LatestState = {
+  device_id: string
+  reading: {
+    moisture_percentage: number
+    moisture_digital: boolean
+    pump_status: boolean | null
+    created_at: string
+  } | null
+  status: {
+    pump_status: boolean
+    automatic_mode: boolean
+    updated_at: string
+  } | null
+  presence: {
+    status: string
+    last_seen: string
+  } | null
+}
+
+// Fetch the current state of a device. Served from the ingestion gateway's
+// in-memory cache when it is configured, so frequent polling does not reach Postgres
+export async function fetchLatestState(deviceId: string): Promise<LatestState | null> {
+  const { data: { session } } = await supabase.auth.getSession()
+  if (!session) return null
+
+  const response = await fetch(`/api/latest/${encodeURIComponent(deviceId)}`, {
+    headers: { Authorization: `Bearer ${session.access_token}` },
+    cache: 'no-store'
+  })
+
+  if (response.status === 404) return null
+  if (!response.ok) throw new Error(`Latest state request failed (${response.status})`)
+
+  return response.json()
+}
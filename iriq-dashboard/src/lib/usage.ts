@@ -0,0 +1,63 @@
+import { supabase } from './supabase'
+
+export type DailyUsage = {
+  day: string
+  runtime_seconds: number
+  volume_liters: number
+  events: number
+}
+
+export type IrrigationEvent = {
+  sequence: number
+  started_at: string
+  duration_seconds: number
+  volume_liters: number
+  automatic: boolean
+}
+
+// Daily pump runtime and water use metered on the device (UTC days, oldest first)
+export async function fetchDailyUsage(deviceId: string, from: Date, to: Date): Promise<DailyUsage[]> {
+  const { data, error } = await supabase
+    .from('pump_usage_daily')
+    .select('day, runtime_ms, volume_ml, events')
+    .eq('device_id', deviceId)
+    .gte('day', from.toISOString().slice(0, 10))
+    .lte('day', to.toISOString().slice(0, 10))
+    .order('day', { ascending: true })
+
+  if (error) throw error
+
+  return (data ?? []).map(row => ({
+    day: row.day,
+    runtime_seconds: row.runtime_ms / 1000,
+    volume_liters: row.volume_ml / 1000,
+    events: row.events
+  }))
+}
+
+// Individual pump runs in a time range, newest first
+export async function fetchIrrigationEvents(
+  deviceId: string,
+  from: Date,
+  to: Date,
+  limit = 100
+): Promise<IrrigationEvent[]> {
+  const { data, error } = await supabase
+    .from('pump_usage_events')
+    .select('sequence, started_at, duration_ms, volume_ml, automatic')
+    .eq('device_id', deviceId)
+    .gte('started_at', from.toISOString())
+    .lte('started_at', to.toISOString())
+    .order('started_at', { ascending: false })
+    .limit(limit)
+
+  if (error) throw error
+
+  return (data ?? []).map(row => ({
+    sequence: row.sequence,
+    started_at: row.started_at,
+    duration_seconds: row.duration_ms / 1000,
+    volume_liters: row.volume_ml / 1000,
+    automatic: row.automatic
+  }))
+}